@@ -1,10 +1,12 @@
 #include "Controller.h"
 #include <QSettings>
 #include <QCoreApplication>
+#include <QDesktopServices>
 #include "types.h"
 #include "gui/GUI.h"
 #include <schnee/net/Tools.h>
 #include <schnee/schnee.h>
+#include <schnee/settings.h>
 #include "autostart.h"
 #include "modeladapters/UserList.h"
 #include "modeladapters/TransferList.h"
@@ -62,6 +64,10 @@ void Controller::init () {
 	settings.endGroup ();
 	{
 		SF_SCHNEE_LOCK;
+		if (sf::schnee::settings().keyStore.empty()) {
+			// keep own key and certificate between starts
+			sf::schnee::setKeyStore (sfString (QDesktopServices::storageLocation (QDesktopServices::DataLocation)) + "/keys");
+		}
 		mModel->setSettings(s);
 
 
@@ -181,7 +187,11 @@ bool Controller::isConnectedTo_locked (const sf::HostId & hostId) {
 sf::Error Controller::trackHostShared (const sf::HostId & hostId) {
 	SF_SCHNEE_LOCK;
 	if (!isConnectedTo_locked (hostId)){
-		return mModel->beacon()->connections().liftToAtLeast (10, hostId, sf::abind (sf::dMemFun (this, &Controller::onConnectHostForTrackingResult), hostId));
+		// user is waiting for it, connect before the other hosts
+		mModel->beacon()->connections().setLiftPriority (hostId, 1);
+		sf::Error e = mModel->beacon()->connections().liftToAtLeast (10, hostId, sf::abind (sf::dMemFun (this, &Controller::onConnectHostForTrackingResult), hostId));
+		if (e) mModel->beacon()->connections().setLiftPriority (hostId, 0);
+		return e;
 	}
 	// forward as if we woudl have it connected
 	onConnectHostForTrackingResult (sf::NoError, hostId);
@@ -428,6 +438,8 @@ void Controller::onConDetailsChanged () {
 }
 
 void Controller::onConnectHostForTrackingResult (sf::Error result, const sf::HostId & hostId) {
+	// nobody is waiting for the connection anymore
+	mModel->beacon()->connections().setLiftPriority (hostId, 0);
 	if (result) {
 		mGUI->call (sf::bind (&UserList::onLostTracking, mUserList, hostId));
 		onError (err::CouldNotConnectRemoteHost, QObject::tr ("Could not connect remote host"), QObject::tr ("Could not connect remote host %1").arg (qtString(hostId)));
@@ -459,6 +471,7 @@ void Controller::onRegisterAccount (sf::Error e) {
 
 
 void Controller::onLostTracking (const sf::HostId & host, const sf::Error cause) {
+	mModel->beacon()->connections().setLiftPriority (host, 0);
 	mGUI->call (sf::bind (&UserList::onLostTracking, mUserList, host));
 	mGUI->call (sf::bind (&GUI::onLostTracking, mGUI, host, toString (cause)));
 }
@@ -429,6 +429,9 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
    {
       error = 3;
    }
+   // acknowledge any waiting epolls to accept (inside the lock, accept disables it)
+   if (0 == error)
+      m_EPoll.enable_read(listen, ls->m_pUDT->m_sPollID);
    CGuard::leaveCS(ls->m_AcceptLock);
 
    CTimer::triggerEvent();
@@ -1044,16 +1047,13 @@ int CUDTUnited::epoll_create()
 int CUDTUnited::epoll_add_usock(const int eid, const UDTSOCKET u, const int* events)
 {
    CUDTSocket* s = locate(u);
-   if (NULL != s)
-   {
-      s->m_pUDT->addEPoll(eid);
-   }
-   else
-   {
+   if (NULL == s)
       throw CUDTException(5, 4);
-   }
 
-   return m_EPoll.add_usock(eid, u, events);
+   // register the events first, addEPoll reports the current state
+   int ret = m_EPoll.add_usock(eid, u, events);
+   s->m_pUDT->addEPoll(eid);
+   return ret;
 }
 
 int CUDTUnited::epoll_add_ssock(const int eid, const SYSSOCKET s, const int* events)
@@ -1063,15 +1063,12 @@ int CUDTUnited::epoll_add_ssock(const int eid, const SYSSOCKET s, const int* eve
 
 int CUDTUnited::epoll_remove_usock(const int eid, const UDTSOCKET u, const int* events)
 {
+   // the socket may already be closed, it still has to leave the epoll set
    CUDTSocket* s = locate(u);
    if (NULL != s)
    {
       s->m_pUDT->removeEPoll(eid);
    }
-   else
-   {
-      throw CUDTException(5, 4);
-   }
 
    return m_EPoll.remove_usock(eid, u, events);
 }
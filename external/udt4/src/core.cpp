@@ -1037,7 +1037,11 @@ int CUDT::recv(char* data, const int& len)
    if (0 == m_pRcvBuffer->getRcvDataSize())
    {
       if (!m_bSynRecving)
+      {
+         // nothing to read, e.g. after the read event on connecting
+         s_UDTUnited.m_EPoll.disable_read(m_SocketID, m_sPollID);
          throw CUDTException(6, 2, 0);
+      }
       else
       {
          #ifndef WIN32
@@ -1648,6 +1652,7 @@ void CUDT::sendCtrl(const int& pkttype, void* lparam, void* rparam, const int& s
 
          // acknowledge any waiting epolls to read
          s_UDTUnited.m_EPoll.enable_read(m_SocketID, m_sPollID);
+         CTimer::triggerEvent();
       }
       else if (ack == m_iRcvLastAck)
       {
@@ -1902,6 +1907,7 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
 
       // acknowledde any waiting epolls to write
       s_UDTUnited.m_EPoll.enable_write(m_SocketID, m_sPollID);
+      CTimer::triggerEvent();
 
       // insert this socket to snd list if it is not on the list yet
       m_pSndQueue->m_pSndUList->update(this, false);
@@ -2080,6 +2086,10 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       // Signal the sender and recver if they are waiting for data.
       releaseSynch();
 
+      // a closed socket can be "read" to learn the error
+      s_UDTUnited.m_EPoll.enable_read(m_SocketID, m_sPollID);
+      s_UDTUnited.m_EPoll.enable_write(m_SocketID, m_sPollID);
+
       CTimer::triggerEvent();
 
       break;
@@ -2386,17 +2396,13 @@ int CUDT::listen(sockaddr* addr, CPacket& packet)
 
          // send back a response if connection failed or connection already existed
          // new connection response should be sent in connect()
+         // a new connection enables epoll for read in newConnection (inside the accept lock)
          if (result != 1)
          {
             hs.serialize(packet.m_pcData, CHandShake::m_iContentSize);
             packet.m_iID = id;
             m_pSndQueue->sendto(addr, packet);
          }
-         else
-         {
-            // a mew connection has been created, enable epoll for read 
-            s_UDTUnited.m_EPoll.enable_read(m_SocketID, m_sPollID);
-         }
       }
    }
 
@@ -2466,7 +2472,8 @@ void CUDT::checkTimers()
 
          releaseSynch();
 
-         // a broken socket can be "write" to learn the error
+         // a broken socket can be "read" or "write" to learn the error
+         s_UDTUnited.m_EPoll.enable_read(m_SocketID, m_sPollID);
          s_UDTUnited.m_EPoll.enable_write(m_SocketID, m_sPollID);
 
          CTimer::triggerEvent();
@@ -2522,8 +2529,11 @@ void CUDT::addEPoll(const int eid)
    else if ((UDT_DGRAM == m_iSockType) && (m_pRcvBuffer->getRcvMsgNum() > 0))
       s_UDTUnited.m_EPoll.enable_read(m_SocketID, m_sPollID);
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (m_iSndBufSize > m_pSndBuffer->getCurrBufSize())
       s_UDTUnited.m_EPoll.enable_write(m_SocketID, m_sPollID);
+
+   // wake up waiting epolls
+   CTimer::triggerEvent();
 }
 
 void CUDT::removeEPoll(const int eid)
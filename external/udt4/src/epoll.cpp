@@ -89,7 +89,7 @@ int CEPoll::create()
    return desc.m_iID;
 }
 
-int CEPoll::add_usock(const int eid, const UDTSOCKET& u, const int* /*events*/)
+int CEPoll::add_usock(const int eid, const UDTSOCKET& u, const int* events)
 {
    CGuard pg(m_EPollLock);
 
@@ -99,6 +99,22 @@ int CEPoll::add_usock(const int eid, const UDTSOCKET& u, const int* /*events*/)
 
    p->second.m_sUDTSocks.insert(u);
 
+   // only report the requested events; adding again changes them
+   if ((NULL == events) || (*events & UDT_EPOLL_IN))
+      p->second.m_sUDTSocksIn.insert(u);
+   else
+   {
+      p->second.m_sUDTSocksIn.erase(u);
+      p->second.m_sUDTReads.erase(u);
+   }
+   if ((NULL == events) || (*events & UDT_EPOLL_OUT))
+      p->second.m_sUDTSocksOut.insert(u);
+   else
+   {
+      p->second.m_sUDTSocksOut.erase(u);
+      p->second.m_sUDTWrites.erase(u);
+   }
+
    return 0;
 }
 
@@ -144,6 +160,11 @@ int CEPoll::remove_usock(const int eid, const UDTSOCKET& u, const int* /*events*
       throw CUDTException(5, 13);
 
    p->second.m_sUDTSocks.erase(u);
+   p->second.m_sUDTSocksIn.erase(u);
+   p->second.m_sUDTSocksOut.erase(u);
+   // a removed socket must not be reported anymore
+   p->second.m_sUDTReads.erase(u);
+   p->second.m_sUDTWrites.erase(u);
 
    return 0;
 }
@@ -333,7 +354,8 @@ int CEPoll::enable_write(const UDTSOCKET& uid, set<int>& eids)
       }
       else
       {
-         p->second.m_sUDTWrites.insert(uid);
+         if (p->second.m_sUDTSocksOut.count(uid) > 0)
+            p->second.m_sUDTWrites.insert(uid);
       }
    }
 
@@ -359,7 +381,8 @@ int CEPoll::enable_read(const UDTSOCKET& uid, set<int>& eids)
       }
       else
       {
-         p->second.m_sUDTReads.insert(uid);
+         if (p->second.m_sUDTSocksIn.count(uid) > 0)
+            p->second.m_sUDTReads.insert(uid);
       }
    }
 
@@ -51,6 +51,8 @@ struct CEPollDesc
 {
    int m_iID;                                // epoll ID
    std::set<UDTSOCKET> m_sUDTSocks;          // set of UDT sockets waiting for events
+   std::set<UDTSOCKET> m_sUDTSocksIn;        // UDT sockets waiting for read events
+   std::set<UDTSOCKET> m_sUDTSocksOut;       // UDT sockets waiting for write events
 
    int m_iLocalID;                           // local system epoll ID
    std::set<SYSSOCKET> m_sLocals;            // set of local (non-UDT) descriptors
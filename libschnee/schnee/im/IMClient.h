@@ -100,6 +100,16 @@ public:
 	/// Contacts is a contact list
 	/// String is the contact identifier, like Jabber bare JID or ICQ#
 	typedef std::map<String, ContactInfo> Contacts;
+
+	/// An incremental change of the contact roster
+	/// (presence bursts are coalesced into one change)
+	struct RosterChange {
+		RosterChange () : full (false) {}
+		std::set<String> changed;	///< Contacts which were added or changed
+		std::set<String> removed;	///< Contacts which were removed
+		bool full;					///< The roster was reloaded completely
+		bool empty () const { return changed.empty() && removed.empty() && !full; }
+	};
 	
 	virtual ~IMClient () {}
 
@@ -170,13 +180,24 @@ public:
 	
 	/// Returns the current tracked contact list
 	virtual Contacts contactRoster () const = 0;
+
+	/// Returns information about a single contact without copying the whole roster
+	/// Returns false if there is no such contact.
+	virtual bool contactInfo (const String & id, ContactInfo * info) const {
+		Contacts contacts = contactRoster ();
+		Contacts::const_iterator i = contacts.find (id);
+		if (i == contacts.end()) return false;
+		if (info) *info = i->second;
+		return true;
+	}
 	
 	/// Updates the info about connected contacts (usually only necessary for one time, shall be detected automatically)
 	virtual void updateContactRoster () = 0;
 	
 	/// Sends a message through the IM service (asynchronous!)
 	/// Returns false if it is already doomed to fail (e.g. when offline)
-	virtual bool sendMessage (const Message & msg) = 0;
+	/// The callback is called as soon as the message left the IM client (only if returning true)
+	virtual bool sendMessage (const Message & msg, const ResultCallback & callback = ResultCallback()) = 0;
 
 	/// @}
 
@@ -246,6 +267,13 @@ public:
 	/// Delegate informed at contact roster changed
 	virtual VoidDelegate & contactRosterChanged () = 0;
 
+	/// A delegate informing about the contacts affected by a roster change
+	typedef function <void (const sf::IMClient::RosterChange & change)> RosterChangeDelegate;
+
+	/// Delegate informed about incremental roster changes; returns 0 if not supported.
+	/// If set, it is called instead of contactRosterChanged.
+	virtual RosterChangeDelegate * contactRosterChange () { return 0; }
+
 	/// Delegate informed if we got a message
 	virtual MessageReceivedDelegate & messageReceived () = 0;
 
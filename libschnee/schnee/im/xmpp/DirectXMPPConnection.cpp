@@ -1,4 +1,5 @@
 #include "DirectXMPPConnection.h"
+#include <schnee/settings.h>
 
 namespace sf {
 
@@ -34,6 +35,7 @@ String DirectXMPPConnection::errorText () const {
 Error DirectXMPPConnection::startConnectingProcess (const XMPPStreamPtr & stream, int timeOutMs,const ResultCallback & callback){
 	if (mWithLogin && (mDetails.username.empty() || mDetails.server.empty())) return error::NotInitialized;
 	mStream    = stream;
+	mZlibChannel.reset();
 	stateChange (IMClient::CS_CONNECTING);
 	mErrorText.clear();
 	mTcpSocket = TCPSocketPtr (new TCPSocket());
@@ -140,11 +142,36 @@ void DirectXMPPConnection::onFinalStreamInit(Error result) {
 void DirectXMPPConnection::onFinalStreamFeatures (Error result) {
 	if (result) return onConnectError (result);
 	if (!mConnecting) return;
+	if (!mZlibChannel && !schnee::settings().disableXmppCompression) {
+		Error e = mStream->requestCompression (dMemFun (this, &DirectXMPPConnection::onCompressionReply));
+		if (!e) {
+			setPhase ("Request Compression");
+			return;
+		}
+		if (e != error::NotSupported) return onConnectError (e);
+	}
 	Error e = mStream->bindResource(mDetails.resource, dMemFun (this, &DirectXMPPConnection::onFinalBind));
 	setPhase ("Bind Resource");
 	if (e) onConnectError (result);
 }
 
+void DirectXMPPConnection::onCompressionReply (Error result) {
+	if (!mConnecting) return;
+	if (result == error::NotSupported) {
+		// server refused, continuing uncompressed
+		Error e = mStream->bindResource(mDetails.resource, dMemFun (this, &DirectXMPPConnection::onFinalBind));
+		setPhase ("Bind Resource");
+		if (e) onConnectError (e);
+		return;
+	}
+	if (result) return onConnectError (result);
+	mStream->uncouple();
+	mZlibChannel = ZlibChannelPtr (new ZlibChannel (mTlsChannel));
+	Error e = mStream->startInit(mZlibChannel, dMemFun (this, &DirectXMPPConnection::onFinalStreamInit));
+	setPhase ("Compressed Stream Init");
+	if (e) onConnectError (e);
+}
+
 void DirectXMPPConnection::onFinalBind (Error result, const String & fullJid) {
 	if (result) return onConnectError (result);
 	if (!mConnecting) return;
@@ -165,6 +192,7 @@ void DirectXMPPConnection::onSessionStart (Error result) {
 	mConnecting = false;
 	stateChange (IMClient::CS_CONNECTED);
 	mTlsChannel.reset(); // stored in Stream now
+	mZlibChannel.reset();
 	sf::cancelTimer(mTimeoutHandle);
 	notifyAsync (mConnectCallback, NoError);
 	mConnectCallback.clear();
@@ -182,6 +210,7 @@ void DirectXMPPConnection::onConnectError(Error e){
 	mConnecting = false;
 	mState = IMClient::CS_ERROR;
 	mTlsChannel.reset();
+	mZlibChannel.reset();
 	mTcpSocket.reset();
 	notifyAsync (mConnectCallback, e);
 	mConnectCallback.clear();
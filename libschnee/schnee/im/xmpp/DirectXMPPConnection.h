@@ -3,13 +3,14 @@
 #include <schnee/tools/async/DelegateBase.h>
 #include <schnee/net/TCPSocket.h>
 #include <schnee/net/TLSChannel.h>
+#include <schnee/net/ZlibChannel.h>
 
 namespace sf {
 
 /**
  * Implements the state machine for connecting XMPP.
  *
- * TLS/TCP version
+ * TLS/TCP version, with stream compression (XEP-0138) if the server offers it
  */
 class DirectXMPPConnection : public XMPPConnection, public DelegateBase {
 public:
@@ -53,6 +54,7 @@ private:
 	void onAuthenticate (Error result);
 	void onFinalStreamInit (Error result);
 	void onFinalStreamFeatures (Error result);
+	void onCompressionReply (Error result);
 	void onFinalBind (Error result, const String& fullJid);
 	void onSessionStart (Error result);
 
@@ -68,6 +70,7 @@ private:
 	XmppConnectDetails mDetails;
 	TCPSocketPtr  mTcpSocket;
 	TLSChannelPtr mTlsChannel;
+	ZlibChannelPtr mZlibChannel;
 	bool mConnecting;
 	bool mWithLogin; // != Skip authentication
 	TimedCallHandle mTimeoutHandle;
@@ -4,6 +4,7 @@ namespace sf {
 XMLStreamDecoder::XMLStreamDecoder () {
 	mState = XS_Start;
 	mError = NoError;
+	mReadPos = 0;
 }
 
 XMLStreamDecoder::~XMLStreamDecoder () {
@@ -33,6 +34,8 @@ void XMLStreamDecoder::reset () {
 	mError = NoError;
 	mErrorText.clear();
 	mInputBuffer.clear();
+	mReadPos = 0;
+	mTokenizer.reset();
 	mOpener = XMLChunk::errChunk();
 }
 
@@ -42,6 +45,8 @@ void XMLStreamDecoder::resetToPureStream () {
 	mError = NoError;
 	mErrorText.clear();
 	mInputBuffer.clear();
+	mReadPos = 0;
+	mTokenizer.reset();
 	mOpener = XMLChunk::errChunk();
 }
 
@@ -84,6 +89,20 @@ static Error fillElement (const char * start, size_t len, XMLChunk * dest) {
 	return NoError;
 }
 
+void XMLStreamDecoder::compactInput () {
+	if (mReadPos == 0) return;
+	if (mReadPos == mInputBuffer.size()) {
+		mInputBuffer.clear();
+		mReadPos = 0;
+		return;
+	}
+	// Avoid moving the rest after each element
+	if (mState != XS_ReadOpener || (mReadPos > 4096 && mReadPos * 2 > mInputBuffer.size())) {
+		mInputBuffer.l_truncate (mReadPos);
+		mReadPos = 0;
+	}
+}
+
 void XMLStreamDecoder::handleData () {
 	State before = mState;
 	while (true) {
@@ -93,7 +112,11 @@ void XMLStreamDecoder::handleData () {
 		before = mState;
 		if (mState == XS_Closed || mState == XS_Error) return;
 
-		skipWhiteSpaces (mInputBuffer);
+		if (mState != XS_ReadOpener) {
+			// Opener states work on the beginning of the buffer
+			compactInput ();
+			skipWhiteSpaces (mInputBuffer);
+		}
 
 		switch (mState) {
 		case XS_Start:{
@@ -132,38 +155,44 @@ void XMLStreamDecoder::handleData () {
 			continue;
 		}
 		case XS_ReadOpener:{
-			int code = xml::fullTag (mInputBuffer);
+			// The tokenizer continues where it stopped on the last call
+			const char * data = mInputBuffer.const_c_array() + mReadPos;
+			int code = mTokenizer.scanElement (data, mInputBuffer.size() - mReadPos);
 			if (code < 0) {
-				mErrorText = "InvalidElement";
+				mErrorText = "Invalid Element";
 				mError = error::BadDeserialization;
 				mState = XS_Error;
 				continue;
 			}
-			if (code == 0) return;
-			if (mInputBuffer[0] == '<' && mInputBuffer[1] == '/') {
-				mInputBuffer.l_truncate(code);
-				mState = XS_Closed;
-				continue;
+			if (code == 0) {
+				if (!mTokenizer.started()) {
+					// only white space (e.g. keep alive)
+					mReadPos += mTokenizer.scanned();
+					mTokenizer.reset();
+				}
+				compactInput ();
+				return;
 			}
-			code = xml::completionDetection(mInputBuffer);
-			if (code < 0) {
-				mErrorText = "Invalid Element";
-				mError = error::BadDeserialization;
-				mState = XS_Error;
+			size_t begin = mTokenizer.begin();
+			if (mTokenizer.closing()) {
+				mReadPos += code;
+				mState = XS_Closed;
 				continue;
 			}
-			if (code ==  0) return;
-			XMLChunk chunk = xml::parseDocument(mInputBuffer.const_c_array(), code);
-			if (chunk.error() || chunk.children().size() != 1){
+			XMLDocumentPtr document (new XMLDocument ());
+			Error e = document->parse (data + begin, code - begin);
+			XMLView chunk = XMLView::ownedRoot (document);
+			if (e || !chunk.valid() || chunk.next().valid()){
 				mErrorText = "Invalid Element";
 				mError = error::BadDeserialization;
 				mState = XS_Error;
 				continue;
 			}
+			// consuming before calling back, as the receiver may reset us.
+			mReadPos += code;
 			if (mChunkRead){
-				mChunkRead (chunk.children()[0]);
+				mChunkRead (chunk);
 			}
-			mInputBuffer.l_truncate(code);
 			continue;
 		}
 		default:
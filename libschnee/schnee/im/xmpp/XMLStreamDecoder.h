@@ -1,6 +1,8 @@
 #pragma once
 #include <schnee/sftypes.h>
 #include <schnee/tools/XMLChunk.h>
+#include <schnee/tools/XMLTokenizer.h>
+#include <schnee/tools/XMLView.h>
 
 namespace sf {
 
@@ -49,9 +51,9 @@ public:
 	/// Get called on state changes
 	VoidDelegate & stateChange ()  { return mStateChange; }
 
-	typedef function<void (const XMLChunk & )> ChunkReadDelegate;
+	typedef function<void (const XMLView & )> ChunkReadDelegate;
 
-	/// A chunk was read
+	/// A chunk was read. Each chunk is parsed into its own XMLDocument, owned by the view.
 	ChunkReadDelegate & chunkRead () { return mChunkRead; }
 
 	///@}
@@ -61,9 +63,13 @@ private:
 	XMLStreamDecoder (const XMLStreamDecoder &);
 
 	void handleData ();
+	/// Removes already handled data from the input buffer (if worth it)
+	void compactInput ();
 	State           mState;
 	XMLChunk        mOpener;
 	ByteArray       mInputBuffer;
+	size_t          mReadPos;		///< Begin of not yet handled data in mInputBuffer (XS_ReadOpener)
+	XMLTokenizer    mTokenizer;		///< Scans for the end of the current element
 
 	ChunkReadDelegate mChunkRead;
 	VoidDelegate      mStateChange;
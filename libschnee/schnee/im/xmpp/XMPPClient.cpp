@@ -12,6 +12,8 @@ namespace sf {
 XMPPClient::XMPPClient() {
 	SF_REGISTER_ME;
 	mConnectionState = CS_OFFLINE;
+	mRosterChangeScheduled = false;
+	mPresenceBatchMs = 50;
 }
 
 XMPPClient::~XMPPClient() {
@@ -39,17 +41,20 @@ void XMPPClient::connect(const ResultDelegate & callback) {
 	connector->setConnectionDetails(mConnectDetails);
 
 	mStream = shared_ptr<XMPPStream> (new XMPPStream ());
-	mStream->incomingMessage()     = dMemFun (this, &XMPPClient::onIncomingMessage);
-	mStream->incomingPresence()    = dMemFun (this, &XMPPClient::onIncomingPresence);
-	mStream->incomingIq()          = dMemFun (this, &XMPPClient::onIncomingIq);
-	mStream->incomingStreamError() = dMemFun (this, &XMPPClient::onIncomingStreamError);
-	mStream->closed() = dMemFun (this, &XMPPClient::onStreamClosed);
-	mStream->asyncError() = dMemFun (this, &XMPPClient::onStreamError);
+	bindStream ();
 
 	Error e = connector->connect (mStream, 10000, abind (dMemFun (this, &XMPPClient::onConnect), connector, callback));
 	if (e) xcall (abind (callback, e));
 }
 
+Error XMPPClient::attachStream (const XMPPStreamPtr & stream) {
+	if (!stream) return error::InvalidArgument;
+	mStream = stream;
+	bindStream ();
+	onConnectionStateChanged (CS_CONNECTED);
+	return NoError;
+}
+
 void XMPPClient::disconnect() {
 	if (mStream) {
 		mStream->close();
@@ -89,6 +94,13 @@ IMClient::Contacts XMPPClient::contactRoster() const {
 	return mContacts;
 }
 
+bool XMPPClient::contactInfo (const String & id, ContactInfo * info) const {
+	Contacts::const_iterator i = mContacts.find (id);
+	if (i == mContacts.end()) return false;
+	if (info) *info = i->second;
+	return true;
+}
+
 struct RosterIq : public xmpp::Iq {
 	virtual String encode () const {
 		return "<iq id='" + id + "' type='get'><query xmlns='jabber:iq:roster'/></iq>";
@@ -104,14 +116,18 @@ void XMPPClient::updateContactRoster() {
 	mStream->requestIq(&iq, dMemFun (this, &XMPPClient::onRosterIqResult));
 }
 
-bool XMPPClient::sendMessage(const Message & msg) {
+bool XMPPClient::sendMessage(const Message & msg, const ResultCallback & callback) {
 	if (!isConnected()) {
 		Log (LogWarning) << LOGID
 				<< "No connection, will throw message away";
 		return false;
 	}
 	xmpp::Message m (msg);
-	mStream->sendMessage(m);
+	Error e = mStream->sendMessage(m, callback);
+	if (e) {
+		Log (LogWarning) << LOGID << "Could not send message: " << toString (e) << std::endl;
+		return false;
+	}
 	return true;
 }
 
@@ -129,7 +145,7 @@ struct RequestFeatureIq : public xmpp::Iq {
 	}
 };
 
-static void onRequestFeatureResult (const Error result, const xmpp::Iq & iq, const XMLChunk & base, const IMClient::FeatureCallback & originalCallback){
+static void onRequestFeatureResult (const Error result, const xmpp::Iq & iq, const XMLView & base, const IMClient::FeatureCallback & originalCallback){
 	// decoding response
 	if (!originalCallback) return;
 	typedef std::vector<String> StringVec;
@@ -334,10 +350,10 @@ void XMPPClient::onIncomingRosterIq(const xmpp::RosterIq & rosterIq) {
 		const xmpp::RosterIq::Item & item = *i;
 
 		String bareJid = item.jid;
-		Log (LogInfo) << LOGID << "(RemoveMe) Item " << toJSON (item) << std::endl;
 		if (item.remove) {
 			Log (LogInfo) << LOGID << "Removing " << bareJid << std::endl;
 			mContacts.erase(bareJid);
+			markRemoved (bareJid);
 		} else if (item.subscription == SS_NONE && !item.waitForSubscription){
 			// Kill that subscription, we are probably removed while being offline
 			RemoveContactIq iq;
@@ -357,6 +373,7 @@ void XMPPClient::onIncomingRosterIq(const xmpp::RosterIq & rosterIq) {
 			}
 			info.hide = false;
 			existingJids.insert (bareJid);
+			markChanged (bareJid);
 		}
 	}
 	if (deleteNotFound) {
@@ -364,22 +381,25 @@ void XMPPClient::onIncomingRosterIq(const xmpp::RosterIq & rosterIq) {
 		while (i != mContacts.end()){
 			if (existingJids.count(i->first) == 0){
 				// remove that contact, doesn't exist anymore
+				markRemoved (i->first);
 				mContacts.erase(i++);
 				continue;
 			} else
 				i++;
 		}
 	}
-	if (mContactRosterChangedDelegate) mContactRosterChangedDelegate();
-	Log (LogInfo) << LOGID << "Ready updating roster\n" << toJSONEx (mContacts, sf::COMPRESS | sf::COMPACT) << std::endl;
+	if (deleteNotFound) mPendingChange.full = true;
+	// roster updates are not delayed, pending presences go with them
+	flushRosterChange ();
+	Log (LogInfo) << LOGID << "Ready updating roster, " << mContacts.size() << " contacts" << std::endl;
 }
 
-void XMPPClient::onRosterIqResult (Error result, const xmpp::Iq & iq, const XMLChunk & base) {
+void XMPPClient::onRosterIqResult (Error result, const xmpp::Iq & iq, const XMLView & base) {
 	// mapping to default handler.
 	if (!result) onIncomingIq (iq, base);
 }
 
-void XMPPClient::onIncomingPresence(const xmpp::PresenceInfo & elem, const XMLChunk & base) {
+void XMPPClient::onIncomingPresence(const xmpp::PresenceInfo & elem, const XMLView & base) {
 	if (elem.type == "subscribe"){
 		bool toAuthorize = false;
 
@@ -424,7 +444,8 @@ void XMPPClient::onIncomingPresence(const xmpp::PresenceInfo & elem, const XMLCh
 			info.error     = true;
 			info.errorText = elem.errorText;
 		}
-		if (mContactRosterChangedDelegate) mContactRosterChangedDelegate();
+		markChanged (elem.from);
+		scheduleRosterChange ();
 		return;
 	}
 
@@ -493,19 +514,20 @@ void XMPPClient::onIncomingPresence(const xmpp::PresenceInfo & elem, const XMLCh
 			change = true;
 		}
 	}
-	if (change && mContactRosterChangedDelegate) {
-		mContactRosterChangedDelegate ();
+	if (change) {
+		markChanged (bareJid);
+		scheduleRosterChange ();
 	}
 }
 
-void XMPPClient::onIncomingMessage(const xmpp::Message & msg, const XMLChunk & base) {
+void XMPPClient::onIncomingMessage(const xmpp::Message & msg, const XMLView & base) {
 	if (mMessageReceivedDelegate) mMessageReceivedDelegate(msg);
 }
 
-void XMPPClient::onIncomingIq (const xmpp::Iq & iq, const XMLChunk & base) {
-	const XMLChunk * query = base.getHasChild ("query");
-	if (query) {
-		if (query->ns() == "jabber:iq:roster"){
+void XMPPClient::onIncomingIq (const xmpp::Iq & iq, const XMLView & base) {
+	XMLView query = base.child ("query");
+	if (query.valid()) {
+		if (query.ns() == "jabber:iq:roster"){
 			xmpp::RosterIq result;
 			if (!result.decode(base)) {
 				Log (LogWarning) << LOGID << "Could not decode iq roster iq" << base << std::endl;
@@ -514,7 +536,7 @@ void XMPPClient::onIncomingIq (const xmpp::Iq & iq, const XMLChunk & base) {
 			onIncomingRosterIq (result);
 			return;
 		}
-		if (iq.type == "get" && query->ns() == "http://jabber.org/protocol/disco#info") {
+		if (iq.type == "get" && query.ns() == "http://jabber.org/protocol/disco#info") {
 			xmpp::DiscoInfoIq result;
 			result.type = "result";
 			result.features = mFeatures;
@@ -538,7 +560,7 @@ void XMPPClient::onIncomingIq (const xmpp::Iq & iq, const XMLChunk & base) {
 	}
 }
 
-void XMPPClient::onIncomingStreamError (const String & text, const XMLChunk & base) {
+void XMPPClient::onIncomingStreamError (const String & text, const XMLView & base) {
 	if (mServerStreamErrorReceived) mServerStreamErrorReceived (text);
 }
 
@@ -555,4 +577,45 @@ void XMPPClient::onAsyncCloseStream () {
 	mStream->close();
 }
 
+void XMPPClient::bindStream () {
+	mStream->incomingMessage()     = dMemFun (this, &XMPPClient::onIncomingMessage);
+	mStream->incomingPresence()    = dMemFun (this, &XMPPClient::onIncomingPresence);
+	mStream->incomingIq()          = dMemFun (this, &XMPPClient::onIncomingIq);
+	mStream->incomingStreamError() = dMemFun (this, &XMPPClient::onIncomingStreamError);
+	mStream->closed() = dMemFun (this, &XMPPClient::onStreamClosed);
+	mStream->asyncError() = dMemFun (this, &XMPPClient::onStreamError);
+}
+
+void XMPPClient::markChanged (const String & bareJid) {
+	mPendingChange.removed.erase (bareJid);
+	mPendingChange.changed.insert (bareJid);
+}
+
+void XMPPClient::markRemoved (const String & bareJid) {
+	mPendingChange.changed.erase (bareJid);
+	mPendingChange.removed.insert (bareJid);
+}
+
+void XMPPClient::scheduleRosterChange () {
+	if (mPresenceBatchMs <= 0) {
+		flushRosterChange ();
+		return;
+	}
+	if (mRosterChangeScheduled) return;
+	mRosterChangeScheduled = true;
+	xcallTimed (dMemFun (this, &XMPPClient::flushRosterChange), futureInMs (mPresenceBatchMs));
+}
+
+void XMPPClient::flushRosterChange () {
+	mRosterChangeScheduled = false;
+	if (mPendingChange.empty()) return;
+	RosterChange change;
+	std::swap (change, mPendingChange);
+	if (mContactRosterChangeDelegate) {
+		mContactRosterChangeDelegate (change);
+	} else if (mContactRosterChangedDelegate) {
+		mContactRosterChangedDelegate ();
+	}
+}
+
 }
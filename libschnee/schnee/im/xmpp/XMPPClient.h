@@ -34,8 +34,9 @@ public:
 
 	virtual void setPresence (const PresenceState & state, const String & desc = "", int priority = 0);
 	virtual Contacts contactRoster () const;
+	virtual bool contactInfo (const String & id, ContactInfo * info) const;
 	virtual void updateContactRoster ();
-	virtual bool sendMessage (const Message & msg);
+	virtual bool sendMessage (const Message & msg, const ResultCallback & callback = ResultCallback());
 	virtual Error requestFeatures (const HostId & dst, const FeatureCallback & callback);
 	virtual Error setFeatures (const std::vector<String> & features);
 	virtual Error setIdentity (const String & name, const String & type);
@@ -52,11 +53,22 @@ public:
 		return mConnectionStateChangedDelegate;
 	}
 	virtual VoidDelegate & contactRosterChanged () { return mContactRosterChangedDelegate; }
+	virtual RosterChangeDelegate * contactRosterChange () { return &mContactRosterChangeDelegate; }
 	virtual MessageReceivedDelegate & messageReceived () { return mMessageReceivedDelegate; }
 	virtual ServerStreamErrorDelegate & streamErrorReceived () { return mServerStreamErrorReceived; }
 
 
 	
+	/// Presence changes arriving within windowMs are reported as one roster change
+	/// (0 reports every presence on its own). Default is 50ms.
+	void setPresenceBatching (int windowMs) { mPresenceBatchMs = windowMs; }
+
+	typedef shared_ptr<XMPPStream> XMPPStreamPtr;
+
+	/// Uses an already initialized stream instead of connecting
+	/// (e.g. a local stand-in for testing)
+	Error attachStream (const XMPPStreamPtr & stream);
+
 	/// Extracts bare jid from a full one
 	static String fullJidToBareJid (const String & fullJid);
 	/// Checks whether jid is a full or bare jid
@@ -78,30 +90,46 @@ private:
 	void onConnectionStateChanged (ConnectionState state);
 
 	void onIncomingRosterIq (const xmpp::RosterIq & result);
-	void onRosterIqResult (Error result, const xmpp::Iq & iq, const XMLChunk & base);
+	void onRosterIqResult (Error result, const xmpp::Iq & iq, const XMLView & base);
 
 	// regular handlers
-	void onIncomingPresence (const xmpp::PresenceInfo & elem, const XMLChunk & base);
-	void onIncomingMessage (const xmpp::Message & msg, const XMLChunk & base);
-	void onIncomingIq (const xmpp::Iq & , const XMLChunk & base);
-	void onIncomingStreamError (const String & text, const XMLChunk & base);
+	void onIncomingPresence (const xmpp::PresenceInfo & elem, const XMLView & base);
+	void onIncomingMessage (const xmpp::Message & msg, const XMLView & base);
+	void onIncomingIq (const xmpp::Iq & , const XMLView & base);
+	void onIncomingStreamError (const String & text, const XMLView & base);
 	void onStreamClosed ();
 	void onStreamError ();
 	void onAsyncCloseStream (); /// < Close stream asyncronously (on StreamErrors)
 
+	/// Installs our handlers on the stream
+	void bindStream ();
+
+	///@name Roster change batching
+	///@{
+	void markChanged (const String & bareJid);
+	void markRemoved (const String & bareJid);
+	/// Reports pending changes after the batching window
+	void scheduleRosterChange ();
+	/// Reports pending changes now
+	void flushRosterChange ();
+	///@}
+
 	// Login data
 	XMPPConnection::XmppConnectDetails mConnectDetails;
 
-	typedef shared_ptr<XMPPStream> XMPPStreamPtr;
 	String mErrorText;
 	XMPPStreamPtr mStream;
 
 	Contacts 		 mContacts;
+	RosterChange	 mPendingChange;	///< Not yet reported roster changes
+	bool			 mRosterChangeScheduled;
+	int				 mPresenceBatchMs;
 	
 	// Delegates
 	SubscribeRequestDelegate    mContactAddRequestDelegate;
 	MessageReceivedDelegate 	 mMessageReceivedDelegate;
 	VoidDelegate		  		 mContactRosterChangedDelegate;
+	RosterChangeDelegate		 mContactRosterChangeDelegate;
 	ServerStreamErrorDelegate    mServerStreamErrorReceived;
 	ConnectionStateChangedDelegate mConnectionStateChangedDelegate;
 	
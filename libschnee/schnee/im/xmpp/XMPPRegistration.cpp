@@ -25,42 +25,41 @@ struct RegisterGetIq : public xmpp::Iq {
 /// Callback for register get iq.
 typedef function<void (Error result, const String & instructions, const std::vector<String> & fields)> RegisterGetCallback;
 
-static void registerGetIqHandler (Error e, const xmpp::Iq & iq, const XMLChunk & chunk, const RegisterGetCallback & originalCallback) {
+static void registerGetIqHandler (Error e, const xmpp::Iq & iq, const XMLView & chunk, const RegisterGetCallback & originalCallback) {
 	std::vector<String> fields;
 	String instructions;
-	if (chunk.hasChildWithName("error")){
+	if (chunk.child("error").valid()){
 		return originalCallback (error::NotSupported, instructions, fields);
 	}
-	const XMLChunk * query = chunk.getHasChild("query");
-	if (!query) {
+	XMLView query = chunk.child("query");
+	if (!query.valid()) {
 		return originalCallback (error::BadProtocol, instructions, fields);
 	}
 
-	const XMLChunk::ChunkVector & v = query->children();
 	bool foundInstructions = false;
 	bool foundRedirection  = false;
 	bool registered        = false;
 	bool xform             = false; // not supported
-	for (XMLChunk::ChunkVector::const_iterator i = v.begin(); i != v.end(); i++) {
-		Log (LogInfo) << LOGID << "Blob: " << *i << std::endl;
-		if (i->name() == "registered"){
+	for (XMLView i = query.child(); i.valid(); i = i.next()) {
+		Log (LogInfo) << LOGID << "Blob: " << i << std::endl;
+		if (i.name() == "registered"){
 			registered = true;
 			break;
 		}
-		if (i->name() == "x" && i->ns() == "jabber:x:oob"){
+		if (i.name() == "x" && i.ns() == "jabber:x:oob"){
 			foundRedirection = true;
 			break;
 		}
-		if (i->name() == "instructions"){
+		if (i.name() == "instructions"){
 			foundInstructions = true;
-			instructions = i->text();
+			instructions = i.text();
 			continue;
 		}
-		if (i->name() == "x" && i->ns() == "'jabber:x:data"){
+		if (i.name() == "x" && i.ns() == "'jabber:x:data"){
 			xform = true;
 			break;
 		}
-		fields.push_back(i->name());
+		fields.push_back(i.name());
 	}
 	if (foundRedirection) {
 		Log (LogProfile) << LOGID << "Server uses redirection, not supported" << std::endl;
@@ -98,20 +97,20 @@ struct RegisterSetIq : public xmpp::Iq {
 	}
 };
 
-static void registerSetIqHandler (Error e, const xmpp::Iq & iq, const XMLChunk & base, const ResultCallback & callback) {
+static void registerSetIqHandler (Error e, const xmpp::Iq & iq, const XMLView & base, const ResultCallback & callback) {
 	if (!callback) return;
 	if (e) return callback (e);
 	if (iq.type == "error") {
 		Error e = error::Other;
-		const XMLChunk * errorChield = base.getHasChild("error");
-		const XMLChunk * textChild   = errorChield ? errorChield->getHasChild("text") : 0;
-		if (errorChield) {
+		XMLView errorChield = base.child("error");
+		XMLView textChild   = errorChield.child("text");
+		if (errorChield.valid()) {
 			Log (LogProfile) << LOGID << "Register failed " << std::endl;
-			if (textChild){
-				Log (LogProfile) << LOGID << "Cause: " << textChild->text();
+			if (textChild.valid()){
+				Log (LogProfile) << LOGID << "Cause: " << textChild.text();
 			}
-			if (errorChield->hasChildWithName("conflict")) e = error::ExistsAlready;
-			if (errorChield->hasChildWithName("not-acceptable")) e = error::NotSupported;
+			if (errorChield.child("conflict").valid()) e = error::ExistsAlready;
+			if (errorChield.child("not-acceptable").valid()) e = error::NotSupported;
 		}
 		return callback (e);
 	}
@@ -2,28 +2,28 @@
 
 #include <schnee/tools/Base64.h>
 #include <schnee/tools/Serialization.h>
-#include <schnee/tools/XMLChunk.h>
+#include <schnee/tools/XMLView.h>
 
 namespace sf {
 namespace xmpp {
 
-bool decodeStanza (IMClient::Stanza & stanza, const XMLChunk & elem){
-	stanza.from = elem.getAttribute ("from");
-	stanza.to   = elem.getAttribute ("to");
+bool decodeStanza (IMClient::Stanza & stanza, const XMLView & elem){
+	stanza.from = elem.attribute ("from");
+	stanza.to   = elem.attribute ("to");
 	return true;
 }
 
-bool PresenceInfo::decode (const XMLChunk & chunk){
+bool PresenceInfo::decode (const XMLView & chunk){
 	if (!decodeStanza(*this, chunk)) return false;
-	const XMLChunk * prioChunk = chunk.getHasChild ("priority");
-	if (prioChunk){
-		priority = atoi (prioChunk->text().c_str());
+	XMLView prioChunk = chunk.child ("priority");
+	if (prioChunk.valid()){
+		priority = atoi (prioChunk.text().str().c_str());
 	} else {
 		priority = 0;
 	}
-	const XMLChunk * showChild = chunk.getHasChild ("show");
-	if (showChild){
-		String show = showChild->text();
+	XMLView showChild = chunk.child ("show");
+	if (showChild.valid()){
+		StringRef show = showChild.text();
 		if (show == "chat"){
 			state = IMClient::PS_CHAT;
 		} else
@@ -40,21 +40,21 @@ bool PresenceInfo::decode (const XMLChunk & chunk){
 			state = IMClient::PS_UNKNOWN;
 		}
 	} else state = IMClient::PS_UNKNOWN; // allowed
-	type = chunk.getAttribute ("type");
+	type = chunk.attribute ("type");
 	if (type == "unavailable"){
 		if (state != IMClient::PS_UNKNOWN){
 			Log (LogError) << LOGID << "Incoherent data" << std::endl;
 		}
 		state = IMClient::PS_OFFLINE;
 	}
-	const XMLChunk * errChunk = chunk.getHasChild ("error");
-	if (errChunk) {
-		errorType = errChunk->getAttribute("type");
-		errorText = errChunk->getChildText("text");
+	XMLView errChunk = chunk.child ("error");
+	if (errChunk.valid()) {
+		errorType = errChunk.attribute("type");
+		errorText = errChunk.childText("text");
 	}
-	const XMLChunk * statusChild = chunk.getHasChild ("status");
-	if (statusChild){
-		status = statusChild->text();
+	XMLView statusChild = chunk.child ("status");
+	if (statusChild.valid()){
+		status = statusChild.text();
 	}
 	return true;
 }
@@ -101,14 +101,14 @@ String PresenceInfo::encode() const {
 	return ss.str();
 }
 
-bool Iq::decode (const XMLChunk & chunk) {
+bool Iq::decode (const XMLView & chunk) {
 	if (!decodeStanza(*this, chunk)) return false;
-	id   = chunk.getAttribute ("id");
+	id   = chunk.attribute ("id");
 	if (id == ""){
 		Log (LogWarning) << LOGID << "No/empty 'id' attribute in IqResult, discarding";
 		return false;
 	}
-	type = chunk.getAttribute ("type");
+	type = chunk.attribute ("type");
 	return true;
 }
 
@@ -133,25 +133,24 @@ String ErrorIq::encodeInner () const {
 	return ss.str();
 }
 
-bool RosterIq::decode (const XMLChunk & chunk) {
+bool RosterIq::decode (const XMLView & chunk) {
 	if (!Iq::decode(chunk)) return false;
-	const XMLChunk * qr = chunk.getHasChild ("query");
-	if (!qr) {
+	XMLView qr = chunk.child ("query");
+	if (!qr.valid()) {
 		Log (LogWarning) << LOGID << "No <query> child in " << chunk << std::endl;
 		return false;
 	}
-	if (qr->ns() != "jabber:iq:roster"){
-		Log (LogWarning) << LOGID << "Query has the wrong namespace " << qr->ns ()  << " (in chunk=" << chunk << ")";
+	if (qr.ns() != "jabber:iq:roster"){
+		Log (LogWarning) << LOGID << "Query has the wrong namespace " << qr.ns ()  << " (in chunk=" << chunk << ")";
 		return false;
 	}
 	
-	std::vector<const XMLChunk*> xitems = qr->getChildren ("item");
-	for (std::vector<const XMLChunk*>::const_iterator i = xitems.begin(); i != xitems.end(); i++){
+	for (XMLView i = qr.child ("item"); i.valid(); i = i.next ("item")){
 		Item item;
-		item.jid  = (*i)->getAttribute("jid");
-		item.name = (*i)->getAttribute("name");
+		item.jid  = i.attribute("jid");
+		item.name = i.attribute("name");
 		
-		String subscription = (*i)->getAttribute("subscription");
+		StringRef subscription = i.attribute("subscription");
 		if (subscription.empty() || subscription == "none")
 			item.subscription = IMClient::SS_NONE;
 		if (subscription == "to")
@@ -163,7 +162,7 @@ bool RosterIq::decode (const XMLChunk & chunk) {
 		if (subscription == "remove") {
 			item.remove = true;
 		}
-		if ((*i)->getAttribute ("ask") == "subscribe")
+		if (i.attribute ("ask") == "subscribe")
 			item.waitForSubscription = true;
 		
 		if (item.jid == ""){
@@ -175,22 +174,19 @@ bool RosterIq::decode (const XMLChunk & chunk) {
 	return true;
 }
 
-bool DiscoInfoIq::decode (const XMLChunk & chunk) {
+bool DiscoInfoIq::decode (const XMLView & chunk) {
 	if (!Iq::decode(chunk)) return false;
 
-	const XMLChunk * queryNode = chunk.getHasChild("query");
-	if (!queryNode) return false;
-	std::vector<const XMLChunk*> identities = queryNode->getChildren("identity");
-	for (std::vector<const XMLChunk*>::const_iterator i = identities.begin(); i != identities.end(); i++) {
-		const XMLChunk * identity (*i);
-		if (identity->getAttribute("category") == "client"){
-			clientType = identity->getAttribute ("type");
-			clientName = identity->getAttribute ("name");
+	XMLView queryNode = chunk.child("query");
+	if (!queryNode.valid()) return false;
+	for (XMLView identity = queryNode.child("identity"); identity.valid(); identity = identity.next("identity")) {
+		if (identity.attribute("category") == "client"){
+			clientType = identity.attribute ("type");
+			clientName = identity.attribute ("name");
 		}
 	}
-	std::vector<const XMLChunk*> names = queryNode->getChildren("feature");
-	for (std::vector<const XMLChunk*>::const_iterator i = names.begin(); i != names.end(); i++) {
-		features.push_back((*i)->getAttribute("var"));
+	for (XMLView feature = queryNode.child("feature"); feature.valid(); feature = feature.next("feature")) {
+		features.push_back(feature.attribute("var"));
 	}
 	return true;
 }
@@ -212,10 +208,10 @@ String DiscoInfoIq::encode () const {
 	return ss.str();
 }
 
-bool Message::decode (const XMLChunk & chunk){
+bool Message::decode (const XMLView & chunk){
 	if (!decodeStanza (*this, chunk)) return false;
-	String t = chunk.getAttribute ("type");
-	if (t == "") {
+	StringRef t = chunk.attribute ("type");
+	if (t.empty()) {
 		type = IMClient::MT_NORMAL;
 	} else {
 		if (t == "normal") type = IMClient::MT_NORMAL;
@@ -231,21 +227,23 @@ bool Message::decode (const XMLChunk & chunk){
 	
 	// may have multiple childs with name subject .. confusing
 	// we still take the first
-	subject = xml::decEntities (chunk.getChildText("subject"));
-	body    = xml::decEntities (chunk.getChildText("body"));
-	thread  = xml::decEntities (chunk.getChildText("thread"));
-	id      = chunk.getAttribute("id");
-	const XMLChunk * dataChild = chunk.getHasChild("data");
-	if (dataChild){
-		if (dataChild->ns() != "urn:xmpp:bob"){
+	// (entities are already decoded by the parser)
+	subject = chunk.childText("subject");
+	body    = chunk.childText("body");
+	thread  = chunk.childText("thread");
+	id      = chunk.attribute("id");
+	XMLView dataChild = chunk.child("data");
+	if (dataChild.valid()){
+		if (dataChild.ns() != "urn:xmpp:bob"){
 			Log (LogWarning) << LOGID << "Found data child in message, but it does not have a urn:xmpp:bob namespace, ignoring";
 		} else {
 			data = DataBlockPtr (new DataBlock ());
-			String ageS = dataChild->getAttribute("age");
-			if (ageS == "") data->age = -1; else data->age = atoi (ageS.c_str());
-			data->cid  = dataChild->getAttribute ("cid");
-			data->type = dataChild->getAttribute ("type");
-			Base64::decodeToArray (dataChild->text(), data->data);
+			StringRef ageS = dataChild.attribute("age");
+			if (ageS.empty()) data->age = -1; else data->age = atoi (ageS.str().c_str());
+			data->cid  = dataChild.attribute ("cid");
+			data->type = dataChild.attribute ("type");
+			StringRef encoded = dataChild.text();
+			Base64::decodeToArray (encoded.data(), encoded.size(), data->data);
 		}
 	}
 	return true;
@@ -12,7 +12,7 @@
 
 // @cond DEV
 
-#include <schnee/tools/XMLChunk.h>
+#include <schnee/tools/XMLView.h>
 #include <schnee/tools/Log.h>
 #include <schnee/im/IMClient.h>
 #include <schnee/sftypes.h>
@@ -23,7 +23,7 @@ namespace sf {
 namespace xmpp {
 
 /// Decodes an IMClient-Stanza; returns true on success
-bool decodeStanza (IMClient::Stanza & stanza, const XMLChunk & elem);
+bool decodeStanza (IMClient::Stanza & stanza, const XMLView & elem);
 
 /** A message we received about the presence of someone
  * 
@@ -38,7 +38,7 @@ bool decodeStanza (IMClient::Stanza & stanza, const XMLChunk & elem);
  */
 struct PresenceInfo : public IMClient::Stanza {
 	PresenceInfo () : priority (0), state (IMClient::PS_UNKNOWN) {}
-	bool decode (const XMLChunk&);
+	bool decode (const XMLView &);
 	virtual String encode() const;
 
 	int     priority; 			    ///< priority of the client (0 is either 0 or not set)
@@ -56,7 +56,7 @@ struct Iq : public IMClient::Stanza {
 	virtual ~Iq () {}
 	String id;	/// id of the Iq query
 	String type;
-	bool decode (const XMLChunk &);
+	bool decode (const XMLView &);
 	virtual String encode () const;
 	// Encode the inner part between <iq> and </iq>
 	virtual String encodeInner () const { return "";}
@@ -88,7 +88,7 @@ struct RosterIq : public Iq {
 		SF_AUTOREFLECT_SERIAL;
 	};
 	std::vector <Item> items;
-	bool decode (const XMLChunk &);
+	bool decode (const XMLView &);
 	SF_AUTOREFLECT_SERIAL;
 };
 
@@ -97,7 +97,7 @@ struct DiscoInfoIq : public Iq {
 	std::vector<String> features;
 	String clientType;
 	String clientName;
-	bool decode (const XMLChunk &);
+	bool decode (const XMLView &);
 	virtual String encode () const;
 	SF_AUTOREFLECT_SERIAL;
 };
@@ -128,7 +128,7 @@ typedef shared_ptr<DataBlock> DataBlockPtr;
 struct Message : public IMClient::Message {
 	Message () {}
 	Message (const IMClient::Message & msg) { IMClient::Message::operator= (msg); }
-	bool decode (const XMLChunk &);
+	bool decode (const XMLView &);
 	void encode (String & target) const;
 	
 	String thread;		///< machine readable for tracking conversation, must be unique through conversation
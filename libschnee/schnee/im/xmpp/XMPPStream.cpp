@@ -46,7 +46,7 @@ String XMPPStream::dstJid () const {
 	return mDstJid;
 }
 
-XMLChunk XMPPStream::features () const {
+XMLView XMPPStream::features () const {
 	return mFeatures;
 }
 
@@ -106,22 +106,27 @@ Error XMPPStream::waitFeatures (const ResultCallback & callback) {
 	return NoError;
 }
 
-static bool hasMechanism (const String & name, const XMLChunk & features) {
-	XMLChunk mechanisms = features.getChild ("mechanisms");
-	if (mechanisms.error()) return false;
+static bool hasMechanism (const String & name, const XMLView & features) {
+	XMLView mechanisms = features.child ("mechanisms");
+	if (!mechanisms.valid()) return false;
 	String nameUppered (name);
 	boost::algorithm::to_upper(nameUppered);
-	typedef std::vector<const XMLChunk*> Vec;
-	Vec elements = mechanisms.getChildren("mechanism");
-	for (Vec::const_iterator i = elements.begin(); i != elements.end(); i++) {
-		const XMLChunk * chunk (*i);
-		String text = chunk->text();
+	for (XMLView chunk = mechanisms.child("mechanism"); chunk.valid(); chunk = chunk.next("mechanism")) {
+		String text = chunk.text();
 		boost::algorithm::to_upper (text);
 		if (text == nameUppered) return true;
 	}
 	return false;
 }
 
+static bool hasCompressionMethod (const String & name, const XMLView & features) {
+	XMLView compression = features.child ("compression");
+	for (XMLView method = compression.child ("method"); method.valid(); method = method.next ("method")) {
+		if (method.text() == name) return true;
+	}
+	return false;
+}
+
 /// Constructs the secret as the PLAIN mechanism wants it.
 static String plainSecret (const String & username, const String & password) {
 	// construction of the Base64 secret = \0username\0password
@@ -161,7 +166,7 @@ Error XMPPStream::requestTls (const ResultCallback & callback) {
 		Log (LogWarning) << LOGID << "Cannot request TLS, no stream features" << std::endl;
 		return error::WrongState;
 	}
-	if (!mFeatures.hasChildWithName("starttls")){
+	if (!mFeatures.child("starttls").valid()){
 		Log (LogWarning) << LOGID << "Cannot request TLS, not supported by stream features" << std::endl;
 		return error::NotSupported;
 	}
@@ -174,6 +179,22 @@ Error XMPPStream::requestTls (const ResultCallback & callback) {
 	return NoError;
 }
 
+Error XMPPStream::requestCompression (const ResultCallback & callback) {
+	if (!mReceivedFeatures) {
+		Log (LogWarning) << LOGID << "Cannot request compression, no stream features" << std::endl;
+		return error::WrongState;
+	}
+	if (!hasCompressionMethod ("zlib", mFeatures)) {
+		return error::NotSupported;
+	}
+	Error e = startOp (XMO_RequestCompression, callback);
+	if (e) return e;
+	e = send ("<compress xmlns='http://jabber.org/protocol/compress'><method>zlib</method></compress>");
+	if (e) return e;
+	mNextChunkHandler = memFun (this, &XMPPStream::onCompressReply);
+	return NoError;
+}
+
 Error XMPPStream::requestIq (xmpp::Iq * iq, const IqResultCallback & callback) {
 	iq->id = generateIqId ();
 	String req = iq->encode();
@@ -201,7 +222,7 @@ Error XMPPStream::bindResource  (const String & name, const BindCallback & callb
 	return requestIq (&iq, abind (dMemFun (this, &XMPPStream::onResourceBind), callback));
 }
 
-static void sessionIqResultHandler (Error e, const xmpp::Iq & iq, const XMLChunk & chunk, const ResultCallback & originalCallback) {
+static void sessionIqResultHandler (Error e, const xmpp::Iq & iq, const XMLView & chunk, const ResultCallback & originalCallback) {
 	if (originalCallback) originalCallback(e);
 }
 
@@ -213,7 +234,7 @@ struct SessionIq : public xmpp::Iq {
 Error XMPPStream::startSession (const ResultCallback & callback) {
 	SessionIq iq;
 	// hack
-	typedef function<void (Error, const xmpp::Iq &, const XMLChunk &, const ResultCallback &)> InternalHandler;
+	typedef function<void (Error, const xmpp::Iq &, const XMLView &, const ResultCallback &)> InternalHandler;
 	return requestIq (&iq, abind (&sessionIqResultHandler, callback));
 }
 
@@ -222,10 +243,10 @@ Error XMPPStream::sendPresence (const xmpp::PresenceInfo & p) {
 	return send (dst);
 }
 
-Error XMPPStream::sendMessage (const xmpp::Message & m) {
+Error XMPPStream::sendMessage (const xmpp::Message & m, const ResultCallback & callback) {
 	String dst;
 	m.encode(dst);
-	return send (dst);
+	return send (dst, callback);
 }
 
 Error XMPPStream::sendPlainIq (const xmpp::Iq & iq) {
@@ -244,7 +265,7 @@ Error XMPPStream::init (ChannelPtr channel, bool skipInit) {
 	else
 		mXmlStreamDecoder.reset();
 	mReceivedFeatures = false;
-	mFeatures = XMLChunk ();
+	mFeatures = XMLView ();
 	mChannel = channel;
 	mChannel->changed() = dMemFun (this, &XMPPStream::onChannelChange);
 	xcall (dMemFun (this, &XMPPStream::onChannelChange));
@@ -283,7 +304,7 @@ void XMPPStream::onXmlStreamStateChange () {
 	}
 }
 
-void XMPPStream::onXmlChunkRead (const XMLChunk & chunk) {
+void XMPPStream::onXmlChunkRead (const XMLView & chunk) {
 	if (mNextChunkHandler){
 		mNextChunkHandler (chunk);
 		mNextChunkHandler.clear();
@@ -306,7 +327,7 @@ void XMPPStream::onXmlChunkRead (const XMLChunk & chunk) {
 			Log (LogWarning) << LOGID << "Could not decode " << chunk << std::endl;
 			return;
 		}
-		String id = chunk.getAttribute("id");
+		String id = chunk.attribute("id");
 		if (id.empty()){
 			Log (LogWarning) << LOGID << "Received empty id in iq" << std::endl;
 		}
@@ -347,7 +368,7 @@ void XMPPStream::onXmlChunkRead (const XMLChunk & chunk) {
 		notifyAsync (mIncomingPresence, p, chunk);
 	} else
 	if (chunk.name() == "stream:error"){
-		String text = chunk.getChild("text").text();
+		String text = chunk.child("text").text();
 		if (mIncomingStreamError){
 			notifyAsync (mIncomingStreamError, text, chunk);
 		} else {
@@ -384,7 +405,7 @@ void XMPPStream::onChannelChange   () {
 	}
 }
 
-void XMPPStream::onAuthReply (const XMLChunk & chunk) {
+void XMPPStream::onAuthReply (const XMLView & chunk) {
 	if (chunk.name() == "success"){
 		finishOp (XMO_Authenticate, NoError);
 		return;
@@ -392,7 +413,7 @@ void XMPPStream::onAuthReply (const XMLChunk & chunk) {
 	finishOp (XMO_Authenticate, error::AuthError);
 }
 
-void XMPPStream::onStartTlsReply (const XMLChunk & chunk) {
+void XMPPStream::onStartTlsReply (const XMLView & chunk) {
 	if (chunk.name() == "proceed"){
 		finishOp (XMO_RequestTls, NoError);
 		return;
@@ -401,8 +422,17 @@ void XMPPStream::onStartTlsReply (const XMLChunk & chunk) {
 	finishOp (XMO_RequestTls, error::NotSupported);
 }
 
-void XMPPStream::onResourceBind (Error e, const xmpp::Iq & iq, const XMLChunk & chunk, const XMPPStream::BindCallback & originalCallback) {
-	String jid = chunk.getChild ("bind").getChild("jid").text();
+void XMPPStream::onCompressReply (const XMLView & chunk) {
+	if (chunk.name() == "compressed"){
+		finishOp (XMO_RequestCompression, NoError);
+		return;
+	}
+	Log (LogWarning) << LOGID << "Could not request compression: " << chunk << std::endl;
+	finishOp (XMO_RequestCompression, error::NotSupported);
+}
+
+void XMPPStream::onResourceBind (Error e, const xmpp::Iq & iq, const XMLView & chunk, const XMPPStream::BindCallback & originalCallback) {
+	String jid = chunk.child ("bind").child("jid").text();
 	if (jid.empty() && !e){
 		Log (LogWarning) << LOGID << "Could not bind, got no JID" << std::endl;
 	}
@@ -433,12 +463,12 @@ void XMPPStream::sendStreamInit () {
 	send (init);
 }
 
-Error XMPPStream::send (const String & content) {
+Error XMPPStream::send (const String & content, const ResultCallback & callback) {
 	if (!mChannel) return error::NotInitialized;
 #ifndef NDEBUG
 	Log (LogInfo) << LOGID << "send " << content << std::endl;
 #endif
-	return mChannel->write (sf::createByteArrayPtr(content));
+	return mChannel->write (sf::createByteArrayPtr(content), callback);
 }
 
 Error XMPPStream::startOp (CurrentOp op, const ResultCallback & callback) {
@@ -27,7 +27,8 @@ public:
 		XMO_RespondInitialize,
 		XMO_WaitFeatures,
 		XMO_Authenticate,
-		XMO_RequestTls
+		XMO_RequestTls,
+		XMO_RequestCompression
 	};
 
 	/// Access to current state
@@ -47,7 +48,7 @@ public:
 	String dstJid () const;
 
 	/// Features of the stream
-	XMLChunk features () const;
+	XMLView features () const;
 
 	/// Returns channel info
 	Channel::ChannelInfo channelInfo() const;
@@ -76,7 +77,12 @@ public:
 	/// Requests establishment of TLS to the other site
 	Error requestTls (const ResultCallback & callback);
 
-	typedef function <void (Error result, const xmpp::Iq & iq, const XMLChunk & base)> IqResultCallback;
+	/// Requests zlib stream compression (XEP-0138), usually after authentication.
+	/// On success the channel must be wrapped into a ZlibChannel and the stream restarted.
+	/// Returns error::NotSupported if the stream features do not offer it.
+	Error requestCompression (const ResultCallback & callback);
+
+	typedef function <void (Error result, const xmpp::Iq & iq, const XMLView & base)> IqResultCallback;
 
 	/// Sends an Iq (automatically sets the id!)
 	/// Calls you back on response
@@ -106,7 +112,8 @@ public:
 	Error sendPresence (const xmpp::PresenceInfo & p);
 
 	/// Send a message
-	Error sendMessage (const xmpp::Message & m);
+	/// The callback is called when the message was written to the transport channel
+	Error sendMessage (const xmpp::Message & m, const ResultCallback & callback = ResultCallback());
 
 	/// Send a plain iq stanza (e.g. a result)
 	/// No tracking will be started
@@ -117,10 +124,10 @@ public:
 	///@name Delegates
 	///@{
 
-	typedef function<void (const xmpp::Message & m,      const XMLChunk & base)> MessageDelegate;
-	typedef function<void (const xmpp::PresenceInfo & p, const XMLChunk & base)> PresenceDelegate;
-	typedef function<void (const xmpp::Iq & iq,          const XMLChunk & base)> IqDelegate;
-	typedef function<void (const String & text, const XMLChunk & base)> StreamErrorDelegate;
+	typedef function<void (const xmpp::Message & m,      const XMLView & base)> MessageDelegate;
+	typedef function<void (const xmpp::PresenceInfo & p, const XMLView & base)> PresenceDelegate;
+	typedef function<void (const xmpp::Iq & iq,          const XMLView & base)> IqDelegate;
+	typedef function<void (const String & text, const XMLView & base)> StreamErrorDelegate;
 
 	/// A message flow in
 	MessageDelegate  & incomingMessage ()  { return mIncomingMessage; }
@@ -145,18 +152,19 @@ private:
 	Error init (ChannelPtr channel, bool skipInit);
 
 	void onXmlStreamStateChange ();
-	void onXmlChunkRead (const XMLChunk & chunk);
+	void onXmlChunkRead (const XMLView & chunk);
 	void onChannelError (Error e);
 	void onChannelChange   ();
-	void onAuthReply     (const XMLChunk & chunk);
-	void onStartTlsReply (const XMLChunk & chunk);
-	void onResourceBind (Error e, const xmpp::Iq & iq, const XMLChunk & chunk, const XMPPStream::BindCallback & originalCallback);
+	void onAuthReply     (const XMLView & chunk);
+	void onStartTlsReply (const XMLView & chunk);
+	void onCompressReply (const XMLView & chunk);
+	void onResourceBind (Error e, const xmpp::Iq & iq, const XMLView & chunk, const XMPPStream::BindCallback & originalCallback);
 
 	/// Decodes stream opener, returns true if successfull
 	/// On Error the error state will be set and the init callback called.
 	bool decodeStreamInit ();
 	void sendStreamInit ();
-	Error send (const String & content);
+	Error send (const String & content, const ResultCallback & callback = ResultCallback());
 
 	/// An iq timeouted
 	void onTimeoutIq (const String & id);
@@ -179,11 +187,11 @@ private:
 	Error  mError;		 		///< Error code
 	bool   mReceivedFeatures; 	///< Received Features yet.
 	bool   mSkipInit;			///< Skip init receiving (BOSH)
-	XMLChunk mFeatures;			///< Received Features
+	XMLView mFeatures;			///< Received Features
 
 	VoidDelegate          mAsyncError;    ///< Got some error
 	VoidDelegate          mClosed;
-	typedef function<void (XMLChunk)> ChunkHandler;
+	typedef function<void (const XMLView &)> ChunkHandler;
 	ChunkHandler          mNextChunkHandler; ///< Can change handling of chunks
 
 	MessageDelegate  	mIncomingMessage;
@@ -11,6 +11,12 @@ BoshTransport::BoshTransport () {
 	mRid   = 0;
 	mState = Unconnected;
 	mOpenRidCount = 0;
+	mOutputSize   = 0;
+	mRequests     = 2;
+	mHold         = 1;
+	mBatchDelayMs = 2;
+	mMaxBatchSize = 65536;
+	mFlushPending = false;
 
 	mError = NoError;
 	mErrorCount    = 0;
@@ -94,15 +100,25 @@ void BoshTransport::restart () {
 	startNextRequest (args);
 }
 
+void BoshTransport::setBatching (int delayMs, size_t maxSize) {
+	mBatchDelayMs = delayMs;
+	mMaxBatchSize = maxSize;
+}
+
 Error BoshTransport::write (const ByteArrayPtr& data, const ResultCallback & callback) {
 	if (mState != Connected)
 		return error::WrongState;
-	if (callback) {
-		Log (LogError) << LOGID << "BoshTransport does not support any write callbacks yet!" << std::endl;
-	}
 	mOutputBuffer.push_back(data);
-	/// some braking
-	sf::xcallTimed(dMemFun (this, &BoshTransport::continueWorking), sf::futureInMs(mReconnectWaitMs));
+	mOutputSize += data->size();
+	// called back as soon as the server received the request carrying the data
+	if (callback) mOutputCallbacks.push_back (callback);
+	if (mOutputSize >= mMaxBatchSize) {
+		continueWorking ();
+	} else if (!mFlushPending) {
+		// collecting further stanzas
+		mFlushPending = true;
+		sf::xcallTimed(dMemFun (this, &BoshTransport::onFlushTimer), sf::futureInMs(mBatchDelayMs));
+	}
 	return NoError;
 }
 
@@ -182,6 +198,20 @@ void BoshTransport::onConnectReply (Error result, const HttpResponsePtr & respon
 		}
 	}
 
+	// Concurrent requests; the server may lower our hold value
+	// If not set, XEP-0124 says requests = hold + 1 (hold is mandatory, but some servers don't send it)
+	try {
+		String hold = parser.attribute ("hold");
+		mHold = hold.empty() ? 1 : boost::lexical_cast<int> (hold);
+		String requests = parser.attribute ("requests");
+		mRequests = requests.empty() ? mHold + 1 : boost::lexical_cast<int> (requests);
+	} catch (boost::bad_lexical_cast & e){
+		return failConnect (error::BadProtocol, callback, "bad hold/requests response");
+	}
+	if (mHold < 1) mHold = 1; // at least one long poll for receiving data
+	if (mRequests < mHold) mRequests = mHold;
+	Log (LogInfo) << LOGID << "Server allows requests=" << mRequests << " hold=" << mHold << std::endl;
+
 	String type = parser.attribute ("type");
 	if (!type.empty()) { // error or terminate
 		return failConnect (error::CouldNotConnectHost, callback, String ("opponent sent type=" + type).c_str());
@@ -213,15 +243,23 @@ void BoshTransport::failConnect (Error result, const ResultCallback & callback,
 }
 
 void BoshTransport::continueWorking () {
-	if (mOpenRidCount >= 2) {
-		Log (LogInfo) << LOGID << "Not continuing " << mOpenRidCount << "(>=2) connections are open..." << std::endl;
-		return;
-	}
-	if (mOpenRidCount >= 1 && mOutputBuffer.empty()){
-		Log (LogInfo) << LOGID << "Not continuing, pending connection and no data to be sent" << std::endl;
-		return;
+	while (mState == Connected) {
+		if (mOpenRidCount >= mRequests) {
+			// data goes out with the next free request
+			Log (LogInfo) << LOGID << "Not continuing " << mOpenRidCount << "(>=" << mRequests << ") connections are open..." << std::endl;
+			return;
+		}
+		if (mOpenRidCount >= mHold && mOutputBuffer.empty()){
+			// enough long polls waiting
+			return;
+		}
+		startNextRequest ();
 	}
-	startNextRequest ();
+}
+
+void BoshTransport::onFlushTimer () {
+	mFlushPending = false;
+	continueWorking ();
 }
 
 void BoshTransport::startNextRequest (const StringMap & additionalArgs, const ResultCallback & callback) {
@@ -245,6 +283,10 @@ void BoshTransport::startNextRequest (const StringMap & additionalArgs, const Re
 		builder.addContent(*i);
 	}
 	mOutputBuffer.clear();
+	mOutputSize = 0;
+	if (!mOutputCallbacks.empty()){
+		mOpenCallbacks[mRid].swap (mOutputCallbacks);
+	}
 
 	// Sending
 	sf::ByteArrayPtr data = sf::createByteArrayPtr (builder.toString());
@@ -290,6 +332,7 @@ void BoshTransport::onRequestReply (Error result, const HttpResponsePtr & respon
 	}
 	mOpenRids.erase(rid);
 	mOpenRidCount--;
+	notifyWriteCallbacks (rid, NoError);
 
 	mInWaitingRids[rid] = sf::createByteArrayPtr (parser.content());
 	if (!parser.attribute ("type").empty()){
@@ -300,8 +343,13 @@ void BoshTransport::onRequestReply (Error result, const HttpResponsePtr & respon
 	}
 	insertWaitingInputData ();
 
-	/// some braking
-	sf::xcallTimed(dMemFun (this, &BoshTransport::continueWorking), sf::futureInMs(mReconnectWaitMs));
+	if (!mOutputBuffer.empty() && !mFlushPending) {
+		// data was waiting for a free request
+		continueWorking ();
+	} else {
+		/// some braking
+		sf::xcallTimed(dMemFun (this, &BoshTransport::continueWorking), sf::futureInMs(mReconnectWaitMs));
+	}
 	if (mChanged)
 		xcall (mChanged);
 }
@@ -330,6 +378,7 @@ void BoshTransport::failRequest (Error result, int64_t rid, const String & msg,
 	Log (LogWarning) << LOGID << "Terminating connection with " << toString (result) << " " << msg << std::endl;
 	Log (LogWarning) << LOGID << "Open Output data: " << mOutputBuffer.size() << " parts" << std::endl;
 	Log (LogWarning) << LOGID << "Open Connections: " << mOpenRidCount << std::endl;
+	notifyAllWriteCallbacks (result == error::Eof ? error::Closed : result);
 
 	if (result == error::Eof) {
 		// not so bad, just terminated session
@@ -345,6 +394,28 @@ void BoshTransport::failRequest (Error result, int64_t rid, const String & msg,
 }
 
 
+void BoshTransport::notifyWriteCallbacks (int64_t rid, Error result) {
+	RidCallbackMap::iterator i = mOpenCallbacks.find (rid);
+	if (i == mOpenCallbacks.end()) return;
+	for (std::vector<ResultCallback>::const_iterator j = i->second.begin(); j != i->second.end(); j++){
+		notifyAsync (*j, result);
+	}
+	mOpenCallbacks.erase (i);
+}
+
+void BoshTransport::notifyAllWriteCallbacks (Error result) {
+	for (RidCallbackMap::const_iterator i = mOpenCallbacks.begin(); i != mOpenCallbacks.end(); i++){
+		for (std::vector<ResultCallback>::const_iterator j = i->second.begin(); j != i->second.end(); j++){
+			notifyAsync (*j, result);
+		}
+	}
+	mOpenCallbacks.clear();
+	for (std::vector<ResultCallback>::const_iterator j = mOutputCallbacks.begin(); j != mOutputCallbacks.end(); j++){
+		notifyAsync (*j, result);
+	}
+	mOutputCallbacks.clear();
+}
+
 void BoshTransport::executeRequest (const ByteArrayPtr & data, int timeOutMs, const HttpContext::RequestCallback & callback) {
 	HttpRequest req;
 	req.start("POST", mUrl);
@@ -30,6 +30,17 @@ public:
     /// xmlns:xmpp='urn:xmpp:xbosh'/>
 	void restart ();
 
+	/// Stanzas written within delayMs are sent together in one request body,
+	/// if more than maxSize bytes are waiting they are sent out immediately.
+	/// (Default: 2ms, 65536 bytes)
+	void setBatching (int delayMs, size_t maxSize);
+
+	/// Maximum count of concurrent requests (as advertised by the server)
+	int requests () const { return mRequests; }
+
+	/// Count of requests the server may hold (as advertised by the server)
+	int hold () const { return mHold; }
+
 	// Implementation of Channel
 	virtual sf::Error error () const { return mError; }
 	virtual sf::String errorMessage () const { return mErrorMessage; }
@@ -47,9 +58,12 @@ private:
 	void onConnectReply (Error result, const HttpResponsePtr & response, const ResultCallback & callback);
 	void failConnect (Error result, const ResultCallback & callback, const String & msg);
 
-	/// Issues new requests
+	/// Issues new requests (as long as the server allows it)
 	void continueWorking ();
 
+	/// Batching window of written data is over
+	void onFlushTimer ();
+
 	/// Gets called periodically in order to get new data
 	void startNextRequest (const StringMap & additionalArgs = StringMap (), const ResultCallback & callback = ResultCallback());
 	void onRequestReply (Error result, const HttpResponsePtr & response, int64_t rid, const ResultCallback & originalCallback);
@@ -60,14 +74,30 @@ private:
 	/// Packs data into a POST request and sends it
 	void executeRequest (const ByteArrayPtr & data, int timeOutMs, const HttpContext::RequestCallback & callback);
 
+	/// Notifies all write callbacks of a request (and removes them)
+	void notifyWriteCallbacks (int64_t rid, Error result);
+	/// Notifies all pending write callbacks (e.g. on connection fail)
+	void notifyAllWriteCallbacks (Error result);
+
 	std::deque<ByteArrayPtr> mOutputBuffer; // Output Buffer
+	size_t mOutputSize; // Bytes in mOutputBuffer
+	std::vector<ResultCallback> mOutputCallbacks; // Write callbacks of the data in mOutputBuffer
 	ByteArray   mInputBuffer; // Input Buffer, in order
 
 	typedef std::map<int64_t, ByteArrayPtr> RidDataMap;
 	RidDataMap mOpenRids; // yet not answered regular requests
 	RidDataMap mInWaitingRids; // Incoming data
+	typedef std::map<int64_t, std::vector<ResultCallback> > RidCallbackMap;
+	RidCallbackMap mOpenCallbacks; // Write callbacks of yet not answered requests
 
 	int mOpenRidCount; // = |mOpenRids|
+	int mRequests;     // Maximum concurrent requests
+	int mHold;         // Requests the server may hold (empty long polls)
+
+	// Batching
+	int    mBatchDelayMs;
+	size_t mMaxBatchSize;
+	bool   mFlushPending; // flush timer is waiting
 
 	int64_t     mRid;	  ///< Last RID sent
 	int64_t     mRidRecv; ///< Next RID to be received
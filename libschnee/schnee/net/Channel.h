@@ -57,17 +57,42 @@ public:
 	///@name Channel Information
 	///@{
 
+	/// Live statistics of the transport protocol (e.g. UDT perfmon)
+	struct TransportStatistics {
+		TransportStatistics () : valid (false), rtt (-1), bandwidth (-1), sendRate (-1), receiveRate (-1),
+				packetsSent (0), packetsReceived (0), packetsRetransmitted (0), sendLoss (0), receiveLoss (0),
+				flowWindow (-1), congestionWindow (-1), packetsInFlight (-1), sendBufferFree (-1), receiveBufferFree (-1) {}
+		bool    valid;				///< Statistics are available
+		float   rtt;				///< Round trip time in seconds
+		float   bandwidth;			///< Estimated link bandwidth in bytes/s
+		float   sendRate;			///< Current sending rate in bytes/s
+		float   receiveRate;		///< Current receiving rate in bytes/s
+		int64_t packetsSent;		///< Sent data packets, including retransmissions
+		int64_t packetsReceived;	///< Received packets
+		int     packetsRetransmitted;	///< Retransmitted packets
+		int     sendLoss;			///< Lost packets (sender side)
+		int     receiveLoss;		///< Lost packets (receiver side)
+		int     flowWindow;			///< Flow window in packets
+		int     congestionWindow;	///< Congestion window in packets
+		int     packetsInFlight;	///< Packets sent but not yet acknowledged
+		int     sendBufferFree;		///< Free bytes in the sending buffer
+		int     receiveBufferFree;	///< Free bytes in the receiving buffer
+		SF_AUTOREFLECT_SERIAL;
+	};
+
 	/// Generic information about channels
 	struct ChannelInfo {
-		ChannelInfo () : bandwidth (-1), delay (-1), toNeighbor (false), virtual_ (false), authenticated (false), encrypted (false) {}
+		ChannelInfo () : bandwidth (-1), delay (-1), toNeighbor (false), virtual_ (false), authenticated (false), encrypted (false), compressionRatio (-1) {}
 		float       bandwidth;	///< Bandwidth or < 0 if unknown
 		float       delay;		///< Delay or < 0 if unknown
 		bool        toNeighbor;	///< Channel is to a neighbor (very near)
 		bool        virtual_;	///< Channel is virtual (e.g. IM Channel)
 		bool        authenticated;	///< Channel is authenticated so far
 		bool        encrypted;		///< Channel is encrypted
+		float       compressionRatio;	///< Uncompressed / compressed bytes if the channel is compressed, < 0 otherwise
 		std::string laddress;	///< Full local address (e.g. IP + Port), if available
 		std::string raddress;	///< Full remote address (e.g. IP + Port), if available
+		TransportStatistics transport;	///< Statistics of the transport, if the channel provides them
 		SF_AUTOREFLECT_SERIAL;
 	};
 
@@ -0,0 +1,142 @@
+#include "KeyStore.h"
+#include <schnee/tools/FileTools.h>
+#include <schnee/tools/Log.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+namespace sf {
+
+/// Certificates expiring earlier are regenerated
+static const time_t gMinRemainingValidity = 30 * 24 * 3600;
+
+KeyStore::KeyStore (const String & directory) : mDirectory (directory) {
+}
+
+Error KeyStore::loadIdentity (const String & identity, x509::KeyType type, x509::PrivateKeyPtr * key, x509::CertificatePtr * cert) const {
+	if (mDirectory.empty()) return error::NotInitialized;
+	String keyText, certText;
+	Error e = readFile ("identity.key", &keyText);
+	if (e) return e;
+	e = readFile ("identity.crt", &certText);
+	if (e) return e;
+
+	x509::PrivateKeyPtr  k (new x509::PrivateKey());
+	x509::CertificatePtr c (new x509::Certificate());
+	if (k->textImport (keyText) || c->textImport (certText)) {
+		Log (LogWarning) << LOGID << "Could not import stored key/certificate in " << mDirectory << std::endl;
+		return error::BadDeserialization;
+	}
+	String cn;
+	if (c->getCommonName (&cn) || cn != identity) {
+		Log (LogInfo) << LOGID << "Stored certificate belongs to " << cn << ", not " << identity << std::endl;
+		return error::NotFound;
+	}
+	String requested;
+	if (!readFile ("identity.type", &requested)) {
+		// the key may be a fallback, it would be generated the same way again
+		if (requested != x509::toString (type)) {
+			Log (LogInfo) << LOGID << "Stored key was not generated for type " << x509::toString (type) << std::endl;
+			return error::NotFound;
+		}
+	} else {
+		x509::KeyType storedType;
+		if (k->type (&storedType) || storedType != type) {
+			Log (LogInfo) << LOGID << "Stored key has not type " << x509::toString (type) << std::endl;
+			return error::NotFound;
+		}
+	}
+	time_t expiration = c->expirationTime();
+	if (expiration == (time_t) -1 || expiration < ::time (NULL) + gMinRemainingValidity) {
+		Log (LogInfo) << LOGID << "Stored certificate expires soon" << std::endl;
+		return error::NotFound;
+	}
+	if (!c->matches (k.get())) {
+		Log (LogWarning) << LOGID << "Stored certificate does not belong to stored key" << std::endl;
+		return error::NotFound;
+	}
+	*key  = k;
+	*cert = c;
+	return NoError;
+}
+
+Error KeyStore::saveIdentity (const x509::PrivateKeyPtr & key, const x509::CertificatePtr & cert, x509::KeyType requested) const {
+	if (mDirectory.empty()) return error::NotInitialized;
+	if (!key || !cert) return error::InvalidArgument;
+	String keyText, certText;
+	if (key->textExport (&keyText) || cert->textExport (&certText)) return error::InvalidArgument;
+	// certificate is written last, a key without certificate won't be loaded
+	Error e = writeFile ("identity.key", keyText, true);
+	if (e) return e;
+	e = writeFile ("identity.type", x509::toString (requested), false);
+	if (e) return e;
+	return writeFile ("identity.crt", certText, false);
+}
+
+Error KeyStore::loadDhParams (int bits, x509::DhParamsPtr * params) const {
+	if (mDirectory.empty()) return error::NotInitialized;
+	String text;
+	Error e = readFile ("dh" + toString (bits) + ".pem", &text);
+	if (e) return e;
+	x509::DhParamsPtr p (new x509::DhParams());
+	if (p->textImport (text)) {
+		Log (LogWarning) << LOGID << "Could not import stored DH parameters in " << mDirectory << std::endl;
+		return error::BadDeserialization;
+	}
+	*params = p;
+	return NoError;
+}
+
+Error KeyStore::saveDhParams (int bits, const x509::DhParamsPtr & params) const {
+	if (mDirectory.empty()) return error::NotInitialized;
+	if (!params) return error::InvalidArgument;
+	String text;
+	if (params->textExport (&text)) return error::InvalidArgument;
+	return writeFile ("dh" + toString (bits) + ".pem", text, false);
+}
+
+String KeyStore::path (const String & file) const {
+	return mDirectory + gDirectoryDelimiter + file;
+}
+
+Error KeyStore::readFile (const String & file, String * content) const {
+	String p = path (file);
+	if (!isRegularFile (p)) return error::NotFound;
+	std::ifstream stream (p.c_str(), std::ios::in | std::ios::binary);
+	if (!stream) return error::ReadError;
+	std::ostringstream buffer;
+	buffer << stream.rdbuf();
+	if (stream.bad()) return error::ReadError;
+	*content = buffer.str();
+	return NoError;
+}
+
+Error KeyStore::writeFile (const String & file, const String & content, bool privateFile) const {
+	String p   = path (file);
+	String tmp = p + ".tmp";
+	Error e = createDirectoriesForFilePath (p);
+	if (e) return e;
+	if (privateFile) {
+		e = writePrivateFile (tmp, content);
+		if (e) {
+			Log (LogWarning) << LOGID << "Could not write private file " << tmp << std::endl;
+			return e;
+		}
+	} else {
+		std::ofstream stream (tmp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!stream) return error::WriteError;
+		stream.write (content.c_str(), content.size());
+		if (!stream) return error::WriteError;
+	}
+	try {
+		fs::rename (fs::path (tmp), fs::path (p));
+	} catch (fs::filesystem_error & e) {
+		Log (LogWarning) << LOGID << "Could not write " << p << ": " << e.what() << std::endl;
+		return error::WriteError;
+	}
+	return NoError;
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <schnee/sftypes.h>
+#include "x509.h"
+
+namespace sf {
+
+/// Keeps the own private key, certificate and Diffie Hellman parameters in a directory,
+/// so that they do not need to be generated on each start.
+///
+/// Files:
+/// - identity.key / identity.crt own key and self signed certificate (PEM)
+/// - identity.type key type which was requested for the identity (the key may be rsa if that could not be generated)
+/// - dh[bits].pem Diffie Hellman parameters (PKCS#3 PEM)
+class KeyStore {
+public:
+	/// Uses directory (empty: everything fails with NotInitialized)
+	KeyStore (const String & directory = "");
+
+	void setDirectory (const String & directory) { mDirectory = directory; }
+	const String & directory () const { return mDirectory; }
+
+	/// Loads own key and certificate.
+	/// Fails (NotFound) if there is none, or it belongs to another identity, was requested with
+	/// another key type or will expire soon.
+	Error loadIdentity (const String & identity, x509::KeyType type, x509::PrivateKeyPtr * key, x509::CertificatePtr * cert) const;
+
+	/// Saves own key and certificate, generated for the requested key type
+	Error saveIdentity (const x509::PrivateKeyPtr & key, const x509::CertificatePtr & cert, x509::KeyType requested) const;
+
+	/// Loads Diffie Hellman parameters of given size
+	Error loadDhParams (int bits, x509::DhParamsPtr * params) const;
+
+	/// Saves Diffie Hellman parameters of given size
+	Error saveDhParams (int bits, const x509::DhParamsPtr & params) const;
+
+private:
+	/// Full path of a file inside the store
+	String path (const String & file) const;
+	/// Reads a whole file
+	Error readFile (const String & file, String * content) const;
+	/// Writes a whole file (via temporary file; private = only readable by the user)
+	Error writeFile (const String & file, const String & content, bool privateFile) const;
+
+	String mDirectory;
+};
+
+}
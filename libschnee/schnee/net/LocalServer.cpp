@@ -0,0 +1,45 @@
+#include "LocalServer.h"
+#ifndef WIN32
+#include "impl/LocalServerPrivate.h"
+
+namespace sf {
+
+LocalServer::LocalServer () {
+	d = new LocalServerPrivate ();
+}
+
+LocalServer::~LocalServer () {
+	d->requestDelete ();
+}
+
+void LocalServer::close () {
+	d->close ();
+}
+
+Error LocalServer::listen (const String & path) {
+	return d->listen (path);
+}
+
+bool LocalServer::isListening () const {
+	return d->isListening ();
+}
+
+String LocalServer::path () const {
+	return d->mPath;
+}
+
+shared_ptr<LocalSocket> LocalServer::nextPendingConnection () {
+	return d->nextPendingConnection ();
+}
+
+bool LocalServer::hasPendingConnections () const {
+	return !d->mPendingConnections.empty();
+}
+
+VoidDelegate & LocalServer::newConnection () {
+	return d->mNewConnectionDelegate;
+}
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <schnee/sftypes.h>
+
+#include "LocalSocket.h"
+
+namespace sf {
+
+struct LocalServerPrivate;
+
+/**
+ * A server for LocalSockets. It listens on a path in the file system
+ * and creates LocalSockets if someone connects.
+ *
+ * The socket file is only accessible by the own user and removed on close.
+ * Not available on Windows.
+ */
+class LocalServer {
+public:
+	LocalServer ();
+	virtual ~LocalServer ();
+
+	///@name State
+	///@{
+
+	/// Closes any open server
+	void close ();
+
+	/// Starts listening on path.
+	/// A stale socket file (nobody listening) gets replaced, a living one results in ExistsAlready.
+	Error listen (const String & path);
+
+	/// Returns true if server is currently listening
+	bool isListening () const;
+
+	/// Returns path the server is listening on
+	String path () const;
+
+	///@}
+
+	///@name Connections
+	///@{
+
+	/// Next connection which is currently waiting (or 0, if no one)
+	shared_ptr<LocalSocket> nextPendingConnection ();
+
+	/// Returns true if there are pending connections
+	bool hasPendingConnections () const;
+
+	///@}
+
+	///@name Delegates
+	///@{
+
+	/// There is a new connection pending
+	VoidDelegate & newConnection ();
+	///@}
+
+private:
+	LocalServerPrivate * d;
+};
+
+}
@@ -0,0 +1,93 @@
+#include "LocalSocket.h"
+#ifndef WIN32
+#include "impl/LocalSocketPrivate.h"
+
+namespace sf {
+
+LocalSocket::LocalSocket () {
+	d = new LocalSocketPrivate (IOService::service());
+}
+
+LocalSocket::LocalSocket (LocalSocketPrivate * init) {
+	d = init;
+}
+
+LocalSocket::~LocalSocket () {
+	d->requestDelete ();
+}
+
+Error LocalSocket::connectToPath (const String & path, const ResultCallback & callback) {
+	return d->connectToPath (path, callback);
+}
+
+bool LocalSocket::isConnected () const {
+	return d->isConnected ();
+}
+
+void LocalSocket::disconnectFromHost () {
+	d->disconnectFromHost ();
+}
+
+Error LocalSocket::peerUserId (int * uid) const {
+	return d->peerUserId (uid);
+}
+
+void LocalSocket::setAuthenticated (bool v) {
+	d->mAuthenticated = v;
+}
+
+Error LocalSocket::error () const {
+	return d->error ();
+}
+
+String LocalSocket::errorMessage () const {
+	return d->errorMessage ();
+}
+
+Channel::State LocalSocket::state () const {
+	return d->state ();
+}
+
+Error LocalSocket::write (const ByteArrayPtr& data, const ResultCallback & callback) {
+	return d->write (data, callback);
+}
+
+ByteArrayPtr LocalSocket::read (long maxSize) {
+	return d->read (maxSize);
+}
+
+void LocalSocket::close (const ResultCallback & callback) {
+	d->close (callback);
+}
+
+Channel::ChannelInfo LocalSocket::info () const {
+	return d->info ();
+}
+
+VoidDelegate & LocalSocket::changed () {
+	return d->changed ();
+}
+
+bool LocalSocket::atEnd () const {
+	return d->atEnd ();
+}
+
+long LocalSocket::bytesAvailable () const {
+	return d->bytesAvailable ();
+}
+
+long LocalSocket::bytesToWrite () const {
+	return d->mPendingOutputBuffer;
+}
+
+VoidDelegate & LocalSocket::readyRead () {
+	return d->readyRead ();
+}
+
+VoidDelegate & LocalSocket::disconnected () {
+	return d->mDisconnectedDelegate;
+}
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <schnee/sftypes.h>
+#include "Channel.h"
+
+namespace sf {
+
+struct LocalSocketPrivate;
+
+/**
+ * A stream socket to another process on the same host (Unix domain socket).
+ *
+ * The interface follows TCPSocket, but instead of host and port a
+ * path in the file system is connected. Not available on Windows.
+ */
+class LocalSocket : public Channel {
+public:
+	LocalSocket ();
+
+	///@cond DEV
+	/// Used by LocalServer for accepted connections
+	LocalSocket (LocalSocketPrivate * init);
+	///@endcond DEV
+
+	virtual ~LocalSocket ();
+
+	/// @name State
+	/// @{
+
+	/// Connects to a LocalServer listening on path.
+	/// This function is asynchronous; returns only error if already connecting.
+	Error connectToPath (const String & path, const ResultCallback & callback = ResultCallback());
+
+	/// returns state of current connection
+	bool isConnected () const;
+
+	/// disconnects connection
+	void disconnectFromHost ();
+
+	/// Returns the user id of the process on the other side (as told by the kernel)
+	Error peerUserId (int * uid) const;
+
+	/// Marks the channel as authenticated (see ChannelInfo::authenticated), e.g.
+	/// after checking the peerUserId. Local sockets are never encrypted.
+	void setAuthenticated (bool v);
+
+	/// @}
+
+	// Implementation of Channel
+	virtual sf::Error error () const;
+	virtual sf::String errorMessage () const;
+	virtual State state () const;
+	virtual Error write (const ByteArrayPtr& data, const ResultCallback & callback = ResultCallback());
+	virtual sf::ByteArrayPtr read (long maxSize = -1);
+	virtual void close (const ResultCallback & callback = ResultCallback());
+	virtual ChannelInfo info () const;
+	virtual const char * stackInfo () const { return "local"; }
+	virtual sf::VoidDelegate & changed ();
+
+	/// @name Additional IO
+	/// @{
+
+	/// Socket received end of data signal
+	bool atEnd () const;
+
+	/// How much data is in the input buffer
+	long bytesAvailable () const;
+
+	/// How much data is waiting to be written into the socket
+	long bytesToWrite () const;
+
+	/// @}
+
+	/// @name Delegates
+	/// @{
+
+	/// Delegate informed if there is new data to be read
+	VoidDelegate & readyRead ();
+	/// Delegate for being disconnected
+	VoidDelegate & disconnected ();
+	/// @}
+
+private:
+	LocalSocketPrivate * d;
+};
+
+typedef shared_ptr<LocalSocket> LocalSocketPtr;
+
+}
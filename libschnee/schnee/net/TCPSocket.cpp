@@ -11,7 +11,7 @@ TCPSocket::TCPSocket() {
 		std::exit(1);
 	}
 	
-	d = new TCPSocketPrivateImpl();
+	d = TCPSocketPrivateImpl::create (IOService::instance().getService());
 }
 
 TCPSocket::TCPSocket (TCPSocketPrivate * init){
@@ -27,6 +27,14 @@ Error TCPSocket::connectToHost(const String & host, int port, int timeOut, const
 	return d->connectToHost (host, port, timeOut, callback);
 }
 
+Error TCPSocket::connectToHosts (const std::vector<String> & hosts, int port, int timeOut, const ResultCallback & callback){
+	return d->connectToHosts (hosts, port, timeOut, callback);
+}
+
+void TCPSocket::setConnectAttemptDelay (int ms) {
+	d->mConnectAttemptDelayMs = ms;
+}
+
 bool TCPSocket::isConnected() const {
 	return d->isConnected ();
 }
@@ -43,6 +51,10 @@ bool TCPSocket::setKeepAlive (bool v) {
 	return d->setKeepAlive (v);
 }
 
+void TCPSocket::setToNeighbor (bool v) {
+	d->mToNeighbor = v;
+}
+
 Error TCPSocket::error() const {
 	return d->error();
 }
@@ -88,6 +100,15 @@ long TCPSocket::bytesAvailable () const {
 	return d->bytesAvailable ();
 }
 
+long TCPSocket::bytesToWrite () const {
+	return d->mPendingOutputBuffer;
+}
+
+int TCPSocket::nativeHandle () {
+	if (!d->mSocket.is_open()) return -1;
+	return d->mSocket.native_handle();
+}
+
 VoidDelegate& TCPSocket::readyRead () {
 	return d->readyRead();
 }
@@ -40,6 +40,14 @@ public:
 	/// This function is asynchronous.
 	/// Returns only error if already connecting
 	Error connectToHost (const String & host, int port, int timeOut = 30000, const ResultCallback & callback = ResultCallback());
+
+	/// Open up a connection to one of the hosts (e.g. all addresses a peer advertised) at the given port.
+	/// All addresses of all hosts are tried in parallel, staggered by the connect attempt delay;
+	/// the first established connection is used, the other attempts are canceled.
+	Error connectToHosts (const std::vector<String> & hosts, int port, int timeOut = 30000, const ResultCallback & callback = ResultCallback());
+
+	/// Sets the delay between starting two parallel connection attempts (default 250ms)
+	void setConnectAttemptDelay (int ms);
 	
 	/// returns state of current connection
 	bool isConnected () const;
@@ -52,6 +60,9 @@ public:
 	/// Sets keep alive status, returns true on success.
 	/// Should work if socket is bound. It shall be safe to ignore the result.
 	bool setKeepAlive (bool v);
+
+	/// Marks the connection as going to a neighbor, e.g. one found in the local network (see ChannelInfo::toNeighbor)
+	void setToNeighbor (bool v);
 	
 	/// @}
 	
@@ -84,6 +95,14 @@ public:
 	/// @return num of bytes in input buffer
 	virtual long bytesAvailable () const;
 
+	/// How much data is waiting to be written into the socket
+	long bytesToWrite () const;
+
+	///@cond DEV
+	/// Native socket handle, -1 if not open (used for kernel TLS)
+	int nativeHandle ();
+	///@endcond DEV
+
 
 
 	/// @}
@@ -1,7 +1,13 @@
 #include "TLSChannel.h"
 #include "TLSCertificates.h"
+#include "KeyStore.h"
+#include "TLSSessionCache.h"
+#include "impl/CryptoWorkers.h"
+#include "impl/KernelTls.h"
+#include "TCPSocket.h"
 #include <schnee/settings.h>
 #include <schnee/tools/Log.h>
+#include <schnee/tools/MicroTime.h>
 #include <gnutls/gnutls.h>
 #ifdef LINUX
 #include <gcrypt.h>
@@ -24,23 +30,59 @@ namespace sf {
 	return error::TlsError;\
 } }
 
+/// Maximum plaintext size of a TLS record
+static const size_t gMaxRecordSize = 16384;
+/// Upper bound of header, MAC and padding per record, for reserving buffers
+static const size_t gRecordOverhead = 64;
+
+/// Size of generated Diffie Hellman parameters
+static const int gDhBits = 1024;
+
+/// Diffie Hellman parameters shared by all anonymous servers.
+/// They are generated only once and kept in the key store (if there is one).
+/// Returns 0 if the well known groups of RFC 7919 shall be used (GnuTLS >= 3.5.6).
+static x509::DhParamsPtr sharedDhParams () {
+#if GNUTLS_VERSION_NUMBER >= 0x030506
+	return x509::DhParamsPtr ();
+#else
+	static x509::DhParamsPtr params;
+	if (params) return params;
+	KeyStore store (schnee::settings().keyStore);
+	if (!store.directory().empty() && !store.loadDhParams (gDhBits, &params)) return params;
+	double t0 = sf::microtime ();
+	params = x509::DhParamsPtr (new x509::DhParams());
+	params->generate (gDhBits);
+	double t1 = sf::microtime ();
+	Log (LogProfile) << LOGID << "DH parameter generation took " << (t1 - t0) * 1000.0 << "ms" << std::endl;
+	if (!store.directory().empty()) {
+		Error e = store.saveDhParams (gDhBits, params);
+		if (e) Log (LogWarning) << LOGID << "Could not store DH parameters: " << toString (e) << std::endl;
+	}
+	return params;
+#endif
+}
+
 struct ServerDiffieHellman : public TLSChannel::EncryptionData {
 	ServerDiffieHellman () {
 		gnutls_anon_allocate_server_credentials (&credentials);
-		gnutls_dh_params_init (&params);
-		gnutls_dh_params_generate2 (params, 1024);
-		gnutls_anon_set_server_dh_params (credentials, params);
-
+		params = sharedDhParams ();
+		if (params) {
+			gnutls_anon_set_server_dh_params (credentials, params->data);
+		}
+#if GNUTLS_VERSION_NUMBER >= 0x030506
+		else {
+			gnutls_anon_set_server_known_dh_params (credentials, GNUTLS_SEC_PARAM_MEDIUM);
+		}
+#endif
 	}
 	~ServerDiffieHellman () {
 		gnutls_anon_free_server_credentials (credentials);
-		gnutls_dh_params_deinit (params);
 	}
 	virtual int apply (Session s) {
 		return gnutls_credentials_set (s, GNUTLS_CRD_ANON, credentials);
 	}
 
-	gnutls_dh_params_t params;
+	x509::DhParamsPtr params;
 	gnutls_anon_server_credentials_t credentials;
 };
 
@@ -71,14 +113,14 @@ struct X509EncryptionData : public TLSChannel::EncryptionData {
 		       int nreqs,
 		       const gnutls_pk_algorithm_t * sign_algos, int sign_algos_length,
 		       gnutls_retr_st * st) {
-		TLSChannel * instance = static_cast<TLSChannel*> (gnutls_session_get_ptr (session));
+		TLSChannel::SessionData * instance = static_cast<TLSChannel::SessionData*> (gnutls_session_get_ptr (session));
 		st->type = gnutls_certificate_type_get (session);
 		st->ncerts = 0;
 		if (st->type == GNUTLS_CRT_X509){
 #if GNUTLS_VERSION_NUMBER >= 0x020a00 // gnutls_sign_algorithm_get_requested is available on >= 2.10
 			{
 				// Check if server accepts signature algorithm
-				int ret = gnutls_x509_crt_get_signature_algorithm (instance->cert()->data);
+				int ret = gnutls_x509_crt_get_signature_algorithm (instance->cert->data);
 				if (ret < 0) {
 					Log (LogError) << LOGID << "Invalid signature algorithm" << std::endl;
 					return -1; // invalid cert signature algorithm
@@ -100,9 +142,9 @@ struct X509EncryptionData : public TLSChannel::EncryptionData {
 #endif
 
 			// Putting in our key / cert.
-			st->cert.x509   = &(instance->cert()->data);
+			st->cert.x509   = &(instance->cert->data);
 			st->ncerts = 1;
-			st->key.x509    = instance->key()->data;
+			st->key.x509    = instance->key->data;
 			st->deinit_all = 0;
 			return 0;
 		}
@@ -130,6 +172,161 @@ struct X509EncryptionData : public TLSChannel::EncryptionData {
 	gnutls_certificate_credentials_t credentials;
 };
 
+/// Copies the main peer certificate in DER format
+static bool peerCertificateData (gnutls_session_t session, ByteArray * data) {
+	if (gnutls_certificate_type_get (session) != GNUTLS_CRT_X509) return false;
+	unsigned int size = 0;
+	const gnutls_datum_t * list = gnutls_certificate_get_peers (session, &size);
+	if (!list || !size) return false;
+	*data = ByteArray ((const char*) list[0].data, list[0].size);
+	return true;
+}
+
+/// Copies session data for resumption
+static bool sessionData (gnutls_session_t session, ByteArray * data) {
+	gnutls_datum_t d;
+	if (gnutls_session_get_data2 (session, &d)) return false;
+	*data = ByteArray ((const char*) d.data, d.size);
+	gnutls_free (d.data);
+	return true;
+}
+
+struct TLSChannel::CryptoResult {
+	CryptoResult () : handshakeDone (false), handshakeResult (0), resumed (false), readError (0) {}
+	ByteArrayPtr out;		///< Records to be sent to the next channel
+	ByteArray plain;		///< Decrypted data
+	bool handshakeDone;		///< Handshake finished (successful or not)
+	int  handshakeResult;	///< GnuTLS result of handshake
+	bool resumed;			///< Handshake resumed a session
+	ByteArray peerCert;		///< Peer certificate (DER)
+	ByteArray sessionData;	///< New session data for TLSSessionCache
+	int  readError;			///< GnuTLS error during decryption
+};
+
+/// All members are only touched on the channel's strand
+struct TLSChannel::CryptoContext {
+	typedef sf::function<void (const CryptoResultPtr & result)> ProcessedCallback;
+	typedef sf::function<void (const ByteArrayPtr & data, const ResultCallback & callback, Error result)> EncryptedCallback;
+
+	CryptoContext () : session (0), inPos (0), secured (false), storeSessions (false) {}
+	~CryptoContext () {
+		if (session) gnutls_deinit (session);
+	}
+
+	/// Feeds input into the session, continues handshake and decrypts
+	void process (const ByteArrayPtr & input, const ProcessedCallback & done) {
+		if (input) in.append (*input);
+		CryptoResultPtr result (new CryptoResult());
+		if (!secured) {
+			int r = gnutls_handshake (session);
+			if (r != GNUTLS_E_AGAIN && r != GNUTLS_E_INTERRUPTED) {
+				result->handshakeDone   = true;
+				result->handshakeResult = r;
+				if (!r) {
+					secured = true;
+					result->resumed = gnutls_session_is_resumed (session) != 0;
+					peerCertificateData (session, &result->peerCert);
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+					if (gnutls_protocol_get_version (session) != GNUTLS_TLS1_3)
+#endif
+						if (storeSessions) sessionData (session, &result->sessionData);
+				}
+			}
+		}
+		if (secured) {
+			char buffer[16384];
+			for (;;) {
+				ssize_t recv = gnutls_record_recv (session, buffer, sizeof (buffer));
+				if ((recv == GNUTLS_E_AGAIN || recv == GNUTLS_E_INTERRUPTED) && inPos < in.size()) {
+					// post handshake messages (e.g. session tickets) interrupt reading
+					continue;
+				}
+				if (recv <= 0) {
+					if (recv < 0 && recv != GNUTLS_E_AGAIN && recv != GNUTLS_E_INTERRUPTED) result->readError = recv;
+					break;
+				}
+				result->plain.append (buffer, recv);
+			}
+		}
+		if (inPos == in.size()) {
+			in.clear();
+			inPos = 0;
+		}
+		if (!ticket.empty()) result->sessionData.swap (ticket);
+		result->out = ByteArrayPtr (new ByteArray());
+		result->out->swap (out);
+		xcall (abind (done, result));
+	}
+
+	/// Encrypts data, all records are collected in one block
+	void encrypt (const ByteArrayPtr & data, const ResultCallback & callback, const EncryptedCallback & done) {
+		const char * begin = data->const_c_array();
+		size_t rest = data->size();
+		Error result = NoError;
+		while (rest > 0) {
+			ssize_t size = gnutls_record_send (session, begin, rest);
+			if (size == GNUTLS_E_AGAIN || size == GNUTLS_E_INTERRUPTED) continue;
+			if (size <= 0 || size > (ssize_t) rest) {
+				result = error::WriteError;
+				break;
+			}
+			begin += size;
+			rest  -= size;
+		}
+		ByteArrayPtr records (new ByteArray());
+		records->swap (out);
+		xcall (abind (done, records, callback, result));
+	}
+
+	static ssize_t push (gnutls_transport_ptr instance, const void * data, size_t size) {
+		CryptoContext * _this = static_cast<CryptoContext*> (instance);
+		_this->out.append ((const char*) data, size);
+		return size;
+	}
+
+	static ssize_t vecPush (gnutls_transport_ptr instance, const giovec_t * iov, int iovcnt) {
+		CryptoContext * _this = static_cast<CryptoContext*> (instance);
+		ssize_t size = 0;
+		for (int i = 0; i < iovcnt; i++) {
+			_this->out.append ((const char*) iov[i].iov_base, iov[i].iov_len);
+			size += iov[i].iov_len;
+		}
+		return size;
+	}
+
+	static ssize_t pull (gnutls_transport_ptr instance, void * data, size_t size) {
+		CryptoContext * _this = static_cast<CryptoContext*> (instance);
+		size_t available = _this->in.size() - _this->inPos;
+		if (!available) {
+			gnutls_transport_set_errno (_this->session, EAGAIN);
+			return -1;
+		}
+		size = std::min (size, available);
+		memcpy (data, _this->in.const_c_array() + _this->inPos, size);
+		_this->inPos += size;
+		return size;
+	}
+
+	static int ticketHook (gnutls_session_t session, unsigned int type, unsigned int when, unsigned int incoming, const gnutls_datum_t * msg) {
+		CryptoContext * _this = static_cast<SessionData*> (gnutls_session_get_ptr (session))->crypto;
+		if (incoming && _this->secured && _this->storeSessions) {
+			sessionData (session, &_this->ticket);
+		}
+		return 0;
+	}
+
+	gnutls_session_t session;
+	SessionData sessionPtr;	///< What the session pointer points to
+	EncryptionDataPtr encryptionData;	///< Keeps credentials of the session
+	CryptoWorkers::StrandPtr strand;
+	ByteArray in;		///< Received records
+	size_t    inPos;	///< Already consumed part of in
+	ByteArray out;		///< Records to send
+	ByteArray ticket;	///< Session data from a session ticket
+	bool secured;
+	bool storeSessions;	///< Collect session data for TLSSessionCache
+};
+
 TLSChannel::TLSChannel (ChannelPtr next) {
 	SF_REGISTER_ME;
 	mNext            = next;
@@ -140,6 +337,11 @@ TLSChannel::TLSChannel (ChannelPtr next) {
 	mAuthenticated   = false;
 	mHandshakeError  = NoError;
 	mDisableAuthentication = false;
+	mResumption      = false;
+	mResumed         = false;
+	mWriteError      = NoError;
+	mPullPos         = 0;
+	mKernelTls       = KernelTlsOff;
 
 	mSession = 0;
 }
@@ -209,6 +411,15 @@ void TLSChannel::disableAuthentication() {
 	mDisableAuthentication = true;
 }
 
+void TLSChannel::enableSessionResumption (const String & key) {
+	mResumption = true;
+	mSessionKey = key;
+}
+
+void TLSChannel::enableKernelTls () {
+	mKernelTls = KernelTlsRequested;
+}
+
 Error TLSChannel::authenticate (const x509::Certificate*  trusted, const String & hostName) {
 	x509::CertificatePtr peerCert = peerCertificate();
 	if (!peerCert) return error::AuthError;
@@ -251,6 +462,19 @@ Error TLSChannel::authenticate (const String & hostName) {
 x509::CertificatePtr TLSChannel::peerCertificate () const {
 	if (!mSecured) return x509::CertificatePtr();
 	if (mMode != X509) return x509::CertificatePtr();
+	if (mCrypto) {
+		// session belongs to the worker, certificate was copied after handshake
+		if (mPeerCert.empty()) return x509::CertificatePtr();
+		gnutls_datum_t data;
+		data.data = (unsigned char*) mPeerCert.const_c_array();
+		data.size = mPeerCert.size();
+		x509::CertificatePtr result (new x509::Certificate());
+		if (result->binaryImport (&data)) {
+			Log (LogWarning) << LOGID << "Could not decode peer certificate" << std::endl;
+			return x509::CertificatePtr();
+		}
+		return result;
+	}
 	if (gnutls_certificate_type_get(mSession) != GNUTLS_CRT_X509){
 		assert (!"?");
 		return x509::CertificatePtr ();
@@ -272,6 +496,7 @@ x509::CertificatePtr TLSChannel::peerCertificate () const {
 
 sf::Error TLSChannel::error () const {
 	if (mHandshakeError) return mHandshakeError;
+	if (mWriteError) return mWriteError;
 	return mNext->error();
 }
 
@@ -287,49 +512,63 @@ Error TLSChannel::write (const ByteArrayPtr& data, const ResultCallback & callba
 	if (!mSecured) {
 		return error::NotInitialized;
 	}
-	ByteArrayPtr d (data);
-	ssize_t size = 0;
+	if (mWriteError) return mWriteError;
+	if (mCrypto) {
+		mCrypto->strand->post (sf::bind (&CryptoContext::encrypt, mCrypto, data, callback, CryptoContext::EncryptedCallback (dMemFun (this, &TLSChannel::onEncrypted))));
+		return NoError;
+	}
+	if (mKernelTls == KernelTlsPending) tryKernelTls ();
+	if (mKernelTls == KernelTlsActive) {
+		// the kernel encrypts, data goes down unchanged
+		if (!mNext) return error::WriteError;
+		return mNext->write (data, callback);
+	}
+	// Note: data may be shared (e.g. on multi receiver sends) and must not be changed
+	const char * begin = data->const_c_array();
+	size_t rest = data->size();
 
 	/* TLS just accepts up to 16384 bytes per record.
 	 * At the same time we want a callback if all data has been sent (for flow control)
-	 * So we sent the first chunks without these callback, and put it on the last
-	 * chunk.
+	 * So all records are collected by the push functions and handed to the next
+	 * channel in one write, carrying the callback.
 	 */
-	while (d->size() > 16384) {
-		size = gnutls_record_send (mSession, data->const_c_array(), 16384);
-		if (size == 0) {
-			Log (LogWarning) << LOGID << "Bad, 0 sent" << std::endl;
+	mPendingRecords = createByteArrayPtr ();
+	mPendingRecords->reserve (rest + (rest / gMaxRecordSize + 1) * gRecordOverhead);
+	while (rest > 0) {
+		ssize_t size = gnutls_record_send (mSession, begin, std::min (rest, gMaxRecordSize));
+		if (size < 1) {
+			Log (LogInfo) << LOGID << "TLS write failed: " << gnutls_strerror_name (size) << std::endl;
+			// records collected so far already used up their sequence numbers, the stream can't go on
+			mPendingRecords.reset();
+			mWriteError = error::WriteError;
+			return mWriteError;
 		}
-		if (size < 0) {
-			Log (LogInfo) << LOGID << "Write error " << strerror (errno) << std::endl;
-			return error::WriteError;
-		}
-		if (size > ((ssize_t) d->size())) {
+		if (size > (ssize_t) rest){
 			assert (!"May not happen");
-			return error::WriteError;
+			mPendingRecords.reset();
+			mWriteError = error::WriteError;
+			return mWriteError;
 		}
-		d->l_truncate((size_t) size);
-	}
-	// Sending last chunk:
-	mCurrentWriteCallback = callback;
-	size = gnutls_record_send (mSession, d->const_c_array(), d->size());
-	mCurrentWriteCallback = ResultCallback ();
-	if (size < 1) {
-		Log (LogInfo) << LOGID << "TLS write failed: " << strerror (errno) << std::endl;
-		return error::WriteError;
+		begin += size;
+		rest  -= size;
 	}
-	if (size > (ssize_t) data->size()){
-		Log (LogError) << LOGID << "Something serious is wrong" << std::endl;
-		return error::WriteError;
-	}
-	if (size < (ssize_t) data->size()) {
-		Log (LogInfo) << LOGID << "Could not send it all, rest size " << d->size() << " got " << size << std::endl;
-		return error::WriteError;
-	}
-	return NoError;
+	ByteArrayPtr records;
+	records.swap (mPendingRecords);
+	if (!mNext) return error::WriteError;
+	return mNext->write (records, callback);
 }
 
 sf::ByteArrayPtr TLSChannel::read (long maxSize) {
+	if (mCrypto) {
+		ByteArrayPtr result = createByteArrayPtr();
+		if (maxSize < 0 || (size_t) maxSize >= mPlain.size()) {
+			result->swap (mPlain);
+		} else {
+			result->append (mPlain.const_c_array(), maxSize);
+			mPlain.l_truncate (maxSize);
+		}
+		return result;
+	}
 	const size_t bufSize = 65536;
 	char buffer [bufSize];
 	size_t len = maxSize < 0 ? bufSize : std::min (bufSize, (size_t)maxSize);
@@ -376,14 +615,55 @@ Error TLSChannel::startHandshake (Mode m, const ResultCallback & callback, bool
 	mHandshakeCallback = callback;
 	CHECK (gnutls_init (&mSession, server ? GNUTLS_SERVER : GNUTLS_CLIENT));
 	CHECK (gnutls_priority_set_direct (mSession, type, NULL));
-	gnutls_session_set_ptr (mSession, this);
+	mSessionPtr        = SessionData ();
+	mSessionPtr.channel = this;
+	mSessionPtr.cert    = mCert;
+	mSessionPtr.key     = mKey;
+	gnutls_session_set_ptr (mSession, &mSessionPtr);
 	CHECK (mEncryptionData->apply(mSession));
 	if (m == X509 && server){
 		// request certificate from the client
 		// otherwise he would never send it
 		gnutls_certificate_server_set_request (mSession, GNUTLS_CERT_REQUEST);
 	}
+	if (mKernelTls == KernelTlsOff && CryptoWorkers::hasInstance() && CryptoWorkers::instance().running()) {
+		// From now on the session is only touched by the strand
+		mCrypto = CryptoContextPtr (new CryptoContext());
+		mCrypto->session        = mSession;
+		mCrypto->encryptionData = mEncryptionData;
+		mCrypto->strand         = CryptoWorkers::instance().createStrand();
+		mCrypto->storeSessions  = mResumption && !server && !mSessionKey.empty();
+		// the worker must not touch the channel, it may be gone or used in parallel
+		mCrypto->sessionPtr.crypto = mCrypto.get();
+		mCrypto->sessionPtr.cert   = mCert;
+		mCrypto->sessionPtr.key    = mKey;
+		gnutls_session_set_ptr (mSession, &mCrypto->sessionPtr);
+	}
+	if (mResumption && TLSSessionCache::hasInstance()) {
+		TLSSessionCache & cache = TLSSessionCache::instance();
+		if (server) {
+			const gnutls_datum_t * key = cache.ticketKey();
+			if (key) CHECK (gnutls_session_ticket_enable_server (mSession, key));
+		} else if (!mSessionKey.empty()) {
+#if GNUTLS_VERSION_NUMBER < 0x030000
+			CHECK (gnutls_session_ticket_enable_client (mSession));
+#endif
+			ByteArray data;
+			if (cache.lookup (mSessionKey, &data)) {
+				int r = gnutls_session_set_data (mSession, data.const_c_array(), data.size());
+				if (r) {
+					Log (LogInfo) << LOGID << "Could not use stored session for " << mSessionKey << ": " << gnutls_strerror_name (r) << std::endl;
+					cache.remove (mSessionKey);
+				}
+			}
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+			// TLS 1.3 sends session tickets after the handshake
+			gnutls_handshake_set_hook_function (mSession, GNUTLS_HANDSHAKE_NEW_SESSION_TICKET, GNUTLS_HOOK_POST, mCrypto ? &CryptoContext::ticketHook : &TLSChannel::c_ticketHook);
+#endif
+		}
+	}
     setTransport ();
+    if (mCrypto) mSession = 0;
 
     mHandshaking = true;
     mServer = server;
@@ -394,6 +674,11 @@ Error TLSChannel::startHandshake (Mode m, const ResultCallback & callback, bool
 
 
 void TLSChannel::freeTlsData () {
+	if (mCrypto) {
+		// session is owned by the crypto context
+		mCrypto.reset();
+		mSession = 0;
+	}
 	if (mSession) {
 		gnutls_deinit (mSession);
 		mSession = 0;
@@ -401,10 +686,15 @@ void TLSChannel::freeTlsData () {
 }
 
 void TLSChannel::setTransport() {
+	if (mCrypto) {
+		gnutls_transport_set_push_function (mSession, &CryptoContext::push);
+		gnutls_transport_set_vec_push_function (mSession, &CryptoContext::vecPush);
+		gnutls_transport_set_pull_function (mSession, &CryptoContext::pull);
+		gnutls_transport_set_ptr (mSession, mCrypto.get());
+		return;
+	}
 	gnutls_transport_set_push_function (mSession, &TLSChannel::c_push);
-	// Note: new GnuTLS variants have a vec_push method
-	// But not yet available on development machine
-	// gnutls_transport_set_vec_push_function (mSession, &TLSChannel::c_vec_push);
+	gnutls_transport_set_vec_push_function (mSession, &TLSChannel::c_vecPush);
 	gnutls_transport_set_pull_function  (mSession, &TLSChannel::c_pull);
 	gnutls_transport_set_ptr (mSession, this);
 }
@@ -414,9 +704,22 @@ void TLSChannel::continueHandshake () {
 	if (!mHandshaking) {
 		return;
 	}
+	if (mCrypto) {
+		postIncoming ();
+		return;
+	}
 	int r = gnutls_handshake (mSession);
 	if (!r) {
 		mSecured     = true;
+		mResumed     = gnutls_session_is_resumed (mSession) != 0;
+		if (mKernelTls == KernelTlsRequested) mKernelTls = KernelTlsPending;
+		if (mResumption && !mServer && !mSessionKey.empty()) {
+			Log (LogInfo) << LOGID << "Session to " << mSessionKey << " resumed=" << mResumed << std::endl;
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+			if (gnutls_protocol_get_version (mSession) != GNUTLS_TLS1_3)
+#endif
+				storeSession ();
+		}
 		if (!mDisableAuthentication && mMode == X509 && !mServer) {
 			result = authenticate (mHostname);
 		} else {
@@ -430,13 +733,98 @@ void TLSChannel::continueHandshake () {
 		Log (LogWarning) << LOGID << functionalityName() << "Handshaking failed due " << gnutls_strerror_name (r) << std::endl;
 		result = error::TlsError;
 		mHandshakeError = result;
+		if (mResumption && !mServer && !mSessionKey.empty() && TLSSessionCache::hasInstance()) {
+			TLSSessionCache::instance().remove (mSessionKey);
+		}
 	}
+	finishHandshake (result);
+}
+
+void TLSChannel::finishHandshake (Error result) {
 	mHandshaking = false;
 	Log (LogInfo) << LOGID << "Handshaking result: " << toString (result) << std::endl;
 	if (mHandshakeCallback) mHandshakeCallback (result);
 }
 
+void TLSChannel::tryKernelTls () {
+	TCPSocket * socket = dynamic_cast<TCPSocket*> (mNext.get());
+	if (!socket) {
+		mKernelTls = KernelTlsOff;
+		return;
+	}
+	if (socket->bytesToWrite() > 0) {
+		// records encrypted by GnuTLS are still queued, they must not go through the kernel
+		return;
+	}
+	Error e = KernelTls::enableTx (socket->nativeHandle(), mSession);
+	if (e) {
+		Log (LogInfo) << LOGID << "Kernel TLS not available, staying with GnuTLS" << std::endl;
+		mKernelTls = KernelTlsOff;
+		return;
+	}
+	Log (LogInfo) << LOGID << "Kernel TLS enabled for sending" << std::endl;
+	mKernelTls = KernelTlsActive;
+}
+
+void TLSChannel::postIncoming () {
+	ByteArrayPtr input = mNext ? mNext->read() : ByteArrayPtr();
+	mCrypto->strand->post (sf::bind (&CryptoContext::process, mCrypto, input, CryptoContext::ProcessedCallback (dMemFun (this, &TLSChannel::onProcessed))));
+}
+
+void TLSChannel::onProcessed (const CryptoResultPtr & result) {
+	if (!result->out->empty() && mNext) {
+		Error e = mNext->write (result->out);
+		if (e) Log (LogInfo) << LOGID << "Could not forward TLS data: " << toString (e) << std::endl;
+	}
+	if (!result->sessionData.empty() && TLSSessionCache::hasInstance()) {
+		TLSSessionCache::instance().store (mSessionKey, result->sessionData);
+	}
+	if (result->readError) {
+		Log (LogWarning) << LOGID << "Could not read from TLS channel due error " << gnutls_strerror_name (result->readError) << std::endl;
+	}
+	mPlain.append (result->plain);
+	if (result->handshakeDone && mHandshaking) {
+		Error e = NoError;
+		if (!result->handshakeResult) {
+			mSecured  = true;
+			mResumed  = result->resumed;
+			mPeerCert = result->peerCert;
+			if (mResumption && !mServer && !mSessionKey.empty()) {
+				Log (LogInfo) << LOGID << "Session to " << mSessionKey << " resumed=" << mResumed << std::endl;
+			}
+			if (!mDisableAuthentication && mMode == X509 && !mServer) {
+				e = authenticate (mHostname);
+			}
+		} else {
+			Log (LogWarning) << LOGID << functionalityName() << "Handshaking failed due " << gnutls_strerror_name (result->handshakeResult) << std::endl;
+			e = error::TlsError;
+			mHandshakeError = e;
+			if (mResumption && !mServer && !mSessionKey.empty() && TLSSessionCache::hasInstance()) {
+				TLSSessionCache::instance().remove (mSessionKey);
+			}
+		}
+		finishHandshake (e);
+	}
+	if (mChanged) mChanged ();
+}
+
+void TLSChannel::onEncrypted (const ByteArrayPtr & data, const ResultCallback & callback, Error result) {
+	if (!result && !mNext) result = error::WriteError;
+	if (!result) {
+		result = mNext->write (data, callback);
+		if (!result) return;
+	}
+	Log (LogInfo) << LOGID << "TLS write failed: " << toString (result) << std::endl;
+	mWriteError = result;
+	notifyAsync (callback, result);
+}
+
 void TLSChannel::onChanged() {
+	if (mCrypto) {
+		// order of processing and notifications is kept by the strand
+		postIncoming ();
+		return;
+	}
 	{
 		if (mHandshaking) {
 			xcall (dMemFun (this, &TLSChannel::continueHandshake));
@@ -445,19 +833,72 @@ void TLSChannel::onChanged() {
 	if (mChanged) mChanged ();
 }
 
+void TLSChannel::storeSession () {
+	if (!TLSSessionCache::hasInstance()) return;
+	gnutls_datum_t data;
+	int r = gnutls_session_get_data2 (mSession, &data);
+	if (r) {
+		Log (LogInfo) << LOGID << "Could not get session data: " << gnutls_strerror_name (r) << std::endl;
+		return;
+	}
+	TLSSessionCache::instance().store (mSessionKey, ByteArray ((const char*) data.data, data.size));
+	gnutls_free (data.data);
+}
+
+/*static*/ int TLSChannel::c_ticketHook (gnutls_session_t session, unsigned int type, unsigned int when, unsigned int incoming, const gnutls_datum_t * msg) {
+	TLSChannel * _this = static_cast<SessionData*> (gnutls_session_get_ptr (session))->channel;
+	if (incoming && _this->mSecured) {
+		_this->storeSession ();
+	}
+	return 0;
+}
+
 /*static*/ ssize_t TLSChannel::c_push   (gnutls_transport_ptr instance, const void * data, size_t size) {
 	TLSChannel * _this = static_cast<TLSChannel*> (instance);
-	if (!_this->mNext) {
-		gnutls_transport_set_errno (_this->mSession, EBADFD);
+	if (_this->mPendingRecords) {
+		_this->mPendingRecords->append ((const char*) data, size);
+		return size;
+	}
+	return _this->forward (ByteArrayPtr (new ByteArray ((const char*)data, size)));
+}
+
+/*static*/ ssize_t TLSChannel::c_vecPush (gnutls_transport_ptr instance, const giovec_t * iov, int iovcnt) {
+	TLSChannel * _this = static_cast<TLSChannel*> (instance);
+	ByteArrayPtr target = _this->mPendingRecords;
+	if (!target) {
+		// not within write(), e.g. handshake messages or alerts; send them at once
+		size_t size = 0;
+		for (int i = 0; i < iovcnt; i++) size += iov[i].iov_len;
+		target = createByteArrayPtr();
+		target->reserve (size);
+	}
+	ssize_t size = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		target->append ((const char*) iov[i].iov_base, iov[i].iov_len);
+		size += iov[i].iov_len;
+	}
+	if (target == _this->mPendingRecords) return size;
+	return _this->forward (target);
+}
+
+ssize_t TLSChannel::forward (const ByteArrayPtr & data) {
+	if (mKernelTls == KernelTlsActive) {
+		// e.g. answer of a key update; would break the kernel's record sequence
+		Log (LogWarning) << LOGID << "Cannot send TLS records, sending is done by the kernel" << std::endl;
+		gnutls_transport_set_errno (mSession, EBADFD);
+		return -1;
+	}
+	if (!mNext) {
+		gnutls_transport_set_errno (mSession, EBADFD);
 		return -1;
 	}
-	Error e = _this->mNext->write(ByteArrayPtr (new ByteArray ((const char*)data, size)), _this->mCurrentWriteCallback);
+	Error e = mNext->write (data);
 	if (e) {
 		Log (LogInfo) << LOGID << "Returning BADFD in sent" << std::endl;
-		gnutls_transport_set_errno (_this->mSession, EBADFD);
+		gnutls_transport_set_errno (mSession, EBADFD);
 		return -1;
 	}
-	return size;
+	return data->size();
 }
 
 /*static*/ ssize_t TLSChannel::c_pull   (gnutls_transport_ptr instance, void * data, size_t size) {
@@ -466,8 +907,14 @@ void TLSChannel::onChanged() {
 		gnutls_transport_set_errno (_this->mSession, EBADFD);
 		return -1;
 	}
-	ByteArrayPtr block = _this->mNext->read(size);
-	if (!block || block->size() == 0) {
+	if (_this->mPullPos >= _this->mPullBuffer.size()) {
+		// take all available data at once, instead of cutting small pieces from the next channel's buffer
+		_this->mPullBuffer.clear();
+		_this->mPullPos = 0;
+		ByteArrayPtr block = _this->mNext->read();
+		if (block) _this->mPullBuffer.swap (*block);
+	}
+	if (_this->mPullBuffer.empty()) {
 		// Check for EOF
 		if (_this->mNext->error() == error::Eof){
 			Log (LogInfo) << LOGID << "Forwarding Eof, nothing to read" << std::endl;
@@ -484,8 +931,10 @@ void TLSChannel::onChanged() {
 		gnutls_transport_set_errno (_this->mSession, EAGAIN); // or EWOULDBLOCk
 		return -1;
 	}
-	memcpy (data, block->const_c_array(), block->size());
-	return block->size();
+	size = std::min (size, _this->mPullBuffer.size() - _this->mPullPos);
+	memcpy (data, _this->mPullBuffer.const_c_array() + _this->mPullPos, size);
+	_this->mPullPos += size;
+	return size;
 }
 
 }
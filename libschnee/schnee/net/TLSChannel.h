@@ -8,6 +8,10 @@
 namespace sf {
 
 /// Adds encryption functionality to an existing channel (Decorator)
+///
+/// If crypto worker threads are running (see Settings::cryptoThreads) handshakes and
+/// record processing of the channel are done there, in order. write() returns immediately then,
+/// errors are reported through the callback and error().
 class TLSChannel : public Channel, public DelegateBase {
 public:
 
@@ -34,6 +38,21 @@ public:
 	/// Explicitely disable authentication on X509, used in clientHandshake.
 	void disableAuthentication();
 
+	/// Enables TLS session resumption (using TLSSessionCache), must be called before handshaking.
+	/// Clients resume the session stored under key and store new ones; servers issue session tickets (key is ignored)
+	void enableSessionResumption (const String & key = "");
+
+	/// The handshake resumed an earlier session
+	bool resumed () const { return mResumed; }
+
+	/// Lets the Linux kernel encrypt outgoing data after the handshake (kTLS), if the next channel is a
+	/// TCPSocket and kernel and cipher suite support it; otherwise GnuTLS goes on encrypting.
+	/// Must be called before handshaking, crypto worker threads are not used then.
+	void enableKernelTls ();
+
+	/// Outgoing data is encrypted by the kernel
+	bool kernelTls () const { return mKernelTls == KernelTlsActive; }
+
 	/// Simple explicit x509 authentication; validating the certificate
 	Error authenticate (const x509::Certificate * trusted, const String & hostName);
 
@@ -65,6 +84,24 @@ public:
 	typedef shared_ptr <EncryptionData> EncryptionDataPtr;
 
 private:
+	/// GnuTLS session and buffers when working on crypto worker threads
+	struct CryptoContext;
+	typedef shared_ptr<CryptoContext> CryptoContextPtr;
+public:
+	/// What gnutls_session_get_ptr points to; owned by the one using the session,
+	/// so GnuTLS callbacks only touch data of the thread they run on
+	struct SessionData {
+		SessionData () : channel (0), crypto (0) {}
+		TLSChannel *    channel;	///< Set if the session is used by the channel itself
+		CryptoContext * crypto;		///< Set if the session is used on a crypto worker
+		x509::CertificatePtr cert;	///< Own certificate (for certificate requests)
+		x509::PrivateKeyPtr  key;	///< Own key
+	};
+private:
+	/// Outcome of processing incoming data on a worker thread
+	struct CryptoResult;
+	typedef shared_ptr<CryptoResult> CryptoResultPtr;
+
 	/// Start handshake, once encryption data is set
 	Error startHandshake (Mode m, const ResultCallback & callback, bool server, const char * type);
 
@@ -75,12 +112,25 @@ private:
 	void continueHandshake ();
 	/// Continue reading process
 	void continueReading ();
+	/// Stores current session data in TLSSessionCache (client)
+	void storeSession ();
+	/// Finishes handshake, calls back
+	void finishHandshake (Error result);
+	/// Tries to hand encryption to the kernel, once all GnuTLS records are written
+	void tryKernelTls ();
+	/// Hands available data of next channel to the crypto worker
+	void postIncoming ();
+	/// Incoming data was processed by the crypto worker
+	void onProcessed (const CryptoResultPtr & result);
+	/// Outgoing data was encrypted by the crypto worker
+	void onEncrypted (const ByteArrayPtr & data, const ResultCallback & callback, Error result);
 
 	void onChanged ();
 	VoidDelegate mChanged;
 	ChannelPtr mNext;
 
 	gnutls_session_t mSession; //< TLS session
+	SessionData      mSessionPtr;	///< Session pointer, if the channel uses the session itself
 	EncryptionDataPtr mEncryptionData;
 	x509::CertificatePtr mCert;
 	x509::PrivateKeyPtr  mKey;
@@ -91,14 +141,29 @@ private:
 	bool            mAuthenticated;
 	Mode            mMode;
 	ResultCallback  mHandshakeCallback;
-	ResultCallback  mCurrentWriteCallback;
+	ByteArrayPtr    mPendingRecords;	///< Collects records during write()
+	ByteArray       mPullBuffer;		///< Received records, not yet consumed by GnuTLS
+	size_t          mPullPos;			///< Consumed part of mPullBuffer
 	Error           mHandshakeError;
 	bool            mDisableAuthentication;
 	String          mHostname; /// hostname we are connecting too, if not disabled. (x509 client)
+	bool            mResumption;	///< Session resumption enabled
+	String          mSessionKey;	///< Key of session in TLSSessionCache (client)
+	bool            mResumed;		///< Handshake resumed a session
+	CryptoContextPtr mCrypto;		///< Set if working on crypto worker threads
+	ByteArray       mPlain;			///< Decrypted data (crypto worker threads)
+	ByteArray       mPeerCert;		///< Peer certificate (crypto worker threads)
+	Error           mWriteError;	///< Write error (of crypto worker threads or a failed record send), channel is broken
+	enum KernelTlsState { KernelTlsOff, KernelTlsRequested, KernelTlsPending, KernelTlsActive };
+	KernelTlsState  mKernelTls;
 
 	// Adapters for GnuTLS
 	static ssize_t c_push     (gnutls_transport_ptr instance, const void * data, size_t size);
+	static ssize_t c_vecPush  (gnutls_transport_ptr instance, const giovec_t * iov, int iovcnt);
 	static ssize_t c_pull     (gnutls_transport_ptr instance, void * data, size_t size);
+	/// Writes records directly into the next channel
+	ssize_t forward (const ByteArrayPtr & data);
+	static int     c_ticketHook (gnutls_session_t session, unsigned int type, unsigned int when, unsigned int incoming, const gnutls_datum_t * msg);
 	const char *    functionalityName () { return mServer ? "Server" : "Client"; }
 };
 
@@ -0,0 +1,150 @@
+#include "TLSSessionCache.h"
+#include <schnee/tools/Base64.h>
+#include <schnee/tools/FileTools.h>
+#include <schnee/tools/Log.h>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+namespace sf {
+
+TLSSessionCache::TLSSessionCache () {
+	mMaxSessions = 256;
+	mNextSeq     = 0;
+	mTicketKey.data = 0;
+	mTicketKey.size = 0;
+}
+
+TLSSessionCache::~TLSSessionCache () {
+	freeTicketKey ();
+}
+
+void TLSSessionCache::store (const String & key, const ByteArray & data) {
+	Entry & e = mSessions[key];
+	e.data = data;
+	e.seq  = mNextSeq++;
+	mStatistics.stored++;
+	shrink ();
+	save ();
+}
+
+bool TLSSessionCache::lookup (const String & key, ByteArray * data) {
+	mStatistics.lookups++;
+	SessionMap::iterator i = mSessions.find (key);
+	if (i == mSessions.end()) return false;
+	mStatistics.hits++;
+	i->second.seq = mNextSeq++;
+	*data = i->second.data;
+	return true;
+}
+
+void TLSSessionCache::remove (const String & key) {
+	if (mSessions.erase (key) > 0) {
+		mStatistics.removed++;
+		save ();
+	}
+}
+
+void TLSSessionCache::clear () {
+	mSessions.clear();
+	save ();
+}
+
+void TLSSessionCache::setMaxSessions (size_t maxSessions) {
+	mMaxSessions = maxSessions;
+	shrink ();
+}
+
+Error TLSSessionCache::setFile (const String & file) {
+	mFile = file;
+	if (mFile.empty()) return NoError;
+	if (fileExists (mFile)) {
+		Error e = load ();
+		if (e) {
+			Log (LogWarning) << LOGID << "Could not load TLS sessions from " << mFile << ": " << toString (e) << std::endl;
+		}
+	}
+	save ();
+	return NoError;
+}
+
+const gnutls_datum_t * TLSSessionCache::ticketKey () {
+	if (!mTicketKey.data) {
+		int r = gnutls_session_ticket_key_generate (&mTicketKey);
+		if (r) {
+			Log (LogError) << LOGID << "Could not generate session ticket key: " << gnutls_strerror_name (r) << std::endl;
+			mTicketKey.data = 0;
+			mTicketKey.size = 0;
+			return 0;
+		}
+		save ();
+	}
+	return &mTicketKey;
+}
+
+void TLSSessionCache::shrink () {
+	while (mSessions.size() > mMaxSessions) {
+		SessionMap::iterator oldest = mSessions.begin();
+		for (SessionMap::iterator i = mSessions.begin(); i != mSessions.end(); i++) {
+			if (i->second.seq < oldest->second.seq) oldest = i;
+		}
+		mSessions.erase (oldest);
+	}
+}
+
+void TLSSessionCache::save () {
+	if (mFile.empty()) return;
+	std::ostringstream content;
+	if (mTicketKey.data) {
+		content << "ticketkey " << Base64::encodeFromArray ((const char*) mTicketKey.data, mTicketKey.size) << "\n";
+	}
+	for (SessionMap::const_iterator i = mSessions.begin(); i != mSessions.end(); i++) {
+		content << "session " << Base64::encode (i->first) << " " << Base64::encodeFromArray (i->second.data) << "\n";
+	}
+	if (createDirectoriesForFilePath (mFile)) {
+		Log (LogWarning) << LOGID << "Could not create directory for " << mFile << std::endl;
+		return;
+	}
+	// contains secrets
+	if (writePrivateFile (mFile, content.str())) {
+		Log (LogWarning) << LOGID << "Could not write " << mFile << std::endl;
+	}
+}
+
+Error TLSSessionCache::load () {
+	std::ifstream stream (mFile.c_str(), std::ios::in | std::ios::binary);
+	if (!stream) return error::ReadError;
+	String line;
+	while (std::getline (stream, line)) {
+		std::istringstream fields (line);
+		String type, a, b;
+		fields >> type >> a >> b;
+		if (type == "ticketkey") {
+			ByteArray key;
+			Base64::decodeToArray (a, key);
+			if (key.empty()) return error::BadDeserialization;
+			freeTicketKey ();
+			mTicketKey.data = (unsigned char*) gnutls_malloc (key.size());
+			mTicketKey.size = key.size();
+			::memcpy (mTicketKey.data, key.const_c_array(), key.size());
+		} else if (type == "session") {
+			Entry & e = mSessions[Base64::decode (a)];
+			Base64::decodeToArray (b, e.data);
+			e.seq = mNextSeq++;
+		} else if (!type.empty()) {
+			return error::BadDeserialization;
+		}
+	}
+	shrink ();
+	return NoError;
+}
+
+void TLSSessionCache::freeTicketKey () {
+	if (mTicketKey.data) {
+		gnutls_free (mTicketKey.data);
+		mTicketKey.data = 0;
+		mTicketKey.size = 0;
+	}
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <schnee/sftypes.h>
+#include <schnee/tools/Singleton.h>
+#include <gnutls/gnutls.h>
+
+namespace sf {
+
+/// Keeps TLS session data for resuming sessions (client side) and the key for
+/// encrypting session tickets (server side), so that reconnecting peers can skip
+/// the asymmetric part of the TLS handshake.
+///
+/// Sessions are kept in memory for the lifetime of the process; optionally
+/// they are also written to a file (see setFile).
+class TLSSessionCache : public Singleton<TLSSessionCache> {
+public:
+	TLSSessionCache ();
+	~TLSSessionCache ();
+
+	/// Stores session data under a key (usually own and peer's identity)
+	void store (const String & key, const ByteArray & data);
+
+	/// Looks up session data, returns false if there is none
+	bool lookup (const String & key, ByteArray * data);
+
+	/// Removes session data (e.g. after failed resumption)
+	void remove (const String & key);
+
+	/// Removes all session data
+	void clear ();
+
+	/// Number of stored sessions
+	size_t size () const { return mSessions.size(); }
+
+	/// Maximum number of sessions, the oldest are dropped (default 256)
+	void setMaxSessions (size_t maxSessions);
+
+	/// Keeps sessions and ticket key in a file (private to the user), loads existing ones.
+	/// Empty for no file (default)
+	Error setFile (const String & file);
+
+	/// Key for encrypting session tickets, generated on first use
+	const gnutls_datum_t * ticketKey ();
+
+	/// Usage statistics
+	struct Statistics {
+		Statistics () : lookups (0), hits (0), stored (0), removed (0) {}
+		int lookups;	///< Lookups of session data
+		int hits;		///< Lookups which found session data
+		int stored;		///< Stored session data
+		int removed;	///< Explicitly removed session data
+	};
+
+	const Statistics & statistics () const { return mStatistics; }
+
+private:
+	struct Entry {
+		Entry () : seq (0) {}
+		ByteArray data;
+		int64_t seq;	///< Order of insertion/use
+	};
+	typedef std::map<String, Entry> SessionMap;
+
+	/// Drops oldest entries if there are too many
+	void shrink ();
+	/// Writes everything into the file (if any)
+	void save ();
+	/// Reads file
+	Error load ();
+	void freeTicketKey ();
+
+	SessionMap      mSessions;
+	size_t          mMaxSessions;
+	int64_t         mNextSeq;
+	gnutls_datum_t  mTicketKey;
+	String          mFile;
+	Statistics      mStatistics;
+};
+
+}
@@ -9,6 +9,7 @@ namespace sf {
 UDPEchoClient::UDPEchoClient (UDPSocket & socket) : mSocket (socket) {
 	SF_REGISTER_ME;
 	mState = NOSTATE;
+	mPort  = 0;
 }
 UDPEchoClient::~UDPEchoClient () {
 	SF_UNREGISTER_ME;
@@ -20,6 +20,10 @@ Error UDPSocket::bind (int port, const String & address) {
 	return d->bind(port, address);
 }
 
+Error UDPSocket::bindMulticast (const String & group, int port, const String & interfaceAddress) {
+	return d->bindMulticast (group, port, interfaceAddress);
+}
+
 Error UDPSocket::close () {
 	return d->close();
 }
@@ -17,6 +17,11 @@ public:
 	/// Binds the socket to a port (if empty, than bind it to all addresses)
 	Error bind (int port = 0, const String & address = "");
 
+	/// Binds the socket to a port which may be shared with other sockets of this host and joins a multicast group.
+	/// Multicast datagrams are sent over the interface with the given address (default interface if empty),
+	/// are not routed beyond the local network and are looped back to this host.
+	Error bindMulticast (const String & group, int port, const String & interfaceAddress = "");
+
 	/// Closes the socket
 	Error close ();
 
@@ -9,6 +9,7 @@
 #include <schnee/tools/async/DelegateBase.h>
 #include <sys/types.h>
 #include "impl/UDTMainLoop.h"
+#include "impl/UDTCongestion.h"
 #include <schnee/tools/Log.h>
 #include <schnee/tools/MicroTime.h>
 #ifndef WIN32
@@ -19,17 +20,14 @@
 #include <boost/thread.hpp>
 namespace sf {
 
-const int UDTSocket::gInputTransferSize  = 20000;
-const int UDTSocket::gMaxInputBufferSize = 1024 * 1024 * 10; // 10mb 
-
 UDTSocket::UDTSocket () {
 	SF_REGISTER_ME;
-	init (UDT::socket(AF_INET, SOCK_STREAM, 0));
+	init (UDT::socket(AF_INET, SOCK_STREAM, 0), false);
 }
 
 UDTSocket::UDTSocket (UDTSOCKET s) {
 	SF_REGISTER_ME;
-	init (s);
+	init (s, true);
 }
 
 UDTSocket::~UDTSocket () {
@@ -63,6 +61,7 @@ Error UDTSocket::bind (int port) {
 		Log (LogInfo) << LOGID << "Bind failed: " << UDT::getlasterror().getErrorMessage() << std::endl;
 		return error::ConnectionError;
 	}
+	mOpened = true;
 	return NoError;
 }
 
@@ -97,6 +96,24 @@ bool UDTSocket::isConnected () const {
 	return isConnected_locked ();
 }
 
+Error UDTSocket::setTuning (const UDTTuning & tuning) {
+	LockGuard guard (mMutex);
+	if (mOpened) {
+		Log (LogWarning) << LOGID << "Can't tune an already bound or connected socket" << std::endl;
+		return error::WrongState;
+	}
+	Error e = applyTuning (mSocket, tuning);
+	if (!e) mTuning = tuning;
+	// UDT rounds buffers to packets; on errors parts may be applied already
+	readTuning (mSocket, &mTuning);
+	return e;
+}
+
+UDTTuning UDTSocket::tuning () const {
+	LockGuard guard (mMutex);
+	return mTuning;
+}
+
 ByteArrayPtr UDTSocket::peek (long maxSize) {
 	LockGuard guard (mMutex);
 	if (maxSize < 0) {
@@ -193,16 +210,77 @@ Channel::ChannelInfo UDTSocket::info () const {
 			info.raddress = rIp + ":" + toString (ntohs(sock.sin_port));
 		}
 	}
+	UDT::TRACEINFO perf;
+	if (!UDT::perfmon (mSocket, &perf, false)) {
+		TransportStatistics & t = info.transport;
+		t.valid       = true;
+		t.rtt         = (float) (perf.msRTT / 1000.0);
+		t.bandwidth   = (float) (perf.mbpsBandwidth * 1000000.0 / 8.0);
+		t.sendRate    = (float) (perf.mbpsSendRate  * 1000000.0 / 8.0);
+		t.receiveRate = (float) (perf.mbpsRecvRate  * 1000000.0 / 8.0);
+		t.packetsSent     = perf.pktSentTotal;
+		t.packetsReceived = perf.pktRecvTotal;
+		t.packetsRetransmitted = perf.pktRetransTotal;
+		t.sendLoss    = perf.pktSndLossTotal;
+		t.receiveLoss = perf.pktRcvLossTotal;
+		t.flowWindow       = perf.pktFlowWindow;
+		t.congestionWindow = perf.pktCongestionWindow;
+		t.packetsInFlight  = perf.pktFlightSize;
+		t.sendBufferFree    = perf.byteAvailSndBuf;
+		t.receiveBufferFree = perf.byteAvailRcvBuf;
+		info.bandwidth = t.bandwidth;
+		info.delay     = t.rtt;
+	}
 	return info;
 }
 
-/*static*/ void UDTSocket::setDefaultBufferSize (UDTSOCKET s) {
-	// small buffer size (instead of 10MB default) decreases raw throroughput
-	// but increases reactivity much.
-	// It bases upon a typical fast internet link: 2MB/s with RTT 20ms (=40kb needed)
-	int bufSize = 524288;
-	UDT::setsockopt (s, 0, UDT_SNDBUF, &bufSize, sizeof (bufSize));
-	UDT::setsockopt (s, 0, UDT_RCVBUF, &bufSize, sizeof (bufSize));
+/*static*/ Error UDTSocket::setDefaultBufferSize (UDTSOCKET s) {
+	return applyTuning (s, UDTTuning::defaultProfile());
+}
+
+/// Sets an UDT option, logs failures
+static bool setOption (UDTSOCKET s, UDT::SOCKOPT option, const char * name, const void * value, int size) {
+	if (UDT::setsockopt (s, 0, option, value, size) == 0) return true;
+	Log (LogWarning) << LOGID << "Could not set " << name << ": " << UDT::getlasterror().getErrorMessage() << std::endl;
+	return false;
+}
+
+/*static*/ Error UDTSocket::applyTuning (UDTSOCKET s, const UDTTuning & tuning) {
+	// Order matters: buffer sizes are counted in packets of MSS and the receiving buffer is limited by the flow window
+	bool suc = true;
+	if (tuning.mss > 0) {
+		suc = suc && setOption (s, UDT_MSS, "UDT_MSS", &tuning.mss, sizeof (tuning.mss));
+	}
+	if (tuning.udpBuffer > 0) {
+		suc = suc && setOption (s, UDP_SNDBUF, "UDP_SNDBUF", &tuning.udpBuffer, sizeof (tuning.udpBuffer));
+		suc = suc && setOption (s, UDP_RCVBUF, "UDP_RCVBUF", &tuning.udpBuffer, sizeof (tuning.udpBuffer));
+	}
+	if (tuning.flowWindow > 0) {
+		suc = suc && setOption (s, UDT_FC, "UDT_FC", &tuning.flowWindow, sizeof (tuning.flowWindow));
+	}
+	suc = suc && setOption (s, UDT_SNDBUF, "UDT_SNDBUF", &tuning.sendBuffer, sizeof (tuning.sendBuffer));
+	suc = suc && setOption (s, UDT_RCVBUF, "UDT_RCVBUF", &tuning.receiveBuffer, sizeof (tuning.receiveBuffer));
+	if (tuning.congestion == UDTTuning::CC_BACKGROUND) {
+		CCCFactory<BackgroundCC> factory;
+		suc = suc && setOption (s, UDT_CC, "UDT_CC", &factory, sizeof (factory));
+	} else {
+		CCCFactory<CUDTCC> factory;
+		suc = suc && setOption (s, UDT_CC, "UDT_CC", &factory, sizeof (factory));
+	}
+	return suc ? NoError : error::InvalidArgument;
+}
+
+/*static*/ void UDTSocket::readTuning (UDTSOCKET s, UDTTuning * tuning) {
+	int len = sizeof (int);
+	UDT::getsockopt (s, 0, UDT_MSS, &tuning->mss, &len);
+	len = sizeof (int);
+	UDT::getsockopt (s, 0, UDP_SNDBUF, &tuning->udpBuffer, &len);
+	len = sizeof (int);
+	UDT::getsockopt (s, 0, UDT_FC, &tuning->flowWindow, &len);
+	len = sizeof (int);
+	UDT::getsockopt (s, 0, UDT_SNDBUF, &tuning->sendBuffer, &len);
+	len = sizeof (int);
+	UDT::getsockopt (s, 0, UDT_RCVBUF, &tuning->receiveBuffer, &len);
 }
 
 Error UDTSocket::connect_locked (const String & host, int port) {
@@ -216,6 +294,7 @@ Error UDTSocket::connect_locked (const String & host, int port) {
 	dst.sin_port = htons (port);
 
 	mConnecting = true;
+	mOpened     = true;
 	int result = UDT::connect(mSocket, (const struct sockaddr*) &dst, sizeof(dst));
 	mConnecting = false;
 
@@ -232,15 +311,18 @@ void UDTSocket::onReadable  () {
 	bool error = false;
 	{
 		LockGuard guard (mMutex);
+		const size_t transferSize = mTuning.inputTransferSize;
 		while (true) {
-			if (mInputBuffer.size() + (size_t) gInputTransferSize > (size_t) gMaxInputBufferSize) {
+			size_t size = mInputBuffer.size();
+			if (size + transferSize > (size_t) mTuning.maxInputBuffer) {
 				Log (LogWarning) << LOGID << "Overflowing in UDTSocket" << std::endl;
 				// overflow, user shall consume!
 				break;
 			}
-			mInputBuffer.reserve (mInputBuffer.size() + 2 * gInputTransferSize);
-			char transferBuf [gInputTransferSize];
-			int received = UDT::recv (mSocket, transferBuf, gInputTransferSize, 0);
+			// receiving directly into the input buffer
+			mInputBuffer.resize (size + transferSize);
+			int received = UDT::recv (mSocket, mInputBuffer.c_array() + size, (int) transferSize, 0);
+			mInputBuffer.resize (size + (received > 0 ? received : 0));
 			if (received == UDT::ERROR) {
 				UDT::ERRORINFO & errInfo = UDT::getlasterror();
 				if (errInfo.getErrorCode() == UDT::ERRORINFO::EASYNCRCV) break; // ignoring, no data available
@@ -251,7 +333,6 @@ void UDTSocket::onReadable  () {
 				break;
 			}
 			if (received > 0){
-				mInputBuffer.append(transferBuf, received);
 				receivedSum+=received;
 			} else
 				break;
@@ -303,11 +384,12 @@ void UDTSocket::connectInOtherThread (const String & address, int port, bool ren
 	notifyAsync (callback, result);
 }
 
-void UDTSocket::init (UDTSOCKET s) {
+void UDTSocket::init (UDTSOCKET s, bool opened) {
 	mSocket = s;
 	mOutputBufferSize = 0;
 	mWriting    = false;
 	mConnecting = false;
+	mOpened     = opened;
 	mError = NoError;
 
 	assert (s > 0);
@@ -320,7 +402,11 @@ void UDTSocket::init (UDTSOCKET s) {
 	UDT::setsockopt (mSocket, 0, UDT_SNDSYN, &sync, sizeof(sync));
 	UDT::setsockopt (mSocket, 0, UDT_RCVSYN, &sync, sizeof(sync));
 	
-	setDefaultBufferSize (mSocket);
+	if (!mOpened) {
+		setDefaultBufferSize (mSocket);
+	}
+	// accepted sockets inherited the tuning of the listening socket (congestion control included)
+	readTuning (mSocket, &mTuning);
 
 	UDTMainLoop::instance().add(this);
 }
@@ -331,10 +417,10 @@ Error UDTSocket::continueWriting_locked () {
 		return NoError;
 	}
 	mWriting = true;
-	OutputElement next = mOutputBuffer.front();
+	OutputElement & next = mOutputBuffer.front();
 	bool notifySuccess = false;
-	int size = (int) next.data->size();
-	int result = UDT::send (mSocket, next.data->const_c_array(), size, 0);
+	int size = (int) (next.data->size() - next.offset);
+	int result = UDT::send (mSocket, next.data->const_c_array() + next.offset, size, 0);
 
 	if (result < 0) {
 		Log (LogWarning) << LOGID << "Could not send " << size << "bytes: " << UDT::getlasterror().getErrorMessage() << std::endl;
@@ -346,18 +432,20 @@ Error UDTSocket::continueWriting_locked () {
 	if (result == 0){
 		return NoError; // ?
 	}
+	ResultCallback callback;
 	if (result < size) {
-		// truncate it
-		next.data->l_truncate (result);
+		// continue later
+		next.offset += result;
 	} else {
 		// fully sent
 		notifySuccess = true;
+		callback = next.callback;
 		mOutputBuffer.pop_front();
 	}
 	mOutputBufferSize -= result;
-	if (notifySuccess && next.callback) {
+	if (notifySuccess && callback) {
 		mMutex.unlock();
-		next.callback(NoError);
+		callback(NoError);
 		mMutex.lock();
 	}
 	return NoError;
@@ -3,6 +3,7 @@
 #include <schnee/sftypes.h>
 #include <schnee/net/UDPSocket.h>
 #include "Channel.h"
+#include "UDTTuning.h"
 #include "impl/UDTMainLoop.h"
 
 namespace sf {
@@ -34,6 +35,13 @@ public:
 	/// Checks whether socket is connected (readable)
 	bool isConnected () const;
 
+	/// Sets buffer sizes, packet and window settings and congestion control
+	/// Must be called before binding / connecting (returns error::WrongState otherwise).
+	Error setTuning (const UDTTuning & tuning);
+
+	/// Returns current tuning profile
+	UDTTuning tuning () const;
+
 	// Additional Tool Methods
 	virtual sf::ByteArrayPtr peek (long maxSize = -1);
 	virtual long bytesAvailable () const;
@@ -52,7 +60,13 @@ public:
 	virtual sf::VoidDelegate & changed () { return mChanged; }
 
 	// For internal use: set default UDT buffer size
-	static void setDefaultBufferSize (UDTSOCKET s);
+	static Error setDefaultBufferSize (UDTSOCKET s);
+
+	// For internal use: applies a tuning profile to an UDT socket, logs failing options
+	static Error applyTuning (UDTSOCKET s, const UDTTuning & tuning);
+
+	// For internal use: reads the buffer, packet and window settings of an UDT socket
+	static void readTuning (UDTSOCKET s, UDTTuning * tuning);
 private:
 	Error connect_locked (const String & host, int port);
 
@@ -60,8 +74,8 @@ private:
 
 	void connectInOtherThread (const String & address, int port, bool rendezvous, const function <void (Error)> & callback);
 
-	/// Initializes the socket
-	void init (UDTSOCKET s);
+	/// Initializes the socket (opened = already bound or connected, e.g. accepted)
+	void init (UDTSOCKET s, bool opened);
 
 	Error continueWriting_locked ();
 
@@ -76,12 +90,14 @@ private:
 	UDTSOCKET   mSocket;
 	ByteArray   mInputBuffer;
 	bool        mConnecting;
+	bool        mOpened;	///< Bound or connected, can't be tuned anymore
 	bool		mWriting;
 	struct OutputElement {
-		OutputElement () {}
-		OutputElement (const ByteArrayPtr& _data, const ResultCallback& _callback) : data(_data), callback(_callback) {
+		OutputElement () : offset (0) {}
+		OutputElement (const ByteArrayPtr& _data, const ResultCallback& _callback) : data(_data), offset (0), callback(_callback) {
 		}
 		ByteArrayPtr data;
+		size_t offset;	///< Already sent bytes (data itself may be shared and is never changed)
 		ResultCallback callback;
 	};
 
@@ -89,9 +105,7 @@ private:
 	size_t      mOutputBufferSize;
 	
 	VoidDelegate mChanged;
-	static const int  gInputTransferSize;
-	static const int  gMaxInputBufferSize;
-	static const int  gMaxOutputBufferSize;
+	UDTTuning    mTuning;
 };
 
 }
@@ -0,0 +1,60 @@
+#include "UDTTuning.h"
+#include <algorithm>
+
+namespace sf {
+
+/// UDT packet size if not set (UDT's default)
+static const int gDefaultMss       = 1500;
+/// UDT packet header + UDP/IP headers
+static const int gPacketOverhead   = 28;
+static const int gMinBuffer        = 64 * 1024;
+static const int gMaxBuffer        = 64 * 1024 * 1024;
+static const int gMaxUdpBuffer     = 8 * 1024 * 1024;
+static const int gMinInputBuffer   = 1024 * 1024;
+static const int gMinTransferSize  = 16 * 1024;
+static const int gMaxTransferSize  = 256 * 1024;
+
+template <class T> static T clamp (T v, T minValue, T maxValue) {
+	return std::max (minValue, std::min (maxValue, v));
+}
+
+UDTTuning::UDTTuning () {
+	// small buffer size (instead of 10MB default) decreases raw throroughput
+	// but increases reactivity much.
+	// It bases upon a typical fast internet link: 2MB/s with RTT 20ms (=40kb needed)
+	congestion        = CC_UDT;
+	sendBuffer        = 524288;
+	receiveBuffer     = 524288;
+	mss               = 0;
+	flowWindow        = 0;
+	udpBuffer         = 0;
+	inputTransferSize = 20000;
+	maxInputBuffer    = 1024 * 1024 * 10; // 10mb
+}
+
+UDTTuning UDTTuning::defaultProfile () {
+	return UDTTuning ();
+}
+
+UDTTuning UDTTuning::fromPath (float rtt, float bandwidth) {
+	UDTTuning t = defaultProfile ();
+	if (rtt <= 0 || bandwidth <= 0) return t;
+	// twice the bandwidth delay product, so that losses do not stall the window
+	double bdp = (double) rtt * bandwidth;
+	int buffer = (int) clamp<double> (2 * bdp, gMinBuffer, gMaxBuffer);
+	t.sendBuffer        = buffer;
+	t.receiveBuffer     = buffer;
+	t.flowWindow        = std::max (32, buffer / (gDefaultMss - gPacketOverhead) + 1);
+	t.udpBuffer         = clamp (buffer / 2, gMinBuffer, gMaxUdpBuffer);
+	t.inputTransferSize = clamp (buffer / 8, gMinTransferSize, gMaxTransferSize);
+	t.maxInputBuffer    = clamp (4 * buffer, gMinInputBuffer, gMaxBuffer);
+	return t;
+}
+
+UDTTuning UDTTuning::fromSettings (const String & congestion, float rtt, float bandwidth) {
+	UDTTuning t = fromPath (rtt, bandwidth);
+	if (congestion == "background") t.congestion = CC_BACKGROUND;
+	return t;
+}
+
+}
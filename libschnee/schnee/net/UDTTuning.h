@@ -0,0 +1,48 @@
+#pragma once
+#include <schnee/sftypes.h>
+#include <sfserialization/autoreflect.h>
+
+namespace sf {
+
+/**
+ * Tuning profile for UDTSockets.
+ *
+ * Contains buffer sizes, UDT packet / window settings and the congestion control
+ * to use. Has to be set before the socket is bound or connected.
+ */
+struct UDTTuning {
+	/// Congestion control algorithm
+	enum Congestion {
+		CC_UDT,			///< UDT's native congestion control (DAIMD)
+		CC_BACKGROUND	///< LEDBAT-style delay based control, yields to other traffic (bulk transfers)
+	};
+
+	UDTTuning ();
+
+	Congestion congestion;	///< Congestion control to use
+	int sendBuffer;			///< UDT sending buffer in bytes (UDT_SNDBUF)
+	int receiveBuffer;		///< UDT receiving buffer in bytes (UDT_RCVBUF)
+	int mss;				///< Maximum packet size in bytes, including headers (UDT_MSS), <= 0 for UDT's default
+	int flowWindow;			///< Maximum flow window in packets (UDT_FC), <= 0 for UDT's default
+	int udpBuffer;			///< Kernel buffers of the UDP socket in bytes (UDP_SNDBUF/UDP_RCVBUF), <= 0 for UDT's default
+	int inputTransferSize;	///< Bytes read from UDT at once
+	int maxInputBuffer;		///< Maximum bytes buffered in UDTSocket until the user reads them
+
+	/// Default profile, fitting a typical internet link (2MB/s with a RTT of 20ms)
+	static UDTTuning defaultProfile ();
+
+	/// Derives buffers and flow window from the bandwidth delay product
+	/// @param rtt round trip time in seconds
+	/// @param bandwidth link bandwidth in bytes/s
+	static UDTTuning fromPath (float rtt, float bandwidth);
+
+	/// Like fromPath, but also chooses the congestion control by name ("udt" or "background")
+	/// Unknown names leave UDT's native control
+	static UDTTuning fromSettings (const String & congestion, float rtt, float bandwidth);
+
+	SF_AUTOREFLECT_SERIAL;
+};
+
+SF_AUTOREFLECT_ENUM (UDTTuning::Congestion);
+
+}
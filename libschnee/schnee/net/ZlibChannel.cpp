@@ -0,0 +1,133 @@
+#include "ZlibChannel.h"
+#include <schnee/tools/Log.h>
+#include <zlib.h>
+#include <string.h>
+
+namespace sf {
+
+ZlibChannel::ZlibChannel (ChannelPtr next, int level) {
+	SF_REGISTER_ME;
+	mNext  = next;
+	mError = NoError;
+	mRawBytes        = 0;
+	mCompressedBytes = 0;
+
+	mDeflate = new z_stream;
+	memset (mDeflate, 0, sizeof (z_stream));
+	mInflate = new z_stream;
+	memset (mInflate, 0, sizeof (z_stream));
+	if (deflateInit (mDeflate, level) != Z_OK || inflateInit (mInflate) != Z_OK) {
+		Log (LogError) << LOGID << "Could not initialize zlib" << std::endl;
+		mError = error::ChannelError;
+	}
+	mNext->changed() = dMemFun (this, &ZlibChannel::onChanged);
+	// there may be already compressed data waiting
+	xcall (dMemFun (this, &ZlibChannel::onChanged));
+}
+
+ZlibChannel::~ZlibChannel () {
+	SF_UNREGISTER_ME;
+	if (mNext) mNext->changed().clear();
+	deflateEnd (mDeflate);
+	inflateEnd (mInflate);
+	delete mDeflate;
+	delete mInflate;
+}
+
+float ZlibChannel::compressionRatio () const {
+	if (mCompressedBytes == 0) return 1.0f;
+	return (float) ((double) mRawBytes / (double) mCompressedBytes);
+}
+
+sf::Error ZlibChannel::error () const {
+	if (mError) return mError;
+	return mNext->error();
+}
+
+sf::String ZlibChannel::errorMessage () const {
+	if (mError) return "zlib error";
+	return mNext->errorMessage();
+}
+
+Channel::State ZlibChannel::state () const {
+	return mNext->state();
+}
+
+Error ZlibChannel::write (const ByteArrayPtr& data, const ResultCallback & callback) {
+	if (mError) return mError;
+	// Note: data may be shared and must not be changed
+	ByteArrayPtr out = createByteArrayPtr ();
+	out->resize (deflateBound (mDeflate, data->size()) + 16);
+	mDeflate->next_in   = (Bytef*) data->const_c_array();
+	mDeflate->avail_in  = (uInt) data->size();
+	size_t produced = 0;
+	while (true) {
+		mDeflate->next_out  = (Bytef*) out->c_array() + produced;
+		mDeflate->avail_out = (uInt) (out->size() - produced);
+		int r = deflate (mDeflate, Z_SYNC_FLUSH);
+		if (r != Z_OK && r != Z_BUF_ERROR) {
+			Log (LogError) << LOGID << "deflate failed " << r << std::endl;
+			mError = error::ChannelError;
+			return mError;
+		}
+		produced = out->size() - mDeflate->avail_out;
+		// flushing is complete if there is space left
+		if (mDeflate->avail_in == 0 && mDeflate->avail_out > 0) break;
+		out->resize (out->size() * 2);
+	}
+	out->resize (produced);
+	mRawBytes        += data->size();
+	mCompressedBytes += produced;
+	return mNext->write (out, callback);
+}
+
+sf::ByteArrayPtr ZlibChannel::read (long maxSize) {
+	ByteArrayPtr result = createByteArrayPtr ();
+	if (maxSize < 0 || maxSize >= (long) mInputBuffer.size()) {
+		result->swap (mInputBuffer);
+	} else {
+		result->append (mInputBuffer.const_c_array(), maxSize);
+		mInputBuffer.l_truncate (maxSize);
+	}
+	return result;
+}
+
+void ZlibChannel::close (const ResultCallback & callback) {
+	mNext->close (callback);
+}
+
+Channel::ChannelInfo ZlibChannel::info () const {
+	ChannelInfo info = mNext->info();
+	info.compressionRatio = compressionRatio ();
+	return info;
+}
+
+void ZlibChannel::onChanged () {
+	ByteArrayPtr data = mNext->read ();
+	if (data && !data->empty() && !mError) {
+		mCompressedBytes += data->size();
+		mInflate->next_in  = (Bytef*) data->const_c_array();
+		mInflate->avail_in = (uInt) data->size();
+		size_t before = mInputBuffer.size();
+		while (true) {
+			size_t pos = mInputBuffer.size();
+			mInputBuffer.resize (pos + std::max ((size_t) 16384, 4 * (size_t) mInflate->avail_in));
+			mInflate->next_out  = (Bytef*) mInputBuffer.c_array() + pos;
+			mInflate->avail_out = (uInt) (mInputBuffer.size() - pos);
+			int r = inflate (mInflate, Z_SYNC_FLUSH);
+			bool full = mInflate->avail_out == 0; // there may be more output
+			mInputBuffer.resize (mInputBuffer.size() - mInflate->avail_out);
+			if (r == Z_STREAM_END) break;
+			if (r != Z_OK && r != Z_BUF_ERROR) {
+				Log (LogWarning) << LOGID << "inflate failed " << r << std::endl;
+				mError = error::ChannelError;
+				break;
+			}
+			if (mInflate->avail_in == 0 && !full) break;
+		}
+		mRawBytes += mInputBuffer.size() - before;
+	}
+	if (mChanged) mChanged ();
+}
+
+}
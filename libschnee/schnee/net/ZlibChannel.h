@@ -0,0 +1,55 @@
+#pragma once
+
+#include <schnee/net/Channel.h>
+#include <schnee/tools/async/DelegateBase.h>
+
+typedef struct z_stream_s z_stream;
+
+namespace sf {
+
+/**
+ * Adds zlib stream compression to an existing channel (Decorator)
+ *
+ * Every write is flushed (Z_SYNC_FLUSH), so the other side can decode it
+ * immediately; this is the behaviour of XMPP stream compression (XEP-0138).
+ */
+class ZlibChannel : public Channel, public DelegateBase {
+public:
+	/// @param level zlib compression level (0..9, -1 for default)
+	ZlibChannel (ChannelPtr next, int level = -1);
+	virtual ~ZlibChannel ();
+
+	/// Uncompressed bytes / compressed bytes (of both directions), 1 if nothing transferred
+	float compressionRatio () const;
+
+	// Implementation of Channel
+	virtual sf::Error error () const;
+	virtual sf::String errorMessage () const;
+	virtual State state () const;
+	virtual Error write (const ByteArrayPtr& data, const ResultCallback & callback = ResultCallback());
+	virtual sf::ByteArrayPtr read (long maxSize = -1);
+	virtual void close (const ResultCallback & callback = ResultCallback());
+	virtual ChannelInfo info () const;
+	virtual const char * stackInfo () const { return "zlib"; }
+	const ChannelPtr next () const { return mNext; }
+	virtual sf::VoidDelegate & changed () { return mChanged; }
+
+private:
+	void onChanged ();
+
+	ChannelPtr   mNext;
+	VoidDelegate mChanged;
+	Error        mError;		///< Compression error
+	ByteArray    mInputBuffer;	///< Decompressed data
+
+	z_stream * mDeflate;
+	z_stream * mInflate;
+
+	// Statistics
+	int64_t mRawBytes;			///< Uncompressed bytes
+	int64_t mCompressedBytes;	///< Compressed bytes
+};
+
+typedef shared_ptr<ZlibChannel> ZlibChannelPtr;
+
+}
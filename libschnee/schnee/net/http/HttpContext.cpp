@@ -20,11 +20,16 @@ void HttpContext::get (const Url & url, int timeOutMs, const RequestCallback & c
 }
 
 void HttpContext::request (const HttpRequest & request, int timeOutMs, const RequestCallback & callback){
+	this->request (request, timeOutMs, callback, DataCallback());
+}
+
+void HttpContext::request (const HttpRequest & request, int timeOutMs, const RequestCallback & callback, const DataCallback & consumer){
 	HttpGetOperation * op = new HttpGetOperation (sf::regTimeOutMs(timeOutMs));
 	op->setId(genFreeId());
 	op->url = request.url();
 	op->request = request.result();
 	op->callback = callback;
+	op->parser.setConsumer (consumer);
 	op->setState (HttpGetOperation::HG_WAITCONNECT);
 	mConnectionManager.requestConnection(op->url, timeOutMs, abind(dMemFun(this, &HttpContext::onConnect), op->id()));
 	addAsyncOp (op);
@@ -104,7 +109,6 @@ void HttpContext::onChanged (AsyncOpId id) {
 	}
 	ByteArrayPtr all = op->con->channel->read();
 	if (!all->empty()){
-		Log (LogInfo) << LOGID << "Recv\n" << *all << std::endl;
 		op->parser.push(*all);
 		if (op->parser.ready()) {
 			Log (LogInfo) << LOGID << "Result of parser: " << toString (op->parser.result()) << std::endl;
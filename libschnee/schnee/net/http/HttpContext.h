@@ -22,6 +22,8 @@ public:
 	~HttpContext();
 
 	typedef function <void (Error result, const HttpResponsePtr & response)> RequestCallback;
+	/// Receives slices of the (decoded) response body as they arrive; only valid during the call
+	typedef HttpResponseParser::DataCallback DataCallback;
 
 	// Instantiates a simple HTTP get call
 	void get (const Url & url, int timeOutMs = 60000, const RequestCallback & callback = RequestCallback ());
@@ -29,6 +31,10 @@ public:
 	// Starts a custom HTTP call
 	void request (const HttpRequest & request, int timeOutMs = 60000, const RequestCallback & callback = RequestCallback ());
 
+	// Starts a custom HTTP call in streaming mode: the body is given to consumer
+	// while receiving and not saved in the response.
+	void request (const HttpRequest & request, int timeOutMs, const RequestCallback & callback, const DataCallback & consumer);
+
 	// Starts a custom HTTP call, comes back synchronously
 	// (For testcases!)
 	std::pair<Error, HttpResponsePtr> syncRequest (const HttpRequest & request, int timeOutMs = 60000);
@@ -42,6 +42,8 @@ void HttpRequest::start (const String & method, const Url & url, HttpVersion ver
 	mStarted = true;
 	if (version == HTTP_11)
 		addHeader ("Host", url.host());
+	// decoded by HttpResponseParser
+	addHeader ("Accept-Encoding", "gzip, deflate");
 }
 
 void HttpRequest::end () {
@@ -16,7 +16,8 @@ public:
 	void end ();
 
 	/// Adds an header element
-	/// The 'Host' header will be set automatically if HttpVersion is 11
+	/// The 'Host' header will be set automatically if HttpVersion is 11,
+	/// 'Accept-Encoding' is always set (gzip and deflate are decoded transparently)
 	void addHeader (const String & key, const String & value);
 
 	/// Adds content
@@ -12,7 +12,7 @@ struct HttpResponse {
 	int resultCode;				///< Result code sent by server
 	HttpVersion httpVersion;	///< Http Version the server used
 	HeaderMap headers;			///< Http Headers the server sent
-	ByteArrayPtr data;			///< Received data
+	ByteArrayPtr data;			///< Received data (already decoded; not set in streaming mode)
 	bool authenticated;			///< Operation was done via authenticated channel
 };
 typedef shared_ptr<HttpResponse> HttpResponsePtr;
@@ -1,27 +1,45 @@
 #include "HttpResponseParser.h"
 #include <stdio.h>
+#include <string.h>
+#include <zlib.h>
 #include <schnee/tools/Log.h>
 #include <boost/lexical_cast.hpp>
 
 namespace sf {
 
+/// Maximum size of a (non streamed) body
+static const size_t gMaxBodySize = 16777216;
+/// Maximum length of a header line
+static const size_t gMaxLineLength = 65536;
+
 HttpResponseParser::HttpResponseParser () {
 	mReady  = false;
 	mResult = NoError;
 	mState = HP_START;
-	mNextScanLinePos = 0;
 	mContentLength = 0;
 	mContentLengthSet = false;
+	mChunkedEncoding  = false;
+	mBodySize = 0;
+	mInflate  = 0;
+	mInflateRaw = false;
+	mInflateStarted = false;
+}
+
+HttpResponseParser::~HttpResponseParser () {
+	if (mInflate) {
+		inflateEnd (mInflate);
+		delete mInflate;
+	}
 }
 
 void HttpResponseParser::push (const ByteArray & data) {
-	mInputBuffer.append(data);
-	if (mInputBuffer.size() > 16777216) {
-		mReady = true;
-		mResult = error::TooMuch;
-		return;
+	if (!mReady && !mInputBuffer.empty()) {
+		// data from before (e.g. was in the connection's buffer)
+		ByteArray pending;
+		pending.swap (mInputBuffer);
+		consume (pending.const_c_array(), pending.size());
 	}
-	consume ();
+	consume (data.const_c_array(), data.size());
 }
 
 static bool splitHeader (const String & s, String * key, String * value) {
@@ -35,153 +53,216 @@ static bool splitHeader (const String & s, String * key, String * value) {
 	return true;
 }
 
-void HttpResponseParser::consume () {
-	String line;
-	while (true) {
-		switch (mState){
-		case HP_START:{
-			if (mInputBuffer.empty()) return;
-			bool suc = consumeLine (&line);
-			if (!suc || mReady) return;
-			if (sscanf (line.c_str(), "HTTP/1.0 %d", &mResponse->resultCode) == 1) {
-				mResponse->httpVersion = HTTP_10;
-			} else if (sscanf (line.c_str(), "HTTP/1.1 %d", &mResponse->resultCode) == 1) {
-				mResponse->httpVersion = HTTP_11;
-			} else {
-				return fail (error::BadProtocol, "Bad protocol start");
-			}
-			Log (LogInfo) << LOGID << "Response Code: " << mResponse->resultCode << " version= " << mResponse->httpVersion << std::endl;
-			if (mResponse->resultCode == 100) {
-				// it's a plain proceed, ignoring
-				break;
-			}
-			mState = HP_INHEADERS;
-			break;
-		}
-		case HP_INHEADERS:{
-			if (mInputBuffer.empty()) return;
-			bool suc = consumeLine (&line);
-			if (!suc || mReady) return;
-			if (line.empty()) {
-				mState = HP_INCONTENT;
-				if (mResponse->headers.count("Content-Length") > 0){
-					String cl = mResponse->headers["Content-Length"];
-					try {
-						mContentLength = boost::lexical_cast<size_t> (cl);
-						mContentLengthSet = true;
-					} catch (boost::bad_lexical_cast & e) {
-						Log (LogInfo) << LOGID << "Could not cast content length" << std::endl;
-					}
+void HttpResponseParser::consume (const char * data, size_t len) {
+	size_t pos = 0;
+	while (!mReady && pos < len) {
+		if (mState == HP_INCONTENT || mState == HP_INCONTENT_CHUNK) {
+			// body data goes out directly, without buffering
+			size_t part = std::min (len - pos, mContentLength);
+			onBody (data + pos, part);
+			pos += part;
+			mContentLength -= part;
+			if (mReady) break;
+			if (mContentLength == 0) {
+				if (mState == HP_INCONTENT) {
+					mReady  = true;
+					mResult = NoError;
+					Log (LogInfo) << LOGID << "Ready, read " << mBodySize << std::endl;
+				} else {
+					mState = HP_INCONTENT_CHUNKBEGIN;
 				}
-				if (mResponse->headers.count("Transfer-Encoding") > 0){
-					String te = mResponse->headers["Transfer-Encoding"];
-					if (te == "chunked" || te == "Chunked" || te == "CHUNKED"){
-						mChunkedEncoding = true;
-						mState = HP_INCONTENT_CHUNKBEGIN;
-					} else {
-						Log (LogWarning) << LOGID << "Unknown transfer encoding " << te << std::endl;
-					}
-				}
-				if (!mContentLengthSet && !mChunkedEncoding) {
-					return fail (error::BadProtocol, "Neither length set nor chunked encoding available, aborting");
-				}
-				Log (LogInfo) << LOGID << "Finished with header" << std::endl;
-				break;
 			}
-			String key, value;
-			suc = splitHeader (line, &key, &value);
-			if (!suc) {
-				return fail (error::BadProtocol, "Strange protocol during header splitting");
-			}
-			mResponse->headers[key] = value;
-			// Log (LogInfo) << LOGID << "Parsed Header: " << key << " -> " << value << std::endl;
-			break;
+			continue;
 		}
-		case HP_INCONTENT:
-			if (mInputBuffer.size() < mContentLength){
-				// not enough, wait...
-				return;
-			}
-			mResponse->data = createByteArrayPtr();
-			if (mInputBuffer.size() == mContentLength) {
-				mResponse->data->swap(mInputBuffer);
-			} else {
-				mResponse->data->append(mInputBuffer.const_c_array(), mContentLength);
-				mInputBuffer.l_truncate(mContentLength);
-			}
-			mReady  = true;
-			mResult = NoError;
-			Log (LogInfo) << LOGID << "Ready, read " << mContentLength << std::endl;
+		// line based states
+		const char * end = (const char*) memchr (data + pos, '\n', len - pos);
+		size_t part = (end ? end - data : len) - pos;
+		if (memchr (data + pos, 0, part)) {
+			return fail (error::BadProtocol, "NULL character in header");
+		}
+		mLine.append (data + pos, part);
+		pos += part;
+		if (mLine.size() > gMaxLineLength) {
+			return fail (error::TooMuch, "Line too long");
+		}
+		if (!end) break;
+		pos++; // '\n'
+		if (!mLine.empty() && mLine[mLine.size() - 1] == '\r') mLine.resize (mLine.size() - 1);
+		String line;
+		line.swap (mLine);
+		onLine (line);
+	}
+	if (pos < len) {
+		// belongs to the next response
+		mInputBuffer.append (data + pos, len - pos);
+	}
+}
+
+void HttpResponseParser::onLine (const String & line) {
+	switch (mState){
+	case HP_START:{
+		if (line.empty()) return; // e.g. after 100 Continue
+		if (sscanf (line.c_str(), "HTTP/1.0 %d", &mResponse->resultCode) == 1) {
+			mResponse->httpVersion = HTTP_10;
+		} else if (sscanf (line.c_str(), "HTTP/1.1 %d", &mResponse->resultCode) == 1) {
+			mResponse->httpVersion = HTTP_11;
+		} else {
+			return fail (error::BadProtocol, "Bad protocol start");
+		}
+		Log (LogInfo) << LOGID << "Response Code: " << mResponse->resultCode << " version= " << mResponse->httpVersion << std::endl;
+		if (mResponse->resultCode == 100) {
+			// it's a plain proceed, ignoring
 			return;
-		case HP_INCONTENT_CHUNKBEGIN:{
-			if (mInputBuffer.empty()) return;
-			bool suc = consumeLine (&line);
-			if (!suc) {
-				return fail (error::BadProtocol, "Awaited a chunk line");
-			}
-			// Log (LogInfo) << LOGID << "Read this as a chunk line: " << line << " len=" << line.size() << std::endl;
-			if (line.empty())
-				break; // try it again
-			// Chunk: Hexadecimal Length and then possiblly a ';' and some comment
-			unsigned int l;
-			int parsed = sscanf (line.c_str(), "%x", &l);
-			if (parsed < 1) {
-				return fail (error::BadProtocol, "Awaited hexadecimal chunk length");
-			}
-			if (l == 0) {
-				mState = HP_INFOOTERS;
-				break;
-			}
-			// Log (LogInfo) << LOGID << "Len=" << l << std::endl;
-			mContentLength = l;
-			mState = HP_INCONTENT_CHUNK;
-			break;
-			}
-		case HP_INCONTENT_CHUNK: {
-			if (mInputBuffer.size() < mContentLength) return; // wait
-			if (!mResponse->data)
-				mResponse->data = createByteArrayPtr();
-			mResponse->data->append(mInputBuffer.c_array(), mContentLength);
-			mInputBuffer.l_truncate(mContentLength);
-			mState = HP_INCONTENT_CHUNKBEGIN;
-			break;
-			}
+		}
+		mState = HP_INHEADERS;
+		return;
+	}
+	case HP_INHEADERS:{
+		if (line.empty()) {
+			return onHeaderEnd ();
+		}
+		String key, value;
+		bool suc = splitHeader (line, &key, &value);
+		if (!suc) {
+			return fail (error::BadProtocol, "Strange protocol during header splitting");
+		}
+		mResponse->headers[key] = value;
+		// Log (LogInfo) << LOGID << "Parsed Header: " << key << " -> " << value << std::endl;
+		return;
+	}
+	case HP_INCONTENT_CHUNKBEGIN:{
+		// Log (LogInfo) << LOGID << "Read this as a chunk line: " << line << " len=" << line.size() << std::endl;
+		if (line.empty())
+			return; // line break after the chunk
+		// Chunk: Hexadecimal Length and then possiblly a ';' and some comment
+		unsigned int l;
+		int parsed = sscanf (line.c_str(), "%x", &l);
+		if (parsed < 1) {
+			return fail (error::BadProtocol, "Awaited hexadecimal chunk length");
+		}
+		if (l == 0) {
+			mState = HP_INFOOTERS;
+			return;
+		}
+		// Log (LogInfo) << LOGID << "Len=" << l << std::endl;
+		mContentLength = l;
+		mState = HP_INCONTENT_CHUNK;
+		return;
+	}
+	case HP_INFOOTERS:{
+		if (line.empty()){
+			mReady = true;
+			Log (LogInfo) << LOGID << "Ready." << std::endl;
+			return;
+		}
+		Log (LogInfo) << LOGID << "Ignoring footer line: " << line << std::endl;
+		return;
+	}
+	default:
+		assert (!"should not come here");
+	}
+}
 
-		case HP_INFOOTERS:{
-			bool suc = consumeLine (&line);
-			if (!suc || mReady) return;
-			if (line.empty()){
-				mReady = true;
-				Log (LogInfo) << LOGID << "Ready." << std::endl;
-				return;
-			}
-			Log (LogInfo) << LOGID << "Ignoring footer line: " << line << std::endl;
-			break;
-			}
+void HttpResponseParser::onHeaderEnd () {
+	HeaderMap & headers = mResponse->headers;
+	mState = HP_INCONTENT;
+	if (headers.count("Content-Length") > 0){
+		String cl = headers["Content-Length"];
+		try {
+			mContentLength = boost::lexical_cast<size_t> (cl);
+			mContentLengthSet = true;
+		} catch (boost::bad_lexical_cast & e) {
+			Log (LogInfo) << LOGID << "Could not cast content length" << std::endl;
+		}
+	}
+	if (headers.count("Transfer-Encoding") > 0){
+		String te = headers["Transfer-Encoding"];
+		if (te == "chunked" || te == "Chunked" || te == "CHUNKED"){
+			mChunkedEncoding = true;
+			mState = HP_INCONTENT_CHUNKBEGIN;
+		} else {
+			Log (LogWarning) << LOGID << "Unknown transfer encoding " << te << std::endl;
+		}
+	}
+	if (!mContentLengthSet && !mChunkedEncoding) {
+		return fail (error::BadProtocol, "Neither length set nor chunked encoding available, aborting");
+	}
+	if (headers.count("Content-Encoding") > 0){
+		Error e = initDecoder (headers["Content-Encoding"]);
+		if (e) return fail (e, "Unsupported content encoding");
+	}
+	if (!mConsumer) {
+		mResponse->data = createByteArrayPtr();
+		if (mContentLengthSet && !mInflate && mContentLength <= gMaxBodySize) {
+			mResponse->data->reserve (mContentLength);
 		}
 	}
+	Log (LogInfo) << LOGID << "Finished with header" << std::endl;
+	if (mState == HP_INCONTENT && mContentLength == 0) {
+		mReady  = true;
+		mResult = NoError;
+	}
+}
+
+Error HttpResponseParser::initDecoder (const String & encoding) {
+	if (encoding == "identity") return NoError;
+	if (encoding != "gzip" && encoding != "x-gzip" && encoding != "deflate") {
+		Log (LogWarning) << LOGID << "Unknown content encoding " << encoding << std::endl;
+		return error::NotSupported;
+	}
+	mInflate = new z_stream;
+	memset (mInflate, 0, sizeof (z_stream));
+	// 15 + 32: zlib and gzip header detection
+	if (inflateInit2 (mInflate, 15 + 32) != Z_OK) {
+		delete mInflate;
+		mInflate = 0;
+		return error::Other;
+	}
+	mInflateBuffer.resize (16384);
+	return NoError;
 }
 
-bool HttpResponseParser::consumeLine (String * dst) {
-	for (; mNextScanLinePos < ((int)mInputBuffer.size() - 1); mNextScanLinePos++) {
-		const int & i = mNextScanLinePos;
-		char c = mInputBuffer[i];
-		char d = mInputBuffer[i+1];
-		if (c == 0) {
-			// bad protocol.
-			mReady  = true;
-			mResult = error::BadProtocol;
-			return true;
+void HttpResponseParser::onBody (const char * data, size_t len) {
+	if (!mInflate) return deliver (data, len);
+	mInflate->next_in  = (Bytef*) data;
+	mInflate->avail_in = (uInt) len;
+	while (mInflate->avail_in > 0) {
+		mInflate->next_out  = (Bytef*) mInflateBuffer.c_array();
+		mInflate->avail_out = (uInt) mInflateBuffer.size();
+		int r = inflate (mInflate, Z_NO_FLUSH);
+		if (r == Z_DATA_ERROR && !mInflateStarted && !mInflateRaw) {
+			// Content-Encoding: deflate without zlib header
+			Log (LogInfo) << LOGID << "Trying raw deflate" << std::endl;
+			inflateEnd (mInflate);
+			memset (mInflate, 0, sizeof (z_stream));
+			if (inflateInit2 (mInflate, -15) != Z_OK) return fail (error::Other, "Could not init zlib");
+			mInflateRaw = true;
+			mInflate->next_in  = (Bytef*) data;
+			mInflate->avail_in = (uInt) len;
+			continue;
 		}
-		if (c == '\n' || (c == '\r' && d == '\n')) {
-			dst->assign(mInputBuffer.const_c_array(), i);
-			int skip = i + (c == '\r' ? 2 : 1);
-			mInputBuffer.l_truncate (skip);
-			mNextScanLinePos = 0;
-			return true;
+		if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+			return fail (error::BadDeserialization, "Could not decode content");
 		}
+		mInflateStarted = true;
+		size_t produced = mInflateBuffer.size() - mInflate->avail_out;
+		if (produced > 0) deliver (mInflateBuffer.const_c_array(), produced);
+		if (mReady) return;
+		if (r == Z_STREAM_END) break; // ignoring trailing garbage
+		if (r == Z_BUF_ERROR && produced == 0) break;
+	}
+}
+
+void HttpResponseParser::deliver (const char * data, size_t len) {
+	mBodySize += len;
+	if (mConsumer) {
+		mConsumer (data, len);
+		return;
 	}
-	return false;
+	if (mBodySize > gMaxBodySize) {
+		return fail (error::TooMuch, "Body too big");
+	}
+	mResponse->data->append (data, len);
 }
 
 void HttpResponseParser::fail (Error e, const char * msg) {
@@ -192,4 +273,3 @@ void HttpResponseParser::fail (Error e, const char * msg) {
 
 
 }
-
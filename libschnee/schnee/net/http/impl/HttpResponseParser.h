@@ -1,11 +1,24 @@
 #pragma once
 #include "../HttpResponse.h"
 
+typedef struct z_stream_s z_stream;
+
 namespace sf{
 
+/**
+ * Parses HTTP responses as they arrive.
+ *
+ * Body data is directly appended to the destination response (or given to a consumer)
+ * without buffering it in the input buffer. Bodies with Content-Encoding gzip or deflate
+ * are decoded transparently.
+ */
 class HttpResponseParser {
 public:
 	HttpResponseParser ();
+	~HttpResponseParser ();
+
+	/// Receives slices of the (decoded) body; the data is only valid during the call
+	typedef function<void (const char * data, size_t len)> DataCallback;
 
 	// Set destination response where to save data
 	// must be done before any data pushing occurs
@@ -13,6 +26,12 @@ public:
 		mResponse = response;
 	}
 
+	/// Streaming mode: body data is given to the consumer and not saved in the response
+	/// must be done before any data pushing occurs
+	void setConsumer (const DataCallback & consumer) {
+		mConsumer = consumer;
+	}
+
 	bool   ready () const { return mReady; }
 	Error  result () const { return mResult; }
 
@@ -24,11 +43,23 @@ public:
 	void push (const ByteArray & data);
 
 private:
-	void consume ();
+	/// Parses data, data after the end of the response is saved in the input buffer
+	void consume (const char * data, size_t len);
+
+	/// Handles a complete line (without \r\n)
+	void onLine (const String & line);
 
-	// consumes a line, returns true if enough data
-	// line is returned without \r\n
-	bool consumeLine (String * dst);
+	/// Handles (still encoded) body data
+	void onBody (const char * data, size_t len);
+
+	/// Hands out decoded body data
+	void deliver (const char * data, size_t len);
+
+	/// Finished the header, prepares receiving content
+	void onHeaderEnd ();
+
+	/// Sets up decoding of the Content-Encoding
+	Error initDecoder (const String & encoding);
 
 	// Fail (perhaps with some error message)
 	void fail (Error e, const char * msg = 0);
@@ -41,15 +72,23 @@ private:
 		HP_INCONTENT_CHUNK,		 // Inside a chunk
 		HP_INFOOTERS			 // Footers during chunk encoding
 	};
-	int mNextScanLinePos;
-	size_t mContentLength;	 // Full content length (if mContentLengthSet) or current chunk length (if mChunkedEncoding set)
+	String mLine;			 // Current incomplete line
+	size_t mContentLength;	 // Remaining content length (if mContentLengthSet) or of the current chunk (if mChunkedEncoding set)
 	bool   mContentLengthSet;
 	bool   mChunkedEncoding; // if we are receiving chunked encoding
+	size_t mBodySize;		 // Decoded body bytes so far
 	State mState;
 	bool mReady;
 	Error mResult;
 	ByteArray mInputBuffer;
 	HttpResponsePtr mResponse;
+	DataCallback mConsumer;
+
+	// Content-Encoding
+	z_stream * mInflate;		// zlib stream (if encoded)
+	bool   mInflateRaw;			// Trying raw deflate (some servers send deflate without zlib header)
+	bool   mInflateStarted;		// Already decoded some data
+	ByteArray mInflateBuffer;
 };
 
 }
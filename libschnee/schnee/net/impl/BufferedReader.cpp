@@ -97,13 +97,19 @@ void BufferedReader::checkAndContinueReading(){
 
 void BufferedReader::readHandler (const boost::system::error_code & ec, std::size_t bytesRead){
 	SF_SCHNEE_LOCK;
-	bool doClose = false;
-	bool fireDelegate = false;
 	mPendingOperations--;
 	mAsyncReading = false;
 	if (!ec){
 		// Log (LogInfo) << LOGID << "Read " << bytesRead << std::endl;
 		mInputBuffer.append (mInputTransferBuffer, bytesRead);
+	}
+	onReadResult (ec, bytesRead);
+}
+
+void BufferedReader::onReadResult (const boost::system::error_code & ec, std::size_t bytesRead) {
+	bool doClose = false;
+	bool fireDelegate = false;
+	if (!ec){
 		fireDelegate = true;
 	} else if (ec == boost::asio::error::operation_aborted){
 		// nothing
@@ -62,6 +62,10 @@ protected:
 	
 	/// Comes back in async Reading
 	void readHandler (const boost::system::error_code & ec, std::size_t bytesRead);
+
+	/// Handles the result of a read operation whose data is already appended to mInputBuffer
+	/// (notifies, continues reading, closes on errors)
+	void onReadResult (const boost::system::error_code & ec, std::size_t bytesRead);
 	
 	size_t    	mInputTransferBufferSize;		///< Size of input buffer
 	char * 	  	mInputTransferBuffer;			///< Smaller input buffer for current async reading process 
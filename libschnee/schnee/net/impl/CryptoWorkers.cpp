@@ -0,0 +1,42 @@
+#include "CryptoWorkers.h"
+#include <schnee/tools/Log.h>
+#include <boost/bind.hpp>
+
+namespace sf {
+
+/// Thread function of a worker
+static void runWorker (boost::asio::io_service * service) {
+	service->run();
+}
+
+void CryptoWorkers::start (int threads) {
+	stop ();
+	if (threads <= 0) return;
+	mService.reset ();
+	mWork = new boost::asio::io_service::work (mService);
+	for (int i = 0; i < threads; i++) {
+		mThreads.push_back (new boost::thread (boost::bind (&runWorker, &mService)));
+	}
+	Log (LogInfo) << LOGID << "Started " << threads << " crypto worker threads" << std::endl;
+}
+
+void CryptoWorkers::stop () {
+	if (mThreads.empty()) return;
+	// run() returns as soon as all posted jobs are done
+	delete mWork;
+	mWork = 0;
+	for (std::vector<boost::thread*>::iterator i = mThreads.begin(); i != mThreads.end(); i++) {
+		(*i)->join();
+		delete *i;
+	}
+	mThreads.clear();
+}
+
+CryptoWorkers::CryptoWorkers () : mWork (0) {
+}
+
+CryptoWorkers::~CryptoWorkers () {
+	stop ();
+}
+
+}
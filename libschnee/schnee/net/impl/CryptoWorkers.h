@@ -0,0 +1,53 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <schnee/tools/Singleton.h>
+#include <schnee/sftypes.h>
+
+/// @cond DEV
+
+namespace sf {
+
+/**
+ * A pool of worker threads for CPU heavy cryptographic work (TLS record processing and handshakes).
+ *
+ * Jobs are posted on strands; jobs of one strand are executed in order and never in parallel,
+ * jobs of different strands run concurrently. Jobs do not hold the schnee lock, results have
+ * to be brought back using xcall.
+ *
+ * This class is not designed for use outside of libschnee.
+ */
+class CryptoWorkers : public Singleton<CryptoWorkers> {
+public:
+	typedef boost::asio::io_service::strand Strand;
+	typedef shared_ptr<Strand> StrandPtr;
+
+	/// Starts worker threads (stopping the running ones), usually done via schnee::init()
+	void start (int threads);
+
+	/// Stops the worker threads after they finished all posted jobs
+	void stop ();
+
+	/// Number of running worker threads
+	int threads () const { return mThreads.size(); }
+
+	/// There are worker threads running
+	bool running () const { return !mThreads.empty(); }
+
+	/// Creates a new strand
+	StrandPtr createStrand () { return StrandPtr (new Strand (mService)); }
+
+private:
+	friend class Singleton<CryptoWorkers>;
+	CryptoWorkers ();
+	~CryptoWorkers ();
+
+	boost::asio::io_service mService;
+	boost::asio::io_service::work * mWork;
+	std::vector<boost::thread*> mThreads;
+};
+
+}
+
+/// @endcond DEV
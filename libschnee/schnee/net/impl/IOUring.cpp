@@ -0,0 +1,469 @@
+#include "IOUring.h"
+#include "IOService.h"
+#include <schnee/tools/Log.h>
+#include <schnee/tools/async/MemFun.h>
+#include <schnee/schnee.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef LINUX
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace sf {
+
+#if defined (LINUX) && defined (IORING_RECV_MULTISHOT)
+
+/*
+ * Implementation Notice
+ * We do not depend on liburing but talk to the kernel directly; the ring handling
+ * follows the kernel documentation (io_uring(7)). The submission queue array is mapped
+ * 1:1 to the entries, so entries are used in order. Only the IOService thread consumes
+ * completions and refills the buffer ring; submissions may come from any thread
+ * and are protected by mMutex.
+ */
+
+/// Submission queue entries
+static const unsigned gEntries = 256;
+/// Completion queue entries (multishot receives produce many completions per submission)
+static const unsigned gCompletionEntries = 4 * gEntries;
+/// Number of provided receive buffers (power of 2)
+static const unsigned gBufferCount = 256;
+/// Size of one receive buffer
+static const unsigned gBufferSize  = 16384;
+/// Buffer group of the receive buffers
+static const int gBufferGroup = 0;
+/// Maximum length of send chains
+static const int gMaxChain = 16;
+
+static int uringSetup (unsigned entries, io_uring_params * params) {
+	return (int) syscall (__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter (int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+	return (int) syscall (__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister (int fd, unsigned opcode, void * arg, unsigned args) {
+	return (int) syscall (__NR_io_uring_register, fd, opcode, arg, args);
+}
+
+/// Operation user data: receiver pointer with operation kind in the lower bits
+static uint64_t userData (IOUringReceiver * receiver, IOUring::Operation op) {
+	return (uint64_t) (uintptr_t) receiver | (uint64_t) op;
+}
+
+struct IOUring::Ring {
+	Ring () : fd (-1), sqMap (0), sqMapSize (0), cqMap (0), cqMapSize (0), sqes (0), sqesSize (0),
+			bufRing (0), bufRingSize (0), buffers (0), bufTail (0), multishot (true), eventFd (-1), signal (0), signalValue (0) {}
+
+	/// Sets up ring, buffers and eventfd
+	bool open ();
+	/// Releases everything
+	void close ();
+	/// Gives a receive buffer back to the kernel (after publishBuffers)
+	void recycle (unsigned short bid) {
+		io_uring_buf * b = &bufRing[bufTail & (gBufferCount - 1)];
+		b->addr = (uint64_t) (uintptr_t) (buffers + bid * gBufferSize);
+		b->len  = gBufferSize;
+		b->bid  = bid;
+		bufTail++;
+	}
+	void publishBuffers () {
+		// the tail overlays the reserved field of the first entry (io_uring_buf_ring)
+		__atomic_store_n (&bufRing[0].resv, bufTail, __ATOMIC_RELEASE);
+	}
+
+	int fd;
+	// submission queue (mapped)
+	void *     sqMap;
+	size_t     sqMapSize;
+	unsigned * sqHead;
+	unsigned * sqTail;
+	unsigned * sqFlags;
+	unsigned   sqMask;
+	unsigned   sqEntries;
+	unsigned   sqLocalTail;	///< Entries filled, the kernel sees them after submit_locked
+	// completion queue (mapped)
+	void *     cqMap;
+	size_t     cqMapSize;
+	unsigned * cqHead;
+	unsigned * cqTail;
+	unsigned   cqMask;
+	io_uring_cqe * cqes;
+	io_uring_sqe * sqes;
+	size_t     sqesSize;
+	// provided receive buffers
+	io_uring_buf * bufRing;	///< io_uring_buf_ring, its C++ declaration has the entries at a wrong offset
+	size_t     bufRingSize;
+	char *     buffers;
+	unsigned short bufTail;
+	bool       multishot;	///< Kernel supports multishot receive
+
+	int eventFd;
+	boost::asio::posix::stream_descriptor * signal;
+	uint64_t signalValue;
+	std::vector<io_uring_cqe> batch;
+};
+
+bool IOUring::Ring::open () {
+	io_uring_params p;
+	memset (&p, 0, sizeof (p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = gCompletionEntries;
+	fd = uringSetup (gEntries, &p);
+	if (fd < 0) {
+		Log (LogInfo) << LOGID << "Could not create io_uring: " << strerror (errno) << std::endl;
+		return false;
+	}
+	sqMapSize = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+	cqMapSize = p.cq_off.cqes  + p.cq_entries * sizeof (io_uring_cqe);
+	bool singleMap = p.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMap) {
+		sqMapSize = cqMapSize = std::max (sqMapSize, cqMapSize);
+	}
+	sqMap = mmap (0, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sqMap == MAP_FAILED) { sqMap = 0; return false; }
+	if (singleMap) {
+		cqMap = sqMap;
+	} else {
+		cqMap = mmap (0, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cqMap == MAP_FAILED) { cqMap = 0; return false; }
+	}
+	sqesSize = p.sq_entries * sizeof (io_uring_sqe);
+	void * sqesMap = mmap (0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqesMap == MAP_FAILED) return false;
+	sqes = (io_uring_sqe*) sqesMap;
+
+	char * sq = (char*) sqMap;
+	sqHead    = (unsigned*) (sq + p.sq_off.head);
+	sqTail    = (unsigned*) (sq + p.sq_off.tail);
+	sqFlags   = (unsigned*) (sq + p.sq_off.flags);
+	sqMask    = *(unsigned*) (sq + p.sq_off.ring_mask);
+	sqEntries = p.sq_entries;
+	unsigned * array = (unsigned*) (sq + p.sq_off.array);
+	for (unsigned i = 0; i < sqEntries; i++) array[i] = i;
+	sqLocalTail = *sqTail;
+
+	char * cq = (char*) cqMap;
+	cqHead = (unsigned*) (cq + p.cq_off.head);
+	cqTail = (unsigned*) (cq + p.cq_off.tail);
+	cqMask = *(unsigned*) (cq + p.cq_off.ring_mask);
+	cqes   = (io_uring_cqe*) (cq + p.cq_off.cqes);
+
+	// provided buffer ring
+	bufRingSize = gBufferCount * sizeof (io_uring_buf);
+	void * bufMap = mmap (0, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (bufMap == MAP_FAILED) return false;
+	bufRing = (io_uring_buf*) bufMap;
+	io_uring_buf_reg reg;
+	memset (&reg, 0, sizeof (reg));
+	reg.ring_addr    = (uint64_t) (uintptr_t) bufRing;
+	reg.ring_entries = gBufferCount;
+	reg.bgid         = gBufferGroup;
+	if (uringRegister (fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		Log (LogInfo) << LOGID << "Could not register buffer ring (needs Linux >= 5.19): " << strerror (errno) << std::endl;
+		return false;
+	}
+	buffers = new char [gBufferCount * gBufferSize];
+	for (unsigned i = 0; i < gBufferCount; i++) {
+		recycle ((unsigned short) i);
+	}
+	publishBuffers ();
+
+	eventFd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (eventFd < 0 || uringRegister (fd, IORING_REGISTER_EVENTFD, &eventFd, 1) < 0) {
+		Log (LogInfo) << LOGID << "Could not register eventfd: " << strerror (errno) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void IOUring::Ring::close () {
+	if (signal) {
+		delete signal; // closes eventFd
+		signal  = 0;
+		eventFd = -1;
+	}
+	if (eventFd >= 0) ::close (eventFd);
+	if (fd >= 0) ::close (fd);
+	if (sqes)    munmap (sqes, sqesSize);
+	if (cqMap && cqMap != sqMap) munmap (cqMap, cqMapSize);
+	if (sqMap)   munmap (sqMap, sqMapSize);
+	if (bufRing) munmap (bufRing, bufRingSize);
+	delete [] buffers;
+}
+
+Error IOUring::start () {
+	LockGuard guard (mMutex);
+	if (mRing) return NoError;
+	Ring * ring = new Ring ();
+	if (!ring->open()) {
+		ring->close ();
+		delete ring;
+		return error::NotSupported;
+	}
+	ring->signal = new boost::asio::posix::stream_descriptor (IOService::service(), ring->eventFd);
+	mRing = ring;
+	startWait ();
+	Log (LogInfo) << LOGID << "Started io_uring with " << mRing->sqEntries << " entries" << std::endl;
+	return NoError;
+}
+
+Error IOUring::recv (int fd, IOUringReceiver * receiver) {
+	LockGuard guard (mMutex);
+	if (!mRing) return error::NotInitialized;
+	io_uring_sqe * sqe = (io_uring_sqe*) nextEntry_locked ();
+	if (!sqe) return error::BufferFull;
+	sqe->opcode    = IORING_OP_RECV;
+	sqe->fd        = fd;
+	sqe->flags     = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = gBufferGroup;
+	sqe->len       = 0; // size of the selected buffer
+	if (mRing->multishot) sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->user_data = userData (receiver, Recv);
+	scheduleSubmit_locked ();
+	return NoError;
+}
+
+Error IOUring::sendChain (int fd, const std::vector<boost::asio::const_buffer> & buffers, IOUringReceiver * receiver) {
+	LockGuard guard (mMutex);
+	if (!mRing) return error::NotInitialized;
+	if (buffers.empty() || buffers.size() > (size_t) gMaxChain) return error::InvalidArgument;
+	// a chain must not be split between two submissions
+	unsigned n = (unsigned) buffers.size();
+	if (mRing->sqEntries - (mRing->sqLocalTail - __atomic_load_n (mRing->sqHead, __ATOMIC_ACQUIRE)) < n) {
+		submit_locked ();
+		if (mRing->sqEntries - (mRing->sqLocalTail - __atomic_load_n (mRing->sqHead, __ATOMIC_ACQUIRE)) < n) return error::BufferFull;
+	}
+	for (unsigned i = 0; i < n; i++) {
+		io_uring_sqe * sqe = (io_uring_sqe*) nextEntry_locked ();
+		sqe->opcode    = IORING_OP_SEND;
+		sqe->fd        = fd;
+		sqe->addr      = (uint64_t) (uintptr_t) boost::asio::buffer_cast<const char*> (buffers[i]);
+		sqe->len       = (unsigned) boost::asio::buffer_size (buffers[i]);
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		if (i + 1 < n) sqe->flags = IOSQE_IO_LINK;
+		sqe->user_data = userData (receiver, Send);
+	}
+	scheduleSubmit_locked ();
+	return NoError;
+}
+
+void IOUring::cancel (IOUringReceiver * receiver, Operation op) {
+	LockGuard guard (mMutex);
+	if (!mRing) return;
+	uint64_t data = userData (receiver, op);
+	if (!queueCancel_locked (data)) {
+		// the receiver waits for the cancelled completion, so it must not get lost
+		Log (LogInfo) << LOGID << "Submission queue full, retrying cancel later" << std::endl;
+		mPendingCancels.push_back (data);
+		scheduleSubmit_locked ();
+		return;
+	}
+	// not batched, a multishot receive goes on until the kernel sees this
+	submit_locked ();
+}
+
+bool IOUring::queueCancel_locked (uint64_t data) {
+	io_uring_sqe * sqe = (io_uring_sqe*) nextEntry_locked ();
+	if (!sqe) return false;
+	sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+	sqe->fd           = -1;
+	sqe->addr         = data;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+	sqe->user_data    = 0; // result not interesting
+	return true;
+}
+
+void IOUring::retryCancels_locked () {
+	size_t queued = 0;
+	while (queued < mPendingCancels.size() && queueCancel_locked (mPendingCancels[queued])) {
+		queued++;
+	}
+	mPendingCancels.erase (mPendingCancels.begin(), mPendingCancels.begin() + queued);
+	if (!mPendingCancels.empty()) scheduleSubmit_locked ();
+}
+
+int IOUring::maxChain () {
+	return gMaxChain;
+}
+
+void * IOUring::nextEntry_locked () {
+	Ring * r = mRing;
+	if (r->sqLocalTail - __atomic_load_n (r->sqHead, __ATOMIC_ACQUIRE) >= r->sqEntries) {
+		submit_locked ();
+		if (r->sqLocalTail - __atomic_load_n (r->sqHead, __ATOMIC_ACQUIRE) >= r->sqEntries) return 0;
+	}
+	io_uring_sqe * sqe = &r->sqes[r->sqLocalTail & r->sqMask];
+	memset (sqe, 0, sizeof (*sqe));
+	r->sqLocalTail++;
+	return sqe;
+}
+
+void IOUring::submit_locked () {
+	Ring * r = mRing;
+	__atomic_store_n (r->sqTail, r->sqLocalTail, __ATOMIC_RELEASE);
+	unsigned pending = r->sqLocalTail - __atomic_load_n (r->sqHead, __ATOMIC_ACQUIRE);
+	while (pending > 0) {
+		int submitted = uringEnter (r->fd, pending, 0, 0);
+		mStatistics.enters++;
+		if (submitted < 0) {
+			if (errno == EINTR) continue;
+			// EAGAIN / EBUSY: kernel is short on resources, try again later
+			Log (LogWarning) << LOGID << "io_uring_enter failed: " << strerror (errno) << std::endl;
+			scheduleSubmit_locked ();
+			return;
+		}
+		mStatistics.submissions += submitted;
+		pending -= std::min ((unsigned) submitted, pending);
+	}
+}
+
+void IOUring::scheduleSubmit_locked () {
+	if (mInCompletion || mSubmitScheduled) return; // submitted at the end of handleCompletions
+	mSubmitScheduled = true;
+	IOService::service().post (memFun (this, &IOUring::onSubmit));
+}
+
+void IOUring::onSubmit () {
+	LockGuard guard (mMutex);
+	mSubmitScheduled = false;
+	if (!mRing) return;
+	retryCancels_locked ();
+	submit_locked ();
+}
+
+void IOUring::startWait () {
+	// async_read_some tries reading first, so no signal gets lost between two waits
+	mRing->signal->async_read_some (boost::asio::buffer (&mRing->signalValue, sizeof (mRing->signalValue)), memFun (this, &IOUring::onSignal));
+}
+
+void IOUring::onSignal (const boost::system::error_code & ec, std::size_t bytes) {
+	if (ec == boost::asio::error::operation_aborted) return;
+	if (ec) {
+		Log (LogError) << LOGID << "Error waiting for completions: " << ec.message() << std::endl;
+		return;
+	}
+	SF_SCHNEE_LOCK;
+	handleCompletions ();
+	startWait ();
+}
+
+void IOUring::handleCompletions () {
+	Ring * r = mRing;
+	{
+		LockGuard guard (mMutex);
+		mInCompletion = true;
+		mStatistics.wakeups++;
+	}
+	int64_t completions = 0;
+	while (true) {
+		unsigned head = *r->cqHead;
+		unsigned tail = __atomic_load_n (r->cqTail, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			// the kernel keeps completions which did not fit in, flush them
+			if (__atomic_load_n (r->sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) {
+				uringEnter (r->fd, 0, 0, IORING_ENTER_GETEVENTS);
+				continue;
+			}
+			break;
+		}
+		// copying them out, receivers may submit (and so produce) new completions
+		r->batch.clear ();
+		for (; head != tail; head++) {
+			r->batch.push_back (r->cqes[head & r->cqMask]);
+		}
+		__atomic_store_n (r->cqHead, head, __ATOMIC_RELEASE);
+
+		for (std::vector<io_uring_cqe>::const_iterator i = r->batch.begin(); i != r->batch.end(); i++) {
+			if (i->user_data == 0) continue; // cancel requests
+			IOUringReceiver * receiver = (IOUringReceiver*) (uintptr_t) (i->user_data & ~(uint64_t) 3);
+			int op       = (int) (i->user_data & 3);
+			int result   = i->res;
+			bool more    = (i->flags & IORING_CQE_F_MORE) != 0;
+			bool buffer  = (i->flags & IORING_CQE_F_BUFFER) != 0;
+			unsigned short bid = (unsigned short) (i->flags >> IORING_CQE_BUFFER_SHIFT);
+			if (op == Recv && result == -EINVAL && r->multishot) {
+				Log (LogInfo) << LOGID << "No multishot receive (needs Linux >= 6.0), re-arming single receives" << std::endl;
+				r->multishot = false;
+				result = -ENOBUFS; // lets the receiver re-arm
+			}
+			receiver->onUringCompletion (op, result, more, buffer ? r->buffers + bid * gBufferSize : 0);
+			if (buffer) r->recycle (bid);
+			completions++;
+		}
+		r->publishBuffers ();
+	}
+	LockGuard guard (mMutex);
+	mInCompletion = false;
+	mStatistics.completions += completions;
+	// the kernel consumed entries meanwhile
+	retryCancels_locked ();
+	submit_locked ();
+}
+
+void IOUring::stop () {
+	LockGuard guard (mMutex);
+	if (!mRing) return;
+	mRing->close ();
+	delete mRing;
+	mRing = 0;
+	mPendingCancels.clear ();
+}
+
+#else
+
+// No io_uring on this platform
+
+struct IOUring::Ring {};
+
+Error IOUring::start () {
+	return error::NotSupported;
+}
+
+Error IOUring::recv (int, IOUringReceiver *) {
+	return error::NotSupported;
+}
+
+Error IOUring::sendChain (int, const std::vector<boost::asio::const_buffer> &, IOUringReceiver *) {
+	return error::NotSupported;
+}
+
+void IOUring::cancel (IOUringReceiver *, Operation) {
+}
+
+int IOUring::maxChain () {
+	return 1;
+}
+
+void * IOUring::nextEntry_locked () { return 0; }
+void IOUring::submit_locked () {}
+void IOUring::scheduleSubmit_locked () {}
+void IOUring::onSubmit () {}
+void IOUring::startWait () {}
+void IOUring::onSignal (const boost::system::error_code &, std::size_t) {}
+void IOUring::handleCompletions () {}
+void IOUring::stop () {}
+
+#endif
+
+IOUring::Statistics IOUring::statistics () {
+	LockGuard guard (mMutex);
+	return mStatistics;
+}
+
+IOUring::IOUring () : mRing (0), mSubmitScheduled (false), mInCompletion (false) {
+}
+
+IOUring::~IOUring () {
+	// the IOService is stopped already, so no handler is running anymore
+	stop ();
+}
+
+}
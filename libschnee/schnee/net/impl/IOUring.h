@@ -0,0 +1,114 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <schnee/tools/Singleton.h>
+#include <schnee/sftypes.h>
+
+/// @cond DEV
+
+namespace sf {
+
+/// Receives completions of IOUring operations
+struct IOUringReceiver {
+	virtual ~IOUringReceiver () {}
+	/// An operation completed; called in the IOService thread with locked schnee mutex
+	/// @param op      operation kind (IOUring::Operation)
+	/// @param result  result of the operation (bytes transferred or negative errno)
+	/// @param more    more completions of a multishot operation follow
+	/// @param data    received data (result bytes) of a receive operation, valid only during the call
+	virtual void onUringCompletion (int op, int result, bool more, const char * data) = 0;
+};
+
+/**
+ * A Linux io_uring instance for TCP sockets, used as an alternative to asio's reactor.
+ *
+ * - Receiving is done by multishot receive operations into one ring of provided buffers
+ *   shared by all sockets, so an armed socket does not need any own buffer and a
+ *   single operation delivers all data until it is cancelled.
+ * - Sending is done by chains of linked send operations, one for each queued output element.
+ * - Submissions are collected and submitted once per IOService iteration; all completions
+ *   are handled in one go, with locking the schnee mutex once.
+ *
+ * Completions are signalled by an eventfd, which is read by the IOService; so all handlers
+ * are executed in the IOService thread like the asio ones.
+ *
+ * Needs Linux >= 5.19 (provided buffer rings); multishot receive needs Linux >= 6.0,
+ * older kernels are handled by re-arming single receives. If not available, start()
+ * fails and TCPSockets use the asio backend.
+ *
+ * This class is not designed for use outside of libschnee.
+ */
+class IOUring : public Singleton<IOUring> {
+public:
+	/// Operation kinds (user data of the operations)
+	enum Operation { Recv = 1, Send = 2 };
+
+	/// Creates the ring; TCPSockets created afterwards will use it.
+	/// Usually done via schnee::init(), needs a running IOService.
+	Error start ();
+
+	/// Ring is running
+	bool available () const { return mRing != 0; }
+
+	/// Starts receiving from fd into the shared buffers until cancelled, an error or EOF
+	Error recv (int fd, IOUringReceiver * receiver);
+
+	/// Sends the buffers in order (linked operations), each one gives a completion
+	/// At most maxChain() buffers are sent at once.
+	Error sendChain (int fd, const std::vector<boost::asio::const_buffer> & buffers, IOUringReceiver * receiver);
+
+	/// Cancels all operations of kind op of the receiver; they complete with -ECANCELED
+	void cancel (IOUringReceiver * receiver, Operation op);
+
+	/// Maximum number of sends in one chain
+	static int maxChain ();
+
+	/// Ring statistics (for benchmarking)
+	struct Statistics {
+		Statistics () : enters (0), submissions (0), completions (0), wakeups (0) {}
+		int64_t enters;			///< io_uring_enter system calls
+		int64_t submissions;	///< Submitted operations
+		int64_t completions;	///< Handled completions
+		int64_t wakeups;		///< Completion batches (eventfd wakeups)
+	};
+	Statistics statistics ();
+
+private:
+	friend class Singleton<IOUring>;
+	IOUring ();
+	~IOUring ();
+
+	struct Ring;
+
+	/// Releases the ring
+	void stop ();
+	/// Returns a cleared submission entry or 0 if the queue is full even after submitting
+	void * nextEntry_locked ();
+	/// Queues a cancel request for the operations with given user data, false if the queue is full
+	bool queueCancel_locked (uint64_t userData);
+	/// Queues the cancel requests which did not fit in before
+	void retryCancels_locked ();
+	/// Submits all pending entries
+	void submit_locked ();
+	/// Schedules submission at the end of the current IOService iteration
+	void scheduleSubmit_locked ();
+	/// Submits (from the IOService)
+	void onSubmit ();
+	/// Waits for the next completion signal
+	void startWait ();
+	/// Eventfd got signaled, handles all completions
+	void onSignal (const boost::system::error_code & ec, std::size_t bytes);
+	/// Hands all completions to their receivers
+	void handleCompletions ();
+
+	Ring * mRing;
+	bool mSubmitScheduled;
+	bool mInCompletion;			///< Handling completions (submits at the end)
+	std::vector<uint64_t> mPendingCancels;	///< Cancel requests waiting for a free submission entry
+	Statistics mStatistics;
+	Mutex mMutex;				///< Protects the submission queue
+};
+
+}
+
+/// @endcond DEV
@@ -0,0 +1,132 @@
+#include "KernelTls.h"
+#include <schnee/tools/Log.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
+namespace sf {
+
+#if defined (LINUX) && defined (TLS_TX) && GNUTLS_VERSION_NUMBER >= 0x030400
+
+bool KernelTls::supported (gnutls_session_t session) {
+	gnutls_protocol_t version = gnutls_protocol_get_version (session);
+	if (version != GNUTLS_TLS1_2
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+		&& version != GNUTLS_TLS1_3
+#endif
+	) return false;
+	switch (gnutls_cipher_get (session)) {
+		case GNUTLS_CIPHER_AES_128_GCM:
+		case GNUTLS_CIPHER_AES_256_GCM:
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+		case GNUTLS_CIPHER_CHACHA20_POLY1305:
+#endif
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// Fills the kernel's crypto info of an AES-GCM cipher (same layout for 128 and 256 bit)
+template <class Info> static void fillGcm (Info * info, bool tls13, const gnutls_datum_t & iv, const gnutls_datum_t & key, const unsigned char * seq) {
+	// GnuTLS keeps the 4 byte implicit part of the nonce (salt) in front, followed by
+	// the 8 byte explicit part with TLS 1.3; TLS 1.2 uses the sequence number as explicit part
+	memcpy (info->salt, iv.data, sizeof (info->salt));
+	if (tls13) {
+		memcpy (info->iv, iv.data + sizeof (info->salt), sizeof (info->iv));
+	} else {
+		memcpy (info->iv, seq, sizeof (info->iv));
+	}
+	memcpy (info->key, key.data, sizeof (info->key));
+	memcpy (info->rec_seq, seq, sizeof (info->rec_seq));
+}
+
+Error KernelTls::enableTx (int fd, gnutls_session_t session) {
+	if (fd < 0 || !supported (session)) return error::NotSupported;
+	gnutls_datum_t mac, iv, key;
+	unsigned char seq[8];
+	int r = gnutls_record_get_state (session, 0, &mac, &iv, &key, seq);
+	if (r) {
+		Log (LogInfo) << LOGID << "Could not get TLS state: " << gnutls_strerror_name (r) << std::endl;
+		return error::NotSupported;
+	}
+	bool tls13 = gnutls_protocol_get_version (session) != GNUTLS_TLS1_2;
+	unsigned short version = tls13 ? TLS_1_3_VERSION : TLS_1_2_VERSION;
+
+	union {
+		tls12_crypto_info_aes_gcm_128 aes128;
+		tls12_crypto_info_aes_gcm_256 aes256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+		tls12_crypto_info_chacha20_poly1305 chacha;
+#endif
+	} info;
+	memset (&info, 0, sizeof (info));
+	size_t size = 0;
+	switch (gnutls_cipher_get (session)) {
+		case GNUTLS_CIPHER_AES_128_GCM:
+			if (key.size != sizeof (info.aes128.key)) return error::NotSupported;
+			info.aes128.info.version     = version;
+			info.aes128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+			fillGcm (&info.aes128, tls13, iv, key, seq);
+			size = sizeof (info.aes128);
+			break;
+		case GNUTLS_CIPHER_AES_256_GCM:
+			if (key.size != sizeof (info.aes256.key)) return error::NotSupported;
+			info.aes256.info.version     = version;
+			info.aes256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+			fillGcm (&info.aes256, tls13, iv, key, seq);
+			size = sizeof (info.aes256);
+			break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+		case GNUTLS_CIPHER_CHACHA20_POLY1305:
+			if (key.size != sizeof (info.chacha.key) || iv.size != sizeof (info.chacha.iv)) return error::NotSupported;
+			info.chacha.info.version     = version;
+			info.chacha.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+			memcpy (info.chacha.iv, iv.data, sizeof (info.chacha.iv));
+			memcpy (info.chacha.key, key.data, sizeof (info.chacha.key));
+			memcpy (info.chacha.rec_seq, seq, sizeof (info.chacha.rec_seq));
+			size = sizeof (info.chacha);
+			break;
+#endif
+		default:
+			return error::NotSupported;
+	}
+
+	Error result = NoError;
+	if (::setsockopt (fd, SOL_TCP, TCP_ULP, "tls", sizeof ("tls"))) {
+		Log (LogInfo) << LOGID << "No kernel TLS support: " << strerror (errno) << std::endl;
+		result = error::NotSupported;
+	} else if (::setsockopt (fd, SOL_TLS, TLS_TX, &info, size)) {
+		// The socket stays usable, without keys the tls layer just passes data through
+		Log (LogInfo) << LOGID << "Kernel TLS does not accept cipher: " << strerror (errno) << std::endl;
+		result = error::NotSupported;
+	}
+	memset (&info, 0, sizeof (info)); // no key copies lying around
+	return result;
+}
+
+#else
+
+bool KernelTls::supported (gnutls_session_t session) {
+	return false;
+}
+
+Error KernelTls::enableTx (int fd, gnutls_session_t session) {
+	return error::NotSupported;
+}
+
+#endif
+
+}
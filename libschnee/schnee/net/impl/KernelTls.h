@@ -0,0 +1,32 @@
+#pragma once
+
+#include <schnee/sftypes.h>
+#include <gnutls/gnutls.h>
+
+/// @cond DEV
+
+namespace sf {
+
+/**
+ * Hands the sending direction of an established GnuTLS session to the Linux kernel (kTLS).
+ *
+ * Afterwards plaintext written into the socket is encrypted by the kernel; the
+ * GnuTLS session must not send any records anymore.
+ *
+ * Only available on Linux with the tls module and for AES-GCM or ChaCha20-Poly1305 ciphers
+ * in TLS 1.2/1.3. On other systems and cipher suites error::NotSupported is returned and
+ * the socket is left untouched; it is safe to go on with GnuTLS then.
+ *
+ * This is not to be used from outside libschnee.
+ */
+struct KernelTls {
+	/// Whether the cipher suite of the session can be handled by kTLS
+	static bool supported (gnutls_session_t session);
+
+	/// Installs the write keys and sequence number of session in the socket fd
+	static Error enableTx (int fd, gnutls_session_t session);
+};
+
+}
+
+/// @endcond DEV
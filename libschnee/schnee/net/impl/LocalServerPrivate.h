@@ -0,0 +1,134 @@
+#pragma once
+
+///@cond DEV
+
+#include "../LocalServer.h"
+#include "IOBase.h"
+#include "LocalSocketPrivate.h"
+#include "IOService.h"
+#include <schnee/tools/Log.h>
+
+#include <deque>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sf {
+
+struct LocalServerPrivate : public IOBase {
+	VoidDelegate mNewConnectionDelegate;
+	int mMaxPendingConnections;
+	LocalProtocol::acceptor * mAcceptor;
+	String mPath;
+
+	std::deque<LocalSocketPrivate *> mPendingConnections;
+	LocalSocketPrivate * mNextSocket;
+
+	LocalServerPrivate () : IOBase (IOService::service()) {
+		mMaxPendingConnections = 30;
+		mAcceptor   = 0;
+		mNextSocket = 0;
+	}
+
+protected:
+	virtual void onDeleteItSelf () {
+		mNewConnectionDelegate.clear();
+		close ();
+		IOBase::onDeleteItSelf ();
+	}
+public:
+
+	void close () {
+		if (!mAcceptor) return;
+		boost::system::error_code ec;
+		mAcceptor->close (ec);
+		delete mAcceptor;
+		mAcceptor = 0;
+		// mNextSocket is deleted by the aborted accept handler
+		mNextSocket = 0;
+		for (std::deque<LocalSocketPrivate*>::iterator i = mPendingConnections.begin(); i != mPendingConnections.end(); i++) {
+			(*i)->requestDelete ();
+		}
+		mPendingConnections.clear ();
+		::unlink (mPath.c_str());
+		mPath.clear ();
+	}
+
+	Error listen (const String & path) {
+		if (mAcceptor) close ();
+		if (isAlive (path)) {
+			Log (LogWarning) << LOGID << "Someone is already listening on " << path << std::endl;
+			return error::ExistsAlready;
+		}
+		::unlink (path.c_str()); // stale
+		mode_t oldMask = ::umask (S_IRWXG | S_IRWXO);
+		try {
+			mAcceptor = new LocalProtocol::acceptor (mService, LocalProtocol::endpoint (path));
+		} catch (boost::system::system_error & err) {
+			::umask (oldMask);
+			Log (LogWarning) << LOGID << "Could not listen on " << path << ": " << err.what() << std::endl;
+			return error::ServerError;
+		}
+		::umask (oldMask);
+		mPath = path;
+		Log (LogInfo) << LOGID << "Start listening on " << path << std::endl;
+		startAccept ();
+		return NoError;
+	}
+
+	bool isListening () const {
+		return mAcceptor != 0 && mAcceptor->is_open();
+	}
+
+	shared_ptr<LocalSocket> nextPendingConnection () {
+		shared_ptr<LocalSocket> s;
+		if (mPendingConnections.empty()) return s;
+		LocalSocketPrivate * impl = mPendingConnections.front();
+		mPendingConnections.pop_front();
+		impl->startAsyncReading ();
+		s = shared_ptr<LocalSocket> (new LocalSocket (impl));
+		if (mAcceptor && !mNextSocket) startAccept ();
+		return s;
+	}
+
+private:
+	/// Checks whether somebody listens on path
+	bool isAlive (const String & path) {
+		LocalProtocol::socket probe (mService);
+		boost::system::error_code ec;
+		probe.connect (LocalProtocol::endpoint (path), ec);
+		if (ec) return false;
+		probe.close (ec);
+		return true;
+	}
+
+	void startAccept () {
+		assert (mAcceptor);
+		if (!mAcceptor->is_open()) return;
+		if (mPendingConnections.size () >= (size_t) mMaxPendingConnections) return;
+		mNextSocket = new LocalSocketPrivate (mService);
+		mPendingOperations++;
+		mAcceptor->async_accept (mNextSocket->mSocket, abind (memFun (this, &LocalServerPrivate::acceptHandler), mNextSocket));
+	}
+
+	void acceptHandler (const boost::system::error_code & error, LocalSocketPrivate * socket) {
+		SF_SCHNEE_LOCK;
+		mPendingOperations--;
+		if (error || !mAcceptor || socket != mNextSocket) {
+			if (error && error != boost::asio::error::operation_aborted) {
+				Log (LogError) << LOGID << "There was an error waiting for an accept " << error.message() << std::endl;
+			}
+			socket->requestDelete ();
+			if (socket == mNextSocket) mNextSocket = 0;
+			return;
+		}
+		mNextSocket = 0;
+		socket->mConnected = true;
+		mPendingConnections.push_back (socket);
+		notify (mNewConnectionDelegate);
+		if (mAcceptor) startAccept ();
+	}
+};
+
+}
+
+///@endcond DEV
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <schnee/tools/Log.h>
+#include <schnee/tools/async/MemFun.h>
+#include <schnee/tools/async/ABind.h>
+#include <schnee/tools/async/Notify.h>
+#include <schnee/tools/async/DelegateBase.h>
+#include <schnee/sftypes.h>
+#include <schnee/schnee.h>
+#include "IOService.h"
+#include "BufferedReader.h"
+#include "../Channel.h"
+
+#include <deque>
+
+/// @cond DEV
+
+namespace sf {
+
+typedef boost::asio::local::stream_protocol LocalProtocol;
+
+/**
+ * Private code of LocalSocket, a Unix domain stream socket.
+ * Compared to TCPSocketPrivate there is no resolving and no connect timeout, as a local
+ * connect either succeeds or fails immediately.
+ */
+struct LocalSocketPrivate : public BufferedReader {
+	LocalSocketPrivate (boost::asio::io_service & service) :
+		BufferedReader (service),
+		mSocket (service),
+		mConnected (false),
+		mConnecting (false),
+		mAuthenticated (false),
+		mPendingOutputBuffer (0),
+		mAsyncWriting (false)
+	{
+		// there is no network in between, reading larger pieces saves syscalls
+		delete [] mInputTransferBuffer;
+		mInputTransferBufferSize = 65536;
+		mInputTransferBuffer = new char [mInputTransferBufferSize];
+	}
+
+protected:
+	virtual ~LocalSocketPrivate () {}
+
+	virtual void onDeleteItSelf () {
+		boost::system::error_code ec;
+		mSocket.cancel (ec);
+		mSocket.close (ec);
+		mDisconnectedDelegate.clear ();
+		BufferedReader::onDeleteItSelf ();
+	}
+public:
+
+	LocalProtocol::socket mSocket;
+	bool mConnected;
+	bool mConnecting;
+	bool mAuthenticated;	// peer was checked by the owner (reported by info)
+	String mPath;			// path connected to (empty for accepted sockets)
+
+	VoidDelegate mDisconnectedDelegate;
+	ResultCallback mConnectResultCallback;
+
+	size_t mPendingOutputBuffer;
+
+	/// Output buffer for async writing
+	struct OutputElement {
+		OutputElement (const ByteArrayPtr & _data, const ResultCallback & _callback)
+			: data (_data), offset (0), callback (_callback) {}
+		ByteArrayPtr data;
+		size_t offset;	///< Already written bytes
+		ResultCallback callback;
+	};
+	std::deque<OutputElement> mOutputBuffer;
+	bool mAsyncWriting;
+
+	Channel::State state () const {
+		if (mConnected)  return Channel::Connected;
+		if (mConnecting) return Channel::Connecting;
+		return Channel::Unconnected;
+	}
+
+	// Implementation of BufferedReader::asyncRead
+	virtual void asyncRead (const boost::asio::mutable_buffers_1 & buffer, const ReadHandler & handler) {
+		assert (IOService::isCurrentThreadService (mService));
+		mPendingOperations++;
+		mAsyncReading = true;
+		if (mSocket.is_open()) {
+			mSocket.async_read_some (buffer, handler);
+		} else {
+			mService.post (abind (handler, boost::asio::error::operation_aborted, 0));
+		}
+	}
+
+	// Implementation of BufferedReader::stopAsyncRead
+	virtual void stopAsyncRead () {
+		assert (IOService::isCurrentThreadService (mService));
+		if (mSocket.is_open()) {
+			boost::system::error_code ec;
+			mSocket.cancel (ec);
+		}
+	}
+
+	Error connectToPath (const String & path, const ResultCallback & callback) {
+		mError = NoError;
+		if (mConnecting || mConnected) return error::WrongState;
+		mConnectResultCallback = callback;
+		mPath = path;
+		mConnecting = true;
+		mPendingOperations++;
+		mSocket.async_connect (LocalProtocol::endpoint (path), memFun (this, &LocalSocketPrivate::connectHandler));
+		return NoError;
+	}
+
+	void connectHandler (const boost::system::error_code & ec) {
+		SF_SCHNEE_LOCK;
+		mPendingOperations--;
+		mConnecting = false;
+		if (ec) {
+			Log (LogInfo) << LOGID << "Could not connect " << mPath << ": " << ec.message() << std::endl;
+			setError (error::CouldNotConnectHost, ec.message());
+			boost::system::error_code ec2;
+			mSocket.close (ec2);
+			notifyCallback (&mConnectResultCallback, error::CouldNotConnectHost);
+		} else {
+			mConnected = true;
+			checkAndContinueReading ();
+			notifyCallback (&mConnectResultCallback, NoError);
+		}
+		notify (mChangedDelegate);
+	}
+
+	bool isConnected () const {
+		return mConnected;
+	}
+
+	void disconnectFromHost () {
+		bool wasOpen = mConnected;
+		mConnected = false;
+		boost::system::error_code ec;
+		mSocket.close (ec);
+		if (wasOpen && mDisconnectedDelegate) {
+			mPendingOperations++;
+			mService.post (memFun (this, &LocalSocketPrivate::callDisconnectedDelegate));
+		}
+	}
+
+	void callDisconnectedDelegate () {
+		SF_SCHNEE_LOCK;
+		notify (mDisconnectedDelegate);
+		notify (mChangedDelegate);
+		mPendingOperations--;
+	}
+
+	virtual void close (const ResultCallback & callback) {
+		disconnectFromHost ();
+		notifyAsync (callback, NoError);
+	}
+
+	Error peerUserId (int * uid) const {
+		if (!mSocket.is_open()) return error::NotInitialized;
+		int fd = const_cast<LocalProtocol::socket&> (mSocket).native_handle();
+#if defined (SO_PEERCRED)
+		struct ucred cred;
+		socklen_t len = sizeof (cred);
+		if (::getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return error::Other;
+		*uid = (int) cred.uid;
+#else
+		uid_t euid;
+		gid_t egid;
+		if (::getpeereid (fd, &euid, &egid) != 0) return error::Other;
+		*uid = (int) euid;
+#endif
+		return NoError;
+	}
+
+	Channel::ChannelInfo info () const {
+		Channel::ChannelInfo result;
+		result.toNeighbor    = true;
+		result.authenticated = mAuthenticated;
+		boost::system::error_code ec;
+		LocalProtocol::endpoint le = mSocket.local_endpoint (ec);
+		if (!ec) result.laddress = le.path();
+		LocalProtocol::endpoint re = mSocket.remote_endpoint (ec);
+		if (!ec) result.raddress = re.path();
+		return result;
+	}
+
+	Error write (const ByteArrayPtr & data, const ResultCallback & callback) {
+		if (!data) {
+			Log (LogError) << LOGID << "Invalid data" << std::endl;
+			return error::InvalidArgument;
+		}
+		if (!mConnected) return error::ConnectionError;
+		mPendingOutputBuffer += data->size();
+		mOutputBuffer.push_back (OutputElement (data, callback));
+		if (!mAsyncWriting)
+			continueWriting ();
+		return NoError;
+	}
+
+	void continueWriting () {
+		if (mOutputBuffer.empty()) {
+			mAsyncWriting = false;
+			return;
+		}
+		// gathering all pending elements, so that small writes do not need one syscall each
+		std::vector<boost::asio::const_buffer> buffers;
+		for (std::deque<OutputElement>::const_iterator i = mOutputBuffer.begin(); i != mOutputBuffer.end() && buffers.size() < 64; i++) {
+			buffers.push_back (boost::asio::buffer (i->data->const_c_array() + i->offset, i->data->size() - i->offset));
+		}
+		mPendingOperations++;
+		mAsyncWriting = true;
+		boost::asio::async_write (mSocket, buffers, memFun (this, &LocalSocketPrivate::writeHandler));
+	}
+
+	void writeHandler (const boost::system::error_code & werror, std::size_t bytesTransferred) {
+		SF_SCHNEE_LOCK;
+		mAsyncWriting = false;
+		std::vector<ResultCallback> callbacks;
+		mPendingOutputBuffer -= bytesTransferred;
+		while (!mOutputBuffer.empty()) {
+			OutputElement & elem = mOutputBuffer.front();
+			size_t left = elem.data->size() - elem.offset;
+			if (bytesTransferred < left) {
+				elem.offset += bytesTransferred;
+				break;
+			}
+			bytesTransferred -= left;
+			if (elem.callback) callbacks.push_back (elem.callback);
+			mOutputBuffer.pop_front ();
+		}
+		if (werror) {
+			Log (LogInfo) << LOGID << "There was an error during writing " << werror.message() << std::endl;
+			setError (error::WriteError, werror.message());
+		} else {
+			continueWriting ();
+		}
+		for (std::vector<ResultCallback>::iterator i = callbacks.begin(); i != callbacks.end(); i++) {
+			(*i) (NoError);
+		}
+		mPendingOperations--;
+	}
+};
+
+}
+
+/// @endcond DEV
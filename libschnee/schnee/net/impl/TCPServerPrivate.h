@@ -143,7 +143,7 @@ private:
 			return;
 		}
 
-		mNextSocket = new TCPSocketPrivateImpl (mService);
+		mNextSocket = TCPSocketPrivateImpl::create (mService);
 		mPendingAcception = true;
 		mPendingOperations++;
 		mAcceptor->async_accept(mNextSocket->mSocketImpl, boost::bind (&TCPServerPrivate::acceptHandler, this, _1));
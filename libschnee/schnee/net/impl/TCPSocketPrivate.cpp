@@ -1,5 +1,13 @@
 #include "TCPSocketPrivate.h"
+#include "UringTCPSocketPrivate.h"
 
 namespace sf{
 
+TCPSocketPrivateImpl * TCPSocketPrivateImpl::create (boost::asio::io_service & service) {
+	if (IOUring::hasInstance() && IOUring::instance().available()) {
+		return new UringTCPSocketPrivate (service);
+	}
+	return new TCPSocketPrivateImpl (service);
+}
+
 }
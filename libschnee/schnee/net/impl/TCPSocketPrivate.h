@@ -13,6 +13,9 @@
 #include "BufferedReader.h"
 #include "../Channel.h"
 
+#include <set>
+#include <algorithm>
+
 using boost::asio::ip::tcp;
 
 /// @cond DEV
@@ -22,6 +25,8 @@ namespace sf {
 typedef boost::asio::deadline_timer DeadlineTimer;
 typedef shared_ptr<DeadlineTimer> DeadlineTimerPtr;
 
+/// Default delay between two parallel connection attempts (RFC 8305 "Connection Attempt Delay")
+static const int gConnectAttemptDelayMs = 250;
 
 
 /**
@@ -40,12 +45,16 @@ struct TCPSocketPrivate : public BufferedReader {
 		mSocket (_socket),
 		mConnected(false),
 		mConnecting(false),
+		mToNeighbor (false),
 		mWaitForTimer (false),
 		mWaitForResolve (false),
 		mWaitForConnect (false),
 		mWaitForWrite (false),
 		mBytesTransferred (0),
 		mResolver (ioService),
+		mResolving (0),
+		mAttemptTimerPending (false),
+		mConnectAttemptDelayMs (gConnectAttemptDelayMs),
 		mAsyncWriting (false)
 	{ 
 		mPendingOutputBuffer = 0;
@@ -58,6 +67,10 @@ protected:
 
 	virtual void onDeleteItSelf () {
 		boost::system::error_code ec; // we do not want any exceptions here..
+		cancelBackendOperations ();
+		closeAttempts ();
+		if (mTimer) mTimer->cancel (ec);
+		mConnectResultCallback.clear ();
 		mSocket.cancel (ec);
 		mResolver.cancel();
 		mSocket.close(ec);
@@ -70,6 +83,7 @@ public:
 	tcp::socket & mSocket;
 	bool mConnected;		// is something different than being open
 	bool mConnecting;		// there is already a connection attempt
+	bool mToNeighbor;		// connection goes to a neighbor (reported by info)
 	// debug fields
 	bool mWaitForTimer;		// waiting for a timer
 	bool mWaitForResolve;	// wait for a resolving handler
@@ -83,9 +97,24 @@ public:
 	tcp::resolver mResolver;
 	
 	DeadlineTimerPtr mTimer;
-	
-	/// After resolving, next_endpoint holds the next possible endpoint (or no more possible)
-	tcp::resolver::iterator mNextEndpoint;
+
+	/// A single connection attempt while connecting, the winning socket is moved into mSocket
+	struct ConnectAttempt {
+		ConnectAttempt (boost::asio::io_service & service, const tcp::endpoint & _endpoint) : socket (service), endpoint (_endpoint) {}
+		tcp::socket   socket;
+		tcp::endpoint endpoint;
+	};
+	typedef shared_ptr<ConnectAttempt> ConnectAttemptPtr;
+
+	int mResolving;								///< Outstanding resolve operations
+	std::deque<tcp::endpoint> mEndpoints;		///< Resolved endpoints not tried yet
+	std::set<tcp::endpoint>   mKnownEndpoints;	///< All endpoints of the current connect (for removing duplicates)
+	std::vector<ConnectAttemptPtr> mAttempts;	///< Running connection attempts
+	DeadlineTimerPtr mAttemptTimer;				///< Starts the next attempt if the running ones take too long
+	bool mAttemptTimerPending;					///< mAttemptTimer is waiting
+	Time mLastAttemptStart;						///< Start of the last attempt
+	int mConnectAttemptDelayMs;					///< Delay between starting two attempts
+	boost::system::error_code mLastConnectError;
 	
 	/// The Delegate for being disconnected
 	VoidDelegate mDisconnectedDelegate;
@@ -98,8 +127,9 @@ public:
 	struct OutputElement {
 		OutputElement ();
 		OutputElement (const ByteArrayPtr & _data, const ResultCallback & _callback)
-			: data (_data), callback (_callback) {};
+			: data (_data), offset (0), callback (_callback) {};
 		ByteArrayPtr data;
+		size_t offset;	///< Already written bytes (data may be shared with other sockets, so it is not changed)
 		ResultCallback callback;
 	};
 	std::deque<OutputElement> mOutputBuffer;
@@ -137,29 +167,44 @@ public:
 	}
 
 	Error connectToHost(const String & host, int port, int timeOut, const ResultCallback & resultCallback){
+		return connectToHosts (std::vector<String> (1, host), port, timeOut, resultCallback);
+	}
+
+	/// Connects to the first reachable endpoint of all hosts (RFC 8305 "Happy Eyeballs").
+	/// All hosts are resolved at once, the endpoints are tried alternating between address
+	/// families. A new attempt is started each mConnectAttemptDelayMs (or as soon as one fails)
+	/// while the older ones keep running; the first established connection wins.
+	Error connectToHosts (const std::vector<String> & hosts, int port, int timeOut, const ResultCallback & resultCallback){
 		mError = NoError;
 		if (mConnecting) {
 			Log (LogError) << LOGID << "BAD! Already connecting..." << std::endl;
 			return error::WrongState;
 		}
+		if (hosts.empty()) return error::InvalidArgument;
 		mConnectResultCallback = resultCallback;
+		mEndpoints.clear ();
+		mKnownEndpoints.clear ();
+		mLastConnectError = boost::asio::error::host_not_found;
 
 		std::string ports;
 		{	// port conversion (to string)
 			std::ostringstream s; s << port;
 			ports = s.str();
 		}
-		tcp::resolver::query query (host, ports);
 
 		mTimer = DeadlineTimerPtr (new DeadlineTimer (mService, sf::regTimeOutMs (timeOut)));
+		mAttemptTimer = DeadlineTimerPtr (new DeadlineTimer (mService));
 
-		Log (LogInfo) << LOGID << "Start resolving... " << host.c_str() << std::endl;
-		mPendingOperations++;
-		mWaitForResolve = true;
 		mConnecting = true;
-		mResolver.async_resolve (query,
-				memFun (this,
-						&TCPSocketPrivate::resolveHandler));
+		for (std::vector<String>::const_iterator i = hosts.begin(); i != hosts.end(); i++) {
+			Log (LogInfo) << LOGID << "Start resolving... " << i->c_str() << std::endl;
+			mPendingOperations++;
+			mResolving++;
+			mWaitForResolve = true;
+			mResolver.async_resolve (tcp::resolver::query (*i, ports),
+					memFun (this,
+							&TCPSocketPrivate::resolveHandler));
+		}
 		mPendingOperations++;
 		mWaitForTimer = true;
 		mTimer->async_wait (memFun (this, &TCPSocketPrivate::timerHandler));
@@ -170,14 +215,27 @@ public:
 	void resolveHandler (const boost::system::error_code& error, tcp::resolver::iterator i){
 		SF_SCHNEE_LOCK
 		mPendingOperations--;
-		mWaitForResolve = false;
+		mResolving--;
+		mWaitForResolve = mResolving > 0;
+		if (!mConnecting) return; // timed out or closed meanwhile
 		Log (LogInfo) << LOGID << "Resolve returned " << error.message().c_str() << std::endl;
+		if (error) mLastConnectError = error;
 		for (tcp::resolver::iterator j = i; j != tcp::resolver::iterator (); j++){
 			Log (LogInfo) << "    " << " Endpoint: " << j->host_name () << ":" << j->service_name () << " <--> " << j->endpoint().address().to_string() << std::endl;
+			if (mKnownEndpoints.insert (j->endpoint()).second) {
+				mEndpoints.push_back (j->endpoint());
+			}
+		}
+		interleaveEndpoints ();
+		if (mAttempts.empty()) {
+			// nothing running yet (or anymore), no reason to wait
+			startNextAttempt ();
+		} else if (!mAttemptTimerPending && !mEndpoints.empty()) {
+			// the attempt timer found nothing to start before, keep staggering from the last attempt
+			int delayMs = mConnectAttemptDelayMs - (int) (currentTime () - mLastAttemptStart).total_milliseconds();
+			if (delayMs <= 0) startNextAttempt ();
+			else armAttemptTimer (delayMs);
 		}
-		// connectNextEndpoint will fail for itself if there was an error
-		mNextEndpoint = i;
-		connectNextEndpoint (boost::asio::error::host_not_found);
 	}
 
 	void timerHandler (const boost::system::error_code& error) {
@@ -188,6 +246,8 @@ public:
 			Log (LogInfo) << LOGID << "Received time out" << std::endl;
 			setError (error::TimeOut, "timed out");
 			{
+				cancelBackendOperations ();
+				closeAttempts ();
 				mSocket.close();
 				mConnected = false;
 			}
@@ -198,25 +258,83 @@ public:
 		}
 	}
 
-	/// Connect the next available endpoint, if no endpoint there, cancel the timer and set error
-	void connectNextEndpoint (const boost::system::error_code & lastError) {
-		tcp::resolver::iterator end;
-		if (mNextEndpoint == end){
-			setError (error::CouldNotConnectHost, lastError.message());
-			mTimer->cancel();
-			Log (LogInfo) << LOGID << "Canceling timer, there are no next ones" << std::endl;
-			mPendingOperations++;
-			mConnecting = false;
-			mService.post (memFun (this, &TCPSocketPrivate::connectFailedHandler));
+	/// Reorders the pending endpoints, so that address families alternate (starting with the first one)
+	void interleaveEndpoints () {
+		if (mEndpoints.empty()) return;
+		bool firstV6 = mEndpoints.front().address().is_v6();
+		std::deque<tcp::endpoint> first, second;
+		for (std::deque<tcp::endpoint>::const_iterator i = mEndpoints.begin(); i != mEndpoints.end(); i++) {
+			if (i->address().is_v6() == firstV6) first.push_back (*i);
+			else second.push_back (*i);
+		}
+		mEndpoints.clear ();
+		while (!first.empty() || !second.empty()) {
+			if (!first.empty())  { mEndpoints.push_back (first.front());  first.pop_front(); }
+			if (!second.empty()) { mEndpoints.push_back (second.front()); second.pop_front(); }
+		}
+	}
+
+	/// Starts an attempt to the next endpoint; fails if there is nothing left to try
+	void startNextAttempt () {
+		if (mEndpoints.empty()) {
+			if (mAttempts.empty() && mResolving == 0) {
+				Log (LogInfo) << LOGID << "Canceling timer, there are no next ones" << std::endl;
+				failConnecting (mLastConnectError.message());
+			}
 			return;
 		}
-		mConnected = false;
-		mSocket.close();
-		Log (LogInfo) << LOGID << "Starting connect..." << mNextEndpoint->endpoint().address().to_string() << std::endl;
+		ConnectAttemptPtr attempt (new ConnectAttempt (mService, mEndpoints.front()));
+		mEndpoints.pop_front ();
+		mAttempts.push_back (attempt);
+		Log (LogInfo) << LOGID << "Starting connect..." << attempt->endpoint.address().to_string() << std::endl;
 		mPendingOperations++;
 		mWaitForConnect = true;
-		mSocket.async_connect (*mNextEndpoint, memFun (this,
-				&TCPSocketPrivate::connectResultHandler));
+		mLastAttemptStart = currentTime ();
+		attempt->socket.async_connect (attempt->endpoint, abind (memFun (this,
+				&TCPSocketPrivate::connectResultHandler), attempt));
+		if (!mEndpoints.empty() || mResolving > 0) {
+			armAttemptTimer (mConnectAttemptDelayMs);
+		}
+	}
+
+	/// Starts the next attempt after delayMs (restarting the timer aborts a still waiting one)
+	void armAttemptTimer (int delayMs) {
+		mAttemptTimer->expires_from_now (boost::posix_time::milliseconds (delayMs));
+		mPendingOperations++;
+		mAttemptTimerPending = true;
+		mAttemptTimer->async_wait (memFun (this, &TCPSocketPrivate::attemptTimerHandler));
+	}
+
+	void attemptTimerHandler (const boost::system::error_code & error) {
+		SF_SCHNEE_LOCK
+		mPendingOperations--;
+		if (error == boost::asio::error::operation_aborted || !mConnecting) return;
+		mAttemptTimerPending = false;
+		startNextAttempt ();
+	}
+
+	/// Closes all running attempts, their handlers will find nothing to do anymore
+	void closeAttempts () {
+		boost::system::error_code ec;
+		for (std::vector<ConnectAttemptPtr>::iterator i = mAttempts.begin(); i != mAttempts.end(); i++) {
+			(*i)->socket.close (ec);
+		}
+		mAttempts.clear ();
+		mEndpoints.clear ();
+		mWaitForConnect = false;
+		mAttemptTimerPending = false;
+		if (mAttemptTimer) mAttemptTimer->cancel (ec);
+	}
+
+	/// Stops connecting and informs about the failure (asynchronous)
+	void failConnecting (const String & message) {
+		setError (error::CouldNotConnectHost, message);
+		boost::system::error_code ec;
+		mTimer->cancel (ec);
+		closeAttempts ();
+		mConnecting = false;
+		mPendingOperations++;
+		mService.post (memFun (this, &TCPSocketPrivate::connectFailedHandler));
 	}
 
 	void connectFailedHandler () {
@@ -226,29 +344,36 @@ public:
 		mPendingOperations--;
 	}
 
-	void connectResultHandler (const boost::system::error_code& cerror) {
+	void connectResultHandler (const boost::system::error_code& cerror, const ConnectAttemptPtr & attempt) {
 		SF_SCHNEE_LOCK;
-		bool informDelegate = false;
-		mWaitForConnect = false;
 		mPendingOperations--;
-		if (!cerror){
-			// we have it
-			Log (LogInfo) << LOGID << "Connection established" << std::endl;
-			informDelegate = true;
-			mPendingOutputBuffer = 0;
-			mOutputBuffer.clear();
-			mTimer->cancel ();
-			mConnecting = false;
-			mConnected  = true;
-			checkAndContinueReading ();
-		} else {
-			mNextEndpoint++;
-			connectNextEndpoint (cerror);
+		std::vector<ConnectAttemptPtr>::iterator i = std::find (mAttempts.begin(), mAttempts.end(), attempt);
+		if (i == mAttempts.end()) return; // canceled, another one was faster
+		mAttempts.erase (i);
+		mWaitForConnect = !mAttempts.empty();
+		boost::system::error_code ec = cerror;
+		if (!ec) {
+			// the winner becomes our socket
+			mSocket.close ();
+			tcp::socket::native_handle_type handle = attempt->socket.release (ec);
+			if (!ec) mSocket.assign (attempt->endpoint.protocol(), handle, ec);
 		}
-		if (informDelegate){
-			notifyCallback (&mConnectResultCallback, NoError);
-			notify (mChangedDelegate);
+		if (ec) {
+			Log (LogInfo) << LOGID << "Could not connect " << attempt->endpoint.address().to_string() << ": " << ec.message() << std::endl;
+			mLastConnectError = ec;
+			startNextAttempt ();
+			return;
 		}
+		Log (LogInfo) << LOGID << "Connection established to " << attempt->endpoint.address().to_string() << std::endl;
+		closeAttempts ();
+		mPendingOutputBuffer = 0;
+		mOutputBuffer.clear();
+		mTimer->cancel ();
+		mConnecting = false;
+		mConnected  = true;
+		checkAndContinueReading ();
+		notifyCallback (&mConnectResultCallback, NoError);
+		notify (mChangedDelegate);
 	}
 
 	bool isConnected() const {
@@ -258,6 +383,8 @@ public:
 	void disconnectFromHost (){
 		bool wasOpen = isConnected ();
 		mConnected = false;
+		if (mConnecting) failConnecting ("disconnected");
+		cancelBackendOperations ();
 		mSocket.close ();
 		if (wasOpen && mDisconnectedDelegate) {
 			mPendingOperations++;
@@ -278,6 +405,7 @@ public:
 
 	Channel::ChannelInfo info () const {
 		Channel::ChannelInfo result;
+		result.toNeighbor = mToNeighbor;
 		boost::system::error_code ec;
 		tcp::endpoint le = mSocket.local_endpoint(ec);
 		if (!ec) {
@@ -323,6 +451,9 @@ public:
 		return NoError;
 	}
 
+	/// Cancels reading/writing operations not done by asio, before the socket gets closed
+	virtual void cancelBackendOperations () {}
+
 	virtual void continueWriting () {
 		if (mPendingOutputBuffer == 0) {
 			mAsyncWriting = false;
@@ -332,7 +463,7 @@ public:
 		mPendingOperations++;
 		mWaitForWrite = true;
 		mAsyncWriting = true;
-		boost::asio::async_write (mSocket, boost::asio::buffer (*elem.data),
+		boost::asio::async_write (mSocket, boost::asio::buffer (elem.data->const_c_array() + elem.offset, elem.data->size() - elem.offset),
 				memFun (this, &TCPSocketPrivate::writeHandler));
 	}
 
@@ -350,9 +481,9 @@ public:
 			ByteArrayPtr & data = elem.data;
 			mPendingOutputBuffer -= bytesTransferred;
 			mBytesTransferred    += bytesTransferred;
-			assert (bytesTransferred <= data->size());
-			if (bytesTransferred != data->size()){
-				data->l_truncate (bytesTransferred);
+			assert (elem.offset + bytesTransferred <= data->size());
+			if (elem.offset + bytesTransferred != data->size()){
+				elem.offset += bytesTransferred;
 			} else {
 				if (elem.callback){
 					callback = elem.callback;
@@ -385,6 +516,9 @@ struct TCPSocketPrivateImpl : public TCPSocketPrivate {
 	TCPSocketPrivateImpl (boost::asio::io_service & service) :
 		TCPSocketPrivate (mSocketImpl, service),
 		mSocketImpl (service) {}
+
+	/// Creates a socket using the io_uring backend if it is running, the asio one otherwise
+	static TCPSocketPrivateImpl * create (boost::asio::io_service & service);
 	
 	tcp::socket mSocketImpl;
 };
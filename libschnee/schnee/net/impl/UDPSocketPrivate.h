@@ -97,6 +97,37 @@ public:
 		return NoError;
 	}
 
+	Error bindMulticast (const String & group, int port, const String & interfaceAddress) {
+		error_code ec;
+		ip::address groupAddress = ip::address::from_string (group, ec);
+		if (ec || !groupAddress.is_v4() || !groupAddress.is_multicast()) return error::InvalidArgument;
+		ip::address_v4 interface;
+		if (!interfaceAddress.empty()) {
+			interface = ip::address_v4::from_string (interfaceAddress, ec);
+			if (ec) return error::InvalidArgument;
+		}
+		if (!mSocket.is_open()){
+			mSocket.open(udp::v4(), ec);
+		}
+		if (ec) {
+			Log (LogWarning) << LOGID << "Could not open socket: " << ec.message () << std::endl;
+			return error::ConnectionError;
+		}
+		mSocket.set_option (udp::socket::reuse_address (true), ec);
+		if (!ec) mSocket.bind (udp::endpoint (ip::address_v4::any(), port), ec);
+		if (ec == boost::asio::error::address_in_use) return error::ExistsAlready;
+		if (!ec) mSocket.set_option (ip::multicast::join_group (groupAddress.to_v4(), interface), ec);
+		if (!ec && !interfaceAddress.empty()) mSocket.set_option (ip::multicast::outbound_interface (interface), ec);
+		if (!ec) mSocket.set_option (ip::multicast::enable_loopback (true), ec);
+		if (!ec) mSocket.set_option (ip::multicast::hops (1), ec);
+		if (ec) {
+			Log (LogInfo) << LOGID << "Could not join multicast group " << group << ": " << ec.message() << std::endl;
+			return error::Other;
+		}
+		startAsyncReading ();
+		return NoError;
+	}
+
 	Error close () {
 		error_code ec;
 		mSocket.close(ec);
@@ -137,8 +168,8 @@ public:
 		Log (LogInfo) << LOGID << "Sent " << bytes_transferred << " bytes" << std::endl;
 		mPendingOperations--;
 		mWriting = false;
+		if (!ec && mOutputBuffer.empty()) return; // closed while sending
 		if (!ec) {
-			assert (!mOutputBuffer.empty());
 			assert (bytes_transferred == mOutputBuffer.front().size());
 			mOutputBuffer.pop_front();
 			mOutputBufferSize-= bytes_transferred;
@@ -0,0 +1,99 @@
+#include "UDTCongestion.h"
+#include <udt4/src/common.h>
+#include <algorithm>
+
+namespace sf {
+
+const int BackgroundCC::gTargetDelay = 100000; // 100ms, the maximum of RFC 6817
+
+/// Period of base RTT history in microseconds, so that route changes are recognized
+static const uint64_t gBasePeriod = 60 * 1000000;
+/// Minimum window in packets; UDT acknowledges only every 10ms (SYN interval) or 64 packets,
+/// so windows smaller than UDT's initial one would stall
+static const double gMinWindow = 16.0;
+/// UDT's ACK interval (SYN) in microseconds
+static const int gAckInterval = 10000;
+/// Maximum window growth per RTT in packets
+static const double gMaxIncrease = 1.0;
+
+BackgroundCC::BackgroundCC () {
+	mLastAck     = 0;
+	mSlowStart   = true;
+	mBaseRtt     = 0;
+	mLastBaseRtt = 0;
+	mBasePeriodStart = 0;
+	mLastDecSeq  = 0;
+}
+
+void BackgroundCC::init () {
+	mLastAck   = m_iSndCurrSeqNo;
+	mSlowStart = true;
+	mBaseRtt = mLastBaseRtt = 0;
+	mBasePeriodStart = CTimer::getTime ();
+	mLastDecSeq = CSeqNo::decseq (m_iSndCurrSeqNo);
+	// window based, no rate control until the RTT is known
+	m_dPktSndPeriod = 0.0;
+	m_dCWndSize     = gMinWindow;
+}
+
+void BackgroundCC::updatePacing () {
+	// spread the window over the time until it is acknowledged (RTT + ACK interval),
+	// bursts of the whole window cause losses otherwise
+	if (m_iRTT > 0) m_dPktSndPeriod = (double) (m_iRTT + gAckInterval) / m_dCWndSize;
+}
+
+int BackgroundCC::updateBaseRtt (int rtt) {
+	uint64_t now = CTimer::getTime ();
+	if (now - mBasePeriodStart > gBasePeriod) {
+		mLastBaseRtt = mBaseRtt;
+		mBaseRtt = 0;
+		mBasePeriodStart = now;
+	}
+	if (mBaseRtt == 0 || rtt < mBaseRtt) mBaseRtt = rtt;
+	if (mLastBaseRtt == 0) return mBaseRtt;
+	return std::min (mBaseRtt, mLastBaseRtt);
+}
+
+void BackgroundCC::onACK (const int32_t & ack) {
+	int acked = CSeqNo::seqoff (mLastAck, ack);
+	if (acked <= 0) return;
+	mLastAck = ack;
+	if (m_iRTT <= 0) return;
+
+	int queuingDelay = m_iRTT - updateBaseRtt (m_iRTT);
+	double offTarget = (double) (gTargetDelay - queuingDelay) / gTargetDelay;
+
+	if (mSlowStart) {
+		if (queuingDelay > gTargetDelay / 2) {
+			mSlowStart = false;
+		} else {
+			m_dCWndSize += acked;
+		}
+	}
+	if (!mSlowStart) {
+		// RFC 6817: cwnd += GAIN * off_target * bytes_newly_acked * MSS / cwnd
+		m_dCWndSize += std::min (offTarget, 1.0) * gMaxIncrease * acked / m_dCWndSize;
+	}
+	m_dCWndSize = std::max (gMinWindow, std::min (m_dCWndSize, m_dMaxCWndSize));
+	updatePacing ();
+}
+
+void BackgroundCC::onLoss (const int32_t * losses, const int & size) {
+	if (size <= 0) return;
+	mSlowStart = false;
+	// UDT reports each loss list; only decrease once per window (like CUDTCC)
+	int32_t lossSeq = losses[0] & 0x7FFFFFFF;
+	if (CSeqNo::seqcmp (lossSeq, mLastDecSeq) <= 0) return;
+	mLastDecSeq = m_iSndCurrSeqNo;
+	m_dCWndSize = std::max (gMinWindow, m_dCWndSize / 2);
+	updatePacing ();
+}
+
+void BackgroundCC::onTimeout () {
+	mSlowStart  = false;
+	mLastDecSeq = m_iSndCurrSeqNo;
+	m_dCWndSize = gMinWindow;
+	updatePacing ();
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <udt4/src/udt.h>
+#include <udt4/src/ccc.h>
+
+namespace sf {
+
+/// @cond DEV
+
+/**
+ * LEDBAT-style (RFC 6817) background congestion control for UDT.
+ *
+ * Window based; the window grows while the queuing delay (RTT above the
+ * smallest RTT seen) is below a target and shrinks if it rises above. So bulk
+ * transfers using it yield to other traffic on the same link. Losses halve the window (once per window).
+ *
+ * UDT reports RTT, not one way delay as LEDBAT proposes; so queues on the
+ * reverse path also slow it down.
+ */
+class BackgroundCC : public CCC {
+public:
+	BackgroundCC ();
+
+	virtual void init ();
+	virtual void onACK (const int32_t & ack);
+	virtual void onLoss (const int32_t * losses, const int & size);
+	virtual void onTimeout ();
+
+	/// Target queuing delay in microseconds
+	static const int gTargetDelay;
+private:
+	/// Updates base RTT history, returns current base RTT (microseconds)
+	int updateBaseRtt (int rtt);
+	/// Sets the packet sending period from window and RTT
+	void updatePacing ();
+
+	int32_t  mLastAck;
+	bool     mSlowStart;
+	int      mBaseRtt;		///< Smallest RTT in current period
+	int      mLastBaseRtt;	///< Smallest RTT in last period
+	uint64_t mBasePeriodStart;
+	int32_t  mLastDecSeq;	///< Sent sequence number at the last window decrease
+};
+
+/// @endcond DEV
+
+}
@@ -11,23 +11,26 @@ namespace sf {
 
 /*
  * Implementation Notice
- * We are using UDT::selectEx instead of UDT::epoll because there seems to
- * be no possibility to tell UDT to just watch out for readevents and not write
- * events on some sockets (maybe this is possible with two epoll instances).
- *
- * With always getting writeable-Events we burned a lot of CPU cycles.
- * If the program is gonna having more connections (in the moment around 1 - 50)
- * we will have to switch back, but for the moment its fast enough.
+ * We are using one UDT epoll instance with separate read and write event sets:
+ * all sockets are registered for read events, only the sockets in mWriteableWaiting
+ * for write events (our copy of UDT has been patched to respect this). So idle
+ * sockets do not generate permanent write events, the loop sleeps if nothing happens
+ * and the costs of one iteration depend on the number of ready sockets only.
  */
 
+/// Maximum time the loop waits for events; UDT wakes it up earlier on any change
+static const int gMaxWaitMs = 1000;
+
 void UDTMainLoop::add    (UDTEventReceiver * s) {
 	LockGuard guard (mMutex);
 	UDTSOCKET impl = s->impl();
 	assert (mSockets.count (impl) == 0);
 	mSockets[impl] = s;
-	
+
 	if (!mRunning)
 		start_locked ();
+	int events = UDT_EPOLL_IN | UDT_EPOLL_ERR;
+	SF_UDT_CHECK (UDT::epoll_add_usock (mPoll, impl, &events));
 }
 
 void UDTMainLoop::addWrite (UDTEventReceiver * s) {
@@ -35,7 +38,10 @@ void UDTMainLoop::addWrite (UDTEventReceiver * s) {
 	UDTSOCKET impl = s->impl();
 	assert (mSockets.count(impl) == 1);
 
-	mWriteableWaiting.insert(impl);
+	if (mWriteableWaiting.insert(impl).second) {
+		int events = UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ERR;
+		SF_UDT_CHECK (UDT::epoll_add_usock (mPoll, impl, &events));
+	}
 }
 
 
@@ -44,6 +50,7 @@ void UDTMainLoop::remove (UDTEventReceiver * s) {
 	UDTSOCKET impl = s->impl();
 	assert (mSockets.count (impl) > 0);
 	mWriteableWaiting.erase(impl);
+	UDT::epoll_remove_usock (mPoll, impl);
 	mSockets.erase (impl);
 	if (mSockets.empty()){
 		stop_locked ();
@@ -55,98 +62,114 @@ bool UDTMainLoop::isRunning () {
 	return mRunning;
 }
 
+UDTMainLoop::Statistics UDTMainLoop::statistics () {
+	LockGuard guard (mMutex);
+	return mStatistics;
+}
+
 void UDTMainLoop::start_locked () {
-	mToQuit  = false;
 	mRunning = true;
-	boost::thread t (memFun (this, &UDTMainLoop::threadEntry));
+	mPoll = UDT::epoll_create ();
+	SF_UDT_CHECK (mPoll);
+	mThreads++;
+	boost::thread t (boost::bind (&UDTMainLoop::threadEntry, this, mGeneration, mPoll));
 }
 
 void UDTMainLoop::stop_locked () {
 	if (!mRunning) return;
-	mToQuit = true;
-	while (mRunning) {
-		mCondition.wait(mMutex);
-	}
+	mRunning = false;
+	mGeneration++;
+	// lets the waiting thread return; we do not wait for it, as it may
+	// wait for the libschnee lock, which our caller is possibly holding
+	UDT::epoll_release (mPoll);
+	mPoll = -1;
 }
 
-void UDTMainLoop::threadEntry () {
+void UDTMainLoop::threadEntry (int generation, int poll) {
+	std::set<UDTSOCKET> readable;
+	std::set<UDTSOCKET> writeable;
+	std::vector<UDTSOCKET> writeDone;
 	mMutex.lock ();
-	while (!mToQuit) {
+	while (generation == mGeneration) {
+		mStatistics.wakeups++;
+		mMutex.unlock (); // UDT epoll is thread safe
 
-		typedef std::vector<UDTSOCKET> SocketVec;
-		SocketVec readableCheck; // list could be created somewhere else
-		for (SocketMap::const_iterator i = mSockets.begin(); i != mSockets.end(); i++) {
-			readableCheck.push_back(i->first);
-		}
-		SocketVec writeableCheck;
-		for (SocketSet::const_iterator i = mWriteableWaiting.begin(); i != mWriteableWaiting.end(); i++) {
-			writeableCheck.push_back(*i);
-		}
-		SocketVec readable;
-		SocketVec writeable;
-		mMutex.unlock (); // according to docu this shall be thread safe
-
-		// watch out for writeable.
-		bool fastTrack = false;
-		if (writeableCheck.size() > 0){
-			UDT::selectEx (writeableCheck, 0, &writeable, 0, 0);
-			if (writeable.size() > 0) fastTrack = true;
-		}
-		int timeOutMs = fastTrack ? 0 : 10; // if something writeable is true do not wait for readables
-		UDT::selectEx (readableCheck, &readable, 0, 0, timeOutMs);
+		readable.clear ();
+		writeable.clear ();
+		UDT::epoll_wait (poll, &readable, &writeable, gMaxWaitMs);
 
 		mMutex.lock();
-		
-		/*
-		 * TODO Clean up this DelegateRegisterLock stuff
-		 * It is necessary to not have the own mutex locked while calling out
-		 * as the UDTSockets may delete theirself or register a write event
-		 * during callback.
-		 */
-
-		// Sending signals
-		for (SocketVec::const_iterator i = readable.begin(); i != readable.end(); i++) {
-			SocketMap::iterator j = mSockets.find(*i);
-			if (j != mSockets.end()){
-				UDTEventReceiver * receiver = j->second;
-				mMutex.unlock();
-				{
-					sf::DelegateRegisterLock lock (receiver->delegateKey());
-					if (lock.suc()){
-						SF_SCHNEE_LOCK;
-						receiver->onReadable();
-					}
+		if (generation != mGeneration) break;
+
+		dispatch_locked (readable, false, 0);
+		for (std::set<UDTSOCKET>::const_iterator i = readable.begin(); i != readable.end(); i++) {
+			// broken sockets stay readable, the receiver already learned the error
+			if (UDT::recv (*i, 0, 0, 0) == UDT::ERROR) {
+				int code = UDT::getlasterror().getErrorCode();
+				if (code == UDT::ERRORINFO::ECONNLOST || code == UDT::ERRORINFO::EINVSOCK) {
+					UDT::epoll_remove_usock (poll, *i);
 				}
-				mMutex.lock();
 			}
 		}
-		for (SocketVec::const_iterator i = writeable.begin(); i != writeable.end(); i++) {
-			SocketMap::iterator j = mSockets.find(*i);
-			bool continueWriting = false;
-			if (j != mSockets.end()) {
-				UDTEventReceiver * receiver = j->second;
-				mMutex.unlock();
-				{
-					sf::DelegateRegisterLock lock (receiver->delegateKey());
-					if (lock.suc()) {
-						SF_SCHNEE_LOCK;
-						continueWriting = receiver->onWriteable();
-					}
-				}
-				mMutex.lock();
-			}
-			if (!continueWriting) {
-				mWriteableWaiting.erase(*i);
+		writeDone.clear ();
+		dispatch_locked (writeable, true, &writeDone);
+		for (std::vector<UDTSOCKET>::const_iterator i = writeDone.begin(); i != writeDone.end(); i++) {
+			if (mWriteableWaiting.erase (*i) > 0) {
+				int events = UDT_EPOLL_IN | UDT_EPOLL_ERR;
+				UDT::epoll_add_usock (poll, *i, &events);
 			}
 		}
 	}
-	mRunning = false;
+	mThreads--;
 	mMutex.unlock ();
 	mCondition.notify_all();
 }
 
+void UDTMainLoop::dispatch_locked (const std::set<UDTSOCKET> & ready, bool write, std::vector<UDTSOCKET> * writeDone) {
+	if (ready.empty()) return;
+	/*
+	 * It is necessary to not have the own mutex locked while calling out
+	 * as the UDTSockets may delete theirself or register a write event
+	 * during callback. The delegate key protects against deleted receivers.
+	 */
+	typedef std::vector<std::pair<UDTSOCKET, std::pair<UDTEventReceiver*, DelegateKey> > > ReceiverVec;
+	ReceiverVec receivers;
+	receivers.reserve (ready.size());
+	for (std::set<UDTSOCKET>::const_iterator i = ready.begin(); i != ready.end(); i++) {
+		SocketMap::const_iterator j = mSockets.find (*i);
+		if (j == mSockets.end()) {
+			if (write) writeDone->push_back (*i);
+			continue;
+		}
+		receivers.push_back (std::make_pair (*i, std::make_pair (j->second, j->second->delegateKey())));
+	}
+	if (write) mStatistics.writeEvents += receivers.size();
+	else mStatistics.readEvents += receivers.size();
+
+	mMutex.unlock();
+	{
+		// libschnee lock first (like xcall), a receiver may wait for it inside SF_UNREGISTER_ME otherwise
+		SF_SCHNEE_LOCK;
+		for (ReceiverVec::const_iterator i = receivers.begin(); i != receivers.end(); i++) {
+			bool continueWriting = false;
+			{
+				sf::DelegateRegisterLock lock (i->second.second);
+				if (lock.suc()) {
+					if (write) continueWriting = i->second.first->onWriteable();
+					else i->second.first->onReadable();
+				}
+			}
+			if (write && !continueWriting) writeDone->push_back (i->first);
+		}
+	}
+	mMutex.lock();
+}
+
 UDTMainLoop::UDTMainLoop () {
-	mRunning = false;
+	mRunning    = false;
+	mGeneration = 0;
+	mThreads    = 0;
+	mPoll       = -1;
 	if (UDT::startup()){
 		fprintf (stderr, "Failed to startup UDT: %s\n", UDT::getlasterror().getErrorMessage());
 		abort ();
@@ -154,6 +177,11 @@ UDTMainLoop::UDTMainLoop () {
 }
 
 UDTMainLoop::~UDTMainLoop () {
+	LockGuard guard (mMutex);
+	stop_locked ();
+	while (mThreads > 0) {
+		mCondition.wait (mMutex);
+	}
 }
 
 }
@@ -41,12 +41,25 @@ public:
 	// (Does so if > 0 UDTEventReceivers are connected)
 	bool isRunning ();
 
+	/// Loop statistics (for benchmarking)
+	struct Statistics {
+		Statistics () : wakeups (0), readEvents (0), writeEvents (0) {}
+		int64_t wakeups;		///< Iterations of the loop
+		int64_t readEvents;		///< Dispatched read events
+		int64_t writeEvents;	///< Dispatched write events
+	};
+	Statistics statistics ();
+
 private:
 	void start_locked ();
 
 	void stop_locked ();
 
-	void threadEntry ();
+	/// Loop of one thread, runs until the generation changes
+	void threadEntry (int generation, int poll);
+
+	/// Dispatches read or write events, adds sockets which do not want to write anymore to writeDone
+	void dispatch_locked (const std::set<UDTSOCKET> & ready, bool write, std::vector<UDTSOCKET> * writeDone);
 
 	UDTMainLoop ();
 	~UDTMainLoop ();
@@ -56,10 +69,14 @@ private:
 	SocketMap mSockets;
 	SocketSet mWriteableWaiting;
 
+	int       mPoll;		///< UDT epoll, read events for all sockets, write events for mWriteableWaiting
+	Statistics mStatistics;
+
 	Mutex     mMutex;
 	Condition mCondition;
 	bool      mRunning;
-	bool      mToQuit;
+	int       mGeneration;	///< Incremented on each stop, lets the current thread quit
+	int       mThreads;		///< Running (or still quitting) threads
 };
 
 }
@@ -0,0 +1,139 @@
+#include "UringTCPSocketPrivate.h"
+#include <errno.h>
+#include <string.h>
+
+namespace sf {
+
+UringTCPSocketPrivate::UringTCPSocketPrivate (boost::asio::io_service & service) :
+	TCPSocketPrivateImpl (service),
+	mReadStopped (false),
+	mReadCancelled (false),
+	mSendsInFlight (0) {
+}
+
+void UringTCPSocketPrivate::asyncRead (const boost::asio::mutable_buffers_1 & buffer, const ReadHandler & handler) {
+	assert (IOService::isCurrentThreadService (mService));
+	mReadStopped = false;
+	mPendingOperations++;
+	mAsyncReading = true;
+	if (!mSocket.is_open()) {
+		mService.post (abind (handler, boost::asio::error::operation_aborted, 0));
+		return;
+	}
+	// the data does not go into buffer but into the shared buffers of IOUring
+	Error e = IOUring::instance().recv (mSocket.native_handle(), this);
+	if (e) {
+		Log (LogWarning) << LOGID << "Could not start receiving: " << toString (e) << std::endl;
+		mService.post (abind (handler, boost::asio::error::no_buffer_space, 0));
+	}
+}
+
+void UringTCPSocketPrivate::stopAsyncRead () {
+	assert (IOService::isCurrentThreadService (mService));
+	mReadStopped = true;
+	if (mAsyncReading) IOUring::instance().cancel (this, IOUring::Recv);
+}
+
+void UringTCPSocketPrivate::continueWriting () {
+	if (mPendingOutputBuffer == 0) {
+		mAsyncWriting = false;
+		return;
+	}
+	if (!mSocket.is_open()) {
+		mAsyncWriting = false;
+		setError (error::WriteError, "Socket closed");
+		return;
+	}
+	std::vector<boost::asio::const_buffer> buffers;
+	for (std::deque<OutputElement>::const_iterator i = mOutputBuffer.begin(); i != mOutputBuffer.end() && (int) buffers.size() < IOUring::maxChain(); i++) {
+		buffers.push_back (boost::asio::buffer (i->data->const_c_array() + i->offset, i->data->size() - i->offset));
+	}
+	Error e = IOUring::instance().sendChain (mSocket.native_handle(), buffers, this);
+	if (e) {
+		mAsyncWriting = false;
+		setError (error::WriteError, String ("Could not send: ") + toString (e));
+		return;
+	}
+	mSendResults.clear ();
+	mSendsInFlight      = (int) buffers.size();
+	mPendingOperations += (int) buffers.size();
+	mWaitForWrite = true;
+	mAsyncWriting = true;
+}
+
+void UringTCPSocketPrivate::cancelBackendOperations () {
+	if (mAsyncReading) IOUring::instance().cancel (this, IOUring::Recv);
+	if (mAsyncWriting) IOUring::instance().cancel (this, IOUring::Send);
+}
+
+void UringTCPSocketPrivate::onUringCompletion (int op, int result, bool more, const char * data) {
+	if (op == IOUring::Recv) onRecv (result, more, data);
+	else onSend (result);
+}
+
+void UringTCPSocketPrivate::onRecv (int result, bool more, const char * data) {
+	if (result > 0 && data) {
+		mInputBuffer.append (data, result);
+	}
+	if (!more) {
+		mPendingOperations--;
+		mAsyncReading  = false;
+		mReadCancelled = false;
+	}
+	if (result == -ENOBUFS || result == -ECANCELED) {
+		// out of shared buffers or cancelled: receiving again, if there is room
+		// (checkAndContinueReading stops if the socket is closed or the input buffer full)
+		if (!more && !mReadStopped && !mToDelete) checkAndContinueReading ();
+		return;
+	}
+	boost::system::error_code ec;
+	if (result == 0) ec = boost::asio::error::eof;
+	else if (result == -ECONNRESET) ec = boost::asio::error::connection_reset;
+	else if (result < 0) ec = boost::system::error_code (-result, boost::system::system_category());
+	onReadResult (ec, result > 0 ? result : 0);
+
+	// flow control, the multishot receive would go on otherwise
+	if (mAsyncReading && !mReadCancelled && mInputBuffer.size() + mInputTransferBufferSize > mMaxInputBufferSize) {
+		Log (LogInfo) << LOGID << "Input buffer full, stopping reading" << std::endl;
+		mReadCancelled = true;
+		IOUring::instance().cancel (this, IOUring::Recv);
+	}
+}
+
+void UringTCPSocketPrivate::onSend (int result) {
+	mPendingOperations--;
+	mSendResults.push_back (result);
+	if (--mSendsInFlight > 0) return; // chain completions come in order
+	mWaitForWrite = false;
+	mAsyncWriting = false;
+
+	std::vector<ResultCallback> callbacks;
+	int sendError = 0;
+	for (std::vector<int>::const_iterator i = mSendResults.begin(); i != mSendResults.end() && !mOutputBuffer.empty(); i++) {
+		OutputElement & elem = mOutputBuffer.front();
+		int r = *i;
+		if (r < 0) {
+			// the rest of a chain is cancelled after a short or failed send
+			if (r != -ECANCELED) sendError = -r;
+			break;
+		}
+		mPendingOutputBuffer -= r;
+		mBytesTransferred    += r;
+		elem.offset          += r;
+		assert (elem.offset <= elem.data->size());
+		if (elem.offset != elem.data->size()) break; // short send, continuing with the rest
+		if (elem.callback) callbacks.push_back (elem.callback);
+		mOutputBuffer.pop_front ();
+	}
+	if (sendError) {
+		Log (LogInfo) << LOGID << "There was an error during writing " << strerror (sendError) << std::endl;
+		setError (error::WriteError, strerror (sendError));
+	} else if (!mToDelete) {
+		continueWriting ();
+	}
+	for (std::vector<ResultCallback>::const_iterator i = callbacks.begin(); i != callbacks.end(); i++) {
+		(*i) (NoError);
+	}
+}
+
+}
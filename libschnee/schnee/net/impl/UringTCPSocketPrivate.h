@@ -0,0 +1,48 @@
+#pragma once
+
+#include "TCPSocketPrivate.h"
+#include "IOUring.h"
+
+/// @cond DEV
+
+namespace sf {
+
+/**
+ * TCPSocketPrivate which reads and writes through IOUring.
+ *
+ * Reading is one multishot receive, which is cancelled if the input buffer is full
+ * and started again if there is room (the data the kernel received before the cancel
+ * is kept, so the input buffer may exceed its maximum by that). Queued output elements
+ * are sent in chains of linked send operations. Resolving, connecting, accepting and
+ * socket options are still done by asio.
+ *
+ * This is not to be used from outside libschnee.
+ */
+struct UringTCPSocketPrivate : public TCPSocketPrivateImpl, public IOUringReceiver {
+	UringTCPSocketPrivate (boost::asio::io_service & service);
+
+protected:
+	// Implementation of BufferedReader
+	virtual void asyncRead (const boost::asio::mutable_buffers_1 & buffer, const ReadHandler & handler);
+	virtual void stopAsyncRead ();
+
+	// Implementation of TCPSocketPrivate
+	virtual void continueWriting ();
+	virtual void cancelBackendOperations ();
+
+	// Implementation of IOUringReceiver
+	virtual void onUringCompletion (int op, int result, bool more, const char * data);
+
+private:
+	void onRecv (int result, bool more, const char * data);
+	void onSend (int result);
+
+	bool mReadStopped;				///< stopAsyncRead was called, no automatic restart
+	bool mReadCancelled;			///< Receiving is being cancelled as the input buffer is full
+	int  mSendsInFlight;			///< Send operations of the current chain not completed yet
+	std::vector<int> mSendResults;	///< Results of the current chain so far (in order)
+};
+
+}
+
+/// @endcond DEV
@@ -1,6 +1,9 @@
 #include "x509.h"
 #include "TLSCertificates.h"
 #include <schnee/tools/Log.h>
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+#include <gnutls/abstract.h>
+#endif
 
 namespace sf {
 namespace x509 {
@@ -17,6 +20,107 @@ static void dumpVerifyErrorCode (int v) {
 	}
 }
 
+const char * toString (KeyType type) {
+	switch (type) {
+		case KT_RSA:     return "rsa";
+		case KT_ECDSA:   return "ecdsa";
+		case KT_ED25519: return "ed25519";
+	}
+	return "unknown";
+}
+
+bool fromString (const String & s, KeyType * type) {
+	if (s == "rsa")     { *type = KT_RSA; return true; }
+	if (s == "ecdsa")   { *type = KT_ECDSA; return true; }
+	if (s == "ed25519") { *type = KT_ED25519; return true; }
+	return false;
+}
+
+int PrivateKey::generate (KeyType type, int length) {
+	switch (type) {
+		case KT_RSA:
+			return generate (length);
+		case KT_ECDSA:
+#if GNUTLS_VERSION_NUMBER >= 0x030000
+			return gnutls_x509_privkey_generate (data, GNUTLS_PK_ECDSA, GNUTLS_CURVE_TO_BITS (GNUTLS_ECC_CURVE_SECP256R1), 0);
+#else
+			break;
+#endif
+		case KT_ED25519:
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+			return gnutls_x509_privkey_generate (data, GNUTLS_PK_EDDSA_ED25519, GNUTLS_CURVE_TO_BITS (GNUTLS_ECC_CURVE_ED25519), 0);
+#else
+			break;
+#endif
+	}
+	return GNUTLS_E_UNIMPLEMENTED_FEATURE;
+}
+
+int PrivateKey::type (KeyType * dst) const {
+	int algorithm = gnutls_x509_privkey_get_pk_algorithm (data);
+	if (algorithm < 0) return algorithm;
+	switch (algorithm) {
+		case GNUTLS_PK_RSA:
+			*dst = KT_RSA;
+			return 0;
+#if GNUTLS_VERSION_NUMBER >= 0x030000
+		case GNUTLS_PK_ECDSA:
+			*dst = KT_ECDSA;
+			return 0;
+#endif
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+		case GNUTLS_PK_EDDSA_ED25519:
+			*dst = KT_ED25519;
+			return 0;
+#endif
+		default:
+			return GNUTLS_E_UNKNOWN_PK_ALGORITHM;
+	}
+}
+
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+/// Signature algorithm used by signData / verifyData for keys of the given algorithm
+static gnutls_sign_algorithm_t signAlgorithm (int pkAlgorithm) {
+	if (pkAlgorithm == GNUTLS_PK_EDDSA_ED25519) return GNUTLS_SIGN_EDDSA_ED25519;
+	return gnutls_pk_to_sign ((gnutls_pk_algorithm_t) pkAlgorithm, GNUTLS_DIG_SHA256);
+}
+#endif
+
+int PrivateKey::signData (const ByteArray & src, ByteArray * signature) const {
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+	if (src.empty()) return GNUTLS_E_INVALID_REQUEST;
+	gnutls_privkey_t key;
+	int r = gnutls_privkey_init (&key);
+	if (r) return r;
+	r = gnutls_privkey_import_x509 (key, data, 0);
+	if (!r) {
+		gnutls_datum_t d;
+		d.data = (unsigned char*) src.const_c_array();
+		d.size = (unsigned int) src.size();
+		gnutls_datum_t sig;
+		r = gnutls_privkey_sign_data2 (key, signAlgorithm (gnutls_x509_privkey_get_pk_algorithm (data)), 0, &d, &sig);
+		if (!r) {
+			signature->assign (sig.data, sig.data + sig.size);
+			gnutls_free (sig.data);
+		}
+	}
+	gnutls_privkey_deinit (key);
+	return r;
+#else
+	return GNUTLS_E_UNIMPLEMENTED_FEATURE;
+#endif
+}
+
+bool Certificate::matches (const PrivateKey * key) const {
+	unsigned char certId [64];
+	unsigned char keyId  [64];
+	size_t certIdSize = sizeof (certId);
+	size_t keyIdSize  = sizeof (keyId);
+	if (gnutls_x509_crt_get_key_id (data, 0, certId, &certIdSize)) return false;
+	if (gnutls_x509_privkey_get_key_id (key->data, 0, keyId, &keyIdSize)) return false;
+	return certIdSize == keyIdSize && ::memcmp (certId, keyId, certIdSize) == 0;
+}
+
 bool Certificate::verify (const Certificate * trusted) const {
 	unsigned int v = 0;
 	int r = gnutls_x509_crt_verify (data, &trusted->data, 1, 0, &v);
@@ -35,6 +139,28 @@ bool Certificate::verify (const Certificate * trusted) const {
 	}
 }
 
+bool Certificate::verifyData (const ByteArray & src, const ByteArray & signature) const {
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+	if (src.empty() || signature.empty()) return false;
+	gnutls_pubkey_t key;
+	if (gnutls_pubkey_init (&key)) return false;
+	int r = gnutls_pubkey_import_x509 (key, data, 0);
+	if (!r) {
+		gnutls_datum_t d;
+		d.data = (unsigned char*) src.const_c_array();
+		d.size = (unsigned int) src.size();
+		gnutls_datum_t sig;
+		sig.data = (unsigned char*) signature.const_c_array();
+		sig.size = (unsigned int) signature.size();
+		r = gnutls_pubkey_verify_data2 (key, signAlgorithm (gnutls_pubkey_get_pk_algorithm (key, NULL)), 0, &d, &sig);
+	}
+	gnutls_pubkey_deinit (key);
+	return r >= 0;
+#else
+	return false;
+#endif
+}
+
 bool Certificate::verify (const TLSCertificates & certificates) const {
 	unsigned int v = 0;
 	int caListLength = (int) certificates.certificateCount();
@@ -12,6 +12,20 @@ namespace sf {
 class TLSCertificates;
 
 namespace x509 {
+
+/// Supported types of private keys
+enum KeyType {
+	KT_RSA,		///< RSA (supported by all peers)
+	KT_ECDSA,	///< ECDSA on NIST P-256 (needs GnuTLS >= 3.0), fast generation and handshakes
+	KT_ED25519	///< EdDSA on Curve 25519 (needs GnuTLS >= 3.6)
+};
+
+/// Name of a key type (rsa, ecdsa, ed25519)
+const char * toString (KeyType type);
+
+/// Parses a key type name, returns true on success
+bool fromString (const String & s, KeyType * type);
+
 struct PrivateKey {
 	PrivateKey () { gnutls_x509_privkey_init(&data); }
 	~PrivateKey () { gnutls_x509_privkey_deinit (data); }
@@ -21,14 +35,44 @@ struct PrivateKey {
 		return gnutls_x509_privkey_generate (data, GNUTLS_PK_RSA, length, 0);
 	}
 
+	/// Generate key of given type (length is only used for RSA)
+	/// 0 = success
+	int generate (KeyType type, int length = 1024);
+
+	/// Type of the key
+	/// 0 = success
+	int type (KeyType * dst) const;
+
 	int textExport (std::string * dst) {
 		char buffer [10 * 1024];
 		size_t bufferSize = sizeof(buffer);
+#if GNUTLS_VERSION_NUMBER >= 0x030100
+		// unencrypted PKCS#8, the only PEM format for EdDSA keys
+		int r = gnutls_x509_privkey_export_pkcs8 (data, GNUTLS_X509_FMT_PEM, NULL, GNUTLS_PKCS_PLAIN, buffer, &bufferSize);
+#else
 		int r = gnutls_x509_privkey_export (data, GNUTLS_X509_FMT_PEM, buffer, &bufferSize);
+#endif
 		if (!r) *dst = buffer;
 		return r;
 	}
 
+	/// 0 = success
+	int textImport (const std::string & src) {
+		gnutls_datum_t datum;
+		datum.data = (unsigned char*) src.c_str();
+		datum.size = src.length();
+#if GNUTLS_VERSION_NUMBER >= 0x030100
+		// also understands PKCS#8 (used for EdDSA keys)
+		return gnutls_x509_privkey_import2 (data, &datum, GNUTLS_X509_FMT_PEM, NULL, 0);
+#else
+		return gnutls_x509_privkey_import (data, &datum, GNUTLS_X509_FMT_PEM);
+#endif
+	}
+
+	/// Signs some data (SHA-256, pure EdDSA for Ed25519 keys), see Certificate::verifyData
+	/// 0 = success
+	int signData (const ByteArray & src, ByteArray * signature) const;
+
 	gnutls_x509_privkey_t data;
 };
 
@@ -106,6 +150,14 @@ struct Certificate {
 		return gnutls_x509_crt_set_expiration_time (data ,t);
 	}
 
+	/// Returns expiration time, (time_t) -1 on error
+	time_t expirationTime () const {
+		return gnutls_x509_crt_get_expiration_time (data);
+	}
+
+	/// Returns true if the certificate belongs to the given key
+	bool matches (const PrivateKey * key) const;
+
 	/// 0 = success
 	int setExpirationDays (int days) {
 		return setExpirationTime (::time(NULL) + 3600 * 24 * days);
@@ -260,12 +312,49 @@ struct Certificate {
 	/// verifies against given thrust list of certificates
 	bool verify (const TLSCertificates & certificates) const;
 
+	/// Verifies a signature of the key belonging to this certificate (see PrivateKey::signData)
+	/// true = success
+	bool verifyData (const ByteArray & src, const ByteArray & signature) const;
+
 
 	gnutls_x509_crt_t data;
 };
 
+/// Diffie Hellman parameters for anonymous TLS servers
+/// (not part of X509, but stored alongside keys)
+struct DhParams {
+	DhParams () { gnutls_dh_params_init (&data); }
+	~DhParams () { gnutls_dh_params_deinit (data); }
+
+	/// Generate new parameters (slow!)
+	/// 0 = success
+	int generate (int bits = 1024) {
+		return gnutls_dh_params_generate2 (data, bits);
+	}
+
+	/// 0 = success
+	int textExport (std::string * dst) const {
+		char buffer [10 * 1024];
+		size_t bufferSize = sizeof (buffer);
+		int r = gnutls_dh_params_export_pkcs3 (data, GNUTLS_X509_FMT_PEM, (unsigned char*) buffer, &bufferSize);
+		if (!r) dst->assign (buffer, buffer + bufferSize);
+		return r;
+	}
+
+	/// 0 = success
+	int textImport (const std::string & src) {
+		gnutls_datum_t datum;
+		datum.data = (unsigned char*) src.c_str();
+		datum.size = src.length();
+		return gnutls_dh_params_import_pkcs3 (data, &datum, GNUTLS_X509_FMT_PEM);
+	}
+
+	gnutls_dh_params_t data;
+};
+
 typedef shared_ptr<Certificate> CertificatePtr;
 typedef shared_ptr<PrivateKey>  PrivateKeyPtr;
+typedef shared_ptr<DhParams>    DhParamsPtr;
 
 }
 }
@@ -1,6 +1,8 @@
 #include "Authentication.h"
 #include <schnee/tools/Log.h>
 #include <schnee/tools/MicroTime.h>
+#include <schnee/net/KeyStore.h>
+#include <schnee/settings.h>
 namespace sf {
 
 String Authentication::CertInfo::fingerprint () const {
@@ -20,24 +22,47 @@ void Authentication::setIdentity (const String & identity) {
 
 	String dn;
 	if (mCertificate) mCertificate->getCommonName(&dn);
-	if (!mKey || dn != identity){
-		mKey         = x509::PrivateKeyPtr (new x509::PrivateKey());
-		mCertificate = x509::CertificatePtr (new x509::Certificate());
-		Log (LogProfile) << LOGID << "Generating key as no key was set" << std::endl;
-		double t0 = sf::microtime();
-		mKey->generate(1024);
-		mCertificate->setKey(mKey.get());
-		mCertificate->setVersion (1);
-		time_t activationTime = time (NULL) - 7200; // 2 hours ago
-		mCertificate->setActivationTime(activationTime);
-		mCertificate->setExpirationDays (10 * 365); // todo: reduce in future and check it
-		mCertificate->setSerial (1);
-		mCertificate->setCommonName(mIdentity.c_str());
-		mCertificate->sign(mCertificate.get(), mKey.get()); // self sign
+	if (mKey && dn == identity) return;
+
+	x509::KeyType type = x509::KT_RSA;
+	if (!x509::fromString (schnee::settings().keyType, &type)) {
+		Log (LogWarning) << LOGID << "Unknown key type " << schnee::settings().keyType << ", using rsa" << std::endl;
+	}
+	KeyStore store (schnee::settings().keyStore);
+	double t0 = sf::microtime();
+	if (!store.directory().empty() && !store.loadIdentity (identity, type, &mKey, &mCertificate)) {
 		mCertificate->fingerprintSha256(&mCertFingerprint);
 		mKeySet = true;
 		double t1 = sf::microtime ();
-		Log (LogProfile) << LOGID << "Key generation took " << (t1 - t0) * 1000.0 << "ms" << std::endl;
+		Log (LogProfile) << LOGID << "Loading key took " << (t1 - t0) * 1000.0 << "ms" << std::endl;
+		return;
+	}
+
+	mKey         = x509::PrivateKeyPtr (new x509::PrivateKey());
+	mCertificate = x509::CertificatePtr (new x509::Certificate());
+	Log (LogProfile) << LOGID << "Generating " << x509::toString (type) << " key as no key was set" << std::endl;
+	if (mKey->generate(type, 1024)) {
+		Log (LogWarning) << LOGID << "Could not generate " << x509::toString (type) << " key, falling back to rsa" << std::endl;
+		mKey->generate(1024);
+	}
+	mCertificate->setKey(mKey.get());
+	mCertificate->setVersion (1);
+	time_t activationTime = time (NULL) - 7200; // 2 hours ago
+	mCertificate->setActivationTime(activationTime);
+	mCertificate->setExpirationDays (10 * 365); // todo: reduce in future and check it
+	mCertificate->setSerial (1);
+	mCertificate->setCommonName(mIdentity.c_str());
+	mCertificate->sign(mCertificate.get(), mKey.get()); // self sign
+	mCertificate->fingerprintSha256(&mCertFingerprint);
+	mKeySet = true;
+	double t1 = sf::microtime ();
+	Log (LogProfile) << LOGID << "Key generation took " << (t1 - t0) * 1000.0 << "ms" << std::endl;
+
+	if (!store.directory().empty()) {
+		Error e = store.saveIdentity (mKey, mCertificate, type);
+		if (e) {
+			Log (LogWarning) << LOGID << "Could not store key in " << store.directory() << ": " << toString (e) << std::endl;
+		}
 	}
 }
 
@@ -25,7 +25,7 @@ public:
 	Authentication ();
 
 	/// Sets own identity name
-	/// And generates keys if necessary.
+	/// And loads (from schnee::settings().keyStore) or generates keys if necessary.
 	void setIdentity (const String & identity);
 
 	/// Access to private key
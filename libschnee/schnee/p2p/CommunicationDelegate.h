@@ -1,6 +1,7 @@
 #pragma once
 #include <schnee/sftypes.h>
 #include "Datagram.h"
+#include <map>
 
 namespace sf {
 
@@ -11,11 +12,16 @@ class CommunicationDelegate {
 public:
 	virtual ~CommunicationDelegate () {}
 
+	/// Errors per receiver of a multi receiver send
+	typedef std::map<HostId, Error> ErrorMap;
+
 	/// Send a Datagram to the specific receiver
 	virtual sf::Error send     (const HostId & receiver, const sf::Datagram & datagram, const ResultCallback & callback = ResultCallback ()) = 0;
 
 	/// Send a Datagram to multiple users
-	virtual sf::Error send     (const HostSet & receivers, const sf::Datagram & datagram) = 0;
+	/// The datagram is encoded only once and shared between all receivers.
+	/// If errors is given, it will be filled with the error of each failed receiver.
+	virtual sf::Error send     (const HostSet & receivers, const sf::Datagram & datagram, ErrorMap * errors = 0) = 0;
 
 	/// Returns level of channel (also see ConnectionManagement)
 	virtual int channelLevel (const HostId & receiver) = 0;
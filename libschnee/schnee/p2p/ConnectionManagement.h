@@ -48,6 +48,10 @@ public:
 	/// Close a channel to someone
 	virtual Error closeChannel (const HostId & host, int level) = 0;
 
+	/// Sets the priority of connecting to a host (e.g. there are pending transfers).
+	/// Connection attempts to hosts with a higher priority are started first. Default is 0.
+	virtual void setLiftPriority (const HostId & host, int priority) {}
+
 
 	///@name Delegates
 	///@{
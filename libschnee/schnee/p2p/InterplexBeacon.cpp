@@ -6,6 +6,9 @@
 #include "channels/TCPChannelConnector.h"
 
 #include "channels/UDTChannelConnector.h"
+#include "channels/LANChannelConnector.h"
+#include "channels/LocalChannelConnector.h"
+#include "channels/RelayChannelProvider.h"
 
 #include <schnee/settings.h>
 namespace sf {
@@ -26,6 +29,12 @@ InterplexBeacon * InterplexBeacon::createIMInterplexBeacon (){
 	beacon->setPresenceProvider (imDispatcher);
 	beacon->connections().addChannelProvider  (imDispatcher, 1);
 
+	// Through a friend both sides are connected to, if nothing direct works
+	shared_ptr<RelayChannelProvider> relayProvider (new RelayChannelProvider());
+	relayProvider->setConnectionManagement (&beacon->connections());
+	relayProvider->setRelayBandwidth (schnee::settings().relayBandwidth);
+	beacon->connections().addChannelProvider (relayProvider, 5);
+
 	if (!schnee::settings().disableUdt){
 		shared_ptr<UDTChannelConnector> udtConnector = shared_ptr<UDTChannelConnector> (new UDTChannelConnector());
 		UDTChannelConnector::NetEndpoint echoServer (schnee::settings().echoServer, schnee::settings().echoServerPort);
@@ -43,6 +52,28 @@ InterplexBeacon * InterplexBeacon::createIMInterplexBeacon (){
 
 	} else
 		Log (LogProfile) << LOGID << "Disabled TCP connections" << std::endl;
+
+	if (schnee::settings().lanDiscovery){
+		// tried first, fails fast for peers which are not in the local network
+		shared_ptr<LANChannelConnector> lanConnector (new LANChannelConnector());
+		Error e = lanConnector->start();
+		if (!e) {
+			beacon->connections().addChannelProvider (lanConnector, 12);
+		} else
+			Log (LogWarning) << LOGID << "Could not start LAN discovery: " << toString (e) << std::endl;
+	}
+
+#ifndef WIN32
+	if (schnee::settings().localChannels){
+		// tried before all others, fails immediately for peers on other hosts
+		shared_ptr<LocalChannelConnector> localConnector (new LocalChannelConnector());
+		Error e = localConnector->start();
+		if (!e) {
+			beacon->connections().addChannelProvider (localConnector, 13);
+		} else
+			Log (LogWarning) << LOGID << "Could not start local channels: " << toString (e) << std::endl;
+	}
+#endif
 	return beacon;
 }
 
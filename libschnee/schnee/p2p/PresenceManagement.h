@@ -45,6 +45,15 @@ public:
 	};
 	typedef std::map<UserId, UserInfo> UserInfoMap;
 
+	/// Users and hosts affected by a (batched) presence update
+	struct PeersChange {
+		std::set<UserId> users;			///< Users which were added or changed
+		std::set<UserId> removedUsers;	///< Users which were removed
+		HostSet online;					///< Hosts which went online
+		HostSet offline;				///< Hosts which went offline
+		bool empty () const { return users.empty() && removedUsers.empty() && online.empty() && offline.empty(); }
+	};
+
 
 	///@name Watching other Peers
 	///@{
@@ -98,6 +107,7 @@ public:
 
 	typedef Signal<void (OnlineState os)> OnlineStateChangedSignal;
 	typedef Signal<void ()> VoidSignal;
+	typedef Signal<void (const PeersChange & change)> PeersChangeSignal;
 	typedef Signal<void (const String& text)> ServerStreamErrorSignal;
 	typedef function<void (const UserId & from)> SubscribeRequestDelegate;
 
@@ -107,6 +117,9 @@ public:
 	/// The peer list changed
 	virtual VoidSignal & peersChanged () = 0;
 
+	/// The peer list changed, with the affected users and hosts (emitted right before peersChanged)
+	virtual PeersChangeSignal & peersChange () = 0;
+
 	/// The server sent some stream error, you should display that
 	virtual ServerStreamErrorSignal & serverStreamErrorReceived () = 0;
 
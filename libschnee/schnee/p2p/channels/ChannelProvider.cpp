@@ -5,4 +5,10 @@ namespace sf {
 ChannelProvider::~ChannelProvider () {
 }
 
+String ChannelProvider::tlsSessionKey (const HostId & own, const HostId & target, const Authentication * auth) {
+	String key = own + " " + target;
+	if (auth) key += " " + auth->certFingerprint();
+	return key;
+}
+
 }
@@ -45,6 +45,10 @@ public:
 
 	///@}
 
+protected:
+	/// Key for resuming TLS sessions (see TLSSessionCache) of own host to target.
+	/// Contains own certificate fingerprint, so that sessions are not resumed with another identity
+	static String tlsSessionKey (const HostId & own, const HostId & target, const Authentication * auth);
 };
 
 }
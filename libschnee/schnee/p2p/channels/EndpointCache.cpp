@@ -0,0 +1,147 @@
+#include "EndpointCache.h"
+#include <schnee/tools/Base64.h>
+#include <schnee/tools/FileTools.h>
+#include <schnee/tools/Log.h>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <time.h>
+
+namespace sf {
+
+/*
+ * File format, one line per peer:
+ * peer HOST TRANSPORT ADDRESSES PORT UDPADDRESS UDPPORT EXTERNADDRESS PORTPRESERVING NAT LASTSEEN
+ * HOST is Base64 encoded, ADDRESSES are comma separated, empty fields are "-".
+ */
+
+/// Placeholder for empty fields
+static const char * gEmptyField = "-";
+
+static String field (const String & s) {
+	return s.empty() ? String (gEmptyField) : s;
+}
+
+static String unfield (const String & s) {
+	return s == gEmptyField ? String () : s;
+}
+
+EndpointCache::EndpointCache () {
+	mMaxEntries = 256;
+	mMaxAge     = 7 * 24 * 3600;
+}
+
+void EndpointCache::store (const HostId & host, const Entry & entry) {
+	Entry & e = mEntries[host];
+	e = entry;
+	e.lastSeen = (int64_t) ::time (0);
+	mStatistics.stored++;
+	shrink ();
+	save ();
+}
+
+bool EndpointCache::lookup (const HostId & host, Entry * entry) {
+	mStatistics.lookups++;
+	EntryMap::const_iterator i = mEntries.find (host);
+	if (i == mEntries.end()) return false;
+	if (i->second.lastSeen + mMaxAge < (int64_t) ::time (0)) return false;
+	mStatistics.hits++;
+	*entry = i->second;
+	return true;
+}
+
+void EndpointCache::remove (const HostId & host) {
+	if (mEntries.erase (host) > 0) {
+		mStatistics.removed++;
+		save ();
+	}
+}
+
+void EndpointCache::clear () {
+	mEntries.clear ();
+	save ();
+}
+
+void EndpointCache::setMaxEntries (size_t maxEntries) {
+	mMaxEntries = maxEntries;
+	shrink ();
+}
+
+Error EndpointCache::setFile (const String & file) {
+	mFile = file;
+	if (mFile.empty()) return NoError;
+	if (fileExists (mFile)) {
+		Error e = load ();
+		if (e) {
+			Log (LogWarning) << LOGID << "Could not load peer endpoints from " << mFile << ": " << toString (e) << std::endl;
+		}
+	}
+	save ();
+	return NoError;
+}
+
+void EndpointCache::shrink () {
+	while (mEntries.size() > mMaxEntries) {
+		EntryMap::iterator oldest = mEntries.begin();
+		for (EntryMap::iterator i = mEntries.begin(); i != mEntries.end(); i++) {
+			if (i->second.lastSeen < oldest->second.lastSeen) oldest = i;
+		}
+		mEntries.erase (oldest);
+	}
+}
+
+void EndpointCache::save () {
+	if (mFile.empty()) return;
+	std::ostringstream content;
+	for (EntryMap::const_iterator i = mEntries.begin(); i != mEntries.end(); i++) {
+		const Entry & e = i->second;
+		String addresses;
+		for (std::vector<String>::const_iterator j = e.addresses.begin(); j != e.addresses.end(); j++) {
+			if (!addresses.empty()) addresses += ",";
+			addresses += *j;
+		}
+		content << "peer " << Base64::encode (i->first) << " " << field (e.transport) << " " << field (addresses) << " " << e.port
+				<< " " << field (e.udpAddress) << " " << e.udpPort << " " << field (e.externAddress) << " " << (e.portPreserving ? 1 : 0)
+				<< " " << (int) e.nat << " " << e.lastSeen << "\n";
+	}
+	if (createDirectoriesForFilePath (mFile)) {
+		Log (LogWarning) << LOGID << "Could not create directory for " << mFile << std::endl;
+		return;
+	}
+	// tells who the user talks to
+	if (writePrivateFile (mFile, content.str())) {
+		Log (LogWarning) << LOGID << "Could not write " << mFile << std::endl;
+	}
+}
+
+Error EndpointCache::load () {
+	std::ifstream stream (mFile.c_str(), std::ios::in | std::ios::binary);
+	if (!stream) return error::ReadError;
+	String line;
+	while (std::getline (stream, line)) {
+		std::istringstream fields (line);
+		String type, host, transport, addresses, udpAddress, externAddress;
+		Entry e;
+		int portPreserving = 0, nat = 0;
+		fields >> type;
+		if (type.empty()) continue;
+		if (type != "peer") return error::BadDeserialization;
+		fields >> host >> transport >> addresses >> e.port >> udpAddress >> e.udpPort >> externAddress >> portPreserving >> nat >> e.lastSeen;
+		if (fields.fail()) return error::BadDeserialization;
+		e.transport      = unfield (transport);
+		e.udpAddress     = unfield (udpAddress);
+		e.externAddress  = unfield (externAddress);
+		e.portPreserving = portPreserving != 0;
+		e.nat            = (NatOutcome) nat;
+		std::istringstream list (unfield (addresses));
+		String address;
+		while (std::getline (list, address, ',')) {
+			if (!address.empty()) e.addresses.push_back (address);
+		}
+		mEntries[Base64::decode (host)] = e;
+	}
+	shrink ();
+	return NoError;
+}
+
+}
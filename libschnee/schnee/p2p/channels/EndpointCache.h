@@ -0,0 +1,94 @@
+#pragma once
+#include <schnee/sftypes.h>
+#include <schnee/tools/Singleton.h>
+
+namespace sf {
+
+/// Remembers how peers were reached the last time, so that a reconnect can try
+/// the known path right away while the regular discovery (address exchange over the
+/// initial channel, echo server lookup) is still running.
+///
+/// Entries are kept in memory for the lifetime of the process; optionally
+/// they are also written to a file (see setFile).
+class EndpointCache : public Singleton<EndpointCache> {
+public:
+	/// How the UDP endpoint of the peer was reached
+	enum NatOutcome {
+		NAT_UNKNOWN = 0,	///< Not tried yet
+		NAT_DIRECT,			///< Via one of the peer's internal addresses
+		NAT_PUNCHED,		///< Via the peer's external address (hole punching)
+		NAT_GUESSED			///< Via a guessed port next to the external address
+	};
+
+	/// What is known about a peer
+	struct Entry {
+		Entry () : port (0), udpPort (0), portPreserving (false), nat (NAT_UNKNOWN), lastSeen (0) {}
+		String     transport;		///< Transport of the last created channel ("tcp" or "udt")
+		std::vector<String> addresses;	///< TCP addresses of the peer, the working one first
+		int        port;			///< TCP port of the peer, 0 if unknown
+		String     udpAddress;		///< UDP address of the peer which worked
+		int        udpPort;			///< UDP port of the peer which worked
+		String     externAddress;	///< Own external address (as seen by the echo server)
+		bool       portPreserving;	///< Own NAT kept the local UDP port
+		NatOutcome nat;				///< How the peer's UDP endpoint was reached
+		int64_t    lastSeen;		///< Seconds since epoch of last update
+
+		bool hasTcp () const { return port > 0 && !addresses.empty(); }
+	};
+
+	EndpointCache ();
+
+	/// Stores the entry of a host (updates lastSeen)
+	void store (const HostId & host, const Entry & entry);
+
+	/// Looks up the entry of a host, returns false if there is none (or it is too old)
+	bool lookup (const HostId & host, Entry * entry);
+
+	/// Removes the entry of a host (e.g. if the cached path led to someone else)
+	void remove (const HostId & host);
+
+	/// Removes all entries
+	void clear ();
+
+	/// Number of entries
+	size_t size () const { return mEntries.size(); }
+
+	/// Maximum number of entries, the oldest are dropped (default 256)
+	void setMaxEntries (size_t maxEntries);
+
+	/// Maximum age of entries returned by lookup (default 7 days)
+	void setMaxAge (int seconds) { mMaxAge = seconds; }
+
+	/// Keeps entries in a file (private to the user), loads existing ones.
+	/// Empty for no file (default)
+	Error setFile (const String & file);
+
+	/// Usage statistics
+	struct Statistics {
+		Statistics () : lookups (0), hits (0), stored (0), removed (0) {}
+		int lookups;	///< Lookups of entries
+		int hits;		///< Lookups which found an entry
+		int stored;		///< Stored entries
+		int removed;	///< Explicitly removed entries
+	};
+
+	const Statistics & statistics () const { return mStatistics; }
+
+private:
+	typedef std::map<HostId, Entry> EntryMap;
+
+	/// Drops oldest entries if there are too many
+	void shrink ();
+	/// Writes everything into the file (if any)
+	void save ();
+	/// Reads file
+	Error load ();
+
+	EntryMap    mEntries;
+	size_t      mMaxEntries;
+	int         mMaxAge;
+	String      mFile;
+	Statistics  mStatistics;
+};
+
+}
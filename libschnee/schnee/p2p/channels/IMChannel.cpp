@@ -7,18 +7,42 @@
 
 namespace sf {
 
+IMChannel::Settings::Settings () {
+	// Conservative, most XMPP servers limit client traffic (e.g. Prosody: 10kb/s, 2s burst)
+	stanzaSize = 4096;
+	rate       = 10240;
+	burst      = 20480;
+	maxPendingStanzas = 4;
+}
+
 IMChannel::IMChannel (IMDispatcher * dispatcher, const sf::String & id, OnlineState state){
+	SF_REGISTER_ME;
 	mDispatcher = dispatcher;
 	mId = id;
 	mState = state;
+	mError = NoError;
+	if (dispatcher) mSettings = dispatcher->channelSettings();
+	mTokens = mSettings.burst;
+	mLastRefill = sf::currentTime();
+	mPendingStanzas = 0;
+	mTimerActive = false;
 }
 
 IMChannel::~IMChannel (){
+	SF_UNREGISTER_ME;
+	cancelTimer (mSendTimer);
+}
+
+void IMChannel::setSettings (const Settings & settings) {
+	mSettings = settings;
+	if (mSettings.stanzaSize < 1) mSettings.stanzaSize = 1;
+	if (mSettings.maxPendingStanzas < 1) mSettings.maxPendingStanzas = 1;
+	if (mTokens > mSettings.burst) mTokens = mSettings.burst;
 }
 
 sf::Error IMChannel::error () const {
 	if (!mDispatcher) return sf::error::Closed;
-	return sf::NoError;
+	return mError;
 }
 
 sf::String IMChannel::errorMessage () const {
@@ -36,9 +60,10 @@ Error IMChannel::write (const ByteArrayPtr& data, const ResultCallback & callbac
 		sf::Log (LogError) << LOGID << "Already invalidated" << std::endl;
 		return error::ChannelError;
 	}
-	// Encode it into a message
-	sf::IMClient::Message m;
-	m.to = mId;
+	if (mError) return mError;
+	OutputElement element;
+	element.data     = data;
+	element.callback = callback;
 	if (data->size() < 256){
 		// Try if we can use it without encoding...
 		Datagram datagram;
@@ -49,28 +74,95 @@ Error IMChannel::write (const ByteArrayPtr& data, const ResultCallback & callbac
 		}
 		if (datagram.contentSize() == 0 && datagram.header()->printable()){
 			// we can send it text-only
-			m.body.assign (datagram.header()->begin(), datagram.header()->end());
-			bool ret = mDispatcher->send(m);
-			if (callback) xcall (abind (callback, NoError)); // simulating...
-			return ret ? NoError : error::WriteError;
+			element.data = datagram.header();
+			element.text = true;
 		}
 	}
-	// Let's go binary, in 1024 Byte chunks
-	size_t pos = 0;
-	while (pos < data->size()){
-		size_t length = std::min (data->size() - pos, size_t (1024));
-		sf::ByteArray part;
-		part.assign (data->begin() + pos, data->begin() + pos + length);
-
-		sf::String base64 = sf::Base64::encodeFromArray (part);
-		m.body = "BNRY" + base64;
-		bool ret = mDispatcher->send (m);
-		if (!ret) return error::WriteError;
-		pos += 1024;
-	}
+	mOutputQueue.push_back (element);
+	continueSending ();
 	return NoError;
 }
 
+void IMChannel::continueSending () {
+	if (!mDispatcher || mTimerActive) return;
+	if (mSettings.rate > 0) {
+		// refill token bucket
+		sf::Time now = sf::currentTime();
+		double elapsed = (now - mLastRefill).total_microseconds() / 1000000.0;
+		mTokens = std::min ((double) mSettings.burst, mTokens + elapsed * mSettings.rate);
+		mLastRefill = now;
+	}
+	while (!mOutputQueue.empty() && mPendingStanzas < mSettings.maxPendingStanzas){
+		OutputElement & element = mOutputQueue.front();
+		size_t length   = element.text ? element.data->size() : std::min (element.data->size() - element.offset, mSettings.stanzaSize);
+		size_t bodySize = element.text ? length : 4 + sf::Base64::encodedLength (length);
+		if (mSettings.rate > 0){
+			// stanzas bigger than the bucket need a full bucket
+			double needed = std::min ((double) bodySize, (double) mSettings.burst);
+			if (mTokens < needed) {
+				int waitMs = (int) ((needed - mTokens) * 1000.0 / mSettings.rate) + 1;
+				mTimerActive = true;
+				mSendTimer = xcallTimed (dMemFun (this, &IMChannel::onSendTimer), sf::futureInMs (waitMs));
+				return;
+			}
+			mTokens -= bodySize;
+		}
+
+		sf::IMClient::Message m;
+		m.to = mId;
+		if (element.text){
+			m.body.assign (element.data->const_c_array(), element.data->size());
+		} else {
+			// encoding directly behind the prefix
+			m.body.resize (bodySize);
+			m.body.replace (0, 4, "BNRY");
+			sf::Base64::encodeTo (element.data->const_c_array() + element.offset, length, &m.body[4]);
+		}
+		element.offset += length;
+		ResultCallback callback;
+		if (element.offset >= element.data->size()){
+			// Stanzas leave the stream in order, so the last one is enough to call back
+			callback = element.callback;
+			mOutputQueue.pop_front();
+		}
+		mPendingStanzas++;
+		bool ret = mDispatcher->send (m, abind (dMemFun (this, &IMChannel::onStanzaWritten), callback));
+		if (!ret) {
+			mPendingStanzas--;
+			mError = error::WriteError;
+			notifyAsync (callback, mError);
+			failWrites (mError);
+			if (mChanged) xcall (mChanged);
+			return;
+		}
+	}
+}
+
+void IMChannel::onSendTimer () {
+	mTimerActive = false;
+	continueSending ();
+}
+
+void IMChannel::onStanzaWritten (Error result, const ResultCallback & callback) {
+	mPendingStanzas--;
+	if (callback) callback (result);
+	if (result && !mError) {
+		Log (LogWarning) << LOGID << "Could not write stanza to " << mId << ": " << toString (result) << std::endl;
+		mError = result;
+		failWrites (mError);
+		if (mChanged) mChanged ();
+		return;
+	}
+	continueSending ();
+}
+
+void IMChannel::failWrites (Error result) {
+	for (std::deque<OutputElement>::const_iterator i = mOutputQueue.begin(); i != mOutputQueue.end(); i++){
+		notifyAsync (i->callback, result);
+	}
+	mOutputQueue.clear();
+}
+
 sf::ByteArrayPtr IMChannel::read (long maxSize) {
 	// Copy & Paste from LocalChannel
 	sf::ByteArrayPtr result;
@@ -104,6 +196,7 @@ Channel::ChannelInfo IMChannel::info () const {
 	ChannelInfo info;
 	info.virtual_ = true;
 	info.authenticated = mDispatcher ? mDispatcher->isAuthenticated() : false;
+	if (mSettings.rate > 0) info.bandwidth = mSettings.rate;
 	return info;
 }
 
@@ -111,6 +204,9 @@ Channel::ChannelInfo IMChannel::info () const {
 void IMChannel::invalidate () {
 	mDispatcher = 0;
 	mState = OS_OFFLINE;
+	cancelTimer (mSendTimer);
+	mTimerActive = false;
+	failWrites (error::Closed);
 	if (mChanged) xcall (mChanged);
 }
 
@@ -122,11 +218,12 @@ void IMChannel::pushMessage (const sf::IMClient::Message & m){
 	
 	const sf::String & body = m.body;
 	if (body.size() > 3 && body.substr(0,4) == "BNRY"){
-		// Its a binary encoded message
-		sf::ByteArray data;
-		sf::String rest = body.substr (4, body.length() - 4);
-		sf::Base64::decodeToArray(rest, data);
-		mInputBuffer.append (data);
+		// Its a binary encoded message, decoding directly into the input buffer
+		size_t encodedLength = body.length() - 4;
+		size_t oldSize = mInputBuffer.size();
+		mInputBuffer.resize (oldSize + (encodedLength / 4) * 3 + 3);
+		size_t decoded = sf::Base64::decodeTo (body.data() + 4, encodedLength, mInputBuffer.c_array() + oldSize);
+		mInputBuffer.resize (oldSize + decoded);
 		if (mChanged) mChanged();
 		return;
 	}
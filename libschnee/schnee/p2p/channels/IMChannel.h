@@ -2,6 +2,8 @@
 
 #include <schnee/net/Channel.h>
 #include <schnee/im/IMClient.h>
+#include <schnee/tools/async/DelegateBase.h>
+#include <deque>
 
 namespace sf {
 
@@ -9,15 +11,35 @@ class IMDispatcher;
 
 /**
  * Channel implementation for use with Instant Messaging Systems
+ *
+ * Binary data is split into Base64 encoded stanzas which are paced through a token bucket,
+ * as IM servers tend to throttle or even disconnect clients sending too fast.
+ * Write callbacks are called as soon as the last stanza of the data left the IM client.
  */
-class IMChannel : public Channel {
+class IMChannel : public Channel, public DelegateBase {
 public:
+
+	/// Transport settings of an IMChannel
+	struct Settings {
+		Settings ();
+		size_t stanzaSize;		///< Maximum payload of one stanza in bytes (before Base64 encoding)
+		int    rate;			///< Sustained sending rate in bytes/s (of message bodies), <= 0 means no pacing
+		int    burst;			///< Size of the token bucket in bytes
+		int    maxPendingStanzas;	///< Maximum count of stanzas given to the IM client but not yet written
+	};
+
 	IMChannel (IMDispatcher * dispatcher, const sf::String & id, OnlineState state);
 	virtual ~IMChannel ();
-	
+
 	/// Returns current online state of im Channel
 	OnlineState state () { return mState; }
 
+	/// Changes the transport settings
+	void setSettings (const Settings & settings);
+
+	/// Returns the transport settings
+	const Settings & settings () const { return mSettings; }
+
 	// Implementation of Channel
 	virtual sf::Error error () const;
 	virtual sf::String errorMessage () const;
@@ -39,19 +61,44 @@ private:
 	void pushMessage (const sf::IMClient::Message & m);
 	/// Sets the online state
 	void setState    (OnlineState state);
-	
-	/// Sets connecting State
-	
+
+	/// Sends out stanzas as long as the token bucket and the pending limit allows it
+	void continueSending ();
+	/// Timer for continueSending fired
+	void onSendTimer ();
+	/// A stanza left the IM client
+	void onStanzaWritten (Error result, const ResultCallback & callback);
+	/// Fails all waiting writes
+	void failWrites (Error result);
 
 	// IM Stuff
 	friend class IMDispatcher;
 	IMDispatcher * mDispatcher;				///< Our boss
 	sf::String mId;							///< IM id
 	OnlineState mState;						///< Is the contact online
+	Error mError;							///< Error on sending
 
 	// Input queue
 	sf::ByteArray mInputBuffer;
 
+	// Output queue
+	struct OutputElement {
+		OutputElement () : offset (0), text (false) {}
+		ByteArrayPtr data;
+		size_t offset;			///< Already sent bytes
+		bool text;				///< Data is sent as it is (printable datagram header)
+		ResultCallback callback;
+	};
+	std::deque<OutputElement> mOutputQueue;
+
+	// Pacing
+	Settings mSettings;
+	double   mTokens;			///< Current content of the token bucket (in bytes)
+	sf::Time mLastRefill;		///< Last time the token bucket got refilled
+	int      mPendingStanzas;	///< Stanzas given to the IM client, not yet written
+	bool     mTimerActive;		///< Send timer is waiting
+	TimedCallHandle mSendTimer;
+
 	// Delegates
 	sf::VoidDelegate mChanged;
 
@@ -82,18 +82,27 @@ Error IMDispatcher::setConnectionString (const String & connectionString, const
 		sf::Log(LogError) << LOGID << "Did not found protocol \"" << protocol << "\"" << std::endl;
 		return sf::error::InvalidArgument;
 	}
+	client->setConnectionString (connectionString);
+	if (!password.empty()) client->setPassword (password);
+	return setClient (client);
+}
+
+Error IMDispatcher::setClient (IMClient * client) {
+	if (!client) return error::InvalidArgument;
+	if (mClient && mClient != client) {
+		disconnect ();
+		delete mClient;
+	}
 	mClient = client;
 	mClient->setIdentity(mClientName, "bot");
 	mClient->setFeatures (mFeatures);
-	mClient->setConnectionString (connectionString);
-	if (!password.empty()) mClient->setPassword (password);
 	mClient->subscribeRequest ()      = dMemFun (this, &IMDispatcher::onSubscribeRequest);
 	mClient->connectionStateChanged() = dMemFun (this, &IMDispatcher::onConnectionStateChanged);
 	mClient->contactRosterChanged()   = dMemFun (this, &IMDispatcher::onContactRosterChanged);
+	if (mClient->contactRosterChange())
+		*mClient->contactRosterChange() = dMemFun (this, &IMDispatcher::onContactRosterChange);
 	mClient->messageReceived()        = dMemFun (this, &IMDispatcher::onMessageReceived);
 	mClient->streamErrorReceived()    = dMemFun (this, &IMDispatcher::onServerStreamErrorRecevied);
-
-	mClient->setConnectionString(connectionString);
 	mHostId = mClient->ownId();
 	return NoError;
 }
@@ -115,9 +124,9 @@ void IMDispatcher::disconnect (){
 	if (mClient) {
 		mClient->disconnect();	// callback will be send asynchronous
 	}
-	mHosts.clear();
-	mUsers.clear();
-	if (mPeersChanged) xcall (mPeersChanged);
+	PeersChange change;
+	clearPeers (&change);
+	xcall (abind (dMemFun (this, &IMDispatcher::emitPeersChange), change));
 }
 
 sf::HostId IMDispatcher::hostId() const {
@@ -138,10 +147,10 @@ OnlineState IMDispatcher::onlineState (const HostId & user) const {
 
 IMDispatcher::HostInfoMap IMDispatcher::hosts(const UserId & user) const {
 	HostInfoMap result;
-	for (HostInfoMap::const_iterator i = mHosts.begin(); i != mHosts.end(); i++){
-		if (i->second.userId == user) {
-			result[i->first] = i->second;
-		}
+	// host ids are user id + '/' + resource, so they are neighbours in mHosts
+	String prefix = user + "/";
+	for (HostInfoMap::const_iterator i = mHosts.lower_bound (prefix); i != mHosts.end() && i->first.compare (0, prefix.size(), prefix) == 0; i++){
+		result[i->first] = i->second;
 	}
 	return result;
 }
@@ -180,9 +189,9 @@ Error IMDispatcher::removeContact (const sf::UserId & user) {
 	return mClient->removeContact(user);
 }
 
-bool IMDispatcher::send (const sf::IMClient::Message & m){
+bool IMDispatcher::send (const sf::IMClient::Message & m, const ResultCallback & callback){
 	if (mClient){
-		return mClient->sendMessage (m);
+		return mClient->sendMessage (m, callback);
 	} else {
 		sf::Log (LogError) << LOGID << "Not connected, cannot send a message" << std::endl;
 		return false;
@@ -269,10 +278,9 @@ void IMDispatcher::onConnectionStateChanged (sf::IMClient::ConnectionState state
 		}
 		// TODO: maybe better, if peers are just marked as being offline?
 		// But Skype and other Chat programs delete also all from the List. Tricky.
-		mHosts.clear();
-		mUsers.clear();
-		mRoster.clear ();
-		if (mPeersChanged) xcall (mPeersChanged);
+		PeersChange change;
+		clearPeers (&change);
+		xcall (abind (dMemFun (this, &IMDispatcher::emitPeersChange), change));
 
 	}
 	if (mOnlineStateChanged){
@@ -315,38 +323,111 @@ void IMDispatcher::onContactRosterChanged (){
 	if (!mClient) { // may happen - if client is already shut down and signal is async
 		return;
 	}
-	mRoster = mClient->contactRoster();
-	Log (LogInfo) << LOGID << "Updating roster to " << sf::toJSONEx (mRoster, sf::COMPRESS | sf::COMPACT) << std::endl;
-	mUsers.clear();
-	mHosts.clear();
-
+	IMClient::Contacts roster = mClient->contactRoster();
+	Log (LogInfo) << LOGID << "Updating roster to " << roster.size() << " contacts" << std::endl;
+	PeersChange change;
+	// updateContact erases from mRoster, so collect first
+	std::vector<HostId> removed;
 	for (sf::IMClient::Contacts::const_iterator i = mRoster.begin(); i != mRoster.end(); i++) {
-		const sf::IMClient::ContactInfo & info = i->second;
-		if (info.hide) continue;
-
-		UserInfo & userInfo = mUsers[info.id];
-		userInfo.userId    = info.id;
-		userInfo.name      = info.name;
-		userInfo.waitForSubscription = info.waitForSubscription;
-		userInfo.error     = info.error;
-		userInfo.errorText = info.errorText;
-		
-		for (sf::IMClient::ClientPresences::const_iterator j = info.presences.begin(); j != info.presences.end(); j++) {
+		if (roster.count (i->first) == 0) removed.push_back (i->first);
+	}
+	for (std::vector<HostId>::const_iterator i = removed.begin(); i != removed.end(); i++) {
+		updateContact (*i, 0, &change);
+	}
+	for (sf::IMClient::Contacts::const_iterator i = roster.begin(); i != roster.end(); i++) {
+		updateContact (i->first, &i->second, &change);
+	}
+	emitPeersChange (change);
+}
+
+void IMDispatcher::onContactRosterChange (const IMClient::RosterChange & rosterChange) {
+	if (!mClient) {
+		return;
+	}
+	if (rosterChange.full) {
+		return onContactRosterChanged ();
+	}
+	PeersChange change;
+	IMClient::ContactInfo info;
+	for (std::set<String>::const_iterator i = rosterChange.changed.begin(); i != rosterChange.changed.end(); i++) {
+		if (mClient->contactInfo (*i, &info)) updateContact (*i, &info, &change);
+		else updateContact (*i, 0, &change);
+	}
+	for (std::set<String>::const_iterator i = rosterChange.removed.begin(); i != rosterChange.removed.end(); i++) {
+		updateContact (*i, 0, &change);
+	}
+	emitPeersChange (change);
+}
+
+void IMDispatcher::updateContact (const String & id, const IMClient::ContactInfo * info, PeersChange * change) {
+	if (info) mRoster[id] = *info;
+	else mRoster.erase (id);
+	bool visible = info && !info->hide;
+
+	// Users
+	if (visible) {
+		UserInfo & userInfo = mUsers[info->id];
+		userInfo.userId    = info->id;
+		userInfo.name      = info->name;
+		userInfo.waitForSubscription = info->waitForSubscription;
+		userInfo.error     = info->error;
+		userInfo.errorText = info->errorText;
+		change->users.insert (info->id);
+	} else {
+		if (mUsers.erase (id) > 0) change->removedUsers.insert (id);
+	}
+
+	// Hosts; existing ones are kept, as they may carry feature information
+	HostSet current;
+	if (visible) {
+		for (sf::IMClient::ClientPresences::const_iterator j = info->presences.begin(); j != info->presences.end(); j++) {
 			const IMClient::ClientPresence & p = *j;
 			if (p.presence == IMClient::PS_OFFLINE) continue; // ignoring offline presences
-			if (j->id == mHostId) continue; // ignoring own id
-			HostInfo & hostInfo = mHosts[j->id];
+			if (p.id == mHostId) continue; // ignoring own id
+			current.insert (p.id);
+			if (mHosts.count (p.id) > 0) continue;
+			HostInfo & hostInfo = mHosts[p.id];
 			hostInfo.hostId = p.id;
-			hostInfo.userId = userInfo.userId;
-			hostInfo.name  = getResourceName (p.id);
+			hostInfo.userId = info->id;
+			hostInfo.name   = getResourceName (p.id);
+			change->online.insert (p.id);
+		}
+	}
+	String prefix = id + "/";
+	HostInfoMap::iterator i = mHosts.lower_bound (prefix);
+	while (i != mHosts.end() && i->first.compare (0, prefix.size(), prefix) == 0) {
+		if (current.count (i->first) == 0) {
+			change->offline.insert (i->first);
+			mHosts.erase (i++);
+		} else {
+			i++;
 		}
 	}
+}
 
-	// Updating all Channels...
-	for (ChannelMap::iterator i = mChannels.begin(); i != mChannels.end(); i++){
-		OnlineState s = onlineState (i->first);
-		i->second->setState (s);
+void IMDispatcher::clearPeers (PeersChange * change) {
+	for (HostInfoMap::const_iterator i = mHosts.begin(); i != mHosts.end(); i++) {
+		change->offline.insert (i->first);
+	}
+	for (UserInfoMap::const_iterator i = mUsers.begin(); i != mUsers.end(); i++) {
+		change->removedUsers.insert (i->first);
+	}
+	mHosts.clear();
+	mUsers.clear();
+	mRoster.clear();
+}
+
+void IMDispatcher::emitPeersChange (const PeersChange & change) {
+	// Updating affected channels
+	for (HostSet::const_iterator i = change.online.begin(); i != change.online.end(); i++) {
+		ChannelMap::iterator j = mChannels.find (*i);
+		if (j != mChannels.end()) j->second->setState (onlineState (*i));
+	}
+	for (HostSet::const_iterator i = change.offline.begin(); i != change.offline.end(); i++) {
+		ChannelMap::iterator j = mChannels.find (*i);
+		if (j != mChannels.end()) j->second->setState (onlineState (*i));
 	}
+	if (mPeersChange) mPeersChange (change);
 	if (mPeersChanged) mPeersChanged ();
 }
 
@@ -53,9 +53,19 @@ public:
 
 	virtual SubscribeRequestDelegate & subscribeRequest () { return mSubscribeRequest; }
 	virtual VoidSignal & peersChanged () { return mPeersChanged; }
+	virtual PeersChangeSignal & peersChange () { return mPeersChange; }
 	virtual ServerStreamErrorSignal & serverStreamErrorReceived () { return mServerStreamErrorReceived; }
 	virtual OnlineStateChangedSignal & onlineStateChanged () { return mOnlineStateChanged; }
-	
+
+	/// Uses an already created IM client instead of one created through setConnectionString
+	/// (e.g. a local stand-in for testing). IMDispatcher takes ownership.
+	Error setClient (IMClient * client);
+
+	/// Sets the transport settings for all IMChannels created from now on
+	void setChannelSettings (const IMChannel::Settings & settings) { mChannelSettings = settings; }
+
+	/// Returns the transport settings for new IMChannels
+	const IMChannel::Settings & channelSettings () const { return mChannelSettings; }
 
 
 private:
@@ -107,8 +117,9 @@ private:
 	///@{
 
 	/// Sends a message (Used by IMChannel)
+	/// The callback is called when the message left the IMClient
 	/// @return true if message was given successfully to the IMClient
-	bool send(const sf::IMClient::Message & m);
+	bool send(const sf::IMClient::Message & m, const ResultCallback & callback = ResultCallback());
 	
 	/// IMClient is authenticated
 	bool isAuthenticated () const { return mClient ? mClient->isAuthenticated() : false; }
@@ -136,6 +147,8 @@ private:
 	void onConnectionStateChanged(sf::IMClient::ConnectionState state);
 	/// Handler for changed contact roster
 	void onContactRosterChanged();
+	/// Handler for incremental contact roster changes
+	void onContactRosterChange (const IMClient::RosterChange & change);
 	/// Message received
 	void onMessageReceived(const sf::IMClient::Message & m);
 	/// Stream error received
@@ -145,10 +158,21 @@ private:
 
 	///@}
 
+	///@name Peer tracking
+	///@{
+	/// Updates users/hosts of one contact (info = 0 if it was removed) and notes the differences
+	void updateContact (const String & id, const IMClient::ContactInfo * info, PeersChange * change);
+	/// Removes all users/hosts and notes them as gone
+	void clearPeers (PeersChange * change);
+	/// Updates channel states and emits peersChange/peersChanged
+	void emitPeersChange (const PeersChange & change);
+	///@}
+
 	// Delegates
 	ChannelCreationDelegate mChannelCreated;
 	SubscribeRequestDelegate mSubscribeRequest;
 	VoidSignal mPeersChanged;
+	PeersChangeSignal mPeersChange;
 	ServerStreamErrorSignal mServerStreamErrorReceived;
 	OnlineStateChangedSignal mOnlineStateChanged;
 
@@ -159,6 +183,7 @@ private:
 	HostId mHostId;			///< Own host id
 	int    mTimeOutMs;		///< Timeout for responding of channels (in ms)
 	Authentication * mAuthentication;
+	IMChannel::Settings mChannelSettings; ///< Settings for new IMChannels
 
 	String mClientName;			///< Own client name
 	std::vector<String> mFeatures; ///< Own feature list
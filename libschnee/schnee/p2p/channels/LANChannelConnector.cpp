@@ -0,0 +1,276 @@
+#include "LANChannelConnector.h"
+#include <schnee/tools/ArgSplit.h>
+#include <schnee/tools/Base64.h>
+#include <schnee/tools/Log.h>
+#include <stdlib.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace sf {
+
+/*
+ * Announcement format (one UDP datagram):
+ * lanAnnounce "HOSTID" FINGERPRINT PORT TIMESTAMP SIGNATURE
+ * Fingerprint and signature (Base64) are "-" if authentication is disabled.
+ * The timestamp (ms since 1970, UTC) is signed, too. With authentication stale
+ * announcements and announcements not newer than the last one of a peer (replays)
+ * are rejected.
+ */
+
+/// Command of announcements
+static const char * gAnnounceCmd = "lanAnnounce";
+/// Placeholder for empty fields
+static const char * gEmptyField = "-";
+/// Automatic connection attempts to a neighbor are not repeated earlier (ms)
+static const int gAutoConnectBackoffMs = 30000;
+/// Timeout of automatic connection attempts (ms)
+static const int gAutoConnectTimeOutMs = 10000;
+/// Maximum age (and clock difference) of authenticated announcements (ms)
+static const int64_t gMaxAnnounceAgeMs = 60000;
+
+/// Current time in ms since 1970 (UTC)
+static int64_t announceTime () {
+	static const boost::posix_time::ptime epoch (boost::gregorian::date (1970, 1, 1));
+	return (boost::posix_time::microsec_clock::universal_time() - epoch).total_milliseconds();
+}
+
+/// Quotes a field for argSplit
+static String quote (const String & s) {
+	String result = "\"";
+	for (String::const_iterator i = s.begin(); i != s.end(); i++) {
+		if (*i == '\"' || *i == '\\') result += '\\';
+		result += *i;
+	}
+	result += '\"';
+	return result;
+}
+
+LANChannelConnector::LANChannelConnector () {
+	SF_REGISTER_ME;
+	mGroupPort          = -1;
+	mStarted            = false;
+	mAutoConnect        = true;
+	mSignFailed         = false;
+	mAnnounceIntervalMs = 5000;
+	mAuthentication     = 0;
+	mTcp.channelCreated() = dMemFun (this, &LANChannelConnector::onTcpChannelCreated);
+}
+
+LANChannelConnector::~LANChannelConnector () {
+	SF_UNREGISTER_ME;
+	stop ();
+	mSocket.readyRead().clear();
+}
+
+sf::Error LANChannelConnector::start (const String & group, int port, const String & interfaceAddress) {
+	if (mStarted) return error::ExistsAlready;
+	Error e = mTcp.start ();
+	if (e) return e;
+	mSocket.readyRead() = dMemFun (this, &LANChannelConnector::onReadyRead);
+	e = mSocket.bindMulticast (group, port, interfaceAddress);
+	if (e) {
+		Log (LogWarning) << LOGID << "Could not join " << group << ":" << port << ": " << toString (e) << std::endl;
+		mTcp.stop ();
+		return e;
+	}
+	mGroup     = group;
+	mGroupPort = port;
+	mStarted   = true;
+	Log (LogInfo) << LOGID << "Announcing TCP port " << mTcp.port() << " to " << group << ":" << port << std::endl;
+	onAnnounceTimer ();
+	return NoError;
+}
+
+void LANChannelConnector::stop () {
+	if (!mStarted) return;
+	cancelTimer (mAnnounceTimer);
+	mSocket.close ();
+	mTcp.stop ();
+	mNeighbors.clear ();
+	mBackoff.clear ();
+	mStarted = false;
+}
+
+LANChannelConnector::NeighborVec LANChannelConnector::neighbors () const {
+	NeighborVec result;
+	for (NeighborMap::const_iterator i = mNeighbors.begin(); i != mNeighbors.end(); i++) {
+		result.push_back (i->second);
+	}
+	return result;
+}
+
+sf::Error LANChannelConnector::createChannel (const HostId & target, const ResultCallback & callback, int timeOutMs) {
+	if (!mStarted) return error::NotInitialized;
+	return connectNeighbor (target, callback, timeOutMs);
+}
+
+void LANChannelConnector::setHostId (const sf::HostId & id) {
+	mHostId = id;
+	mTcp.setHostId (id);
+}
+
+void LANChannelConnector::setAuthentication (Authentication * auth) {
+	mAuthentication = auth;
+	mTcp.setAuthentication (auth);
+}
+
+void LANChannelConnector::onAnnounceTimer () {
+	if (!mStarted) return;
+	announce ();
+	// forgetting silent neighbors
+	Time outdated = futureInMs (-3 * mAnnounceIntervalMs);
+	for (NeighborMap::iterator i = mNeighbors.begin(); i != mNeighbors.end();) {
+		if (i->second.lastSeen < outdated) {
+			Log (LogInfo) << LOGID << mHostId << " lost neighbor " << i->first << std::endl;
+			mNeighbors.erase (i++);
+		} else {
+			i++;
+		}
+	}
+	for (ChannelMap::iterator i = mChannels.begin(); i != mChannels.end();) {
+		if (i->second.expired()) mChannels.erase (i++);
+		else i++;
+	}
+	// replays of older announcements are rejected as stale anyway
+	int64_t oldest = announceTime () - gMaxAnnounceAgeMs;
+	for (TimestampMap::iterator i = mTimestamps.begin(); i != mTimestamps.end();) {
+		if (i->second < oldest) mTimestamps.erase (i++);
+		else i++;
+	}
+	mAnnounceTimer = xcallTimed (dMemFun (this, &LANChannelConnector::onAnnounceTimer), futureInMs (mAnnounceIntervalMs));
+}
+
+void LANChannelConnector::announce () {
+	if (mHostId.empty()) return; // not yet
+	String fingerprint = gEmptyField;
+	String signature   = gEmptyField;
+	int64_t timestamp  = announceTime ();
+	if (mAuthentication && mAuthentication->key()) {
+		fingerprint = mAuthentication->certFingerprint();
+		ByteArray sig;
+		if (mAuthentication->key()->signData (signedData (mHostId, fingerprint, mTcp.port(), timestamp), &sig)) {
+			// e.g. not supported by old GnuTLS versions; would fail on every announcement
+			if (!mSignFailed) {
+				Log (LogWarning) << LOGID << "Could not sign announcement, not announcing in the local network" << std::endl;
+				mSignFailed = true;
+			}
+			return;
+		}
+		signature = Base64::encodeFromArray (sig);
+	}
+	String announcement = String (gAnnounceCmd) + " " + quote (mHostId) + " " + fingerprint + " " + toString (mTcp.port()) + " " + toString (timestamp) + " " + signature;
+	Error e = mSocket.sendTo (mGroup, mGroupPort, createByteArrayPtr (announcement));
+	if (e) {
+		Log (LogWarning) << LOGID << "Could not send announcement: " << toString (e) << std::endl;
+	}
+}
+
+void LANChannelConnector::onReadyRead () {
+	String from;
+	ByteArrayPtr data;
+	while ((data = mSocket.recvFrom (&from))) {
+		if (mStarted) onDatagram (*data, from);
+	}
+}
+
+void LANChannelConnector::onDatagram (const ByteArray & data, const String & from) {
+	ArgumentList list;
+	sf::argSplit (String (data.begin(), data.end()), &list);
+	if (list.size() != 6 || list[0] != gAnnounceCmd) return; // net noise
+	const HostId & host = list[1];
+	const String & fingerprint = list[2];
+	int port = atoi (list[3].c_str());
+	int64_t timestamp = strtoll (list[4].c_str(), 0, 10);
+	if (host == mHostId || mHostId.empty()) return; // own announcement
+	if (port <= 0 || port > 65535) return;
+	if (mAuthentication) {
+		Authentication::CertInfo info = mAuthentication->get (host);
+		if (info.type != Authentication::CT_PEER || info.fingerprint() != fingerprint) {
+			Log (LogInfo) << LOGID << mHostId << " ignoring announcement of unknown peer " << host << " from " << from << std::endl;
+			return;
+		}
+		ByteArray signature;
+		Base64::decodeToArray (list[5], signature);
+		if (!info.cert->verifyData (signedData (host, fingerprint, port, timestamp), signature)) {
+			Log (LogWarning) << LOGID << mHostId << " ignoring announcement with bad signature for " << host << " from " << from << std::endl;
+			return;
+		}
+		int64_t age = announceTime () - timestamp;
+		if (age > gMaxAnnounceAgeMs || age < -gMaxAnnounceAgeMs) {
+			Log (LogWarning) << LOGID << mHostId << " ignoring stale announcement of " << host << " from " << from << " (age " << age << "ms)" << std::endl;
+			return;
+		}
+		TimestampMap::iterator t = mTimestamps.find (host);
+		if (t != mTimestamps.end() && timestamp <= t->second) {
+			Log (LogWarning) << LOGID << mHostId << " ignoring replayed announcement of " << host << " from " << from << std::endl;
+			return;
+		}
+		mTimestamps[host] = timestamp;
+	}
+
+	NeighborMap::iterator i = mNeighbors.find (host);
+	if (i == mNeighbors.end()) {
+		Log (LogProfile) << LOGID << mHostId << " found neighbor " << host << " at " << from << ":" << port << std::endl;
+		i = mNeighbors.insert (std::make_pair (host, Neighbor())).first;
+	}
+	Neighbor & n = i->second;
+	n.host     = host;
+	n.address  = from;
+	n.port     = port;
+	n.lastSeen = currentTime ();
+
+	// the one with the smaller id connects
+	if (!mAutoConnect || !(mHostId < host) || hasChannel (host) || mAutoConnecting.count (host) > 0) return;
+	BackoffMap::iterator b = mBackoff.find (host);
+	if (b != mBackoff.end()) {
+		if (b->second > currentTime()) return;
+		mBackoff.erase (b);
+	}
+	Error e = connectNeighbor (host, abind (dMemFun (this, &LANChannelConnector::onAutoConnectResult), host), gAutoConnectTimeOutMs);
+	if (!e) mAutoConnecting.insert (host);
+}
+
+ByteArray LANChannelConnector::signedData (const HostId & host, const String & fingerprint, int port, int64_t timestamp) {
+	return ByteArray (String (gAnnounceCmd) + "\n" + host + "\n" + fingerprint + "\n" + toString (port) + "\n" + toString (timestamp));
+}
+
+sf::Error LANChannelConnector::connectNeighbor (const HostId & host, const ResultCallback & callback, int timeOutMs) {
+	NeighborMap::const_iterator i = mNeighbors.find (host);
+	if (i == mNeighbors.end()) return error::NotFound;
+	TCPChannelConnector::ConnectDetails details;
+	details.error = NoError;
+	details.port  = i->second.port;
+	details.addresses.push_back (i->second.address);
+	Log (LogInfo) << LOGID << mHostId << " connecting neighbor " << host << " at " << i->second.address << ":" << i->second.port << std::endl;
+	return mTcp.connectDirect (host, details, callback, timeOutMs);
+}
+
+void LANChannelConnector::onAutoConnectResult (Error result, const HostId & host) {
+	mAutoConnecting.erase (host);
+	if (result) {
+		Log (LogInfo) << LOGID << mHostId << " could not connect neighbor " << host << ": " << toString (result) << std::endl;
+		mBackoff[host] = futureInMs (gAutoConnectBackoffMs);
+	}
+}
+
+void LANChannelConnector::onTcpChannelCreated (const HostId & target, ChannelPtr channel, bool requested) {
+	for (ChannelPtr c = channel; c; c = c->next()) {
+		TCPSocket * socket = dynamic_cast<TCPSocket*> (c.get());
+		if (socket) {
+			socket->setToNeighbor (true);
+			break;
+		}
+	}
+	mChannels[target] = channel;
+	// automatic connections were not requested by anyone
+	bool automatic = mAutoConnecting.count (target) > 0;
+	notify (mChannelCreated, target, channel, requested && !automatic);
+}
+
+bool LANChannelConnector::hasChannel (const HostId & host) const {
+	ChannelMap::const_iterator i = mChannels.find (host);
+	if (i == mChannels.end()) return false;
+	ChannelPtr channel = i->second.lock();
+	return channel && channel->state() == Channel::Connected;
+}
+
+}
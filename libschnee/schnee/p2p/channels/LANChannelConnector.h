@@ -0,0 +1,138 @@
+#pragma once
+
+#include <schnee/tools/async/DelegateBase.h>
+#include <schnee/net/UDPSocket.h>
+#include "TCPChannelConnector.h"
+
+#include <boost/weak_ptr.hpp>
+
+namespace sf {
+
+/**
+ * LANChannelConnector finds peers in the local network and connects to them directly,
+ * without exchanging addresses over an existing (e.g. IM) channel first.
+ *
+ * Peers announce their host id, certificate fingerprint and TCP port periodically via
+ * UDP multicast. With authentication enabled announcements are signed with the own key
+ * (including a timestamp) and only fresh announcements of peers with a known certificate
+ * are accepted.
+ *
+ * Neighbors are connected as soon as they are seen (the one with the smaller host id connects).
+ * The channels are built like the ones of TCPChannelConnector (TLS + AuthProtocol)
+ * and are marked as ChannelInfo::toNeighbor.
+ */
+class LANChannelConnector : public DelegateBase, public ChannelProvider {
+public:
+	LANChannelConnector ();
+	virtual ~LANChannelConnector ();
+
+	/// Default multicast group of announcements (organization local scope)
+	static const char * defaultGroup () { return "239.255.83.70"; }
+	/// Default multicast port of announcements
+	static const int defaultPort = 35311;
+
+	///@name State
+	///@{
+
+	/// Starts the TCP server, announcing and looking for neighbors
+	/// @param group multicast group of the announcements
+	/// @param port multicast port (shared with other LANChannelConnectors of the host)
+	/// @param interfaceAddress address of the network interface to use, default interface if empty
+	sf::Error start (const String & group = defaultGroup(), int port = defaultPort, const String & interfaceAddress = "");
+
+	/// Stops announcing and the TCP server
+	void stop ();
+
+	/// Returns whether started
+	bool isStarted () const { return mStarted; }
+
+	/// Returns TCP port of the server
+	int port () const { return mTcp.port(); }
+
+	/// Sets the announcement interval, neighbors are forgotten after 3 missed announcements
+	/// Default: 5000ms
+	void setAnnounceInterval (int ms) { mAnnounceIntervalMs = ms; }
+
+	/// Connect neighbors as soon as they are seen (default: true)
+	void setAutoConnect (bool v) { mAutoConnect = v; }
+
+	/// A peer seen in the local network
+	struct Neighbor {
+		Neighbor () : port (-1) {}
+		HostId host;
+		String address;	///< Address the announcement came from
+		int    port;	///< TCP port
+		Time   lastSeen;
+	};
+	typedef std::vector<Neighbor> NeighborVec;
+
+	/// Returns currently known neighbors
+	NeighborVec neighbors () const;
+
+	/// Returns true if host was seen in the local network
+	bool isNeighbor (const HostId & host) const { return mNeighbors.count (host) > 0; }
+
+	///@}
+
+	// Implementation of ChannelProvider
+	virtual sf::Error createChannel (const HostId & target, const ResultCallback & callback, int timeOutMs = -1);
+	virtual bool providesInitialChannels () { return true; }
+	virtual void setHostId (const sf::HostId & id);
+	virtual void setAuthentication (Authentication * auth);
+	virtual ChannelCreationDelegate & channelCreated () { return mChannelCreated; }
+
+private:
+	/// Sends an announcement and schedules the next one
+	void onAnnounceTimer ();
+
+	/// Sends own announcement to the multicast group
+	void announce ();
+
+	/// Incoming announcements
+	void onReadyRead ();
+
+	/// Handles one received datagram
+	void onDatagram (const ByteArray & data, const String & from);
+
+	/// Data which is signed in an announcement
+	static ByteArray signedData (const HostId & host, const String & fingerprint, int port, int64_t timestamp);
+
+	/// Connects a known neighbor
+	sf::Error connectNeighbor (const HostId & host, const ResultCallback & callback, int timeOutMs);
+
+	/// Result of an automatic connection
+	void onAutoConnectResult (Error result, const HostId & host);
+
+	/// Channel from the TCPChannelConnector (outgoing and incoming)
+	void onTcpChannelCreated (const HostId & target, ChannelPtr channel, bool requested);
+
+	/// Returns true if there is a living channel to host created by us
+	bool hasChannel (const HostId & host) const;
+
+	typedef std::map<HostId, Neighbor> NeighborMap;
+	typedef std::map<HostId, boost::weak_ptr<Channel> > ChannelMap;
+	typedef std::map<HostId, Time> BackoffMap;
+	typedef std::map<HostId, int64_t> TimestampMap;
+
+	TCPChannelConnector mTcp;			///< Builds the channels
+	UDPSocket mSocket;					///< Sends and receives announcements
+	String    mGroup;					///< Multicast group
+	int       mGroupPort;				///< Multicast port
+	bool      mStarted;
+	bool      mAutoConnect;
+	int       mAnnounceIntervalMs;
+	TimedCallHandle mAnnounceTimer;
+
+	NeighborMap mNeighbors;				///< Neighbors seen
+	std::set<HostId> mAutoConnecting;	///< Neighbors being connected automatically
+	ChannelMap mChannels;				///< Channels to neighbors
+	BackoffMap mBackoff;				///< No automatic connection attempts to a neighbor before
+	TimestampMap mTimestamps;			///< Timestamp of the last accepted announcement per peer (against replays)
+	bool mSignFailed;					///< Signing announcements failed already (warned)
+
+	HostId mHostId;
+	Authentication * mAuthentication;
+	ChannelCreationDelegate mChannelCreated;
+};
+
+}
@@ -0,0 +1,266 @@
+#include "LocalChannelConnector.h"
+#ifndef WIN32
+#include <schnee/tools/FileTools.h>
+#include <schnee/tools/Log.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sf {
+
+/// Short, file system safe name for a host id (FNV-1a, 64 bit)
+static String socketName (const HostId & host) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (String::const_iterator i = host.begin(); i != host.end(); i++) {
+		hash ^= (unsigned char) *i;
+		hash *= 1099511628211ULL;
+	}
+	char buffer[32];
+	snprintf (buffer, sizeof (buffer), "%016llx.sock", (unsigned long long) hash);
+	return buffer;
+}
+
+LocalChannelConnector::LocalChannelConnector () {
+	SF_REGISTER_ME;
+	mDirectory = defaultDirectory ();
+	mStarted   = false;
+	mTimeOutMs = 10000;
+	mAuthentication = 0;
+	mServer.newConnection () = dMemFun (this, &LocalChannelConnector::onNewConnection);
+}
+
+LocalChannelConnector::~LocalChannelConnector () {
+	SF_UNREGISTER_ME;
+	mServer.newConnection().clear();
+	mServer.close ();
+}
+
+String LocalChannelConnector::defaultDirectory () {
+	const char * runtimeDir = getenv ("XDG_RUNTIME_DIR");
+	if (runtimeDir && *runtimeDir) return String (runtimeDir) + "/schnee";
+	return "/tmp/schnee-" + toString ((int) ::getuid());
+}
+
+sf::Error LocalChannelConnector::start () {
+	if (mStarted) return error::ExistsAlready;
+	::mkdir (mDirectory.c_str(), S_IRWXU);
+	// the directory protects the sockets, it may not belong to someone else
+	struct stat s;
+	if (::lstat (mDirectory.c_str(), &s) != 0 || !S_ISDIR (s.st_mode)) {
+		Log (LogWarning) << LOGID << "Could not create socket directory " << mDirectory << std::endl;
+		return error::ServerError;
+	}
+	if (s.st_uid != ::getuid() || (s.st_mode & (S_IRWXG | S_IRWXO))) {
+		Log (LogWarning) << LOGID << "Socket directory " << mDirectory << " is accessible by others, not using it" << std::endl;
+		return error::NoPerm;
+	}
+	mStarted = true;
+	return listen ();
+}
+
+void LocalChannelConnector::stop () {
+	mServer.close ();
+	mStarted = false;
+}
+
+String LocalChannelConnector::socketPath (const HostId & host) const {
+	return mDirectory + "/" + socketName (host);
+}
+
+sf::Error LocalChannelConnector::createChannel (const HostId & target, const ResultCallback & callback, int timeOutMs) {
+	if (!mStarted || mHostId.empty()) return error::NotInitialized;
+	String path = socketPath (target);
+	if (!fileExists (path)) return error::NotFound; // not on this host
+	AsyncOpId id = genFreeId ();
+	CreateChannelOp * op = new CreateChannelOp (sf::regTimeOutMs (timeOutMs));
+	op->setId (id);
+	op->setState (CreateChannelOp::Connecting);
+	op->callback = callback;
+	op->target   = target;
+	op->socket   = LocalSocketPtr (new LocalSocket());
+	Error e = op->socket->connectToPath (path, aOpMemFun (op, &LocalChannelConnector::onConnect));
+	if (e) {
+		delete op;
+		return e;
+	}
+	addAsyncOp (op);
+	return NoError;
+}
+
+void LocalChannelConnector::setHostId (const sf::HostId & id) {
+	if (id == mHostId) return;
+	mHostId = id;
+	if (mStarted) listen ();
+}
+
+sf::Error LocalChannelConnector::listen () {
+	mServer.close ();
+	if (mHostId.empty()) return NoError; // later
+	Error e = mServer.listen (socketPath (mHostId));
+	if (e) {
+		Log (LogWarning) << LOGID << "Could not listen for local connections to " << mHostId << ": " << toString (e) << std::endl;
+	}
+	return e;
+}
+
+bool LocalChannelConnector::checkPeer (const LocalSocketPtr & socket) {
+	int uid = -1;
+	if (socket->peerUserId (&uid) || uid != (int) ::getuid()) {
+		Log (LogWarning) << LOGID << "Local peer runs as another user (" << uid << "), rejecting" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+TLSChannelPtr LocalChannelConnector::createTlsChannel (const LocalSocketPtr & socket) const {
+	TLSChannelPtr tlsChannel (new TLSChannel (socket));
+	tlsChannel->setKey (mAuthentication->certificate(), mAuthentication->key());
+	// we do that implicit
+	tlsChannel->disableAuthentication ();
+	return tlsChannel;
+}
+
+void LocalChannelConnector::onConnect (CreateChannelOp * op, Error result) {
+	if (!result && !checkPeer (op->socket)) result = error::AuthError;
+	if (result) {
+		Log (LogInfo) << LOGID << "Could not connect local socket of " << op->target << ": " << toString (result) << std::endl;
+		notifyAsync (op->callback, result);
+		sf::safeRemove (op->socket);
+		delete op;
+		return;
+	}
+	if (!mAuthentication) {
+		op->channel = op->socket;
+		startAuthProtocol (op);
+		return;
+	}
+	op->setState (CreateChannelOp::TlsHandshaking);
+	op->tlsChannel = createTlsChannel (op->socket);
+	op->tlsChannel->enableSessionResumption (tlsSessionKey (mHostId, op->target, mAuthentication));
+	Error e = op->tlsChannel->clientHandshake (TLSChannel::X509, op->target, aOpMemFun (op, &LocalChannelConnector::onTlsHandshake));
+	if (e) {
+		xcall (abind (aOpMemFun (op, &LocalChannelConnector::onTlsHandshake), e));
+	}
+	addAsyncOp (op);
+}
+
+void LocalChannelConnector::onTlsHandshake (CreateChannelOp * op, Error result) {
+	if (!result) {
+		Authentication::CertInfo info = mAuthentication->get (op->target);
+		if (info.type != Authentication::CT_PEER) {
+			Log (LogProfile) << LOGID << "Could not do TLS authentication as no certificate is stored" << std::endl;
+			result = error::AuthError;
+		} else {
+			result = op->tlsChannel->authenticate (info.cert.get(), op->target);
+		}
+	}
+	if (result) {
+		Log (LogInfo) << LOGID << "TLS authentication of local peer " << op->target << " failed: " << toString (result) << std::endl;
+		notifyAsync (op->callback, error::AuthError);
+		sf::safeRemove (op->tlsChannel);
+		delete op;
+		return;
+	}
+	op->channel = op->tlsChannel;
+	startAuthProtocol (op);
+}
+
+void LocalChannelConnector::startAuthProtocol (CreateChannelOp * op) {
+	op->setState (CreateChannelOp::Authenticating);
+	op->authProtocol.init (op->channel, mHostId);
+	op->authProtocol.setAuthentication (mAuthentication);
+	op->authProtocol.finished() = aOpMemFun (op, &LocalChannelConnector::onAuthProtocolFinished);
+	op->authProtocol.connect (op->target, op->lastingTimeMs (0.66));
+	addAsyncOp (op);
+}
+
+void LocalChannelConnector::onAuthProtocolFinished (CreateChannelOp * op, Error result) {
+	if (result) {
+		Log (LogInfo) << LOGID << "Authentication failed (" << toString (result) << ") for " << op->target << std::endl;
+		notifyAsync (op->callback, error::AuthError);
+		sf::safeRemove (op->channel);
+		delete op;
+		return;
+	}
+	notifyAsync (mChannelCreated, op->target, op->channel, true);
+	notifyAsync (op->callback, NoError);
+	delete op;
+}
+
+void LocalChannelConnector::onNewConnection () {
+	LocalSocketPtr socket;
+	while ((socket = mServer.nextPendingConnection())) {
+		if (mHostId.empty() || !checkPeer (socket)) {
+			socket->close ();
+			continue;
+		}
+		AcceptConnectionOp * op = new AcceptConnectionOp (sf::regTimeOutMs (mTimeOutMs));
+		op->setId (genFreeId ());
+		op->socket = socket;
+		if (!mAuthentication) {
+			op->channel = socket;
+			startAuthProtocol (op);
+			continue;
+		}
+		op->setState (AcceptConnectionOp::TlsHandshaking);
+		op->tlsChannel = createTlsChannel (socket);
+		op->tlsChannel->enableSessionResumption ();
+		Error e = op->tlsChannel->serverHandshake (TLSChannel::X509, aOpMemFun (op, &LocalChannelConnector::onAcceptTlsHandshake));
+		if (e) {
+			Log (LogWarning) << LOGID << "TLS failed immediately on local connection " << toString (e) << std::endl;
+			delete op;
+			continue;
+		}
+		addAsyncOp (op);
+	}
+}
+
+void LocalChannelConnector::onAcceptTlsHandshake (AcceptConnectionOp * op, Error result) {
+	if (!result) {
+		x509::CertificatePtr peerCert = op->tlsChannel->peerCertificate();
+		if (peerCert) peerCert->getCommonName (&op->target);
+		Authentication::CertInfo info = mAuthentication->get (op->target);
+		if (!peerCert || info.type != Authentication::CT_PEER) {
+			result = error::AuthError;
+		} else {
+			result = op->tlsChannel->authenticate (info.cert.get(), op->target);
+		}
+	}
+	if (result) {
+		Log (LogInfo) << LOGID << "TLS authentication of incoming local connection failed: " << toString (result) << std::endl;
+		sf::safeRemove (op->tlsChannel);
+		delete op;
+		return;
+	}
+	op->channel = op->tlsChannel;
+	startAuthProtocol (op);
+}
+
+void LocalChannelConnector::startAuthProtocol (AcceptConnectionOp * op) {
+	op->setState (AcceptConnectionOp::Authenticating);
+	op->authProtocol.init (op->channel, mHostId);
+	op->authProtocol.setAuthentication (mAuthentication);
+	op->authProtocol.finished () = aOpMemFun (op, &LocalChannelConnector::onAcceptAuthFinished);
+	op->authProtocol.passive (String(), -1);
+	addAsyncOp (op);
+}
+
+void LocalChannelConnector::onAcceptAuthFinished (AcceptConnectionOp * op, Error result) {
+	if (!result && mAuthentication && op->authProtocol.other() != op->target) {
+		Log (LogWarning) << LOGID << "Local peer told another name than in its certificate" << std::endl;
+		result = error::AuthError;
+	}
+	if (result) {
+		Log (LogInfo) << LOGID << "Authentication failed (" << toString (result) << ") for incoming local connection" << std::endl;
+		sf::safeRemove (op->channel);
+		delete op;
+		return;
+	}
+	notifyAsync (mChannelCreated, op->authProtocol.other(), op->channel, false);
+	delete op;
+}
+
+}
+
+#endif
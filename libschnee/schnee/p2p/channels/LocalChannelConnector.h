@@ -0,0 +1,146 @@
+#pragma once
+
+#include <schnee/tools/async/AsyncOpBase.h>
+#include "ChannelProvider.h"
+
+#include <schnee/net/LocalServer.h>
+#include <schnee/net/LocalSocket.h>
+#include <schnee/net/TLSChannel.h>
+#include <schnee/p2p/channels/AuthProtocol.h>
+
+namespace sf {
+
+/**
+ * LocalChannelConnector connects peers running on the same host via Unix domain sockets,
+ * without TCP.
+ *
+ * Every peer listens on a socket named after its host id in a directory only accessible
+ * by the own user. A peer is co-located if its socket exists; otherwise createChannel fails
+ * immediately with NotFound.
+ *
+ * Both sides require the other process to run as the same user (peer credentials of the socket).
+ * That doesn't prove the host id, other instances of the user may use other accounts. So with
+ * Authentication set the channel gets TLS encrypted and both sides authenticate their certificates
+ * like on TCP; without, AuthProtocol runs over the plain socket and the channel is not authenticated.
+ *
+ * Not available on Windows.
+ */
+class LocalChannelConnector : public AsyncOpBase, public ChannelProvider {
+public:
+	typedef shared_ptr<LocalSocket> LocalSocketPtr;
+
+	LocalChannelConnector ();
+	virtual ~LocalChannelConnector ();
+
+	///@name State
+	///@{
+
+	/// Default socket directory ($XDG_RUNTIME_DIR/schnee or /tmp/schnee-[uid])
+	static String defaultDirectory ();
+
+	/// Sets the socket directory, must be done before start
+	void setDirectory (const String & directory) { mDirectory = directory; }
+
+	/// Returns the socket directory
+	const String & directory () const { return mDirectory; }
+
+	/// Creates the socket directory and starts listening (as soon as the host id is set)
+	sf::Error start ();
+
+	/// Stops listening
+	void stop ();
+
+	/// Returns true if started
+	bool isStarted () const { return mStarted; }
+
+	/// Returns true if the server is listening
+	bool isListening () const { return mServer.isListening(); }
+
+	/// Set the timeout connecting entities do have (in ms)
+	/// default = 10000ms
+	void setTimeOut (int timeOutMs) { mTimeOutMs = timeOutMs; }
+
+	/// Path of the socket of a host
+	String socketPath (const HostId & host) const;
+
+	///@}
+
+	// Implementation of ChannelProvider
+	virtual sf::Error createChannel (const HostId & target, const ResultCallback & callback, int timeOutMs = -1);
+	virtual bool providesInitialChannels () { return true; }
+	virtual void setHostId (const sf::HostId & id);
+	virtual void setAuthentication (Authentication * auth) { mAuthentication = auth; }
+	virtual ChannelCreationDelegate & channelCreated () { return mChannelCreated; }
+
+private:
+	struct CreateChannelOp;
+	struct AcceptConnectionOp;
+
+	/// Listens on the socket of own host id
+	sf::Error listen ();
+
+	/// Checks that the other side runs as the same user
+	bool checkPeer (const LocalSocketPtr & socket);
+
+	/// Creates the TLS channel on top of a socket (if Authentication is set)
+	TLSChannelPtr createTlsChannel (const LocalSocketPtr & socket) const;
+
+	/// Callback for LocalSocket::connectToPath
+	void onConnect (CreateChannelOp * op, Error result);
+	/// Callback for TLSChannel::clientHandshake
+	void onTlsHandshake (CreateChannelOp * op, Error result);
+	/// Starts AuthProtocol on op->channel (connecting)
+	void startAuthProtocol (CreateChannelOp * op);
+	/// Callback for AuthProtocol (connecting)
+	void onAuthProtocolFinished (CreateChannelOp * op, Error result);
+
+	/// There is a new connection attempt
+	void onNewConnection ();
+	/// Callback for TLSChannel::serverHandshake
+	void onAcceptTlsHandshake (AcceptConnectionOp * op, Error result);
+	/// Starts AuthProtocol on op->channel (accepting)
+	void startAuthProtocol (AcceptConnectionOp * op);
+	/// Callback for AuthProtocol (accepting)
+	void onAcceptAuthFinished (AcceptConnectionOp * op, Error result);
+
+	enum ChannelOpId { CREATE_CHANNEL = 1, ACCEPT_CONNECTION };
+
+	/// Operation on building a channel
+	struct CreateChannelOp : public AsyncOp {
+		enum State { Connecting, TlsHandshaking, Authenticating };
+		CreateChannelOp (const sf::Time & timeOut) : AsyncOp (CREATE_CHANNEL, timeOut) {}
+		virtual void onCancel (sf::Error reason) {
+			if (callback) callback (reason);
+		}
+		ResultCallback callback;
+		HostId target;
+		LocalSocketPtr socket;
+		TLSChannelPtr  tlsChannel;		///< If Authentication is set
+		ChannelPtr     channel;			///< The socket or the TLS channel on top of it
+		AuthProtocol   authProtocol;
+	};
+
+	/// Operation on accepting a channel
+	struct AcceptConnectionOp : public AsyncOp {
+		enum State { TlsHandshaking, Authenticating };
+		AcceptConnectionOp (const sf::Time & timeOut) : AsyncOp (ACCEPT_CONNECTION, timeOut) {}
+		virtual void onCancel (sf::Error reason) {
+			Log (LogWarning) << LOGID << "Canceling local connection accept attempt due " << toString (reason) << std::endl;
+		}
+		HostId         target;			///< From the certificate (if Authentication is set)
+		LocalSocketPtr socket;
+		TLSChannelPtr  tlsChannel;		///< If Authentication is set
+		ChannelPtr     channel;			///< The socket or the TLS channel on top of it
+		AuthProtocol   authProtocol;
+	};
+
+	LocalServer mServer;
+	String      mDirectory;
+	bool        mStarted;
+	HostId      mHostId;
+	int         mTimeOutMs;			///< Timeout for incoming connections
+	Authentication * mAuthentication;
+	ChannelCreationDelegate mChannelCreated;
+};
+
+}
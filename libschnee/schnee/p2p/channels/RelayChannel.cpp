@@ -0,0 +1,162 @@
+#include "RelayChannel.h"
+#include <schnee/p2p/com/RelayProtocol.h>
+#include <schnee/tools/Log.h>
+
+namespace sf {
+
+RelayChannel::RelayChannel (RelayProtocol * protocol, AsyncOpId leg, const HostId & relay, const HostId & peer, bool connected) {
+	SF_REGISTER_ME;
+	mProtocol  = protocol;
+	mLeg       = leg;
+	mRelay     = relay;
+	mPeer      = peer;
+	mConnected = connected;
+	mClosing   = false;
+	mError     = NoError;
+	mChunkSize = 16384;
+	mWindow    = 524288;
+	mInFlight  = 0;
+}
+
+RelayChannel::~RelayChannel () {
+	SF_UNREGISTER_ME;
+	if (mProtocol && !mError) {
+		// releases the legs at the relay
+		mProtocol->closeLeg (mLeg);
+	}
+}
+
+void RelayChannel::setWindow (size_t chunkSize, size_t window) {
+	mChunkSize = chunkSize < 1 ? 1 : chunkSize;
+	mWindow    = window < mChunkSize ? mChunkSize : window;
+}
+
+Channel::State RelayChannel::state () const {
+	if (mError || !mProtocol) return Unconnected;
+	if (!mConnected) return Connecting;
+	return Connected;
+}
+
+Error RelayChannel::write (const ByteArrayPtr& data, const ResultCallback & callback) {
+	if (!data) return error::InvalidArgument;
+	if (mError) return mError;
+	if (mClosing) return error::Closed;
+	OutputElement element;
+	element.data     = data;
+	element.callback = callback;
+	mOutputQueue.push_back (element);
+	continueSending ();
+	return NoError;
+}
+
+void RelayChannel::continueSending () {
+	if (!mProtocol || !mConnected || mError) return;
+	while (!mOutputQueue.empty() && mInFlight < mWindow) {
+		OutputElement & element = mOutputQueue.front();
+		size_t length = std::min (element.data->size() - element.offset, mChunkSize);
+		ByteArrayPtr chunk;
+		if (element.offset == 0 && length == element.data->size()) {
+			chunk = element.data; // no need to copy
+		} else {
+			chunk = ByteArrayPtr (new ByteArray (element.data->const_c_array() + element.offset, length));
+		}
+		element.offset += length;
+		ResultCallback callback;
+		if (element.offset >= element.data->size()) {
+			// Chunks leave in order, so the last one is enough to call back
+			callback = element.callback;
+			mOutputQueue.pop_front ();
+		}
+		mInFlight += length;
+		Error e = mProtocol->sendData (mLeg, chunk, callback);
+		if (e) {
+			Log (LogWarning) << LOGID << "Could not send relayed data to " << mPeer << " via " << mRelay << ": " << toString (e) << std::endl;
+			mError = error::ChannelError;
+			notifyAsync (callback, e);
+			failWrites (e);
+			if (mChanged) xcall (mChanged);
+			return;
+		}
+	}
+	if (mClosing && mOutputQueue.empty()) {
+		mProtocol->closeLeg (mLeg);
+		invalidate (error::Closed);
+	}
+}
+
+void RelayChannel::failWrites (Error result) {
+	for (std::deque<OutputElement>::const_iterator i = mOutputQueue.begin(); i != mOutputQueue.end(); i++){
+		notifyAsync (i->callback, result);
+	}
+	mOutputQueue.clear();
+}
+
+sf::ByteArrayPtr RelayChannel::read (long maxSize) {
+	// Copy & Paste from IMChannel
+	sf::ByteArrayPtr result;
+	if (maxSize < 0) {
+		result = sf::createByteArrayPtr();
+		result->swap(mInputBuffer);
+		return result;
+	}
+	size_t size = mInputBuffer.size();
+	if (maxSize <= 0 || size == 0) return result;
+	if (maxSize < (long) size){
+		result = sf::ByteArrayPtr (new sf::ByteArray (mInputBuffer.c_array(), maxSize));
+		mInputBuffer.l_truncate (maxSize);
+	} else {
+		result = sf::ByteArrayPtr (new sf::ByteArray());
+		result->swap (mInputBuffer);
+	}
+	return result;
+}
+
+void RelayChannel::close (const ResultCallback & resultCallback) {
+	if (mProtocol && !mError && !mClosing) {
+		mClosing = true;
+		if (mConnected) {
+			continueSending ();
+		} else {
+			// nothing sent yet
+			mProtocol->closeLeg (mLeg);
+			invalidate (error::Closed);
+		}
+	}
+	notifyAsync (resultCallback, NoError);
+}
+
+Channel::ChannelInfo RelayChannel::info () const {
+	ChannelInfo info;
+	info.raddress = mPeer + " via " + mRelay;
+	info.virtual_ = true; // not probed, the relay pays for it
+	return info;
+}
+
+void RelayChannel::setConnected () {
+	if (mConnected) return;
+	mConnected = true;
+	continueSending ();
+	if (mChanged) xcall (mChanged);
+}
+
+void RelayChannel::pushData (const ByteArray & data) {
+	if (mError) return;
+	mInputBuffer.append (data);
+	if (mProtocol) mProtocol->sendAck (mLeg, (int) data.size());
+	if (mChanged) mChanged ();
+}
+
+void RelayChannel::onAck (int bytes) {
+	mInFlight = (size_t) bytes > mInFlight ? 0 : mInFlight - bytes;
+	continueSending ();
+}
+
+void RelayChannel::invalidate (Error reason) {
+	mProtocol  = 0;
+	mConnected = false;
+	if (!mError) mError = reason;
+	failWrites (mError);
+	if (mChanged) xcall (mChanged);
+}
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <schnee/net/Channel.h>
+#include <schnee/tools/async/DelegateBase.h>
+#include <deque>
+
+namespace sf {
+
+class RelayProtocol;
+
+/**
+ * End point of a stream relayed by another peer (see RelayProtocol).
+ *
+ * Written data is split into chunks. At most a window of unacknowledged bytes is on
+ * the way, so the relay buffers only little and the stream runs with the speed of the
+ * slower leg. Write callbacks are called as soon as the last chunk of the data left
+ * the own connection management.
+ *
+ * The relay sees all data, RelayChannelProvider encrypts it with TLS.
+ */
+class RelayChannel : public Channel, public DelegateBase {
+public:
+	RelayChannel (RelayProtocol * protocol, AsyncOpId leg, const HostId & relay, const HostId & peer, bool connected);
+	virtual ~RelayChannel ();
+
+	/// Host relaying the stream
+	const HostId & relay () const { return mRelay; }
+
+	/// Host at the other end of the stream
+	const HostId & peer () const { return mPeer; }
+
+	/// Sets the size of the chunks (default = 16384) and the flow control window (default = 524288)
+	void setWindow (size_t chunkSize, size_t window);
+
+	// Implementation of Channel
+	virtual sf::Error error () const { return mError; }
+	virtual State state () const;
+	virtual Error write (const ByteArrayPtr& data, const ResultCallback & callback = ResultCallback());
+	virtual sf::ByteArrayPtr read (long maxSize = -1);
+	virtual void close (const ResultCallback & resultCallback = ResultCallback());
+	virtual ChannelInfo info () const;
+	virtual const char * stackInfo () const { return "relay"; }
+	virtual sf::VoidDelegate & changed () { return mChanged; }
+
+private:
+	// API for RelayProtocol
+	friend class RelayProtocol;
+
+	/// The other end accepted the stream
+	void setConnected ();
+	/// Content arrived
+	void pushData (const ByteArray & data);
+	/// Content arrived at the other end
+	void onAck (int bytes);
+	/// The stream is gone
+	void invalidate (Error reason);
+
+	/// Sends out chunks as long as the window allows it
+	void continueSending ();
+	/// Fails all waiting writes
+	void failWrites (Error result);
+
+	RelayProtocol * mProtocol;
+	AsyncOpId mLeg;
+	HostId mRelay;
+	HostId mPeer;
+	bool  mConnected;
+	bool  mClosing;				///< Close after sending the output queue
+	Error mError;
+
+	// Input queue
+	sf::ByteArray mInputBuffer;
+
+	// Output queue
+	struct OutputElement {
+		OutputElement () : offset (0) {}
+		ByteArrayPtr data;
+		size_t offset;			///< Already sent bytes
+		ResultCallback callback;
+	};
+	std::deque<OutputElement> mOutputQueue;
+	size_t mChunkSize;
+	size_t mWindow;
+	size_t mInFlight;			///< Sent but not yet acknowledged bytes
+
+	sf::VoidDelegate mChanged;
+};
+
+typedef shared_ptr<RelayChannel> RelayChannelPtr;
+
+}
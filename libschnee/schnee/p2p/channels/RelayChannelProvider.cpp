@@ -0,0 +1,233 @@
+#include "RelayChannelProvider.h"
+#include <schnee/tools/Log.h>
+#include <algorithm>
+
+namespace sf {
+
+RelayChannelProvider::RelayChannelProvider () {
+	SF_REGISTER_ME;
+	mConnections    = 0;
+	mAuthentication = 0;
+	mRelayTimeOutMs = 5000;
+	mTimeOutMs      = 10000;
+	mRefusedTimeOutMs = 60000;
+	mProtocol.setAccepting (true);
+	mProtocol.incoming() = dMemFun (this, &RelayChannelProvider::onIncoming);
+}
+
+RelayChannelProvider::~RelayChannelProvider () {
+	SF_UNREGISTER_ME;
+	mProtocol.incoming() = RelayProtocol::IncomingDelegate ();
+}
+
+void RelayChannelProvider::setAuthentication (Authentication * auth) {
+	mAuthentication = auth;
+	mProtocol.setAuthentication (auth);
+}
+
+sf::Error RelayChannelProvider::createChannel (const HostId & target, const ResultCallback & callback, int timeOutMs) {
+	if (!mConnections || mHostId.empty()) return error::NotInitialized;
+	HostQueue relays = candidates (target);
+	if (relays.empty()) return error::NotFound;
+	CreateChannelOp * op = new CreateChannelOp (regTimeOutMs (timeOutMs));
+	op->setId (genFreeId ());
+	op->target   = target;
+	op->callback = callback;
+	op->relays   = relays;
+	tryNext (op);
+	return NoError;
+}
+
+RelayChannelProvider::HostQueue RelayChannelProvider::candidates (const HostId & target) {
+	Time now = currentTime ();
+	for (RefusedMap::iterator i = mRefused.begin(); i != mRefused.end();) {
+		if (i->second <= now) mRefused.erase (i++);
+		else i++;
+	}
+	// best known bandwidth per possible relay
+	typedef std::map<HostId, float> BandwidthMap;
+	BandwidthMap bandwidths;
+	ConnectionManagement::ConnectionInfos infos = mConnections->connections ();
+	for (ConnectionManagement::ConnectionInfos::const_iterator i = infos.begin(); i != infos.end(); i++) {
+		if (i->target == target || i->target == mHostId) continue;
+		if (i->level < mProtocol.minLegLevel() || i->cinfo.virtual_) continue;
+		if (mRefused.count (RelayTarget (i->target, target)) > 0) continue;
+		BandwidthMap::iterator j = bandwidths.find (i->target);
+		if (j == bandwidths.end()) bandwidths[i->target] = i->cinfo.bandwidth;
+		else j->second = std::max (j->second, i->cinfo.bandwidth);
+	}
+	typedef std::vector<std::pair<float, HostId> > SortVec;
+	SortVec sorted;
+	for (BandwidthMap::const_iterator i = bandwidths.begin(); i != bandwidths.end(); i++) {
+		sorted.push_back (std::make_pair (i->second, i->first));
+	}
+	std::stable_sort (sorted.begin(), sorted.end(), std::greater<std::pair<float, HostId> > ());
+	HostQueue result;
+	for (SortVec::const_iterator i = sorted.begin(); i != sorted.end(); i++) {
+		result.push_back (i->second);
+	}
+	return result;
+}
+
+void RelayChannelProvider::tryNext (CreateChannelOp * op) {
+	while (!op->relays.empty()) {
+		op->relay = op->relays.front();
+		op->relays.pop_front ();
+		int timeOutMs = op->lastingTimeMs ();
+		if (timeOutMs < 0 || timeOutMs > mRelayTimeOutMs) timeOutMs = mRelayTimeOutMs;
+		op->setState (CreateChannelOp::Opening);
+		Error e = mProtocol.open (op->relay, op->target, abind (dMemFun (this, &RelayChannelProvider::onOpened), op->id()), timeOutMs);
+		if (e) {
+			Log (LogInfo) << LOGID << "Could not ask " << op->relay << " for relaying to " << op->target << ": " << toString (e) << std::endl;
+			continue;
+		}
+		addAsyncOp (op);
+		return;
+	}
+	Log (LogInfo) << LOGID << "No relay to " << op->target << " found" << std::endl;
+	notifyAsync (op->callback, op->hasFailedAuthentication ? error::AuthError : error::CouldNotConnectHost);
+	delete op;
+}
+
+void RelayChannelProvider::onOpened (Error result, RelayChannelPtr channel, AsyncOpId id) {
+	CreateChannelOp * op;
+	getReadyAsyncOpInState (id, CREATE_CHANNEL, CreateChannelOp::Opening, &op);
+	if (!op) {
+		// timeouted
+		if (channel) channel->close ();
+		return;
+	}
+	if (result) {
+		Log (LogInfo) << LOGID << op->relay << " does not relay to " << op->target << ": " << toString (result) << std::endl;
+		mRefused[RelayTarget (op->relay, op->target)] = futureInMs (mRefusedTimeOutMs);
+		tryNext (op);
+		return;
+	}
+	op->setState (CreateChannelOp::TlsHandshaking);
+	op->tlsChannel = createTlsChannel (channel);
+	op->tlsChannel->enableSessionResumption (tlsSessionKey (mHostId, op->target, mAuthentication));
+	TLSChannel::Mode mode = mAuthentication ? TLSChannel::X509 : TLSChannel::DH;
+	Error e = op->tlsChannel->clientHandshake (mode, op->target, aOpMemFun (op, &RelayChannelProvider::onTlsHandshake));
+	if (e) {
+		xcall (abind (aOpMemFun (op, &RelayChannelProvider::onTlsHandshake), e));
+	}
+	addAsyncOp (op);
+}
+
+void RelayChannelProvider::onTlsHandshake (CreateChannelOp * op, Error result) {
+	if (result) {
+		Log (LogProfile) << LOGID << "TLS Handshake via " << op->relay << " failed: " << toString (result) << std::endl;
+		sf::safeRemove (op->tlsChannel);
+		tryNext (op);
+		return;
+	}
+	if (mAuthentication) {
+		Authentication::CertInfo info = mAuthentication->get (op->target);
+		if (info.type != Authentication::CT_PEER) {
+			Log (LogProfile) << LOGID << "Could not do TLS authentication as no certificate is stored" << std::endl;
+			notify (op->callback, error::AuthError);
+			sf::safeRemove (op->tlsChannel);
+			delete op;
+			return;
+		}
+		result = op->tlsChannel->authenticate (info.cert.get(), op->target);
+		if (result) {
+			Log (LogProfile) << LOGID << "Could not TLS authenticate " << op->target << " via " << op->relay << std::endl;
+			op->hasFailedAuthentication = true;
+			sf::safeRemove (op->tlsChannel);
+			tryNext (op);
+			return;
+		}
+	}
+	op->setState (CreateChannelOp::Authenticating);
+	op->authProtocol.init (op->tlsChannel, mHostId);
+	op->authProtocol.finished() = aOpMemFun (op, &RelayChannelProvider::onAuthProtocolFinished);
+	op->authProtocol.connect (op->target, op->lastingTimeMs (0.66));
+	addAsyncOp (op);
+}
+
+void RelayChannelProvider::onAuthProtocolFinished (CreateChannelOp * op, Error result) {
+	if (result) {
+		Log (LogInfo) << LOGID << "Authentication failed (" << toString (result) << ") for " << op->target << " via " << op->relay << std::endl;
+		op->hasFailedAuthentication = true;
+		sf::safeRemove (op->tlsChannel);
+		tryNext (op);
+		return;
+	}
+	Log (LogInfo) << LOGID << "Relayed channel to " << op->target << " via " << op->relay << std::endl;
+	notifyAsync (mChannelCreated, op->target, op->tlsChannel, true);
+	notifyAsync (op->callback, NoError);
+	delete op;
+}
+
+void RelayChannelProvider::onIncoming (const HostId & source, RelayChannelPtr channel) {
+	if (mHostId.empty()) {
+		Log (LogWarning) << LOGID << "Getting relayed stream but no host id set yet, throwing away" << std::endl;
+		channel->close ();
+		return;
+	}
+	AcceptStreamOp * op = new AcceptStreamOp (regTimeOutMs (mTimeOutMs));
+	op->setId (genFreeId ());
+	op->setState (AcceptStreamOp::TlsHandshaking);
+	op->source     = source;
+	op->tlsChannel = createTlsChannel (channel);
+	op->tlsChannel->enableSessionResumption ();
+	TLSChannel::Mode mode = mAuthentication ? TLSChannel::X509 : TLSChannel::DH;
+	Error e = op->tlsChannel->serverHandshake (mode, aOpMemFun (op, &RelayChannelProvider::onAcceptTlsHandshake));
+	if (e) {
+		Log (LogWarning) << LOGID << "TLS failed immediately on relayed stream " << toString (e) << std::endl;
+		delete op;
+		return;
+	}
+	addAsyncOp (op);
+}
+
+void RelayChannelProvider::onAcceptTlsHandshake (AcceptStreamOp * op, Error result) {
+	if (result) {
+		Log (LogInfo) << LOGID << "Encrypting failed (" << toString (result) << ") for relayed stream from " << op->source << std::endl;
+		sf::safeRemove (op->tlsChannel);
+		delete op;
+		return;
+	}
+	if (mAuthentication) {
+		// the relay may lie about the source, the certificate doesn't
+		x509::CertificatePtr peerCert = op->tlsChannel->peerCertificate();
+		HostId name;
+		if (peerCert) peerCert->getCommonName (&name);
+		Authentication::CertInfo info = mAuthentication->get (name);
+		if (!peerCert || name != op->source || info.type != Authentication::CT_PEER || op->tlsChannel->authenticate (info.cert.get(), name)) {
+			Log (LogProfile) << LOGID << "TLS Authentication of relayed stream from " << op->source << " failed" << std::endl;
+			sf::safeRemove (op->tlsChannel);
+			delete op;
+			return;
+		}
+	}
+	op->setState (AcceptStreamOp::Authenticating);
+	op->authProtocol.init (op->tlsChannel, mHostId);
+	op->authProtocol.finished () = aOpMemFun (op, &RelayChannelProvider::onAcceptAuthFinished);
+	op->authProtocol.passive (op->source, op->lastingTimeMs ());
+	addAsyncOp (op);
+}
+
+void RelayChannelProvider::onAcceptAuthFinished (AcceptStreamOp * op, Error result) {
+	if (result || op->authProtocol.other() != op->source) {
+		Log (LogInfo) << LOGID << "Authentication failed (" << toString (result) << ") for relayed stream from " << op->source << std::endl;
+		sf::safeRemove (op->tlsChannel);
+		delete op;
+		return;
+	}
+	notifyAsync (mChannelCreated, op->source, op->tlsChannel, false);
+	delete op;
+}
+
+TLSChannelPtr RelayChannelProvider::createTlsChannel (const RelayChannelPtr & channel) const {
+	TLSChannelPtr tlsChannel (new TLSChannel (channel));
+	if (mAuthentication) {
+		tlsChannel->setKey (mAuthentication->certificate(), mAuthentication->key());
+		// we do that implicit
+		tlsChannel->disableAuthentication ();
+	}
+	return tlsChannel;
+}
+
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <schnee/tools/async/AsyncOpBase.h>
+#include "ChannelProvider.h"
+
+#include <schnee/p2p/ConnectionManagement.h>
+#include <schnee/p2p/com/RelayProtocol.h>
+#include <schnee/p2p/channels/AuthProtocol.h>
+#include <schnee/net/TLSChannel.h>
+#include <deque>
+#include <map>
+
+namespace sf {
+
+/**
+ * RelayChannelProvider creates channels through a third peer, to which both sides
+ * have a direct channel (e.g. if neither TCP nor UDT work between them).
+ *
+ * Relayed channels are never initial ones, they are only tried when lifting, after the
+ * better providers failed. Relays are tried in order of their measured bandwidth,
+ * relays which refused a target are not asked again for some time. The relayed stream gets
+ * TLS encrypted and authenticated like a TCP connection, so the relay only forwards
+ * encrypted data (it can't be a man in the middle if Authentication is enabled).
+ *
+ * Relaying for others is off by default, see setRelayBandwidth.
+ */
+class RelayChannelProvider : public AsyncOpBase, public ChannelProvider {
+public:
+	RelayChannelProvider ();
+	virtual ~RelayChannelProvider ();
+
+	/// Connection management, used for finding relays (must be set before creating channels)
+	void setConnectionManagement (ConnectionManagement * connections) { mConnections = connections; }
+
+	/// Sets the rate of all streams relayed for others in bytes/s, 0 disables relaying, < 0 means unlimited
+	/// default = 0
+	void setRelayBandwidth (float bytesPerSecond) { mProtocol.setRelayBandwidth (bytesPerSecond); }
+
+	/// Timeout for asking a single relay (in ms)
+	/// default = 5000
+	void setRelayTimeOut (int timeOutMs) { mRelayTimeOutMs = timeOutMs; }
+
+	/// Timeout for incoming streams (in ms)
+	/// default = 10000
+	void setTimeOut (int timeOutMs) { mTimeOutMs = timeOutMs; }
+
+	/// How long a relay which refused a target is not asked again for it (in ms)
+	/// default = 60000
+	void setRefusedTimeOut (int timeOutMs) { mRefusedTimeOutMs = timeOutMs; }
+
+	/// Access to the relaying protocol (e.g. for statistics)
+	RelayProtocol & relayProtocol () { return mProtocol; }
+
+	// Implementation of ChannelProvider
+	virtual sf::Error createChannel (const HostId & target, const ResultCallback & callback, int timeOutMs = -1);
+	virtual bool providesInitialChannels () { return false; }
+	virtual CommunicationComponent * protocol () { return &mProtocol; }
+	virtual void setHostId (const sf::HostId & id) { mHostId = id; }
+	virtual void setAuthentication (Authentication * auth);
+	virtual ChannelCreationDelegate & channelCreated () { return mChannelCreated; }
+
+private:
+	struct CreateChannelOp;
+	struct AcceptStreamOp;
+	typedef std::deque<HostId> HostQueue;
+	typedef std::pair<HostId, HostId> RelayTarget;	///< relay, target
+	typedef std::map<RelayTarget, Time> RefusedMap;	///< until when not to ask again
+
+	/// Hosts which could relay to target, best first (without the ones which refused recently)
+	HostQueue candidates (const HostId & target);
+
+	///@name Methods for connecting
+	///@{
+
+	/// Asks the next relay
+	void tryNext (CreateChannelOp * op);
+
+	/// Callback for RelayProtocol::open
+	void onOpened (Error result, RelayChannelPtr channel, AsyncOpId id);
+
+	/// Callback for TLSChannel::handshake
+	void onTlsHandshake (CreateChannelOp * op, Error result);
+
+	/// Callback for Auth protocol
+	void onAuthProtocolFinished (CreateChannelOp * op, Error result);
+
+	///@}
+
+	///@name Methods for accepting streams
+	///@{
+
+	/// Someone opened a stream to us
+	void onIncoming (const HostId & source, RelayChannelPtr channel);
+	/// TLSChannel encryption finished
+	void onAcceptTlsHandshake (AcceptStreamOp * op, Error result);
+	/// Authentication finished
+	void onAcceptAuthFinished (AcceptStreamOp * op, Error result);
+
+	///@}
+
+	/// Creates the TLS channel on top of a relayed stream
+	TLSChannelPtr createTlsChannel (const RelayChannelPtr & channel) const;
+
+	enum ChannelOpId { CREATE_CHANNEL = 1, ACCEPT_STREAM };
+
+	/// Operation on building a channel
+	struct CreateChannelOp : public AsyncOp {
+		enum State {
+			Null,				///< Basic state
+			Opening,			///< 1. Waiting for the relay
+			TlsHandshaking,		///< 2. Doing TLS Handshake
+			Authenticating		///< 3. Authenticating connection
+		};
+		CreateChannelOp (const sf::Time & timeOut) : AsyncOp (CREATE_CHANNEL, timeOut) {
+			mState = Null;
+			hasFailedAuthentication = false;
+		}
+		virtual void onCancel (sf::Error reason) {
+			if (callback) callback (reason);
+		}
+
+		ResultCallback callback;
+		HostId target;
+		HostQueue      relays;					///< Relays not tried yet
+		HostId         relay;					///< Current relay
+		TLSChannelPtr  tlsChannel;				///< Encrypting Channel
+		AuthProtocol   authProtocol;			///< Authentication protocol
+		bool           hasFailedAuthentication;	///< Had failed authentication during process
+	};
+
+	/// Operation on accepting a stream
+	struct AcceptStreamOp : public AsyncOp {
+		enum State {
+			Null,				///< Basic state
+			TlsHandshaking,		///< Encrypting connection
+			Authenticating		///< Authenticating connection
+		};
+		AcceptStreamOp (const sf::Time & timeOut) : AsyncOp (ACCEPT_STREAM, timeOut) {
+			mState = Null;
+		}
+		virtual void onCancel (sf::Error reason) {
+			Log (LogWarning) << LOGID << "Canceling relayed stream from " << source << " due " << toString (reason) << std::endl;
+			sf::safeRemove (tlsChannel);
+		}
+
+		HostId source;					///< Source as told by the relay
+		TLSChannelPtr  tlsChannel;		///< Encrypted channel
+		AuthProtocol   authProtocol;	///< Authentication protocol
+	};
+
+	RelayProtocol mProtocol;
+	ConnectionManagement * mConnections;
+	HostId mHostId;
+	int    mRelayTimeOutMs;
+	int    mTimeOutMs;
+	int    mRefusedTimeOutMs;
+	RefusedMap mRefused;
+
+	ChannelCreationDelegate mChannelCreated;
+	Authentication * mAuthentication;
+};
+
+}
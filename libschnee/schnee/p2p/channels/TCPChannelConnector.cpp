@@ -1,9 +1,21 @@
 #include "TCPChannelConnector.h"
+#include "EndpointCache.h"
 #include <schnee/net/Tools.h>
+#include <schnee/settings.h>
 #include <schnee/tools/Log.h>
+#include <algorithm>
 
 namespace sf {
 
+/// Splits "address:port" as reported by ChannelInfo
+static bool splitAddress (const String & s, String * address, int * port) {
+	size_t p = s.rfind (':');
+	if (p == s.npos) return false;
+	*address = s.substr (0, p);
+	*port    = atoi (s.c_str() + p + 1);
+	return true;
+}
+
 TCPChannelConnector::TCPChannelConnector () {
 	SF_REGISTER_ME;
 	mTimeOutMs = 10000;
@@ -64,6 +76,12 @@ sf::Error TCPChannelConnector::createChannel (const HostId & target, const Resul
 	op->setId(id);
 	op->setState(CreateChannelOp::Start);
 	op->target   = target;
+	EndpointCache::Entry cached;
+	if (EndpointCache::hasInstance() && EndpointCache::instance().lookup (target, &cached) && cached.hasTcp()) {
+		Log (LogInfo) << LOGID << "Trying cached endpoint " << toString (cached.addresses) << ":" << cached.port << " of " << target << std::endl;
+		op->cachedSocket = TCPSocketPtr (new TCPSocket());
+		op->cachedSocket->connectToHosts (cached.addresses, cached.port, op->lastingTimeMs (0.33), abind (dMemFun (this, &TCPChannelConnector::onCachedConnect), id));
+	}
 	addAsyncOp (op);
 	// cannot do that yet; as we are called from a possible locked Beacon.
 	// and the tcp connect protocoll will also lock the beacon.
@@ -71,6 +89,21 @@ sf::Error TCPChannelConnector::createChannel (const HostId & target, const Resul
 	return NoError;
 }
 
+sf::Error TCPChannelConnector::connectDirect (const HostId & target, const ConnectDetails & details, const ResultCallback & callback, int timeOutMs) {
+	if (details.port <= 0 || details.addresses.empty()) return error::InvalidArgument;
+	AsyncOpId id = genFreeId ();
+	CreateChannelOp * op = new CreateChannelOp (sf::regTimeOutMs(timeOutMs));
+	op->callback = callback;
+	op->setId(id);
+	op->target   = target;
+	op->connectDetails = details;
+	op->addresses      = op->connectDetails.addresses;
+	op->setState (CreateChannelOp::Connecting);
+	addAsyncOp (op);
+	xcall (aOpMemFun (op, &TCPChannelConnector::connectNext));
+	return NoError;
+}
+
 void TCPChannelConnector::setHostId (const sf::HostId & id) {
 	mHostId = id;
 }
@@ -82,7 +115,18 @@ void TCPChannelConnector::setAuthentication (Authentication * auth) {
 void TCPChannelConnector::startConnecting (CreateChannelOp * op) {
 	int timeMs = op->lastingTimeMs(0.5f);
 	op->setState (CreateChannelOp::AwaitTcpInfo);
-	Error result = mProtocol.requestDetails (op->target, aOpMemFun (op, &TCPChannelConnector::onTcpConnectResult), timeMs);
+	// (not bound to the state, the cached endpoint may be connected meanwhile)
+	Error result = mProtocol.requestDetails (op->target, abind (dMemFun (this, &TCPChannelConnector::onTcpConnectResult), op->id()), timeMs);
+	op->awaitingDetails = !result;
+	if (op->cachedConnected) {
+		// details are a fallback if it does not authenticate
+		useCachedSocket (op);
+		return;
+	}
+	if (result && op->cachedSocket) {
+		addAsyncOp (op); // cached endpoint may still work
+		return;
+	}
 	if (result) {
 		if (op->callback) notifyAsync (op->callback, result);
 		delete op;
@@ -92,55 +136,136 @@ void TCPChannelConnector::startConnecting (CreateChannelOp * op) {
 }
 
 
-void TCPChannelConnector::onTcpConnectResult (CreateChannelOp * op, Error result, const ConnectDetails& details) {
+void TCPChannelConnector::onTcpConnectResult (Error result, const ConnectDetails& details, AsyncOpId id) {
+	CreateChannelOp * op;
+	getReadyAsyncOp (id, CREATE_CHANNEL, &op);
+	if (!op) return;
+	op->awaitingDetails = false;
+	if (op->state() != CreateChannelOp::AwaitTcpInfo) {
+		// the cached endpoint was faster, details are a fallback if it does not authenticate
+		if (!result) {
+			op->connectDetails = details;
+			op->addresses      = details.addresses;
+		}
+		addAsyncOp (op);
+		return;
+	}
+	if (result && op->cachedSocket) {
+		addAsyncOp (op); // cached endpoint may still work
+		return;
+	}
 	if (result){
 		// error, kill op
 		if (op->callback) xcall (abind (op->callback, result));
 		delete op;
 		return;
 	}
+	// the peer's current addresses include the cached ones, if still valid
+	op->cachedSocket.reset ();
 	op->connectDetails = details;
-	op->nextAddress    = op->connectDetails.addresses.begin();
+	op->addresses      = op->connectDetails.addresses;
 	op->setState (CreateChannelOp::Connecting);
 	addAsyncOp (op);
 	xcall (aOpMemFun (op, &TCPChannelConnector::connectNext));
 }
 
 void TCPChannelConnector::connectNext (CreateChannelOp * op){
-	if (op->nextAddress == op->connectDetails.addresses.end()){
+	if (op->viaCache) {
+		// cached endpoint leads to someone else now
+		EndpointCache::instance().remove (op->target);
+		op->viaCache = false;
+	}
+	if (op->addresses.empty() && op->awaitingDetails) {
+		op->setState (CreateChannelOp::AwaitTcpInfo);
+		addAsyncOp (op);
+		return;
+	}
+	if (op->addresses.empty()){
 		Error e = op->hasFailedAuthentication ? error::AuthError : error::CouldNotConnectHost;
 		notifyAsync (op->callback, e);
 		delete op;
 		return;
 	}
 	op->socket = TCPSocketPtr (new TCPSocket());
-	String next = * (op->nextAddress++);
 
 	int leftTime = op->lastingTimeMs(0.66);
-	Log (LogInfo) << LOGID << "Start connecting to " << next << ":" << op->connectDetails.port << " with a timeOut of " << leftTime << "ms" << std::endl;
-	op->socket->connectToHost (next, op->connectDetails.port, leftTime, aOpMemFun (op, &TCPChannelConnector::onConnect));
+	Log (LogInfo) << LOGID << "Start connecting to " << toString (op->addresses) << ":" << op->connectDetails.port << " with a timeOut of " << leftTime << "ms" << std::endl;
+	op->socket->connectToHosts (op->addresses, op->connectDetails.port, leftTime, aOpMemFun (op, &TCPChannelConnector::onConnect));
 	addAsyncOp (op);
 }
 
 void TCPChannelConnector::onConnect (CreateChannelOp * op, Error result) {
-	if (result)
+	if (result) {
+		// all addresses were tried
+		op->addresses.clear ();
 		connectNext (op);
-	else {
-		// Try to encrypt it
-		op->setState (CreateChannelOp::TlsHandshaking);
-		op->tlsChannel = TLSChannelPtr (new TLSChannel (op->socket));
-		TLSChannel::Mode mode = authenticationEnabled () ? TLSChannel::X509 : TLSChannel::DH;
-		if (mode == TLSChannel::X509) {
-			op->tlsChannel->setKey(mAuthentication->certificate(), mAuthentication->key());
-			// we do that implicit.
-			op->tlsChannel->disableAuthentication();
-		}
-		Error e = op->tlsChannel->clientHandshake(mode, op->target, aOpMemFun (op, &TCPChannelConnector::onTlsHandshake));
-		if (e) {
-			xcall (abind (aOpMemFun (op, &TCPChannelConnector::onTlsHandshake), e));
+	}
+	else
+		startEncryption (op);
+}
+
+void TCPChannelConnector::onCachedConnect (Error result, AsyncOpId id) {
+	CreateChannelOp * op;
+	getReadyAsyncOp (id, CREATE_CHANNEL, &op);
+	if (!op) return;
+	bool starting = op->state() == CreateChannelOp::Start;
+	if ((!starting && op->state() != CreateChannelOp::AwaitTcpInfo) || !op->cachedSocket) {
+		addAsyncOp (op);
+		return;
+	}
+	if (result) {
+		Log (LogInfo) << LOGID << "Cached endpoint of " << op->target << " not reachable: " << toString (result) << std::endl;
+		op->cachedSocket.reset ();
+		if (!starting && !op->awaitingDetails) {
+			notifyAsync (op->callback, error::CouldNotConnectHost);
+			delete op;
+			return;
 		}
 		addAsyncOp (op);
+		return;
 	}
+	Log (LogInfo) << LOGID << "Connected cached endpoint of " << op->target << std::endl;
+	if (starting) {
+		// startConnecting is already queued for this state
+		op->cachedConnected = true;
+		addAsyncOp (op);
+		return;
+	}
+	useCachedSocket (op);
+}
+
+void TCPChannelConnector::useCachedSocket (CreateChannelOp * op) {
+	op->cachedConnected = false;
+	op->socket = op->cachedSocket;
+	op->cachedSocket.reset ();
+	op->viaCache = true;
+	startEncryption (op);
+}
+
+void TCPChannelConnector::startEncryption (CreateChannelOp * op) {
+	// If encryption or authentication fails, the other addresses are tried again
+	String raddress;
+	int rport;
+	splitAddress (op->socket->info().raddress, &raddress, &rport);
+	AddressVec::iterator i = std::find (op->addresses.begin(), op->addresses.end(), raddress);
+	if (i != op->addresses.end()) op->addresses.erase (i);
+	else op->addresses.clear ();
+	// Try to encrypt it
+	op->setState (CreateChannelOp::TlsHandshaking);
+	op->tlsChannel = TLSChannelPtr (new TLSChannel (op->socket));
+	TLSChannel::Mode mode = authenticationEnabled () ? TLSChannel::X509 : TLSChannel::DH;
+	if (mode == TLSChannel::X509) {
+		op->tlsChannel->setKey(mAuthentication->certificate(), mAuthentication->key());
+		// we do that implicit.
+		op->tlsChannel->disableAuthentication();
+	}
+	op->tlsChannel->enableSessionResumption (tlsSessionKey (mHostId, op->target, mAuthentication));
+	if (schnee::settings().kernelTls) op->tlsChannel->enableKernelTls ();
+	Error e = op->tlsChannel->clientHandshake(mode, op->target, aOpMemFun (op, &TCPChannelConnector::onTlsHandshake));
+	if (e) {
+		xcall (abind (aOpMemFun (op, &TCPChannelConnector::onTlsHandshake), e));
+	}
+	addAsyncOp (op);
 }
 
 void TCPChannelConnector::onTlsHandshake (CreateChannelOp * op, Error result) {
@@ -189,12 +314,33 @@ void TCPChannelConnector::onAuthProtocolFinished (CreateChannelOp * op, Error re
 		connectNext (op);
 		return;
 	}
+	storeEndpoint (op);
 	// Send out callbacks
 	notifyAsync (mChannelCreated, op->target, op->tlsChannel, true);
 	notifyAsync (op->callback, NoError);
 	delete op;
 }
 
+void TCPChannelConnector::storeEndpoint (CreateChannelOp * op) {
+	if (!EndpointCache::hasInstance()) return;
+	String raddress;
+	int rport;
+	if (!splitAddress (op->socket->info().raddress, &raddress, &rport)) return;
+	EndpointCache & cache = EndpointCache::instance();
+	EndpointCache::Entry entry;
+	cache.lookup (op->target, &entry);
+	// working address first, then the other ones the peer told us (or we knew before)
+	const AddressVec & others = op->connectDetails.addresses.empty() ? entry.addresses : op->connectDetails.addresses;
+	AddressVec addresses (1, raddress);
+	for (AddressVec::const_iterator i = others.begin(); i != others.end(); i++) {
+		if (std::find (addresses.begin(), addresses.end(), *i) == addresses.end()) addresses.push_back (*i);
+	}
+	entry.transport = "tcp";
+	entry.addresses = addresses;
+	entry.port      = rport;
+	cache.store (op->target, entry);
+}
+
 void TCPChannelConnector::onNewConnection (){
 	TCPSocketPtr socket = mServer.nextPendingConnection();
 	assert (socket);
@@ -215,6 +361,8 @@ void TCPChannelConnector::onNewConnection (){
 		// we do that implicit
 		op->tlsChannel->disableAuthentication();
 	}
+	op->tlsChannel->enableSessionResumption ();
+	if (schnee::settings().kernelTls) op->tlsChannel->enableKernelTls ();
 	Error e = op->tlsChannel->serverHandshake(mode, aOpMemFun (op, &TCPChannelConnector::onAcceptTlsHandshake));
 	if (e) {
 		Log (LogWarning) << LOGID << "TLS failed immediately on new connection" << toString (e) << std::endl;
@@ -15,6 +15,8 @@ namespace sf {
 * TCPChannelConnector manages the creation of TCP Channels.
 * It acts as a TCPServer and the opposite client.
 *
+* If the EndpointCache knows where the target was reachable the last time, this endpoint
+* is connected in parallel to requesting the connect details via TCPConnectProtocol.
 */
 class TCPChannelConnector : public AsyncOpBase, public ChannelProvider {
 public:
@@ -53,6 +55,11 @@ public:
 	/// default = 10000ms
 	void setTimeOut (int timeOutMs);
 
+	/// Connects to target using given connect details instead of asking target for them via
+	/// TCPConnectProtocol (e.g. if they got announced in the local network).
+	/// Calls back like createChannel (only if not returning an Error).
+	sf::Error connectDirect (const HostId & target, const ConnectDetails & details, const ResultCallback & callback, int timeOutMs = -1);
+
 	///@}
 
 
@@ -75,7 +82,7 @@ private:
 	void startConnecting (CreateChannelOp * op);
 
 	/// Callback for TCPConnectProtocol
-	void onTcpConnectResult (CreateChannelOp * op, Error result, const ConnectDetails& details);
+	void onTcpConnectResult (Error result, const ConnectDetails& details, AsyncOpId id);
 
 	/// Connect next possible address
 	void connectNext (CreateChannelOp * op);
@@ -83,6 +90,18 @@ private:
 	/// Callback for TCPSocket::conect (Op must be in state Connecting)
 	void onConnect (CreateChannelOp * op, Error result);
 
+	/// Callback for connecting the cached endpoint (Op must be in state Start or AwaitTcpInfo)
+	void onCachedConnect (Error result, AsyncOpId id);
+
+	/// Continues with the connected cached endpoint
+	void useCachedSocket (CreateChannelOp * op);
+
+	/// Starts TLS handshake on connected op->socket
+	void startEncryption (CreateChannelOp * op);
+
+	/// Records the endpoint of a created channel in the EndpointCache
+	void storeEndpoint (CreateChannelOp * op);
+
 	/// Callback for TLSChannel::handshake
 	void onTlsHandshake (CreateChannelOp * op, Error result);
 
@@ -122,6 +141,9 @@ private:
 			mState = Null;
 			hasFailedAuthentication = false;
 			hasFailedEncryption = false;
+			awaitingDetails = false;
+			viaCache = false;
+			cachedConnected = false;
 		}
 		virtual void onCancel (sf::Error reason) {
 			if (callback) callback (reason);
@@ -131,8 +153,12 @@ private:
 		ResultCallback callback;
 		HostId target;
 		ConnectDetails connectDetails;			///< the connect details (if already received)
-		AddressVec::iterator nextAddress;		///< Next address to connect to
+		AddressVec     addresses;				///< Addresses not tried yet (connected in parallel)
 		TCPSocketPtr   socket;					///< Current socket
+		TCPSocketPtr   cachedSocket;			///< Socket connecting the cached endpoint
+		bool           awaitingDetails;			///< TCPConnectProtocol request still running
+		bool           viaCache;				///< Current socket came from the cached endpoint
+		bool           cachedConnected;			///< cachedSocket connected before startConnecting
 		TLSChannelPtr  tlsChannel;				///< Encrypting Channel
 		AuthProtocol   authProtocol;			///< Authentication protocol
 		bool           hasFailedAuthentication;	///< Had failed authentication during process
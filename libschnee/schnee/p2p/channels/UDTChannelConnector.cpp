@@ -1,5 +1,8 @@
 #include "UDTChannelConnector.h"
+#include "EndpointCache.h"
 #include <schnee/net/Tools.h>
+#include <schnee/tools/MicroTime.h>
+#include <schnee/settings.h>
 
 namespace sf {
 
@@ -50,6 +53,15 @@ void UDTChannelConnector::startConnecting (CreateChannelOp * op) {
 	// time for echoing must be < 0.5 as both entities must do some echoing.
 	// and if echoing fails there is still some chance to get connected.
 	op->echoClient.start(mEchoServer.address, mEchoServer.port, op->lastingTimeMs(0.3));
+
+	EndpointCache::Entry cached;
+	if (EndpointCache::hasInstance() && EndpointCache::instance().lookup (op->target, &cached) && cached.portPreserving && !cached.externAddress.empty()) {
+		// our NAT kept the port the last time, no need to wait for the echo server
+		op->externAddress = NetEndpoint (cached.externAddress, op->udpSocket.port());
+		Log (LogInfo) << LOGID << "Assuming external address " << toJSON (op->externAddress) << " (cached)" << std::endl;
+		sendDetails (op, NoError);
+		return;
+	}
 	// waiting for an answer...
 	op->setState (CreateChannelOp::WaitOwnAddress);
 	addAsyncOp (op);
@@ -61,6 +73,7 @@ void UDTChannelConnector::onEchoClientResult (Error result, AsyncOpId id) {
 	if (!op) return; // die.
 	if (op->state() != CreateChannelOp::WaitOwnAddress) {
 		Log (LogInfo) << LOGID << "Ignoring echo result " << toString(result) << ", as being in wrong state " << op->state() << " (addr was=" << op->echoClient.address() << ":" << op->echoClient.port() << ")" << std::endl;
+		if (!result) storeOwnAddress (op->target, NetEndpoint (op->echoClient.address(), op->echoClient.port()), op->udpSocket.port());
 		addAsyncOp (op);
 		return;
 	}
@@ -73,7 +86,11 @@ void UDTChannelConnector::onEchoClientResult (Error result, AsyncOpId id) {
 		op->externAddress.address = op->echoClient.address();
 		op->externAddress.port    = op->echoClient.port();
 	}
+	sendDetails (op, result);
+}
 
+void UDTChannelConnector::sendDetails (CreateChannelOp * op, Error result) {
+	AsyncOpId id = op->id();
 	if (op->connector) {
 		RequestUDTConnect request;
 		request.id     = id;
@@ -125,6 +142,7 @@ void UDTChannelConnector::udpConnect (AsyncOpId id) {
 		delete op;
 		return;
 	}
+	op->punchTime = sf::microtime ();
 	// Try all available other side udp endpoints
 	for (int i = 0; i < op->otherEndpointCount(); i++) {
 		const NetEndpoint & p = op->otherEndpoint (i);
@@ -205,6 +223,9 @@ void UDTChannelConnector::onUdpRecvPunchReply (const NetEndpoint & from, CreateC
 		return;
 	}
 	op->remoteWorkingAddress = from;
+	if (op->rtt < 0 && op->punchTime > 0) {
+		op->rtt = (float) (sf::microtime() - op->punchTime);
+	}
 	if (op->sentAck) {
 		Log (LogInfo) << LOGID << "Ignoring, sent already ack" << std::endl;
 		return;
@@ -229,7 +250,7 @@ void UDTChannelConnector::onUdpRecvPunchReply (const NetEndpoint & from, CreateC
 
 	// let's create UDT Channels
 	op->setState (CreateChannelOp::ConnectingUDT);
-	op->udtSocket = UDTSocketPtr (new UDTSocket());
+	createUdtSocket (op);
 	op->udtSocket->rebind(&op->udpSocket);
 	op->udtSocket->connectRendezvousAsync(endpoint.address, endpoint.port, aOpMemFun (op, &UDTChannelConnector::onUdtConnectResult));
 }
@@ -240,13 +261,22 @@ void UDTChannelConnector::onUdpRecvAck (const NetEndpoint & from, CreateChannelO
 		addAsyncOp (op);
 	}
 	op->recvAck = true;
+	op->remoteWorkingAddress = from;
 	// lets create UDT Channels...
 	op->setState (CreateChannelOp::ConnectingUDT);
-	op->udtSocket = UDTSocketPtr (new UDTSocket());
+	createUdtSocket (op);
 	op->udtSocket->rebind(&op->udpSocket);
 	op->udtSocket->connectRendezvousAsync(from.address, from.port, aOpMemFun (op, &UDTChannelConnector::onUdtConnectResult));
 }
 
+void UDTChannelConnector::createUdtSocket (CreateChannelOp * op) {
+	const schnee::Settings & settings = schnee::settings ();
+	op->udtSocket = UDTSocketPtr (new UDTSocket());
+	UDTTuning tuning = UDTTuning::fromSettings (settings.udtCongestion, op->rtt, settings.udtBandwidth);
+	Error e = op->udtSocket->setTuning (tuning);
+	Log (LogInfo) << LOGID << "UDT tuning for " << op->target << " (rtt=" << op->rtt << "s): " << toJSON (tuning) << " result: " << toString (e) << std::endl;
+}
+
 void UDTChannelConnector::onUdtConnectResult (CreateChannelOp * op, Error result) {
 	Log (LogInfo) << LOGID << mHostId << " UDT connect to " << op->target << " Result: " << toString (result) << std::endl;
 	if (result) {
@@ -268,8 +298,10 @@ void UDTChannelConnector::onUdtConnectResult (CreateChannelOp * op, Error result
 	}
 
 	if (op->connector) {
+		op->tlsChannel->enableSessionResumption (tlsSessionKey (mHostId, op->target, mAuthentication));
 		e = op->tlsChannel->clientHandshake(mode, op->target, aOpMemFun (op, &UDTChannelConnector::onTlsHandshake));
 	} else {
+		op->tlsChannel->enableSessionResumption ();
 		e = op->tlsChannel->serverHandshake(mode, aOpMemFun (op, &UDTChannelConnector::onTlsHandshake));
 	}
 	if (e) {
@@ -334,6 +366,7 @@ void UDTChannelConnector::onAuthResult (CreateChannelOp * op, Error result) {
 	}
 	// Got it!
 	Log (LogInfo) << LOGID << "(" << mHostId << ") Successfull created UDT channel to " << op->target << std::endl;
+	storeEndpoint (op);
 	xcall (abind (mChannelCreated, op->target, op->tlsChannel, op->connector));
 	if (op->callback)
 		xcall (abind (op->callback, NoError));
@@ -346,10 +379,12 @@ void UDTChannelConnector::onRpc (const HostId & sender, const RequestUDTConnect
 	op->connector = false;
 	op->remoteId   = request.id;
 	op->remoteInternAddresses  = request.intern;
+	op->target = sender;
 	if (request.extern_.valid())
 		op->remoteExternAddresses.push_back (request.extern_);
+	else
+		addCachedExternAddress (op);
 	guessSomeExternAddresses (op);
-	op->target = sender;
 	startConnecting (op);
 }
 
@@ -360,6 +395,8 @@ void UDTChannelConnector::onRpc (const HostId & sender, const RequestUDTConnectR
 	op->remoteInternAddresses  = reply.intern;
 	if (reply.extern_.valid())
 		op->remoteExternAddresses.push_back (reply.extern_);
+	else
+		addCachedExternAddress (op);
 	guessSomeExternAddresses (op);
 	op->remoteId              = reply.localId;
 	op->setState (CreateChannelOp::Connecting);
@@ -378,4 +415,48 @@ void UDTChannelConnector::guessSomeExternAddresses (CreateChannelOp * op) {
 	op->remoteExternAddresses.push_back(NetEndpoint (ep.address, ep.port - 2));
 }
 
+void UDTChannelConnector::addCachedExternAddress (CreateChannelOp * op) {
+	EndpointCache::Entry cached;
+	if (!EndpointCache::hasInstance() || !EndpointCache::instance().lookup (op->target, &cached)) return;
+	if (cached.udpAddress.empty() || cached.nat == EndpointCache::NAT_DIRECT || op->remoteInternAddresses.empty()) return;
+	// the peer did not find out its external address; maybe its NAT kept the port again
+	NetEndpoint ep (cached.udpAddress, op->remoteInternAddresses[0].port);
+	Log (LogInfo) << LOGID << "Trying cached external address " << toJSON (ep) << " of " << op->target << std::endl;
+	op->remoteExternAddresses.push_back (ep);
+}
+
+void UDTChannelConnector::storeOwnAddress (const HostId & target, const NetEndpoint & externAddress, int localPort) {
+	if (!EndpointCache::hasInstance() || !externAddress.valid()) return;
+	EndpointCache & cache = EndpointCache::instance();
+	EndpointCache::Entry entry;
+	cache.lookup (target, &entry);
+	entry.externAddress  = externAddress.address;
+	entry.portPreserving = externAddress.port == localPort;
+	cache.store (target, entry);
+}
+
+void UDTChannelConnector::storeEndpoint (CreateChannelOp * op) {
+	if (!EndpointCache::hasInstance() || !op->remoteWorkingAddress.valid()) return;
+	EndpointCache & cache = EndpointCache::instance();
+	EndpointCache::Entry entry;
+	cache.lookup (op->target, &entry);
+	const NetEndpoint & working = op->remoteWorkingAddress;
+	entry.nat = EndpointCache::NAT_GUESSED;
+	for (NetEndpointVec::const_iterator i = op->remoteInternAddresses.begin(); i != op->remoteInternAddresses.end(); i++) {
+		if (i->address == working.address && i->port == working.port) entry.nat = EndpointCache::NAT_DIRECT;
+	}
+	if (entry.nat != EndpointCache::NAT_DIRECT && !op->remoteExternAddresses.empty()
+			&& op->remoteExternAddresses[0].address == working.address && op->remoteExternAddresses[0].port == working.port) {
+		entry.nat = EndpointCache::NAT_PUNCHED;
+	}
+	entry.transport  = "udt";
+	entry.udpAddress = working.address;
+	entry.udpPort    = working.port;
+	if (op->echoClient.port() > 0) {
+		entry.externAddress  = op->echoClient.address();
+		entry.portPreserving = op->echoClient.port() == op->udpSocket.port();
+	}
+	cache.store (op->target, entry);
+}
+
 }
@@ -15,6 +15,9 @@ namespace sf {
 /**
  * UDTChannelConnector manages creation of (potentially) NAT traversed UDT Channels.
  *
+ * The EndpointCache remembers the own external address and the peer's working UDP endpoint.
+ * If the own NAT kept the port the last time, the echo server is not waited for.
+ *
  * During establishing the connection, UDP sockets will be used.
  *
  * There is no server as this is a pure P2P protocol.
@@ -130,6 +133,8 @@ private:
 			punchCount = 0;
 			sentAck = false;
 			recvAck = false;
+			punchTime = 0;
+			rtt = -1;
 		}
 
 		virtual void onCancel (sf::Error reason) {
@@ -167,12 +172,16 @@ private:
 		bool sentAck;
 		bool recvAck;
 		int punchCount;
+		double punchTime;	///< Time of last punch round
+		float rtt;			///< RTT measured by punching in seconds, < 0 if unknown
 	};
 	
 	/// Begins connecting process
 	void startConnecting (CreateChannelOp * op);
 	/// Got echo data from echoserver
 	void onEchoClientResult (Error result, AsyncOpId id);
+	/// Sends own addresses to the other side (request or reply)
+	void sendDetails (CreateChannelOp * op, Error result);
 	/// Start with pure udp connecting
 	void udpConnect (AsyncOpId id);
 	/// There is some UDP Data readable
@@ -184,6 +193,9 @@ private:
 	void onUdpRecvPunchReply (const NetEndpoint & from, CreateChannelOp * op, const PunchUDPReply & reply);
 	/// Received ACK
 	void onUdpRecvAck (const NetEndpoint & from, CreateChannelOp * op, const AckUDP & ack);
+
+	/// Creates the UDT socket of the operation, tuned using the measured RTT
+	void createUdtSocket (CreateChannelOp * op);
 	
 	/// Result of UDT connect
 	void onUdtConnectResult (CreateChannelOp* op, Error result);
@@ -198,6 +210,15 @@ private:
 	// Varies the port [-1,+3] based on some access point port mapping experience
 	void guessSomeExternAddresses (CreateChannelOp * op);
 
+	/// Adds the external address which worked the last time (if the peer has no current one)
+	void addCachedExternAddress (CreateChannelOp * op);
+
+	/// Records the own external address seen by the echo server in the EndpointCache
+	void storeOwnAddress (const HostId & target, const NetEndpoint & externAddress, int localPort);
+
+	/// Records the working endpoint of a created channel in the EndpointCache
+	void storeEndpoint (CreateChannelOp * op);
+
 	/// Checks if authentication is enabled
 	bool authenticationEnabled () const { return mAuthentication ? true : false; }
 
@@ -415,7 +415,11 @@ Error DataSharingServerImpl::notifySubscriber (const Path & path) {
 	n.revision = i->second.currentRevision;
 	n.size     = i->second.promise->size();
 
-	mCommunicationDelegate->send (subscribers, Datagram::fromCmd(n));
+	CommunicationDelegate::ErrorMap errors;
+	mCommunicationDelegate->send (subscribers, Datagram::fromCmd(n), &errors);
+	for (CommunicationDelegate::ErrorMap::const_iterator j = errors.begin(); j != errors.end(); j++) {
+		Log (LogWarning) << LOGID << "Could not notify " << j->first << " about " << path << ": " << toString (j->second) << std::endl;
+	}
 	return NoError;
 }
 
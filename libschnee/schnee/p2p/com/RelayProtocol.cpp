@@ -0,0 +1,393 @@
+#include "RelayProtocol.h"
+
+#include <schnee/tools/Log.h>
+#include <schnee/tools/Serialization.h>
+#include <schnee/tools/Deserialization.h>
+
+namespace sf {
+
+/// Smallest size of the token bucket, must hold at least one chunk
+static const double gMinBurst = 65536;
+
+RelayProtocol::RelayProtocol () {
+	SF_REGISTER_ME;
+	mCommunicationDelegate = 0;
+	mAuthentication = 0;
+	mAccepting      = false;
+	mMaxRelays      = 16;
+	mMinLegLevel    = 10;
+	mOfferTimeOutMs = 15000;
+	mMaxWindow      = 1048576;
+	mRelayBandwidth = 0;
+	mTokens         = gMinBurst;
+	mBurst          = gMinBurst;
+	mLastRefill     = currentTime ();
+	mTimerActive    = false;
+}
+
+RelayProtocol::~RelayProtocol () {
+	SF_UNREGISTER_ME;
+	cancelTimer (mForwardTimer);
+	for (LegMap::iterator i = mLegs.begin(); i != mLegs.end(); i++) {
+		RelayChannelPtr channel = i->second.channel.lock();
+		if (channel) channel->invalidate (error::Closed);
+	}
+}
+
+void RelayProtocol::setRelayBandwidth (float bytesPerSecond) {
+	mRelayBandwidth = bytesPerSecond;
+	mBurst = std::max (gMinBurst, (double) bytesPerSecond / 4);
+	if (mTokens > mBurst) mTokens = mBurst;
+	if (bytesPerSecond != 0) {
+		continueForwarding ();
+		return;
+	}
+	// Relaying disabled, drop all relayed streams
+	mForwards.clear ();
+	std::vector<AsyncOpId> relayed;
+	for (LegMap::const_iterator i = mLegs.begin(); i != mLegs.end(); i++) {
+		if (i->second.peer) relayed.push_back (i->first);
+	}
+	for (std::vector<AsyncOpId>::const_iterator i = relayed.begin(); i != relayed.end(); i++) {
+		removeLeg (*i, error::NoPerm, true);
+	}
+}
+
+RelayProtocol::Statistics RelayProtocol::statistics () const {
+	return mStatistics;
+}
+
+Error RelayProtocol::open (const HostId & relay, const HostId & target, const OpenCallback & callback, int timeOutMs) {
+	if (!mCommunicationDelegate) return error::NotInitialized;
+	if (relay == target) return error::InvalidArgument;
+	AsyncOpId id = genFreeId ();
+	RelayRequest request;
+	request.id     = id;
+	request.target = target;
+	Error e = mCommunicationDelegate->send (relay, Datagram::fromCmd (request));
+	if (e) return e;
+
+	RelayChannelPtr channel (new RelayChannel (this, id, relay, target, false));
+	Leg & leg = mLegs[id];
+	leg.host    = relay;
+	leg.channel = channel;
+
+	OpenOp * op = new OpenOp (regTimeOutMs (timeOutMs), this);
+	op->setId (id);
+	op->callback = callback;
+	op->channel  = channel;
+	addAsyncOp (op);
+	return NoError;
+}
+
+void RelayProtocol::onChannelChange (const HostId & host) {
+	if (mCommunicationDelegate->channelLevel (host) > 0) return;
+	// Lost connection, all legs to host are gone
+	std::vector<AsyncOpId> lost;
+	for (LegMap::const_iterator i = mLegs.begin(); i != mLegs.end(); i++) {
+		if (i->second.host == host) lost.push_back (i->first);
+	}
+	for (std::vector<AsyncOpId>::const_iterator i = lost.begin(); i != lost.end(); i++) {
+		Log (LogInfo) << LOGID << "Lost leg " << *i << " to " << host << std::endl;
+		removeLeg (*i, error::ConnectionError, false);
+	}
+}
+
+Error RelayProtocol::sendData (AsyncOpId leg, const ByteArrayPtr & data, const ResultCallback & callback) {
+	LegMap::const_iterator i = mLegs.find (leg);
+	if (i == mLegs.end() || !i->second.remote) return error::NotFound;
+	RelayData relayData;
+	relayData.id = i->second.remote;
+	return mCommunicationDelegate->send (i->second.host, Datagram::fromCmd (relayData, data), callback);
+}
+
+void RelayProtocol::sendAck (AsyncOpId leg, int bytes) {
+	LegMap::const_iterator i = mLegs.find (leg);
+	if (i == mLegs.end() || !i->second.remote) return;
+	RelayAck ack;
+	ack.id    = i->second.remote;
+	ack.bytes = bytes;
+	mCommunicationDelegate->send (i->second.host, Datagram::fromCmd (ack));
+}
+
+void RelayProtocol::closeLeg (AsyncOpId leg) {
+	LegMap::iterator i = mLegs.find (leg);
+	if (i == mLegs.end()) return;
+	Leg l = i->second;
+	mLegs.erase (i);
+	sendClose (l);
+}
+
+void RelayProtocol::onRpc (const HostId & sender, const RelayRequest & request, const ByteArray & data) {
+	Error e = checkRelay (sender, request.target);
+	if (e) {
+		Log (LogInfo) << LOGID << "Rejecting relay request from " << sender << " to " << request.target << ": " << toString (e) << std::endl;
+		mStatistics.rejected++;
+		RelayAnswer answer;
+		answer.id    = request.id;
+		answer.error = e;
+		mCommunicationDelegate->send (sender, Datagram::fromCmd (answer));
+		return;
+	}
+	AsyncOpId in  = genFreeId ();
+	AsyncOpId out = genFreeId ();
+	Leg & inLeg = mLegs[in];
+	inLeg.host   = sender;
+	inLeg.remote = request.id;
+	inLeg.peer   = out;
+	Leg & outLeg = mLegs[out];
+	outLeg.host = request.target;
+	outLeg.peer = in;
+	mStatistics.streams++;
+
+	RelayOffer offer;
+	offer.id     = out;
+	offer.source = sender;
+	e = mCommunicationDelegate->send (request.target, Datagram::fromCmd (offer));
+	if (e) {
+		removeLeg (out, e, false);
+		return;
+	}
+	OfferOp * op = new OfferOp (regTimeOutMs (mOfferTimeOutMs), this);
+	op->setId (out);
+	addAsyncOp (op);
+	Log (LogInfo) << LOGID << "Relaying from " << sender << " to " << request.target << std::endl;
+}
+
+void RelayProtocol::onRpc (const HostId & sender, const RelayOffer & offer, const ByteArray & data) {
+	RelayAnswer answer;
+	answer.id = offer.id;
+	if (!mAccepting || !mIncoming) {
+		answer.error = error::NoPerm;
+		mCommunicationDelegate->send (sender, Datagram::fromCmd (answer));
+		return;
+	}
+	AsyncOpId id = genFreeId ();
+	RelayChannelPtr channel (new RelayChannel (this, id, sender, offer.source, true));
+	Leg & leg = mLegs[id];
+	leg.host    = sender;
+	leg.remote  = offer.id;
+	leg.channel = channel;
+
+	answer.other = id;
+	Error e = mCommunicationDelegate->send (sender, Datagram::fromCmd (answer));
+	if (e) {
+		mLegs.erase (id);
+		channel->invalidate (e);
+		return;
+	}
+	mIncoming (offer.source, channel);
+}
+
+void RelayProtocol::onRpc (const HostId & sender, const RelayAnswer & answer, const ByteArray & data) {
+	Leg * leg = findLeg (answer.id, sender);
+	if (!leg) {
+		if (!answer.error && answer.other) {
+			// Too late, release the other side
+			RelayClose close;
+			close.id = answer.other;
+			mCommunicationDelegate->send (sender, Datagram::fromCmd (close));
+		}
+		return;
+	}
+	if (leg->peer) {
+		// Relaying, answer of the target
+		OfferOp * op;
+		getReadyAsyncOp (answer.id, OFFER, &op);
+		if (!op) return;
+		delete op;
+		AsyncOpId in = leg->peer;
+		Leg & inLeg  = mLegs[in];
+		RelayAnswer reply;
+		reply.id = inLeg.remote;
+		if (answer.error) {
+			reply.error = answer.error;
+			mCommunicationDelegate->send (inLeg.host, Datagram::fromCmd (reply));
+			mLegs.erase (in);
+			mLegs.erase (answer.id);
+			mStatistics.streams--;
+			return;
+		}
+		leg->remote   = answer.other;
+		reply.other = in;
+		mCommunicationDelegate->send (inLeg.host, Datagram::fromCmd (reply));
+		return;
+	}
+	// End point, answer of the relay
+	if (answer.error) {
+		failOpen (answer.id, answer.error);
+		return;
+	}
+	OpenOp * op;
+	getReadyAsyncOp (answer.id, OPEN, &op);
+	if (!op) return;
+	leg->remote = answer.other;
+	op->channel->setConnected ();
+	if (op->callback) op->callback (NoError, op->channel);
+	delete op;
+}
+
+void RelayProtocol::onRpc (const HostId & sender, const RelayData & relayData, const ByteArray & data) {
+	Leg * leg = findLeg (relayData.id, sender);
+	if (!leg) return;
+	if (leg->peer) {
+		AsyncOpId outId = leg->peer;
+		Leg & out = mLegs[outId];
+		if (!out.remote) return;
+		out.unacked += data.size();
+		if (out.unacked > mMaxWindow) {
+			Log (LogWarning) << LOGID << sender << " exceeded the window relaying to " << out.host << " (" << out.unacked << " bytes unacknowledged), closing" << std::endl;
+			mStatistics.overflows++;
+			removeLeg (outId, error::TooMuch, true);
+			return;
+		}
+		RelayData forwarded;
+		forwarded.id = out.remote;
+		mStatistics.bytes += data.size();
+		forward (outId, out.host, Datagram::fromCmd (forwarded, createByteArrayPtr (data)), (long) data.size());
+		return;
+	}
+	RelayChannelPtr channel = leg->channel.lock();
+	if (channel) channel->pushData (data);
+}
+
+void RelayProtocol::onRpc (const HostId & sender, const RelayAck & ack, const ByteArray & data) {
+	Leg * leg = findLeg (ack.id, sender);
+	if (!leg) return;
+	if (leg->peer) {
+		// Acks are not paced, delaying them would shrink the window of the stream
+		size_t bytes = ack.bytes < 0 ? 0 : (size_t) ack.bytes;
+		leg->unacked = bytes > leg->unacked ? 0 : leg->unacked - bytes;
+		Leg & out = mLegs[leg->peer];
+		if (!out.remote) return;
+		RelayAck forwarded;
+		forwarded.id    = out.remote;
+		forwarded.bytes = ack.bytes;
+		mCommunicationDelegate->send (out.host, Datagram::fromCmd (forwarded));
+		return;
+	}
+	RelayChannelPtr channel = leg->channel.lock();
+	if (channel) channel->onAck (ack.bytes);
+}
+
+void RelayProtocol::onRpc (const HostId & sender, const RelayClose & close, const ByteArray & data) {
+	Leg * leg = findLeg (close.id, sender);
+	if (!leg) return;
+	if (!leg->peer && !leg->remote) {
+		// Relay gave up before the stream got opened
+		failOpen (close.id, error::CouldNotConnectHost);
+		return;
+	}
+	removeLeg (close.id, error::Eof, false);
+}
+
+Error RelayProtocol::checkRelay (const HostId & sender, const HostId & target) const {
+	if (mRelayBandwidth == 0) return error::NoPerm;
+	if (target.empty() || target == sender) return error::InvalidArgument;
+	if (mStatistics.streams >= mMaxRelays) return error::TooMuch;
+	if (mAuthentication) {
+		if (mAuthentication->get (sender).type != Authentication::CT_PEER) return error::NoPerm;
+		if (mAuthentication->get (target).type != Authentication::CT_PEER) return error::NoPerm;
+	}
+	if (mCommunicationDelegate->channelLevel (sender) < mMinLegLevel) return error::ConnectionError;
+	if (mCommunicationDelegate->channelLevel (target) < mMinLegLevel) return error::ConnectionError;
+	return NoError;
+}
+
+RelayProtocol::Leg * RelayProtocol::findLeg (AsyncOpId id, const HostId & sender) {
+	LegMap::iterator i = mLegs.find (id);
+	if (i == mLegs.end()) return 0;
+	if (i->second.host != sender) {
+		Log (LogWarning) << LOGID << sender << " tried to access leg " << id << " of " << i->second.host << std::endl;
+		return 0;
+	}
+	return &i->second;
+}
+
+void RelayProtocol::removeLeg (AsyncOpId id, Error reason, bool notifyHost) {
+	LegMap::iterator i = mLegs.find (id);
+	if (i == mLegs.end()) return;
+	Leg leg = i->second;
+	mLegs.erase (i);
+	if (notifyHost) sendClose (leg);
+	if (!leg.peer) {
+		RelayChannelPtr channel = leg.channel.lock();
+		if (channel) channel->invalidate (reason);
+		return;
+	}
+	// Relaying, the other leg is gone, too
+	mStatistics.streams--;
+	LegMap::iterator j = mLegs.find (leg.peer);
+	if (j == mLegs.end()) return;
+	Leg other = j->second;
+	mLegs.erase (j);
+	sendClose (other);
+}
+
+void RelayProtocol::sendClose (const Leg & leg) {
+	if (!leg.remote) return;
+	RelayClose close;
+	close.id = leg.remote;
+	if (leg.peer) {
+		// must not overtake the forwarded data
+		forward (0, leg.host, Datagram::fromCmd (close), 0);
+	} else {
+		mCommunicationDelegate->send (leg.host, Datagram::fromCmd (close));
+	}
+}
+
+void RelayProtocol::failOpen (AsyncOpId id, Error reason) {
+	OpenOp * op;
+	getReadyAsyncOp (id, OPEN, &op);
+	mLegs.erase (id);
+	if (!op) return;
+	op->channel->invalidate (reason);
+	if (op->callback) op->callback (reason, RelayChannelPtr ());
+	delete op;
+}
+
+void RelayProtocol::forward (AsyncOpId leg, const HostId & receiver, const Datagram & datagram, long cost) {
+	Forward f;
+	f.leg      = leg;
+	f.receiver = receiver;
+	f.datagram = datagram;
+	f.cost     = cost;
+	mForwards.push_back (f);
+	continueForwarding ();
+}
+
+void RelayProtocol::continueForwarding () {
+	Time now = currentTime ();
+	if (mRelayBandwidth > 0) {
+		double passed = (now - mLastRefill).total_microseconds() / 1000000.0;
+		mTokens = std::min (mBurst, mTokens + passed * mRelayBandwidth);
+	}
+	mLastRefill = now;
+	while (!mForwards.empty()) {
+		double cost = std::min ((double) mForwards.front().cost, mBurst);
+		if (mRelayBandwidth >= 0) {
+			if (mTokens < cost) break;
+			mTokens -= cost;
+		}
+		// removeLeg may queue further datagrams
+		Forward f = mForwards.front();
+		mForwards.pop_front ();
+		Error e = mCommunicationDelegate->send (f.receiver, f.datagram);
+		if (e) {
+			Log (LogWarning) << LOGID << "Could not forward to " << f.receiver << ": " << toString (e) << ", closing stream" << std::endl;
+			if (f.leg) removeLeg (f.leg, e, true);
+		}
+	}
+	if (mForwards.empty() || mTimerActive || mRelayBandwidth <= 0) return;
+	double missing = std::min ((double) mForwards.front().cost, mBurst) - mTokens;
+	long waitMs = (long) (missing / mRelayBandwidth * 1000) + 1;
+	mTimerActive  = true;
+	mForwardTimer = xcallTimed (dMemFun (this, &RelayProtocol::onForwardTimer), futureInMs (waitMs));
+}
+
+void RelayProtocol::onForwardTimer () {
+	mTimerActive = false;
+	continueForwarding ();
+}
+
+}
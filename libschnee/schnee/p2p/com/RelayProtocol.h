@@ -0,0 +1,240 @@
+#pragma once
+
+#include <schnee/p2p/CommunicationComponent.h>
+#include <schnee/p2p/Authentication.h>
+#include <schnee/p2p/channels/RelayChannel.h>
+#include <schnee/tools/async/AsyncOpBase.h>
+#include <deque>
+
+namespace sf {
+
+/**
+ * Implements relaying of byte streams between two peers through a third one.
+ *
+ * A stream consists of two legs: initiator <-> relay and relay <-> target. Every host
+ * names a leg with an own id, messages always carry the id of the receiving host.
+ *
+ * - The initiator sends a RelayRequest to the relay, which checks its policy and
+ *   sends a RelayOffer to the target.
+ * - RelayAnswer travels back the same way.
+ * - RelayData carries the stream content and is acknowledged by RelayAck from
+ *   the receiving end point (flow control, see RelayChannel).
+ * - RelayClose closes both legs.
+ *
+ * The relay only forwards; RelayChannelProvider encrypts the stream end-to-end.
+ * Relayed traffic is paced through a token bucket with the relay bandwidth. A stream
+ * whose unacknowledged data at the relay exceeds setMaxWindow gets closed, so a
+ * sender ignoring the flow control can't fill up the relay's memory.
+ *
+ * Used by RelayChannelProvider.
+ */
+class RelayProtocol : public CommunicationComponent, public AsyncOpBase {
+public:
+	RelayProtocol ();
+	virtual ~RelayProtocol ();
+
+	SF_AUTOREFLECT_RPC;
+
+	// Protocol Elements:
+
+	/// Initiator asks relay to open a stream to target
+	struct RelayRequest {
+		RelayRequest () : id (0) {}
+		AsyncOpId id;		///< Leg id of initiator
+		HostId target;
+		SF_AUTOREFLECT_SDC;
+	};
+
+	/// Relay offers a stream from source to the target
+	struct RelayOffer {
+		RelayOffer () : id (0) {}
+		AsyncOpId id;		///< Leg id of relay
+		HostId source;
+		SF_AUTOREFLECT_SDC;
+	};
+
+	/// Answer to RelayRequest / RelayOffer
+	struct RelayAnswer {
+		RelayAnswer () : id (0), other (0), error (NoError) {}
+		AsyncOpId id;		///< Leg id of receiver
+		AsyncOpId other;	///< Leg id of sender
+		Error error;
+		SF_AUTOREFLECT_SDC;
+	};
+
+	/// Stream content
+	struct RelayData {
+		RelayData () : id (0) {}
+		AsyncOpId id;		///< Leg id of receiver
+		SF_AUTOREFLECT_SDC;
+	};
+
+	/// Content arrived at the end point
+	struct RelayAck {
+		RelayAck () : id (0), bytes (0) {}
+		AsyncOpId id;		///< Leg id of receiver
+		int bytes;
+		SF_AUTOREFLECT_SDC;
+	};
+
+	/// Closes a stream
+	struct RelayClose {
+		RelayClose () : id (0) {}
+		AsyncOpId id;		///< Leg id of receiver
+		SF_AUTOREFLECT_SDC;
+	};
+
+	///@name Relaying for others
+	///@{
+
+	/// Sets the rate of all relayed streams in bytes/s, 0 disables relaying, < 0 means unlimited
+	/// default = 0
+	void setRelayBandwidth (float bytesPerSecond);
+
+	/// Sets the maximum number of relayed streams
+	/// default = 16
+	void setMaxRelays (int count) { mMaxRelays = count; }
+
+	/// Maximum unacknowledged bytes per relayed leg, larger ones get closed
+	/// default = 1048576 (twice the window of RelayChannel)
+	void setMaxWindow (size_t bytes) { mMaxWindow = bytes; }
+
+	/// Only channels of at least this level are used as legs
+	/// default = 10 (no IM or relayed channels)
+	void setMinLegLevel (int level) { mMinLegLevel = level; }
+	int minLegLevel () const { return mMinLegLevel; }
+
+	/// Binds with authentication, only known peers get relayed
+	void setAuthentication (Authentication * auth) { mAuthentication = auth; }
+
+	/// Statistics of relaying for others
+	struct Statistics {
+		Statistics () : streams (0), bytes (0), rejected (0), overflows (0) {}
+		int     streams;	///< Currently relayed streams
+		int64_t bytes;		///< Relayed content bytes
+		int     rejected;	///< Rejected requests
+		int     overflows;	///< Streams closed for exceeding the window
+	};
+	Statistics statistics () const;
+
+	///@}
+
+	///@name End points
+	///@{
+
+	typedef function<void (Error result, RelayChannelPtr channel)> OpenCallback;
+
+	/// Opens a stream to target through relay. Calls back if not returning an error.
+	Error open (const HostId & relay, const HostId & target, const OpenCallback & callback, int timeOutMs = -1);
+
+	/// Accept incoming streams (otherwise offers are rejected)
+	void setAccepting (bool v) { mAccepting = v; }
+
+	typedef function<void (const HostId & source, RelayChannelPtr channel)> IncomingDelegate;
+	/// A stream got opened by someone else
+	IncomingDelegate & incoming () { return mIncoming; }
+
+	///@}
+
+	// Implementation of CommunicationComponent
+	virtual void onChannelChange (const HostId & host);
+
+private:
+	friend class RelayChannel;
+
+	// Interface for RelayChannel
+	Error sendData (AsyncOpId leg, const ByteArrayPtr & data, const ResultCallback & callback);
+	void sendAck (AsyncOpId leg, int bytes);
+	void closeLeg (AsyncOpId leg);
+
+	void onRpc (const HostId & sender, const RelayRequest & request, const ByteArray & data);
+	void onRpc (const HostId & sender, const RelayOffer & offer, const ByteArray & data);
+	void onRpc (const HostId & sender, const RelayAnswer & answer, const ByteArray & data);
+	void onRpc (const HostId & sender, const RelayData & relayData, const ByteArray & data);
+	void onRpc (const HostId & sender, const RelayAck & ack, const ByteArray & data);
+	void onRpc (const HostId & sender, const RelayClose & close, const ByteArray & data);
+
+	/// Checks whether we relay for sender to target
+	Error checkRelay (const HostId & sender, const HostId & target) const;
+
+	/// One half of a stream
+	struct Leg {
+		Leg () : remote (0), peer (0), unacked (0) {}
+		HostId host;					///< Other side of the leg
+		AsyncOpId remote;				///< Id of the leg at host (0 if not known yet)
+		AsyncOpId peer;					///< Relaying: the other leg of the stream
+		size_t unacked;					///< Relaying: bytes forwarded to host and not acknowledged yet
+		weak_ptr<RelayChannel> channel;	///< End point: the channel
+	};
+	typedef std::map<AsyncOpId, Leg> LegMap;
+
+	/// Finds a leg belonging to sender
+	Leg * findLeg (AsyncOpId id, const HostId & sender);
+
+	/// Removes a leg (and its relayed peer leg), sending close messages to the other sides
+	void removeLeg (AsyncOpId id, Error reason, bool notifyHost);
+
+	/// Sends RelayClose to the other side of a leg (if it is known there)
+	void sendClose (const Leg & leg);
+
+	/// Fails an open operation which did not get a positive answer
+	void failOpen (AsyncOpId id, Error reason);
+
+	/// Queues a datagram to be forwarded (paced by the relay bandwidth)
+	/// @param leg the leg the datagram belongs to, closed if sending fails (0 for none)
+	void forward (AsyncOpId leg, const HostId & receiver, const Datagram & datagram, long cost);
+	/// Sends out queued datagrams as the token bucket allows
+	void continueForwarding ();
+	void onForwardTimer ();
+
+	enum OpType { OPEN = 1, OFFER };
+
+	/// Initiator waits for the answer of the relay
+	struct OpenOp : public AsyncOp {
+		OpenOp (const sf::Time & timeOut, RelayProtocol * protocol) : AsyncOp (OPEN, timeOut), protocol (protocol) {}
+		virtual void onCancel (sf::Error reason) {
+			protocol->removeLeg (id(), reason, false);
+			if (callback) callback (reason, RelayChannelPtr ());
+		}
+		RelayProtocol * protocol;
+		OpenCallback callback;
+		RelayChannelPtr channel;		///< Holds the channel until answered
+	};
+
+	/// Relay waits for the answer of the target
+	struct OfferOp : public AsyncOp {
+		OfferOp (const sf::Time & timeOut, RelayProtocol * protocol) : AsyncOp (OFFER, timeOut), protocol (protocol) {}
+		virtual void onCancel (sf::Error reason) {
+			protocol->removeLeg (id(), reason, true);
+		}
+		RelayProtocol * protocol;
+	};
+
+	LegMap mLegs;
+	Authentication * mAuthentication;
+	bool mAccepting;
+	int  mMaxRelays;
+	int  mMinLegLevel;
+	int  mOfferTimeOutMs;
+	size_t mMaxWindow;
+	Statistics mStatistics;
+
+	// Pacing of relayed traffic
+	struct Forward {
+		AsyncOpId leg;		///< Outgoing leg (0 if already closed)
+		HostId receiver;
+		Datagram datagram;
+		long cost;
+	};
+	std::deque<Forward> mForwards;
+	float    mRelayBandwidth;
+	double   mTokens;			///< Current content of the token bucket (in bytes)
+	double   mBurst;			///< Size of the token bucket (in bytes)
+	sf::Time mLastRefill;		///< Last time the token bucket got refilled
+	bool     mTimerActive;
+	TimedCallHandle mForwardTimer;
+
+	IncomingDelegate mIncoming;
+};
+
+}
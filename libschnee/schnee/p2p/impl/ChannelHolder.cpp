@@ -1,14 +1,27 @@
 #include "ChannelHolder.h"
 #include <schnee/tools/Serialization.h>
+#include <algorithm>
 
 namespace sf {
 
+/// A measured channel must be better by this factor to be preferred
+static const float gHysteresis = 1.2f;
+/// Incoming traffic with smaller gaps is one busy period (ms)
+static const int gTrafficGapMs = 50;
+/// Minimum duration of a busy period for a passive measurement (ms)
+static const int gPassiveMinMs = 200;
+/// Minimum bytes of a busy period for a passive measurement
+static const int64_t gPassiveMinBytes = 65536;
+/// Long busy periods are reported in windows of this length (ms)
+static const int gPassiveWindowMs = 1000;
+
 ChannelHolder::ChannelHolder () {
 	SF_REGISTER_ME;
 	mNextChannelId = 1;
 	mCloseTimeoutMs   = 60000;
 	mChannelTimeoutMs = 600000;
 	mChannelTimeoutCheckIntervalMs  = 60000;
+	mBulkThreshold    = 16384;
 //	// debug values:
 //	mChannelTimeoutMs = 10000;
 //	mChannelTimeoutCheckIntervalMs = 1000;
@@ -67,6 +80,7 @@ ChannelHolder::ChannelId ChannelHolder::add (ChannelPtr channel, const HostId &
 		info.bestLevel = level;
 	}
 	info.channels[level] = id;
+	updateSelection (info);
 	channel->changed() = abind (dMemFun (this, &ChannelHolder::onChannelChange), id);
 	// prove channel change
 	xcall (abind (dMemFun (this, &ChannelHolder::onChannelChange), id));
@@ -118,11 +132,14 @@ Error ChannelHolder::closeRedundantChannelsToHost (const HostId & host) {
 	if (i == mPeers.end()) return error::NotFound;
 	PeerInfo & info (i->second);
 	PeerInfo::ChannelLevelMap channels = info.channels; // copy it, otherwise it may be destroyed.
-	bool first = true;
+	// the measured best channels are not redundant
+	std::set<ChannelId> keep;
+	keep.insert (info.bestChannel);
+	keep.insert (info.controlChannel);
+	keep.insert (info.bulkChannel);
 	for (PeerInfo::ChannelLevelMap::reverse_iterator i = channels.rbegin(); i != channels.rend(); i++){
-		if (!first)
+		if (keep.count (i->second) == 0)
 			close (i->second);
-		first = false;
 	}
 	return NoError;
 }
@@ -170,6 +187,39 @@ int ChannelHolder::findBestChannelLevel (const HostId & host) const {
 	return i->second.bestLevel;
 }
 
+ChannelHolder::ChannelId ChannelHolder::findBestChannel (const HostId & host, TrafficClass c) const {
+	PeerMap::const_iterator i = mPeers.find (host);
+	if (i == mPeers.end()) {
+		return 0;
+	}
+	ChannelId id = c == Bulk ? i->second.bulkChannel : i->second.controlChannel;
+	return id ? id : i->second.bestChannel;
+}
+
+ChannelHolder::ChannelId ChannelHolder::selectChannel (const HostId & host, long size) {
+	PeerMap::iterator i = mPeers.find (host);
+	if (i == mPeers.end()) {
+		return 0;
+	}
+	PeerInfo & info (i->second);
+	ChannelId id = findBestChannel (host, trafficClass (size));
+	if (id != info.lastChannel && info.lastChannel) {
+		ChannelMap::iterator j = mChannels.find (info.lastChannel);
+		if (j != mChannels.end() && !j->second.closing && j->second.confirmed < j->second.sent) {
+			// the peer may not have got everything of the last channel, stay there to keep the order
+			ChannelReceiver & last (j->second);
+			if (!last.draining) {
+				Drain drain;
+				drain.count = last.sent;
+				last.draining = !send (info.lastChannel, Datagram::fromCmd (drain), false);
+			}
+			id = info.lastChannel;
+		}
+	}
+	info.lastChannel = id;
+	return id;
+}
+
 /// Constructs comma-separated stack
 static String getStack (ChannelPtr channel) {
 	String result = channel->stackInfo();
@@ -191,9 +241,15 @@ ConnectionManagement::ConnectionInfos ChannelHolder::connections () const {
 			info.level  = r.level;
 			info.cinfo  = r.channel->info();
 			info.id     = i->first;
+			if (info.cinfo.delay < 0 && r.estimator.hasRtt()){
+				info.cinfo.delay = r.estimator.srtt();
+			}
 			if (info.cinfo.delay < 0 && r.delayMeasurement->hasAvg()){
 				info.cinfo.delay = r.delayMeasurement->avg();
 			}
+			if (info.cinfo.bandwidth < 0 && r.estimator.hasBandwidth()){
+				info.cinfo.bandwidth = r.estimator.bandwidth();
+			}
 			info.stack  = getStack (r.channel);
 			result.push_back (info);
 		}
@@ -218,6 +274,12 @@ ConnectionManagement::ConnectionInfo ChannelHolder::connectionInfo (const HostId
 	info.level  = r.level;
 	info.cinfo = r.channel->info();
 	info.id = j->first;
+	if (info.cinfo.delay < 0 && r.estimator.hasRtt()){
+		info.cinfo.delay = r.estimator.srtt();
+	}
+	if (info.cinfo.bandwidth < 0 && r.estimator.hasBandwidth()){
+		info.cinfo.bandwidth = r.estimator.bandwidth();
+	}
 	info.stack = getStack (r.channel);
 	return info;
 }
@@ -228,9 +290,24 @@ Error ChannelHolder::send (ChannelId id, const Datagram & d, bool highLevel, con
 	if (i->second.closing) return error::Closed;
 	ByteArrayPtr encoded = d.encode();
 	if (!encoded) return error::TooMuch;
-	if (highLevel)
-		i->second.utime = currentTime();
-	return i->second.channel->write(encoded, callback);
+	return sendEncoded (id, encoded, highLevel, callback);
+}
+
+Error ChannelHolder::send (const HostSet & receivers, const Datagram & d, bool highLevel, CommunicationDelegate::ErrorMap * errors) {
+	if (receivers.empty()) return NoError;
+	// Encoding just once, channels may not change written data
+	ByteArrayPtr encoded = d.encode();
+	if (!encoded) return error::TooMuch;
+	Error result = NoError;
+	for (HostSet::const_iterator i = receivers.begin(); i != receivers.end(); i++){
+		ChannelId id = selectChannel (*i, (long) encoded->size());
+		Error err = id ? sendEncoded (id, encoded, highLevel) : error::ConnectionError;
+		if (!err) continue;
+		if (errors) (*errors)[*i] = err;
+		if (!result) result = err;
+		else result = error::MultipleErrors;
+	}
+	return result;
 }
 
 Error ChannelHolder::addChannelPingMeasure (ChannelId id, float seconds) {
@@ -238,9 +315,31 @@ Error ChannelHolder::addChannelPingMeasure (ChannelId id, float seconds) {
 	if (i == mChannels.end()) return error::NotFound;
 	if (i->second.closing) return error::Closed;
 	i->second.delayMeasurement->add(seconds);
+	i->second.estimator.addRtt (seconds);
+	PeerMap::iterator j = mPeers.find (i->second.target);
+	if (j != mPeers.end()) updateSelection (j->second);
 	return NoError;
 }
 
+Error ChannelHolder::addChannelBandwidthMeasure (ChannelId id, float bytesPerSecond, bool passive) {
+	ChannelMap::iterator i = mChannels.find(id);
+	if (i == mChannels.end()) return error::NotFound;
+	if (i->second.closing) return error::Closed;
+	if (passive)
+		i->second.estimator.addPassive (bytesPerSecond);
+	else
+		i->second.estimator.addProbe (bytesPerSecond);
+	PeerMap::iterator j = mPeers.find (i->second.target);
+	if (j != mPeers.end()) updateSelection (j->second);
+	return NoError;
+}
+
+int ChannelHolder::idleTimeMs (ChannelId id) const {
+	ChannelMap::const_iterator i = mChannels.find(id);
+	if (i == mChannels.end()) return -1;
+	return (int) (currentTime() - i->second.utime).total_milliseconds();
+}
+
 void ChannelHolder::setChannelTimeout (int timeoutMs) {
 	mChannelTimeoutMs = timeoutMs;
 }
@@ -254,6 +353,17 @@ void ChannelHolder::setChannelTimeoutCheckInterval (int intervalMs) {
 	}
 }
 
+Error ChannelHolder::sendEncoded (ChannelId id, const ByteArrayPtr & encoded, bool highLevel, const ResultCallback & callback) {
+	ChannelMap::iterator i = mChannels.find(id);
+	if (i == mChannels.end()) return error::NotFound;
+	if (i->second.closing) return error::Closed;
+	if (highLevel) {
+		i->second.utime = currentTime();
+		i->second.sent++;
+	}
+	return i->second.channel->write(encoded, callback);
+}
+
 void ChannelHolder::onChannelChange (ChannelId id) {
 	HostId sender;
 	std::vector<Datagram> received; // we can store them, they are cheap.
@@ -309,7 +419,39 @@ void ChannelHolder::onChannelChange (ChannelId id) {
 				}else {
 					Log (LogWarning) << LOGID << "Received invalid pong" << std::endl;
 				}
+			} else if (cmd == Probe::getCmdName()){
+				Probe probe;
+				if (probe.deserialize (ds)){
+					onReceivedProbe (id, probe, i->encodedSize());
+				} else {
+					Log (LogWarning) << LOGID << "Received invalid probe" << std::endl;
+				}
+			} else if (cmd == Drain::getCmdName()){
+				Drain drain;
+				if (drain.deserialize (ds)){
+					// all datagrams before are delivered already
+					Drained drained;
+					drained.count = drain.count;
+					send (id, Datagram::fromCmd (drained), false);
+				} else {
+					Log (LogWarning) << LOGID << "Received invalid drain" << std::endl;
+				}
+			} else if (cmd == Drained::getCmdName()){
+				Drained drained;
+				if (drained.deserialize (ds)){
+					onReceivedDrained (id, drained);
+				} else {
+					Log (LogWarning) << LOGID << "Received invalid drained" << std::endl;
+				}
+			} else if (cmd == ProbeReport::getCmdName()){
+				ProbeReport report;
+				if (report.deserialize (ds)){
+					notify (mIncomingProbeReport, id, report);
+				} else {
+					Log (LogWarning) << LOGID << "Received invalid probe report" << std::endl;
+				}
 			} else {
+				meterArrival (id, i->encodedSize());
 				if (!updatedUTime) {
 					ChannelMap::iterator j = mChannels.find(id);
 					if (j != mChannels.end()){
@@ -324,6 +466,122 @@ void ChannelHolder::onChannelChange (ChannelId id) {
 	}
 }
 
+void ChannelHolder::onReceivedDrained (ChannelId id, const Drained & drained) {
+	ChannelMap::iterator i = mChannels.find (id);
+	if (i == mChannels.end()) return;
+	ChannelReceiver & receiver (i->second);
+	receiver.confirmed = std::max (receiver.confirmed, drained.count);
+	receiver.draining  = false;
+	PeerMap::const_iterator j = mPeers.find (receiver.target);
+	if (receiver.confirmed < receiver.sent && j != mPeers.end() && j->second.lastChannel == id) {
+		// more was sent meanwhile, ask again so that switching is possible as soon as sending pauses
+		Drain drain;
+		drain.count = receiver.sent;
+		receiver.draining = !send (id, Datagram::fromCmd (drain), false);
+	}
+}
+
+void ChannelHolder::onReceivedProbe (ChannelId id, const Probe & probe, long size) {
+	ChannelMap::iterator i = mChannels.find (id);
+	if (i == mChannels.end() || i->second.closing) return;
+	ArrivalMeter & train (i->second.probeTrain);
+	Time t = currentTime ();
+	if (probe.num == 0) {
+		// start of train, its own size does not count
+		train.id    = probe.id;
+		train.start = t;
+		train.last  = t;
+		train.bytes = 0;
+	} else if (train.id == probe.id) {
+		train.last   = t;
+		train.bytes += size;
+	} else {
+		return; // lost start of train
+	}
+	if (probe.num + 1 >= probe.count) {
+		ProbeReport report;
+		report.id     = train.id;
+		report.bytes  = train.bytes;
+		report.micros = (train.last - train.start).total_microseconds();
+		train = ArrivalMeter ();
+		send (id, Datagram::fromCmd (report), false);
+	}
+}
+
+void ChannelHolder::meterArrival (ChannelId id, long bytes) {
+	ChannelMap::iterator i = mChannels.find (id);
+	if (i == mChannels.end() || i->second.closing) return;
+	ArrivalMeter & m (i->second.traffic);
+	Time t = currentTime ();
+	if (!m.start.is_not_a_date_time() && (t - m.last).total_milliseconds() <= gTrafficGapMs) {
+		// continuing busy period
+		m.bytes += bytes;
+		m.last   = t;
+		int64_t micros = (m.last - m.start).total_microseconds();
+		if (micros < gPassiveWindowMs * 1000) return;
+		if (m.bytes >= gPassiveMinBytes) {
+			ProbeReport report;
+			report.bytes  = m.bytes;
+			report.micros = micros;
+			send (id, Datagram::fromCmd (report), false);
+		}
+		m.start = t;
+		m.bytes = 0;
+		return;
+	}
+	if (!m.start.is_not_a_date_time()) {
+		int64_t micros = (m.last - m.start).total_microseconds();
+		if (micros >= gPassiveMinMs * 1000 && m.bytes >= gPassiveMinBytes) {
+			// the other side learns what arrived of its traffic
+			ProbeReport report;
+			report.bytes  = m.bytes;
+			report.micros = micros;
+			send (id, Datagram::fromCmd (report), false);
+		}
+	}
+	m.start = t;
+	m.last  = t;
+	m.bytes = 0;
+}
+
+float ChannelHolder::score (ChannelId id, TrafficClass c) const {
+	ChannelMap::const_iterator i = mChannels.find (id);
+	if (i == mChannels.end() || i->second.closing) return -1;
+	const PathEstimator & e (i->second.estimator);
+	if (c == Bulk) return e.hasBandwidth() ? e.bandwidth() : -1;
+	return e.hasRtt() ? e.srtt() : -1;
+}
+
+ChannelHolder::ChannelId ChannelHolder::selectMeasured (const PeerInfo & info, TrafficClass c, ChannelId current) const {
+	float currentScore = score (current, c);
+	if (currentScore < 0) {
+		current      = info.bestChannel;
+		currentScore = score (current, c);
+		if (currentScore < 0) return current; // nothing to compare with
+	}
+	for (PeerInfo::ChannelLevelMap::const_iterator i = info.channels.begin(); i != info.channels.end(); i++) {
+		ChannelId id = i->second;
+		float s = score (id, c);
+		if (id == current || s < 0) continue;
+		bool better = c == Bulk ? s > currentScore * gHysteresis : s * gHysteresis < currentScore;
+		if (better) {
+			current      = id;
+			currentScore = s;
+		}
+	}
+	return current;
+}
+
+void ChannelHolder::updateSelection (PeerInfo & info) {
+	ChannelId control = selectMeasured (info, Control, info.controlChannel);
+	ChannelId bulk    = selectMeasured (info, Bulk, info.bulkChannel);
+	if ((info.controlChannel && control != info.controlChannel) || (info.bulkChannel && bulk != info.bulkChannel)) {
+		Log (LogInfo) << LOGID << mHostId << " selected channel " << control << " for control and " << bulk << " for bulk traffic (best level " << info.bestLevel << ")" << std::endl;
+	}
+	info.controlChannel = control;
+	info.bulkChannel    = bulk;
+}
+
 void ChannelHolder::onCloseChannelError (Error err, ChannelId id) {
 	Log (LogWarning) << LOGID << "Received " << toString(err) << " during waiting on channel close" << std::endl;
 	if (mChannels.count(id) == 0){
@@ -402,6 +660,11 @@ Error ChannelHolder::removeChannelPeerConnection (const HostId & host, ChannelId
 			info.bestLevel   = info.channels.rbegin()->first;
 		}
 	}
+	if (mPeers.count (host) > 0) {
+		if (info.controlChannel == id) info.controlChannel = 0;
+		if (info.bulkChannel == id)    info.bulkChannel    = 0;
+		updateSelection (info);
+	}
 	return NoError;
 }
 
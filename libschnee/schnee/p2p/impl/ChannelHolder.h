@@ -1,10 +1,12 @@
 #pragma once
 
 #include "SmoothingFilter.h"
+#include "PathEstimator.h"
 #include <schnee/tools/async/AsyncOpBase.h>
 #include <schnee/p2p/Datagram.h>
 #include <schnee/p2p/DatagramReader.h>
 #include "../ConnectionManagement.h"
+#include "../CommunicationDelegate.h"
 #include <schnee/tools/Deserialization.h>
 #include <schnee/p2p/com/PingProtocol.h>
 
@@ -15,6 +17,13 @@ namespace sf {
  *
  * Channels do have a associated level.
  *
+ * Besides of the level, channels are chosen by measurement: small datagrams
+ * go to the channel with the lowest smoothed round trip time, large ones
+ * (see setBulkThreshold) to the one with the highest bandwidth. Unmeasured and
+ * virtual channels are never preferred over the channel with the highest level.
+ * The channel to a host is only switched after the peer confirmed (see Drain) that
+ * it got everything sent on the previous channel, so that datagrams keep their order.
+ *
  * Part of GenericConnectionManagement.
  */
 class ChannelHolder : public AsyncOpBase{
@@ -56,6 +65,20 @@ public:
 	/// Finds the best channel level to a given host
 	int findBestChannelLevel (const HostId & host) const;
 
+	enum TrafficClass { Control, Bulk };
+
+	/// Finds the measured best channel to a given host for a traffic class
+	/// Falls back to findBestChannel if there are no (better) measurements
+	ChannelId findBestChannel (const HostId & host, TrafficClass c) const;
+
+	/// Selects the channel for sending a datagram of given encoded size to a host
+	/// Like findBestChannel (host, class), but stays on the last channel until the peer confirmed
+	/// all datagrams sent on it (asking for that if necessary)
+	ChannelId selectChannel (const HostId & host, long size);
+
+	/// Traffic class of a datagram with given encoded size
+	TrafficClass trafficClass (long size) const { return size >= mBulkThreshold ? Bulk : Control; }
+
 	/// Info about all connections (see ConnectionManagement)
 	ConnectionManagement::ConnectionInfos connections () const;
 	/// Info about specifc connection (see ConnectionManagement)
@@ -67,9 +90,26 @@ public:
 	///                    this will also trigger timeouts to be updated.
 	Error send (ChannelId id, const Datagram & d, bool highLevel, const ResultCallback & callback = ResultCallback());
 
+	/// Send a datagram to the best channels of multiple hosts
+	/// The datagram is encoded only once, all channels get the same (immutable) buffer.
+	/// If errors is given, the error of each failed receiver is stored in it.
+	/// Returns the error of a single failing receiver or error::MultipleErrors
+	Error send (const HostSet & receivers, const Datagram & d, bool highLevel, CommunicationDelegate::ErrorMap * errors = 0);
+
 	/// Add a ping measurement to  a channel
 	Error addChannelPingMeasure (ChannelId, float seconds);
 
+	/// Add a bandwidth measurement (bytes/s) to a channel
+	/// @param passive  measured on regular traffic, only a lower bound
+	Error addChannelBandwidthMeasure (ChannelId, float bytesPerSecond, bool passive);
+
+	/// Returns time since last high level traffic on a channel in ms or -1 if not existing
+	int idleTimeMs (ChannelId id) const;
+
+	/// Sets the encoded size from which on datagrams are bulk traffic
+	/// default = 16384
+	void setBulkThreshold (long bytes) { mBulkThreshold = bytes; }
+
 	/// Sets channel timeout
 	void setChannelTimeout (int timeoutMs);
 	/// Sets check interval for channel timeout
@@ -85,41 +125,97 @@ public:
 	typedef function<void (ChannelId id, const PingProtocol::Pong & pong)> PongDelegate;
 	PongDelegate & incomingPong () { return mIncomingPong; }
 
+	struct ProbeReport;
+	typedef function<void (ChannelId id, const ProbeReport & report)> ProbeReportDelegate;
+	ProbeReportDelegate & incomingProbeReport () { return mIncomingProbeReport; }
+
 	typedef function<void (ChannelId id, const HostId & target, int level)> ChannelChangedDelegate;
 	ChannelChangedDelegate & channelChanged () { return mChannelChanged; }
 
 	///@}
 
+	/// One packet of a probe train, content is padding
+	/// The receiver measures the spread of the train and answers with a ProbeReport
+	struct Probe {
+		Probe () : id (0), num (0), count (0) {}
+		AsyncOpId id;
+		int num;	///< Number of packet in train
+		int count;	///< Length of train
+		SF_AUTOREFLECT_SDC;
+	};
+
+	/// Measured arrival of a probe train (or of regular traffic if id is 0)
+	struct ProbeReport {
+		ProbeReport () : id (0), bytes (0), micros (0) {}
+		AsyncOpId id;
+		int64_t bytes;	///< Bytes arrived after the first packet
+		int64_t micros;	///< Time between first and last packet
+		SF_AUTOREFLECT_SDC;
+	};
+
 private:
 	struct ChannelReceiver;
 
 	/// A channel changed
 	void onChannelChange (ChannelId id);
 
+	/// Received a packet of a probe train
+	void onReceivedProbe (ChannelId id, const Probe & probe, long size);
+	/// Accounts regular incoming traffic for passive bandwidth estimation
+	void meterArrival (ChannelId id, long bytes);
+
+	/// Writes an already encoded datagram into a channel
+	Error sendEncoded (ChannelId id, const ByteArrayPtr & encoded, bool highLevel, const ResultCallback & callback = ResultCallback());
+
 	typedef shared_ptr<SmoothingFilter> SmoothingFilterPtr;
 
+	/// Arrival of traffic during a time window
+	struct ArrivalMeter {
+		ArrivalMeter () : id (0), bytes (0) {}
+		AsyncOpId id;	///< Probe train id (if measuring a train)
+		Time start;		///< Arrival of first packet
+		Time last;		///< Arrival of last packet
+		int64_t bytes;	///< Bytes after the first packet
+	};
+
 	/// Contains the channel and associated state machines for receiving datagrams
 	struct ChannelReceiver {
-		ChannelReceiver () : 	closing (0), requested (false), level (0), delayMeasurement (new SmoothingFilter(10)) {}
+		ChannelReceiver () : 	closing (0), requested (false), level (0), sent (0), confirmed (0), draining (false), delayMeasurement (new SmoothingFilter(10)) {}
 		ChannelPtr     			channel;
 		DatagramReader 			reader;
 		HostId                  target;
 		AsyncOpId				closing; ///< AsyncOpId of closing operation if channel is closing
 		bool					requested; // this host has requested the channel
 		int 					level;
+		int64_t                 sent;		///< High level datagrams sent
+		int64_t                 confirmed;	///< High level datagrams the peer confirmed to have got
+		bool                    draining;	///< Sent a Drain, waiting for Drained
 		Time                    utime;	///< Last application level traffic (for timeout purposes)
 		SmoothingFilterPtr delayMeasurement;
+		PathEstimator           estimator;
+		ArrivalMeter            probeTrain;	///< Incoming probe train
+		ArrivalMeter            traffic;	///< Incoming regular traffic (passive estimation)
 	};
 
 	// Information about a peer
 	struct PeerInfo  {
-		PeerInfo () : bestChannel (0), bestLevel (0) {}
+		PeerInfo () : bestChannel (0), bestLevel (0), controlChannel (0), bulkChannel (0), lastChannel (0) {}
 		ChannelId bestChannel; 				///< Best channel to this peer
 		int bestLevel;						///< Best active channel
+		ChannelId controlChannel;			///< Measured best channel for small datagrams
+		ChannelId bulkChannel;				///< Measured best channel for large datagrams
+		ChannelId lastChannel;				///< Channel of last sent datagram
 		typedef std::map<int, ChannelId> ChannelLevelMap;
 		ChannelLevelMap channels; 			///< All channels to this peer
 	};
 
+	/// Recalculates measured best channels of a peer
+	void updateSelection (PeerInfo & info);
+	/// Measured best channel of a class, starting from current choice (with hysteresis)
+	ChannelId selectMeasured (const PeerInfo & info, TrafficClass c, ChannelId current) const;
+	/// Score of a channel for a traffic class (< 0 if unmeasured or not usable)
+	float score (ChannelId id, TrafficClass c) const;
+
 	enum AsyncOperations { CLOSE_CHANNEL = 1};
 
 	/// RPC command for closing a channel
@@ -127,6 +223,23 @@ private:
 		SF_AUTOREFLECT_SDC;
 	};
 
+	/// Asks the peer to confirm the high level datagrams sent on a channel before switching to another one
+	struct Drain {
+		Drain () : count (0) {}
+		int64_t count;	///< High level datagrams sent on the channel before
+		SF_AUTOREFLECT_SDC;
+	};
+
+	/// Answer to Drain, on the same channel, after all datagrams before it got delivered
+	struct Drained {
+		Drained () : count (0) {}
+		int64_t count;	///< count of the Drain
+		SF_AUTOREFLECT_SDC;
+	};
+
+	/// Peer confirmed the datagrams of a channel
+	void onReceivedDrained (ChannelId id, const Drained & drained);
+
 	/// Close a channel to someone
 	struct CloseChannelOp : public AsyncOp {
 		CloseChannelOp (Time timeOut) : AsyncOp (CLOSE_CHANNEL, timeOut) {}
@@ -162,10 +275,12 @@ private:
 	int mCloseTimeoutMs;   				///< Timeout waiting for a close message
 	int mChannelTimeoutMs; 				///< Generic timeout for channels, valid if > 0
 	int mChannelTimeoutCheckIntervalMs; ///< Interval for checking channel timeouts, valid if > 0
+	long mBulkThreshold;				///< Datagrams from this encoded size on are bulk traffic
 	TimedCallHandle mChannelTimeoutId;
 
 	IncomingDatagramDelegate mIncomingDatagram;
 	PongDelegate mIncomingPong;
+	ProbeReportDelegate mIncomingProbeReport;
 	ChannelChangedDelegate mChannelChanged;
 };
 
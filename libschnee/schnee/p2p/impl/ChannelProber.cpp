@@ -0,0 +1,124 @@
+#include "ChannelProber.h"
+#include <schnee/tools/Log.h>
+
+namespace sf {
+
+/// Converts a measured arrival to bytes/s
+/// Arrivals faster than a millisecond can't be resolved, they count as one millisecond.
+static float toBandwidth (const ChannelHolder::ProbeReport & report) {
+	int64_t micros = report.micros < 1000 ? 1000 : report.micros;
+	return (float) ((double) report.bytes * 1000000.0 / (double) micros);
+}
+
+ChannelProber::ChannelProber () {
+	SF_REGISTER_ME;
+	mHolder = 0;
+	mCheckIntervalMs = 5000;
+	mProbeIntervalMs = 60000;
+	mIdleMs          = 1000;
+	mProbeTimeoutMs  = 30000;
+	mTrainLength     = 8;
+	mPacketSize      = 8192;
+	mIsProbing       = false;
+	mNextProbeId     = 1;
+}
+
+ChannelProber::~ChannelProber () {
+	SF_UNREGISTER_ME;
+	sf::cancelTimer (mProbeDelayedCall);
+}
+
+void ChannelProber::init (ChannelHolder * holder) {
+	mHolder = holder;
+}
+
+void ChannelProber::start () {
+	if (mIsProbing) return;
+	mIsProbing = true;
+	mProbeDelayedCall = xcallTimed (dMemFun (this, &ChannelProber::onDoProbing), futureInMs (mCheckIntervalMs));
+}
+
+void ChannelProber::stop () {
+	if (mIsProbing) {
+		sf::cancelTimer (mProbeDelayedCall);
+		mProbeDelayedCall = TimedCallHandle();
+		mIsProbing = false;
+	}
+}
+
+void ChannelProber::onDoProbing () {
+	mProbeDelayedCall = TimedCallHandle();
+	if (!mHolder) {
+		Log (LogError) << LOGID << "No holder!" << std::endl;
+		mIsProbing = false;
+		return;
+	}
+	typedef ConnectionManagement::ConnectionInfos InfoVec;
+	InfoVec infos = mHolder->connections();
+	Time ct = currentTime ();
+
+	ProbeTimeMap lastProbes;
+	for (InfoVec::const_iterator i = infos.begin(); i != infos.end(); i++) {
+		ChannelId channelId = i->id;
+		const Channel::ChannelInfo & info = i->cinfo;
+		if (info.virtual_) continue;
+		ProbeTimeMap::const_iterator j = mLastProbes.find (channelId);
+		if (j != mLastProbes.end()) {
+			lastProbes[channelId] = j->second;
+			if ((ct - j->second).total_milliseconds() < mProbeIntervalMs) continue;
+		}
+		if (info.transport.valid && info.transport.bandwidth > 0) {
+			// the transport measures by itself
+			notify (mMeasure, channelId, info.transport.bandwidth, false);
+			lastProbes[channelId] = ct;
+			continue;
+		}
+		int idle = mHolder->idleTimeMs (channelId);
+		if (idle >= 0 && idle < mIdleMs) continue; // busy, measured passively
+		if (!probe (channelId)) lastProbes[channelId] = ct;
+	}
+	// forgets closed channels
+	mLastProbes.swap (lastProbes);
+
+	// cleanup old probes
+	OpenProbeMap::iterator i = mOpenProbes.begin();
+	while (i != mOpenProbes.end()) {
+		if ((ct - i->second).total_milliseconds() > mProbeTimeoutMs) {
+			mOpenProbes.erase (i++);
+		} else
+			i++;
+	}
+	mProbeDelayedCall = xcallTimed (dMemFun (this, &ChannelProber::onDoProbing), futureInMs (mCheckIntervalMs));
+}
+
+Error ChannelProber::probe (ChannelId channelId) {
+	ChannelHolder::Probe p;
+	p.id    = mNextProbeId++;
+	p.count = mTrainLength;
+	// all packets share the padding, channels do not change written data
+	ByteArrayPtr padding = createByteArrayPtr (ByteArray (mPacketSize, 0));
+	for (p.num = 0; p.num < p.count; p.num++) {
+		Error e = mHolder->send (channelId, Datagram::fromCmd (p, padding), false);
+		if (e) return e;
+	}
+	mOpenProbes[std::make_pair (channelId, p.id)] = currentTime();
+	return NoError;
+}
+
+void ChannelProber::onProbeReport (ChannelId channelId, const ChannelHolder::ProbeReport & report) {
+	if (report.bytes <= 0) return;
+	if (report.id == 0) {
+		// passive measurement of the other side
+		notify (mMeasure, channelId, toBandwidth (report), true);
+		return;
+	}
+	OpenProbeMap::iterator i = mOpenProbes.find (std::make_pair (channelId, report.id));
+	if (i == mOpenProbes.end()) {
+		Log (LogWarning) << LOGID << "Received unrequested probe report" << std::endl;
+		return;
+	}
+	mOpenProbes.erase (i);
+	notify (mMeasure, channelId, toBandwidth (report), false);
+}
+
+}
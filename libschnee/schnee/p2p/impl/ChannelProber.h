@@ -0,0 +1,71 @@
+#pragma once
+#include "ChannelHolder.h"
+
+namespace sf {
+
+/// Does bandwidth probing on a ChannelHolder
+/// Idle, non-virtual channels get a train of padding packets from time to time,
+/// the other side reports the spread of the train. Busy channels are measured
+/// passively by the other side (see ChannelHolder) and channels with own transport
+/// statistics (e.g. UDT) are not probed at all.
+class ChannelProber : public DelegateBase {
+public:
+	typedef ChannelHolder::ChannelId ChannelId;
+	ChannelProber ();
+	~ChannelProber ();
+
+	/// Binds to the holder
+	void init (ChannelHolder * holder);
+
+	// Starts probing
+	void start ();
+	// Stops probing
+	void stop  ();
+
+	/// Interval between probes of the same channel
+	/// default = 60000ms
+	void setProbeInterval (int intervalMs) { mProbeIntervalMs = intervalMs; }
+
+	/// Sets the interval of checking for channels to probe
+	/// default = 5000ms
+	void setCheckInterval (int intervalMs) { mCheckIntervalMs = intervalMs; }
+
+	/// Sets length of probe trains and size of their packets
+	/// default = 8 packets with 8192 bytes
+	void setTrain (int count, int packetSize) { mTrainLength = count; mPacketSize = packetSize; }
+
+	/// Received a report about a probe train or passive measurement
+	void onProbeReport (ChannelId id, const ChannelHolder::ProbeReport & report);
+
+	///@name Delegates
+	///@{
+	typedef function <void (ChannelId id, float bytesPerSecond, bool passive)> MeasureDelegate;
+
+	/// We measured bandwidth of a channel
+	MeasureDelegate & measure () { return mMeasure; }
+	///@}
+private:
+	void onDoProbing ();
+	/// Sends a probe train into a channel
+	Error probe (ChannelId id);
+
+	ChannelHolder * mHolder;
+
+	int mCheckIntervalMs;	///< Interval of looking for channels to probe
+	int mProbeIntervalMs;	///< Interval of probing a single channel
+	int mIdleMs;			///< Channels must be idle for this time to be probed
+	int mProbeTimeoutMs;	///< Unanswered probes are forgotten after this time
+	int mTrainLength;
+	int mPacketSize;
+	bool mIsProbing;
+	TimedCallHandle mProbeDelayedCall;
+	AsyncOpId mNextProbeId;
+	typedef std::map<ChannelId, Time> ProbeTimeMap;
+	ProbeTimeMap mLastProbes;	///< Last probe of each channel
+	typedef std::pair<ChannelId, AsyncOpId> ProbeKey;
+	typedef std::map<ProbeKey, Time> OpenProbeMap; ///< yet not answered probes
+	OpenProbeMap mOpenProbes;
+	MeasureDelegate mMeasure;
+};
+
+}
@@ -0,0 +1,173 @@
+#include "ConnectionScheduler.h"
+#include <schnee/tools/Log.h>
+#include <stdlib.h>
+
+namespace sf {
+
+ConnectionScheduler::ConnectionScheduler () {
+	SF_REGISTER_ME;
+	mNextTicket    = 1;
+	mNextSeq       = 0;
+	mPumpScheduled = false;
+	mTimerAt       = posInfTime ();
+}
+
+ConnectionScheduler::~ConnectionScheduler () {
+	SF_UNREGISTER_ME;
+	cancelTimer (mTimer);
+}
+
+void ConnectionScheduler::setStageLimit (int stage, int maxConcurrent) {
+	mStageLimits[stage] = maxConcurrent;
+	schedulePump ();
+}
+
+void ConnectionScheduler::setPriority (const HostId & host, int priority) {
+	if (priority == 0) mPriorities.erase (host);
+	else mPriorities[host] = priority;
+}
+
+int ConnectionScheduler::priority (const HostId & host) const {
+	std::map<HostId, int>::const_iterator i = mPriorities.find (host);
+	return i == mPriorities.end() ? 0 : i->second;
+}
+
+ConnectionScheduler::Ticket ConnectionScheduler::request (int stage, const HostId & host, const VoidDelegate & start) {
+	Ticket ticket = mNextTicket++;
+	Entry & e = mEntries[ticket];
+	e.stage  = stage;
+	e.host   = host;
+	e.start  = start;
+	e.seq    = mNextSeq++;
+	e.queued = currentTime ();
+	e.notBefore = e.queued;
+	BackoffMap::const_iterator i = mBackoffs.find (StageHost (stage, host));
+	if (i != mBackoffs.end() && i->second.until > e.notBefore) {
+		e.notBefore = i->second.until;
+	}
+	mMetrics[stage].waiting++;
+	schedulePump ();
+	return ticket;
+}
+
+void ConnectionScheduler::finish (Ticket ticket, bool success) {
+	EntryMap::iterator i = mEntries.find (ticket);
+	if (i == mEntries.end()) return;
+	if (!i->second.running) {
+		Log (LogWarning) << LOGID << "Finishing not started attempt " << ticket << std::endl;
+	}
+	release (ticket, i->second.running, success, false);
+}
+
+void ConnectionScheduler::cancel (Ticket ticket) {
+	EntryMap::iterator i = mEntries.find (ticket);
+	if (i == mEntries.end()) return;
+	release (ticket, i->second.running, false, true);
+}
+
+int ConnectionScheduler::backoffMs (int stage, const HostId & host) const {
+	BackoffMap::const_iterator i = mBackoffs.find (StageHost (stage, host));
+	if (i == mBackoffs.end()) return 0;
+	int64_t ms = (i->second.until - currentTime ()).total_milliseconds();
+	return ms > 0 ? (int) ms : 0;
+}
+
+void ConnectionScheduler::release (Ticket ticket, bool running, bool success, bool canceled) {
+	EntryMap::iterator i = mEntries.find (ticket);
+	const Entry & e = i->second;
+	Time now = currentTime ();
+	StageMetrics & m = mMetrics[e.stage];
+	if (running) {
+		m.running--;
+		m.runMs += (now - e.started).total_milliseconds();
+		if (canceled) m.canceled++;
+		else if (success) m.succeeded++;
+		else m.failed++;
+
+		StageHost key (e.stage, e.host);
+		if (success) {
+			mBackoffs.erase (key);
+		} else {
+			Backoff & b = mBackoffs[key];
+			b.failures++;
+			int64_t delay = mSettings.backoffBaseMs;
+			for (int j = 1; j < b.failures && delay < mSettings.backoffMaxMs; j++) delay *= 2;
+			if (delay > mSettings.backoffMaxMs) delay = mSettings.backoffMaxMs;
+			double r = 2.0 * ((double) rand () / RAND_MAX) - 1.0;
+			delay = (int64_t) (delay * (1.0 + mSettings.jitter * r));
+			b.until = now + boost::posix_time::milliseconds (delay);
+			Log (LogInfo) << LOGID << "Backoff for " << e.host << " on stage " << e.stage << ": " << delay << "ms after " << b.failures << " failures" << std::endl;
+		}
+	} else {
+		m.waiting--;
+		m.canceled++;
+	}
+	mEntries.erase (i);
+	schedulePump ();
+}
+
+void ConnectionScheduler::schedulePump () {
+	if (mPumpScheduled) return;
+	mPumpScheduled = true;
+	xcall (dMemFun (this, &ConnectionScheduler::pump));
+}
+
+int ConnectionScheduler::stageLimit (int stage) const {
+	std::map<int, int>::const_iterator i = mStageLimits.find (stage);
+	return i == mStageLimits.end() ? mSettings.maxConcurrent : i->second;
+}
+
+bool ConnectionScheduler::preferred (const Entry & a, const Entry & b) const {
+	int pa = priority (a.host);
+	int pb = priority (b.host);
+	if (pa != pb) return pa > pb;
+	return a.seq < b.seq;
+}
+
+void ConnectionScheduler::pump () {
+	mPumpScheduled = false;
+	Time now  = currentTime ();
+	Time next = posInfTime ();
+	std::vector<VoidDelegate> starts;
+	while (true) {
+		EntryMap::iterator best = mEntries.end();
+		for (EntryMap::iterator i = mEntries.begin(); i != mEntries.end(); i++) {
+			const Entry & e = i->second;
+			if (e.running) continue;
+			if (e.notBefore > now) {
+				if (e.notBefore < next) next = e.notBefore;
+				continue;
+			}
+			if (mMetrics[e.stage].running >= stageLimit (e.stage)) continue;
+			if (best == mEntries.end() || preferred (e, best->second)) best = i;
+		}
+		if (best == mEntries.end()) break;
+		Entry & e = best->second;
+		e.running = true;
+		e.started = now;
+		StageMetrics & m = mMetrics[e.stage];
+		m.waiting--;
+		m.running++;
+		m.attempts++;
+		m.waitMs += (now - e.queued).total_milliseconds();
+		if (m.running > m.maxRunning) m.maxRunning = m.running;
+		starts.push_back (e.start);
+	}
+	// Waking up for attempts in backoff
+	if (next != posInfTime() && next < mTimerAt) {
+		cancelTimer (mTimer);
+		mTimerAt = next;
+		mTimer   = xcallTimed (dMemFun (this, &ConnectionScheduler::onTimer), next);
+	}
+	// start delegates may call back into us
+	for (std::vector<VoidDelegate>::const_iterator i = starts.begin(); i != starts.end(); i++) {
+		if (*i) (*i) ();
+	}
+}
+
+void ConnectionScheduler::onTimer () {
+	mTimerAt = posInfTime ();
+	pump ();
+}
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <schnee/sftypes.h>
+#include <schnee/tools/async/DelegateBase.h>
+#include <sfserialization/autoreflect.h>
+
+namespace sf {
+
+/**
+ * Admission control for connection establishment (used by GenericConnectionManagement).
+ *
+ * Each connecting attempt of a channel provider (a stage, identified by the provider's level)
+ * has to wait for a free slot before it may start. The number of concurrent attempts per stage
+ * is bounded, hosts with a higher priority are admitted first and hosts whose last attempts
+ * failed have to wait for an exponential backoff (with some jitter, so that retries do not
+ * come in waves).
+ */
+class ConnectionScheduler : public DelegateBase {
+public:
+	typedef AsyncOpId Ticket;
+
+	ConnectionScheduler ();
+	~ConnectionScheduler ();
+
+	struct Settings {
+		Settings () : maxConcurrent (4), backoffBaseMs (2000), backoffMaxMs (120000), jitter (0.25f) {}
+		int maxConcurrent;	///< Maximum concurrent attempts per stage (if not set with setStageLimit)
+		int backoffBaseMs;	///< Backoff after the first failure, doubles with every further failure
+		int backoffMaxMs;	///< Maximum backoff
+		float jitter;		///< Random part of the backoff (0.25 = +/- 25%)
+	};
+
+	void setSettings (const Settings & settings) { mSettings = settings; }
+	const Settings & settings () const { return mSettings; }
+
+	/// Sets the maximum of concurrent attempts for one stage
+	void setStageLimit (int stage, int maxConcurrent);
+
+	/// Sets the priority of a host (e.g. if there are pending transfers), default is 0
+	void setPriority (const HostId & host, int priority);
+
+	/// Returns the priority of a host
+	int priority (const HostId & host) const;
+
+	/// Requests a slot; start is called (asynchronous) as soon as the attempt may begin
+	Ticket request (int stage, const HostId & host, const VoidDelegate & start);
+
+	/// A started attempt finished and frees its slot. Failures count into the backoff of the host.
+	void finish (Ticket ticket, bool success);
+
+	/// Removes a waiting or running attempt (e.g. on timeout). A running one counts as failure.
+	void cancel (Ticket ticket);
+
+	/// Remaining backoff time (ms) for a host on a stage, 0 if none
+	int backoffMs (int stage, const HostId & host) const;
+
+	/// Statistics about one stage
+	struct StageMetrics {
+		StageMetrics () : attempts (0), succeeded (0), failed (0), canceled (0), waiting (0), running (0), maxRunning (0), waitMs (0), runMs (0) {}
+		int attempts;		///< Started attempts
+		int succeeded;		///< Successful attempts
+		int failed;			///< Failed attempts
+		int canceled;		///< Attempts canceled while waiting or running
+		int waiting;		///< Attempts currently waiting for a slot
+		int running;		///< Attempts currently running
+		int maxRunning;		///< Maximum of concurrent attempts seen
+		int64_t waitMs;		///< Summed up time attempts waited for their slot
+		int64_t runMs;		///< Summed up time of finished attempts
+		SF_AUTOREFLECT_SERIAL;
+	};
+	typedef std::map<int, StageMetrics> MetricsMap;
+
+	/// Returns metrics of all stages
+	const MetricsMap & metrics () const { return mMetrics; }
+
+private:
+	struct Entry {
+		Entry () : stage (0), seq (0), running (false) {}
+		int stage;
+		HostId host;
+		VoidDelegate start;
+		int64_t seq;		///< Arrival order
+		Time queued;		///< Time of request
+		Time notBefore;		///< End of backoff
+		Time started;		///< Time of admission
+		bool running;
+	};
+
+	struct Backoff {
+		Backoff () : failures (0) {}
+		int failures;
+		Time until;
+	};
+
+	/// Removes an entry and updates metrics and backoff
+	void release (Ticket ticket, bool running, bool success, bool canceled);
+	/// Admits waiting attempts (asynchronous)
+	void schedulePump ();
+	/// Admits waiting attempts
+	void pump ();
+	/// A backoff ended
+	void onTimer ();
+	int stageLimit (int stage) const;
+	/// a should be admitted before b
+	bool preferred (const Entry & a, const Entry & b) const;
+
+	typedef std::map<Ticket, Entry> EntryMap;
+	typedef std::pair<int, HostId> StageHost;
+	typedef std::map<StageHost, Backoff> BackoffMap;
+
+	Settings        mSettings;
+	EntryMap        mEntries;
+	BackoffMap      mBackoffs;
+	MetricsMap      mMetrics;
+	std::map<int, int>    mStageLimits;
+	std::map<HostId, int> mPriorities;
+	Ticket          mNextTicket;
+	int64_t         mNextSeq;
+	bool            mPumpScheduled;
+	TimedCallHandle mTimer;		///< Wakes up at the end of the next backoff
+	Time            mTimerAt;
+};
+
+}
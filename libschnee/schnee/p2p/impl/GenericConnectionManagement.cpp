@@ -2,12 +2,14 @@
 #include <schnee/tools/Log.h>
 #include <schnee/p2p/com/PingProtocol.h>
 #include <schnee/tools/Serialization.h>
+#include <schnee/settings.h>
 #include <assert.h>
 
 namespace sf {
 
 GenericConnectionManagement::GenericConnectionManagement() {
 	mCommunicationMultiplex = 0;
+	mLiftStrategy = schnee::settings().liftStrategy == "race" ? LS_RACE : LS_SEQUENTIAL;
 }
 
 GenericConnectionManagement::~GenericConnectionManagement () {
@@ -24,6 +26,9 @@ Error GenericConnectionManagement::init (CommunicationMultiplex * multiplex, Aut
 	mChannels.channelChanged()   = dMemFun (this, &GenericConnectionManagement::onChannelChanged);
 	mChannels.incomingDatagram() = dMemFun (this, &GenericConnectionManagement::onIncomingDatagram);
 	mChannelPinger.measure()     = dMemFun (&mChannels, &ChannelHolder::addChannelPingMeasure);
+	mChannelProber.init(&mChannels);
+	mChannels.incomingProbeReport() = dMemFun (&mChannelProber, &ChannelProber::onProbeReport);
+	mChannelProber.measure()     = dMemFun (&mChannels, &ChannelHolder::addChannelBandwidthMeasure);
 
 	return NoError;
 }
@@ -56,10 +61,12 @@ void GenericConnectionManagement::setHostId (const HostId & hostId) {
 
 void GenericConnectionManagement::startPing () {
 	mChannelPinger.start();
+	mChannelProber.start();
 }
 
 void GenericConnectionManagement::stopPing () {
 	mChannelPinger.stop();
+	mChannelProber.stop();
 }
 
 Error GenericConnectionManagement::addChannelProvider  (ChannelProviderPtr channelProvider, int priority){
@@ -111,20 +118,13 @@ Error GenericConnectionManagement::closeChannel (const HostId & host, int level)
 }
 
 Error GenericConnectionManagement::send (const HostId & receiver, const sf::Datagram & datagram, const ResultCallback & callback) {
-	ChannelId id = mChannels.findBestChannel(receiver);
+	ChannelId id = mChannels.selectChannel(receiver, datagram.encodedSize());
 	if (id == 0) return error::ConnectionError;
 	return mChannels.send(id, datagram, true, callback);
 }
 
-Error GenericConnectionManagement::send (const HostSet & receivers, const sf::Datagram & datagram) {
-	// TODO: Optimizing?
-	Error result = NoError;
-	for (HostSet::const_iterator i = receivers.begin(); i != receivers.end(); i++){
-		Error err = send (*i, datagram);
-		if (err && !result) result = err;
-		else if (err && result)  result = error::MultipleErrors;
-	}
-	return result;
+Error GenericConnectionManagement::send (const HostSet & receivers, const sf::Datagram & datagram, ErrorMap * errors) {
+	return mChannels.send (receivers, datagram, true, errors);
 }
 
 int GenericConnectionManagement::channelLevel (const HostId & receiver) {
@@ -136,13 +136,11 @@ void GenericConnectionManagement::startLifting (LiftConnectionOp * op){
 	int level = mChannels.findBestChannelLevel(op->target);
 	if (level == 0) {
 		// create initial channel
-		op->setState (LiftConnectionOp::CreateInitial);
 		while (true) {
 			ChannelProviderPtr provider = bestProvider (op->lastLevelTried - 1, true, &op->lastLevelTried);
 			if (!provider)
 				break;
-			Error e = provider->createChannel(op->target, abind (dMemFun (this, &GenericConnectionManagement::onChannelCreate), true, op->id()), op->lastingTimeMs (0.66));
-			if (!e) {
+			if (schedule (op, true)) {
 				addAsyncOp (op);
 				return;
 			}
@@ -165,8 +163,15 @@ void GenericConnectionManagement::lift (LiftConnectionOp * op) {
 		delete op;
 		return;
 	}
+	if (op->liftStarted.is_not_a_date_time()) {
+		op->liftStarted = currentTime ();
+		op->startLevel  = level;
+	}
+	if (mLiftStrategy == LS_RACE) {
+		race (op);
+		return;
+	}
 	Log (LogInfo) << LOGID << mHostId << " continue lift to " << op->target << " current=" << level << " restMs=" << op->lastingTimeMs() << std::endl;
-	op->setState (LiftConnectionOp::Lift);
 	while (true) {
 		ChannelProviderPtr provider = bestProvider (op->lastLevelTried - 1, false, &op->lastLevelTried);
 		if (!provider)
@@ -174,15 +179,20 @@ void GenericConnectionManagement::lift (LiftConnectionOp * op) {
 		if (op->lastLevelTried <= level)
 			break; // won't get better
 		Log (LogInfo) << LOGID << "Trying level con " << op->target << " to " << op->lastLevelTried << " current=" << level << std::endl;
-		Error e = provider->createChannel (op->target, abind (dMemFun (this, &GenericConnectionManagement::onChannelCreate), false, op->id()), op->lastingTimeMs(0.66));
-		if (!e) {
+		if (schedule (op, false)) {
 			addAsyncOp (op);
 			return;
 		}
 	}
 	// Could not go further
+	finishLift (op);
+}
+
+void GenericConnectionManagement::finishLift (LiftConnectionOp * op) {
 	// reached final level?
+	int level = mChannels.findBestChannelLevel (op->target);
 	Log (LogProfile) << LOGID << "Final leveling result to " << op->target << ", lasting time=" << op->lastingTimeMs() << "ms, reached level " << level << std::endl;
+	mLiftMetrics.lifts++;
 	if (level < op->minLevel) {
 		notifyAsync (op->callback, error::CouldNotConnectHost);
 	} else {
@@ -191,10 +201,130 @@ void GenericConnectionManagement::lift (LiftConnectionOp * op) {
 	// stopping redundant connections
 	mChannels.closeRedundantChannelsToHost (op->target);
 	delete op;
-	return;
 }
 
-void GenericConnectionManagement::onChannelCreate (Error result, bool wasInitial, AsyncOpId id) {
+void GenericConnectionManagement::recordLifted (LiftConnectionOp * op) {
+	if (op->lifted || op->liftStarted.is_not_a_date_time()) return;
+	op->lifted = true;
+	int ms = (int) (currentTime () - op->liftStarted).total_milliseconds();
+	mLiftMetrics.lifted++;
+	mLiftMetrics.timeToFirstChannelMs += ms;
+	mLiftMetrics.lastTimeToFirstChannelMs = ms;
+	Log (LogProfile) << LOGID << mHostId << " got first channel above level " << op->startLevel << " to " << op->target << " after " << ms << "ms" << std::endl;
+}
+
+void GenericConnectionManagement::race (LiftConnectionOp * op) {
+	int level = mChannels.findBestChannelLevel (op->target);
+	op->cancelTicket = dMemFun (&mScheduler, &ConnectionScheduler::cancel);
+	for (ChannelProviderMap::reverse_iterator i = mChannelProviders.rbegin(); i != mChannelProviders.rend() && i->first > level; i++) {
+		int backoff = mScheduler.backoffMs (i->first, op->target);
+		if (backoff > op->lastingTimeMs (0.66)) {
+			Log (LogInfo) << LOGID << "Not racing level " << i->first << " to " << op->target << ", backoff for another " << backoff << "ms" << std::endl;
+			continue;
+		}
+		op->raceWaiting[i->first] = mScheduler.request (i->first, op->target, abind (dMemFun (this, &GenericConnectionManagement::onRaceAdmitted), i->first, op->id()));
+	}
+	if (op->raceWaiting.empty()) {
+		finishLift (op);
+		return;
+	}
+	Log (LogInfo) << LOGID << mHostId << " racing " << op->raceWaiting.size() << " providers to " << op->target << " current=" << level << std::endl;
+	mLiftMetrics.raced++;
+	op->setState (LiftConnectionOp::Race);
+	addAsyncOp (op);
+}
+
+void GenericConnectionManagement::onRaceAdmitted (int level, AsyncOpId id) {
+	LiftConnectionOp * op;
+	getReadyAsyncOpInState (id, LIFT_CONNECTION, LiftConnectionOp::Race, &op);
+	if (!op) return;
+	LiftConnectionOp::TicketMap::iterator t = op->raceWaiting.find (level);
+	assert (t != op->raceWaiting.end());
+	ConnectionScheduler::Ticket ticket = t->second;
+	op->raceWaiting.erase (t);
+	op->raceRunning++;
+
+	ChannelProviderMap::const_iterator i = mChannelProviders.find (level);
+	Error e = error::NotFound;
+	if (i != mChannelProviders.end()) {
+		e = i->second->createChannel (op->target, abind (dMemFun (this, &GenericConnectionManagement::onRaceChannelCreate), level, ticket, op->target, op->id()), op->lastingTimeMs (0.66));
+	}
+	if (e) {
+		mScheduler.finish (ticket, false);
+		op->raceRunning--;
+		onRaceResult (op, level, e);
+		return;
+	}
+	addAsyncOp (op);
+}
+
+void GenericConnectionManagement::onRaceChannelCreate (Error result, int level, ConnectionScheduler::Ticket ticket, const HostId & target, AsyncOpId id) {
+	mScheduler.finish (ticket, !result);
+	LiftConnectionOp * op;
+	getReadyAsyncOpInState (id, LIFT_CONNECTION, LiftConnectionOp::Race, &op);
+	if (!op) {
+		// race is already over, keep the new channel only if it is better
+		Log (LogInfo) << LOGID << "Late race result of level " << level << " to " << target << ": " << toString (result) << std::endl;
+		if (!result) mChannels.closeRedundantChannelsToHost (target);
+		return;
+	}
+	op->raceRunning--;
+	onRaceResult (op, level, result);
+}
+
+void GenericConnectionManagement::onRaceResult (LiftConnectionOp * op, int level, Error result) {
+	Log (LogInfo) << LOGID << "Race " << mHostId << " --> " << op->target << " level " << level << " resulted=" << toString (result) << std::endl;
+	if (!result) recordLifted (op);
+	if (!result && level >= op->minLevel) {
+		// the others are not needed anymore; running ones finish in the background
+		for (LiftConnectionOp::TicketMap::const_iterator i = op->raceWaiting.begin(); i != op->raceWaiting.end(); i++) {
+			mScheduler.cancel (i->second);
+		}
+		op->raceWaiting.clear ();
+		finishLift (op);
+		return;
+	}
+	if (op->raceWaiting.empty() && op->raceRunning == 0) {
+		// all done, none good enough
+		finishLift (op);
+		return;
+	}
+	addAsyncOp (op);
+}
+
+bool GenericConnectionManagement::schedule (LiftConnectionOp * op, bool initial) {
+	int backoff = mScheduler.backoffMs (op->lastLevelTried, op->target);
+	if (backoff > op->lastingTimeMs (0.66)) {
+		Log (LogInfo) << LOGID << "Skipping level " << op->lastLevelTried << " to " << op->target << ", backoff for another " << backoff << "ms" << std::endl;
+		return false;
+	}
+	op->setState (initial ? LiftConnectionOp::WaitInitial : LiftConnectionOp::WaitLift);
+	op->ticket = mScheduler.request (op->lastLevelTried, op->target, abind (dMemFun (this, &GenericConnectionManagement::onAdmitted), initial, op->id()));
+	op->cancelTicket = dMemFun (&mScheduler, &ConnectionScheduler::cancel);
+	return true;
+}
+
+void GenericConnectionManagement::onAdmitted (bool wasInitial, AsyncOpId id) {
+	LiftConnectionOp * op;
+	getReadyAsyncOpInState (id, LIFT_CONNECTION, wasInitial ? LiftConnectionOp::WaitInitial : LiftConnectionOp::WaitLift, &op);
+	if (!op) return;
+	ChannelProviderMap::const_iterator i = mChannelProviders.find (op->lastLevelTried);
+	Error e = error::NotFound;
+	if (i != mChannelProviders.end()) {
+		e = i->second->createChannel (op->target, abind (dMemFun (this, &GenericConnectionManagement::onChannelCreate), wasInitial, op->ticket, op->id()), op->lastingTimeMs (0.66));
+	}
+	if (e) {
+		mScheduler.finish (op->ticket, false);
+		op->ticket = 0;
+		onChannelCreateResult (op, e, wasInitial);
+		return;
+	}
+	op->setState (wasInitial ? LiftConnectionOp::CreateInitial : LiftConnectionOp::Lift);
+	addAsyncOp (op);
+}
+
+void GenericConnectionManagement::onChannelCreate (Error result, bool wasInitial, ConnectionScheduler::Ticket ticket, AsyncOpId id) {
+	mScheduler.finish (ticket, !result);
 	LiftConnectionOp * op;
 	if (wasInitial) {
 		getReadyAsyncOpInState (id, LIFT_CONNECTION, LiftConnectionOp::CreateInitial, &op);
@@ -202,7 +332,12 @@ void GenericConnectionManagement::onChannelCreate (Error result, bool wasInitial
 		getReadyAsyncOpInState (id, LIFT_CONNECTION, LiftConnectionOp::Lift, &op);
 	}
 	if (!op) return;
+	op->ticket = 0;
 	Log (LogInfo) << LOGID << "Leveled " << mHostId << " --> " << op->target << " to " << op->lastLevelTried << " initial=" << wasInitial << " resulted=" << toString (result) << std::endl;
+	onChannelCreateResult (op, result, wasInitial);
+}
+
+void GenericConnectionManagement::onChannelCreateResult (LiftConnectionOp * op, Error result, bool wasInitial) {
 	if (result) {
 		if (wasInitial){
 			op->setState (LiftConnectionOp::Start);
@@ -215,6 +350,8 @@ void GenericConnectionManagement::onChannelCreate (Error result, bool wasInitial
 	if (wasInitial){
 		// begin again (but this time not only initial channels)
 		op->lastLevelTried = -1;
+	} else {
+		recordLifted (op);
 	}
 	// begin again, does also error and result handling
 	lift (op);
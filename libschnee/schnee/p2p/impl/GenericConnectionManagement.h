@@ -10,6 +10,8 @@
 
 #include "ChannelHolder.h"
 #include "ChannelPinger.h"
+#include "ChannelProber.h"
+#include "ConnectionScheduler.h"
 #include "../Authentication.h"
 
 
@@ -41,10 +43,10 @@ public:
 	/// Set host id to all Channel Providers
 	void setHostId (const HostId & hostId);
 
-	/// Starts ping measurement
+	/// Starts ping and bandwidth measurement
 	void startPing ();
 
-	/// Stops delay measurement
+	/// Stops delay and bandwidth measurement
 	void stopPing ();
 
 	/// Adds and initializes an ChannelProvider
@@ -56,12 +58,41 @@ public:
 	virtual Error liftConnection (const HostId & hostId, const ResultCallback & callback, int timeOutMs);
 	virtual Error liftToAtLeast  (int level, const HostId & hostId, const ResultCallback & callback, int timeOutMs);
 	virtual Error closeChannel (const HostId & host, int level);
+	virtual void setLiftPriority (const HostId & host, int priority) { mScheduler.setPriority (host, priority); }
+
+	/// How a connection gets lifted after the initial channel exists
+	enum LiftStrategy {
+		LS_SEQUENTIAL,	///< Try providers one after another, best first
+		LS_RACE			///< Start all better providers at once, the first channel wins
+	};
+
+	/// Sets the lift strategy (default from schnee::settings().liftStrategy)
+	void setLiftStrategy (LiftStrategy strategy) { mLiftStrategy = strategy; }
+	LiftStrategy liftStrategy () const { return mLiftStrategy; }
+
+	/// Statistics about lift operations
+	struct LiftMetrics {
+		LiftMetrics () : lifts (0), raced (0), lifted (0), timeToFirstChannelMs (0), lastTimeToFirstChannelMs (-1) {}
+		int lifts;							///< Finished lift operations
+		int raced;							///< Lift operations which raced providers
+		int lifted;							///< Lift operations which got a channel above the initial one
+		int64_t timeToFirstChannelMs;		///< Summed up time from start of lifting to the first channel above the existing one
+		int lastTimeToFirstChannelMs;		///< Last of these times, -1 if none yet
+		SF_AUTOREFLECT_SERIAL;
+	};
+
+	/// Returns lift statistics
+	const LiftMetrics & liftMetrics () const { return mLiftMetrics; }
+
+	/// Admission control of channel creation (one stage per channel provider level)
+	ConnectionScheduler & scheduler () { return mScheduler; }
+	const ConnectionScheduler & scheduler () const { return mScheduler; }
 
 	virtual VoidDelegate & conDetailsChanged () { return mConDetailsChanged; }
 
 	// Implementation of CommunicationDelegate
 	virtual Error send     (const HostId & receiver, const Datagram & datagram, const ResultCallback & callback = ResultCallback ());
-	virtual Error send     (const HostSet & receivers, const sf::Datagram & datagram);
+	virtual Error send     (const HostSet & receivers, const sf::Datagram & datagram, ErrorMap * errors = 0);
 	virtual int channelLevel (const HostId & receiver);
 
 
@@ -72,15 +103,30 @@ private:
 
 	/// Lift connection to another peer
 	struct LiftConnectionOp : public AsyncOp {
-		enum State { Start, CreateInitial, Lift };
-		LiftConnectionOp (Time timeOut) : AsyncOp (LIFT_CONNECTION, timeOut) { mState = Start; lastLevelTried = -1; minLevel = 1; }
+		enum State { Start, WaitInitial, CreateInitial, WaitLift, Lift, Race };
+		LiftConnectionOp (Time timeOut) : AsyncOp (LIFT_CONNECTION, timeOut) { mState = Start; lastLevelTried = -1; minLevel = 1; ticket = 0; raceRunning = 0; startLevel = 0; lifted = false; }
 
 		int lastLevelTried;				///< Last level tried to lift to
 		int minLevel;					///< Minimum level which must be reached to not count as an error
 		HostId target;
 		ResultCallback callback;
+		ConnectionScheduler::Ticket ticket;	///< Current slot request (finished by onChannelCreate once running)
+		function<void (ConnectionScheduler::Ticket)> cancelTicket; ///< Provided by GenericConnectionManagement
+
+		typedef std::map<int, ConnectionScheduler::Ticket> TicketMap;
+		TicketMap raceWaiting;			///< Race attempts waiting for their slot, by level
+		int raceRunning;				///< Race attempts currently creating a channel
+
+		Time liftStarted;				///< Begin of lifting (there was a channel), not_a_date_time before
+		int  startLevel;				///< Channel level at liftStarted
+		bool lifted;					///< Got a channel above startLevel
 
 		virtual void onCancel (sf::Error reason) {
+			// running tickets get finished by the provider callback, which still comes
+			if (ticket && cancelTicket && (state() == WaitInitial || state() == WaitLift)) cancelTicket (ticket);
+			for (TicketMap::const_iterator i = raceWaiting.begin(); i != raceWaiting.end() && cancelTicket; i++) {
+				cancelTicket (i->second);
+			}
 			notify (callback, reason);
 		}
 	};
@@ -94,8 +140,36 @@ private:
 	/// Does acutal lifting (op is not yet added!)
 	void lift (LiftConnectionOp * op);
 
-	/// Callback for channel creation on Lifting operation
-	void onChannelCreate (Error error, bool wasInitial, AsyncOpId id);
+	/// Requests a slot for creating a channel with the provider of op->lastLevelTried
+	/// Returns false if the host is in backoff for longer than the operation may last.
+	bool schedule (LiftConnectionOp * op, bool initial);
+
+	/// The scheduler admitted the channel creation
+	void onAdmitted (bool wasInitial, AsyncOpId id);
+
+	/// Callback for channel creation on Lifting operation (also called if op is already gone)
+	void onChannelCreate (Error error, bool wasInitial, ConnectionScheduler::Ticket ticket, AsyncOpId id);
+
+	/// Continues after a channel creation (op is not added)
+	void onChannelCreateResult (LiftConnectionOp * op, Error result, bool wasInitial);
+
+	/// Starts all providers better than the current channel at once (op is not yet added!)
+	void race (LiftConnectionOp * op);
+
+	/// The scheduler admitted a race attempt
+	void onRaceAdmitted (int level, AsyncOpId id);
+
+	/// Callback for channel creation of a race attempt (also called if the race is already over)
+	void onRaceChannelCreate (Error result, int level, ConnectionScheduler::Ticket ticket, const HostId & target, AsyncOpId id);
+
+	/// A race attempt finished (op is not added)
+	void onRaceResult (LiftConnectionOp * op, int level, Error result);
+
+	/// Finishes a lift operation with the current best level, calls back and deletes op
+	void finishLift (LiftConnectionOp * op);
+
+	/// Lifting of op got a better channel
+	void recordLifted (LiftConnectionOp * op);
 
 	///@}
 
@@ -125,6 +199,10 @@ private:
 	// Components
 	ChannelHolder mChannels;
 	ChannelPinger mChannelPinger;
+	ChannelProber mChannelProber;
+	ConnectionScheduler mScheduler;
+	LiftStrategy mLiftStrategy;
+	LiftMetrics  mLiftMetrics;
 	Authentication * mAuthentication; // not owned
 
 	// Delegates
@@ -19,7 +19,7 @@ void GenericInterplexBeacon::setPresenceProvider (PresenceProviderPtr presencePr
 	if (!presenceProvider) return;
 	mPresenceProvider = presenceProvider;
 	mPresenceProvider->onlineStateChanged().add (dMemFun (this, &GenericInterplexBeacon::onOnlineStateChanged));
-	mPresenceProvider->peersChanged().add (dMemFun (this, &GenericInterplexBeacon::onPeersChanged));
+	mPresenceProvider->peersChange().add (dMemFun (this, &GenericInterplexBeacon::onPeersChange));
 }
 
 Error GenericInterplexBeacon::setConnectionString (const String & connectionString, const String & password) {
@@ -41,7 +41,6 @@ void GenericInterplexBeacon::disconnect () {
 	if (mPresenceProvider){
 		mPresenceProvider->disconnect ();
 	}
-	mHosts.clear();
 	mConnectionManagement.clear();
 }
 
@@ -78,28 +77,18 @@ void GenericInterplexBeacon::onOnlineStateChanged (OnlineState os) {
 	}
 }
 
-void GenericInterplexBeacon::onPeersChanged () {
+void GenericInterplexBeacon::onPeersChange (const PresenceManagement::PeersChange & change) {
 	/*
-	 * Checking who went offline/online
 	 * Offliners : kill connections to them (TODO: is this really necessary?)
 	 * Onliners:   request for additional information
 	 */
-	PresenceManagement::HostInfoMap hosts = mPresenceProvider->hosts();
-	HostSet wentOffline;
-	for (PresenceManagement::HostInfoMap::const_iterator i = mHosts.begin(); i != mHosts.end(); i++) {
-		if (hosts.count(i->first) == 0){
-			wentOffline.insert (i->first);
-			mConnectionManagement.clear(i->first);
-		}
+	for (HostSet::const_iterator i = change.offline.begin(); i != change.offline.end(); i++) {
+		mConnectionManagement.clear(*i);
 	}
-	for (PresenceManagement::HostInfoMap::const_iterator i = hosts.begin(); i != hosts.end(); i++) {
-		if (mHosts.count(i->first) == 0){
-			// went online...
-			mPresenceProvider->updateFeatures(i->first);
-		}
+	for (HostSet::const_iterator i = change.online.begin(); i != change.online.end(); i++) {
+		mPresenceProvider->updateFeatures(*i);
 	}
-	mHosts.swap(hosts);
-	for (HostSet::const_iterator i = wentOffline.begin(); i != wentOffline.end(); i++) {
+	for (HostSet::const_iterator i = change.offline.begin(); i != change.offline.end(); i++) {
 		mCommunicationMultiplex.distChannelChange(*i);
 	}
 }
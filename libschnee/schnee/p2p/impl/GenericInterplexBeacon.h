@@ -51,11 +51,10 @@ private:
 	/// Callback for Onlien State Changes
 	void onOnlineStateChanged (OnlineState os);
 	/// Callback for Peers list changed
-	void onPeersChanged ();
+	void onPeersChange (const PresenceManagement::PeersChange & change);
 	
 	PresenceProviderPtr mPresenceProvider; ///< Current presence provider
-	
-	PresenceManagement::HostInfoMap mHosts;
+
 	CommunicationMultiplex      mCommunicationMultiplex;
 	GenericConnectionManagement mConnectionManagement;
 	Authentication mAuthentication;
@@ -0,0 +1,61 @@
+#pragma once
+
+/// @cond DEV
+
+namespace sf {
+
+/// Estimates round trip time and bandwidth of one channel
+/// RTT is smoothed like TCP does (RFC 6298, alpha = 1/8, beta = 1/4).
+/// Bandwidth is the exponential average of active probes (weight 1/4);
+/// passive measurements are only a lower bound (the traffic may have been application limited).
+struct PathEstimator {
+	PathEstimator () : mSrtt (-1), mRttVar (-1), mProbed (-1), mPassive (-1) {}
+
+	/// Adds one round trip measurement (seconds)
+	void addRtt (float seconds) {
+		if (seconds < 0) return;
+		if (mSrtt < 0) {
+			mSrtt   = seconds;
+			mRttVar = seconds / 2;
+			return;
+		}
+		float diff = mSrtt - seconds;
+		if (diff < 0) diff = -diff;
+		mRttVar = 0.75f * mRttVar + 0.25f * diff;
+		mSrtt   = 0.875f * mSrtt + 0.125f * seconds;
+	}
+
+	/// Adds the result of an active probe (bytes/s)
+	void addProbe (float bytesPerSecond) {
+		if (bytesPerSecond <= 0) return;
+		if (mProbed < 0) mProbed = bytesPerSecond;
+		else mProbed = 0.75f * mProbed + 0.25f * bytesPerSecond;
+	}
+
+	/// Adds a throughput seen on regular traffic (bytes/s)
+	void addPassive (float bytesPerSecond) {
+		if (bytesPerSecond <= 0) return;
+		if (mPassive < 0) mPassive = bytesPerSecond;
+		else mPassive = 0.75f * mPassive + 0.25f * bytesPerSecond;
+	}
+
+	bool hasRtt () const { return mSrtt >= 0; }
+	/// Smoothed round trip time in seconds or < 0
+	float srtt () const { return mSrtt; }
+	/// Round trip time variation in seconds or < 0
+	float rttVar () const { return mRttVar; }
+
+	bool hasBandwidth () const { return mProbed > 0 || mPassive > 0; }
+	/// Estimated bandwidth in bytes/s or < 0
+	float bandwidth () const { return mProbed > mPassive ? mProbed : mPassive; }
+
+private:
+	float mSrtt;
+	float mRttVar;
+	float mProbed;
+	float mPassive;
+};
+
+}
+
+/// @endcond DEV
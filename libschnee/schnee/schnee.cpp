@@ -1,7 +1,11 @@
 #include "net/impl/IOService.h"
 #include "tools/async/impl/DelegateRegister.h"
 #include "net/impl/UDTMainLoop.h"
+#include "net/impl/CryptoWorkers.h"
+#include "net/impl/IOUring.h"
 #include "net/TLSCertificates.h"
+#include "net/TLSSessionCache.h"
+#include "p2p/channels/EndpointCache.h"
 #include "settings.h"
 
 #ifdef LINUX
@@ -15,8 +19,8 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 
 void global_InitGnuTls () {
 #ifdef LINUX
-	// Technically we don't need multithreading support anymore
-	// Because all TLS Operations are working inside one mutex now.
+	// TLS operations are working inside one mutex, unless they are
+	// moved to crypto worker threads (see CryptoWorkers).
 	// Win32 doesn't have it anymore because it's new GnuTLS library
 	// is not based on libcrypt anymore.
 
@@ -64,23 +68,41 @@ bool init (int argc, const char * argv []) {
 	global_InitGnuTls ();
 	TLSCertificates::initInstance();
 	schnee::setInitialCertificates ();
+	TLSSessionCache::initInstance();
+	if (!settings.tlsSessionCache.empty()) {
+		TLSSessionCache::instance().setFile (settings.tlsSessionCache);
+	}
+	EndpointCache::initInstance();
+	if (!settings.endpointCache.empty()) {
+		EndpointCache::instance().setFile (settings.endpointCache);
+	}
 	IOService::initInstance ();
 	IOService::instance().start();
 	Log (LogInfo) << LOGID << "Started IOService, thread " << IOService::threadId(IOService::service()) << std::endl;
 
 	DelegateRegister::initInstance();
 	UDTMainLoop::initInstance();
+	CryptoWorkers::initInstance();
+	CryptoWorkers::instance().start (settings.cryptoThreads);
+	IOUring::initInstance();
+	if (settings.tcpBackend == "uring" && IOUring::instance().start()) {
+		Log (LogWarning) << LOGID << "io_uring not available, using asio for TCP" << std::endl;
+	}
 
 	gInitialized = true;
 	return true;
 }
 
 void deinit () {
+	CryptoWorkers::destroyInstance();
 	UDTMainLoop::destroyInstance();
 	DelegateRegister::instance().finish();
 	IOService::instance().stop();
+	IOUring::destroyInstance(); // after IOService, which may still call into it
 	DelegateRegister::destroyInstance();
 	IOService::destroyInstance ();
+	EndpointCache::destroyInstance();
+	TLSSessionCache::destroyInstance();
 	TLSCertificates::destroyInstance();
 	global_uninitGnuTls ();
 	gInitialized = false;
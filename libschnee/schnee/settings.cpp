@@ -15,9 +15,21 @@ Settings::Settings () {
 	echoServerPort = 1234;
 	disableTcp = false;
 	disableUdt = false;
+	tcpBackend = "asio";
+	udtCongestion = "udt";
+	udtBandwidth  = 0;
+	liftStrategy  = "sequential";
+	lanDiscovery  = false;
+	localChannels = false;
+	relayBandwidth = 0;
 	overrideTlsAuth = false;
 
 	forceBoshXmpp = false;
+	disableXmppCompression = false;
+
+	keyType = "rsa";
+	kernelTls = false;
+	cryptoThreads = 0;
 }
 static Settings gSettings;
 
@@ -53,11 +65,45 @@ void parseArguments (int argc, const char * argv[]) {
 				gSettings.echoServer = t;
 				gSettings.echoServerPort = atoi (u.c_str());
 			}
+			if (s == "--keyStore") {
+				gSettings.keyStore = t;
+			}
+			if (s == "--keyType") {
+				gSettings.keyType = t;
+			}
+			if (s == "--tlsSessionCache") {
+				gSettings.tlsSessionCache = t;
+			}
+			if (s == "--endpointCache") {
+				gSettings.endpointCache = t;
+			}
+			if (s == "--tcpBackend") {
+				gSettings.tcpBackend = t;
+			}
+			if (s == "--udtCongestion") {
+				gSettings.udtCongestion = t;
+			}
+			if (s == "--udtBandwidth") {
+				gSettings.udtBandwidth = (float) atof (t.c_str());
+			}
+			if (s == "--relayBandwidth") {
+				gSettings.relayBandwidth = (float) atof (t.c_str());
+			}
+			if (s == "--liftStrategy") {
+				gSettings.liftStrategy = t;
+			}
+			if (s == "--cryptoThreads") {
+				gSettings.cryptoThreads = atoi (t.c_str());
+			}
 			CHECK_BOOL_ARGUMENT (noLineNoise);
 			CHECK_BOOL_ARGUMENT (disableTcp);
 			CHECK_BOOL_ARGUMENT (disableUdt);
+			CHECK_BOOL_ARGUMENT (lanDiscovery);
+			CHECK_BOOL_ARGUMENT (localChannels);
 			CHECK_BOOL_ARGUMENT (overrideTlsAuth);
 			CHECK_BOOL_ARGUMENT (forceBoshXmpp);
+			CHECK_BOOL_ARGUMENT (disableXmppCompression);
+			CHECK_BOOL_ARGUMENT (kernelTls);
 		}
 	}
 }
@@ -109,5 +155,13 @@ void setForceBoshXmpp (bool v) {
 	gSettings.forceBoshXmpp = v;
 }
 
+void setKeyStore (const String & directory) {
+	gSettings.keyStore = directory;
+}
+
+void setKeyType (const String & type) {
+	gSettings.keyType = type;
+}
+
 }
 }
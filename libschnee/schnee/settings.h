@@ -24,9 +24,24 @@ struct Settings {
 	int    echoServerPort;	///< Echo Server port
 	bool   disableTcp; 		///< Disable TCP connections (--disableTcp)
 	bool   disableUdt;		///< Disalbe UDT connections (--disableUdt)
+	String tcpBackend;		///< IO backend of TCP sockets: asio or uring (Linux io_uring, asio if not available) (--tcpBackend [name])
+	String udtCongestion;	///< Congestion control of UDT channels: udt or background (--udtCongestion [name])
+	float  udtBandwidth;	///< Expected link bandwidth in bytes/s for sizing UDT buffers, 0 for default buffers (--udtBandwidth [bytes/s])
+	String liftStrategy;	///< How connections get lifted: sequential or race (all better channel providers at once) (--liftStrategy [name])
+	bool   lanDiscovery;	///< Announce and find peers in the local network via UDP multicast and connect them directly (--lanDiscovery)
+	bool   localChannels;	///< Connect peers on the same host via Unix domain sockets, without TCP and TLS (--localChannels)
+	float  relayBandwidth;	///< Bandwidth in bytes/s for relaying streams between directly connected friends, 0 disables, < 0 unlimited (--relayBandwidth [bytes/s])
 	bool   overrideTlsAuth; ///< Completely overrides TLS authentication, for debugging purposes. Channels will tell you that they are authenticated! (--overrideTlsAuth)
 
 	bool   forceBoshXmpp;	///< Force BOSH connection when connecting via XMPP (--forceBoshXmpp)
+	bool   disableXmppCompression; ///< Do not negotiate XMPP stream compression (--disableXmppCompression)
+
+	String keyStore;		///< Directory where own key/certificate and DH parameters are kept, empty for none (--keyStore [directory])
+	String keyType;			///< Type of newly generated keys: rsa, ecdsa or ed25519 (--keyType [type])
+	String tlsSessionCache;	///< File for keeping TLS sessions between starts, empty for none (--tlsSessionCache [file])
+	String endpointCache;	///< File for keeping how peers were reached between starts, empty for none (--endpointCache [file])
+	bool   kernelTls;		///< Let the kernel encrypt outgoing data of TCP channels if possible (--kernelTls)
+	int    cryptoThreads;	///< Worker threads for TLS record processing and handshakes, 0 to do it inline (--cryptoThreads [n])
 };
 
 /// Gives (const!) you access to global settings
@@ -41,6 +56,12 @@ void setEchoServerPort (int port);
 /// Explicitly set forcing bosh mode.
 void setForceBoshXmpp (bool v);
 
+/// Explicitly set key store directory
+void setKeyStore (const String & directory);
+
+/// Explicitly set type of newly generated keys
+void setKeyType (const String & type);
+
 ///@}
 
 }
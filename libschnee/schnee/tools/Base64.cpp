@@ -1,4 +1,3 @@
-
 //*********************************************************************
 //* Base64 - a simple base64 encoder and decoder.
 //*
@@ -16,6 +15,14 @@
 
 #include "Base64.h"
 
+// SIMD variants need target attributes (GCC >= 4.9 or Clang) on x86
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define SF_BASE64_SIMD
+#include <immintrin.h>
+#endif
+#endif
+
 ///@cond DEV
 
 using std::string;
@@ -23,18 +30,18 @@ using std::string;
 namespace sf {
 
 static const char fillchar = '=';
-static const string::size_type np = string::npos;
+static const unsigned char np = 0xff;
 
-const string Base64::Base64Table(
+static const char Base64Table[] =
   // 0000000000111111111122222222223333333333444444444455555555556666
   // 0123456789012345678901234567890123456789012345678901234567890123
-  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-// Decode Table gives the index of any valid base64 character in the 
+// Decode Table gives the index of any valid base64 character in the
 // Base64 table
 // 65 == A, 97 == a, 48 == 0, 43 == +, 47 == /
 
-const string::size_type Base64::DecodeTable[] = {
+static const unsigned char DecodeTable[] = {
 // 0  1  2  3  4  5  6  7  8  9
   np,np,np,np,np,np,np,np,np,np,  // 0 - 9
   np,np,np,np,np,np,np,np,np,np,  //10 -19
@@ -64,223 +71,334 @@ const string::size_type Base64::DecodeTable[] = {
   np,np,np,np,np,np               //250 -256
 };
 
-string Base64::encodeFromArray(const char * data, size_t len) {
-  size_t i;
-  char c;
-  string ret;
-
-  ret.reserve(len * 2);
-
-  for (i = 0; i < len; ++i) {
-    c = (data[i] >> 2) & 0x3f;
-    ret.append(1, Base64Table[c]);
-    c = (data[i] << 4) & 0x3f;
-    if (++i < len) {
-      c |= (data[i] >> 4) & 0x0f;
-    }
-
-    ret.append(1, Base64Table[c]);
-    if (i < len) {
-      c = (data[i] << 2) & 0x3f;
-      if (++i < len) {
-        c |= (data[i] >> 6) & 0x03;
-      }
-      ret.append(1, Base64Table[c]);
-    } else {
-        ++i;
-        ret.append(1, fillchar);
-    }
+// Scalar implementation, used for the tails of the SIMD variants too
+
+/// Encodes len bytes, returns number of written characters
+static size_t encodeScalar (const unsigned char * data, size_t len, char * dst) {
+  char * o = dst;
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    o[0] = Base64Table[data[i] >> 2];
+    o[1] = Base64Table[((data[i] << 4) & 0x30) | (data[i+1] >> 4)];
+    o[2] = Base64Table[((data[i+1] << 2) & 0x3c) | (data[i+2] >> 6)];
+    o[3] = Base64Table[data[i+2] & 0x3f];
+    o += 4;
+  }
+  if (i + 1 == len) {
+    o[0] = Base64Table[data[i] >> 2];
+    o[1] = Base64Table[(data[i] << 4) & 0x30];
+    o[2] = fillchar;
+    o[3] = fillchar;
+    o += 4;
+  } else if (i + 2 == len) {
+    o[0] = Base64Table[data[i] >> 2];
+    o[1] = Base64Table[((data[i] << 4) & 0x30) | (data[i+1] >> 4)];
+    o[2] = Base64Table[(data[i+1] << 2) & 0x3c];
+    o[3] = fillchar;
+    o += 4;
+  }
+  return o - dst;
+}
 
-    if (i < len) {
-        c = data[i] & 0x3f;
-        ret.append(1, Base64Table[c]);
-    } else {
-        ret.append(1, fillchar);
+/// Decodes len characters, skipping invalid characters and stopping on fill characters.
+/// Returns number of written bytes
+static size_t decodeScalar (const unsigned char * data, size_t len, char * dst) {
+  char * o = dst;
+  unsigned int quad = 0;
+  int count = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] == fillchar) break;
+    unsigned char c = DecodeTable[data[i]];
+    if (c == np) continue;
+    quad = (quad << 6) | c;
+    if (++count == 4) {
+      o[0] = (char) (quad >> 16);
+      o[1] = (char) (quad >> 8);
+      o[2] = (char) quad;
+      o += 3;
+      quad = 0;
+      count = 0;
     }
   }
+  // incomplete last quad
+  if (count == 2) {
+    *o++ = (char) (quad >> 4);
+  } else if (count == 3) {
+    *o++ = (char) (quad >> 10);
+    *o++ = (char) (quad >> 2);
+  }
+  return o - dst;
+}
+
+#ifdef SF_BASE64_SIMD
 
-  return(ret);
+// Algorithms of Wojciech Mula and Daniel Lemire
+// http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+// http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html
+
+#define SF_SSSE3 __attribute__ ((target ("ssse3")))
+#define SF_AVX2  __attribute__ ((target ("avx2")))
+
+/// Splits 12 bytes (in 16 byte register) into 16 6-bit indices
+SF_SSSE3 static inline __m128i encReshuffle (__m128i in) {
+  in = _mm_shuffle_epi8 (in, _mm_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128 (in, _mm_set1_epi32 (0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16 (t0, _mm_set1_epi32 (0x04000040));
+  const __m128i t2 = _mm_and_si128 (in, _mm_set1_epi32 (0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16 (t2, _mm_set1_epi32 (0x01000010));
+  return _mm_or_si128 (t1, t3);
 }
 
-string Base64::encodeFromArray (const ByteArray & data){
-	  size_t i;
-	  char c;
-	  string ret;
-	  size_t len = data.size();
-	  ret.reserve(len * 2);
-
-	  for (i = 0; i < len; ++i) {
-	    c = (data[i] >> 2) & 0x3f;
-	    ret.append(1, Base64Table[c]);
-	    c = (data[i] << 4) & 0x3f;
-	    if (++i < len) {
-	      c |= (data[i] >> 4) & 0x0f;
-	    }
-
-	    ret.append(1, Base64Table[c]);
-	    if (i < len) {
-	      c = (data[i] << 2) & 0x3f;
-	      if (++i < len) {
-	        c |= (data[i] >> 6) & 0x03;
-	      }
-	      ret.append(1, Base64Table[c]);
-	    } else {
-	        ++i;
-	        ret.append(1, fillchar);
-	    }
-
-	    if (i < len) {
-	        c = data[i] & 0x3f;
-	        ret.append(1, Base64Table[c]);
-	    } else {
-	        ret.append(1, fillchar);
-	    }
-	  }
-
-	  return(ret);
+/// Converts 6-bit indices into the Base64 alphabet
+SF_SSSE3 static inline __m128i encTranslate (__m128i in) {
+  __m128i result = _mm_subs_epu8 (in, _mm_set1_epi8 (51));
+  const __m128i less = _mm_cmpgt_epi8 (_mm_set1_epi8 (26), in);
+  result = _mm_or_si128 (result, _mm_and_si128 (less, _mm_set1_epi8 (13)));
+  const __m128i shift = _mm_setr_epi8 (
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  result = _mm_shuffle_epi8 (shift, result);
+  return _mm_add_epi8 (result, in);
 }
 
-string Base64::encode(const string& data) {
-  string::size_type i;
-  char c;
-  string::size_type len = data.length();
-  string ret;
-
-  ret.reserve(len * 2);
-
-  for (i = 0; i < len; ++i) {
-    c = (data[i] >> 2) & 0x3f;
-    ret.append(1, Base64Table[c]);
-    c = (data[i] << 4) & 0x3f;
-    if (++i < len) {
-      c |= (data[i] >> 4) & 0x0f;
-    }
+SF_SSSE3 static size_t encodeSSSE3 (const unsigned char * data, size_t len, char * dst) {
+  size_t i = 0;
+  char * o = dst;
+  // Reads 16 bytes, consumes 12
+  for (; i + 16 <= len; i += 12) {
+    __m128i in = _mm_loadu_si128 ((const __m128i*) (data + i));
+    _mm_storeu_si128 ((__m128i*) o, encTranslate (encReshuffle (in)));
+    o += 16;
+  }
+  return (o - dst) + encodeScalar (data + i, len - i, o);
+}
 
-    ret.append(1, Base64Table[c]);
-    if (i < len) {
-      c = (data[i] << 2) & 0x3f;
-      if (++i < len) {
-        c |= (data[i] >> 6) & 0x03;
-      }
-
-      ret.append(1, Base64Table[c]);
-    } else {
-      ++i;
-      ret.append(1, fillchar);
-    }
+/// Checks for invalid characters and translates valid ones into their 6-bit values
+/// Returns false if there is an invalid one.
+SF_SSSE3 static inline bool decTranslate (__m128i & str) {
+  const __m128i lutLo = _mm_setr_epi8 (
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lutHi = _mm_setr_epi8 (
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lutRoll = _mm_setr_epi8 (
+    0, 16, 19, 4, -65, -65, -71, -71,
+    0,  0,  0, 0,   0,   0,   0,   0);
+  const __m128i mask2F = _mm_set1_epi8 (0x2f);
+
+  const __m128i hiNibbles = _mm_and_si128 (_mm_srli_epi32 (str, 4), mask2F);
+  const __m128i loNibbles = _mm_and_si128 (str, mask2F);
+  const __m128i hi = _mm_shuffle_epi8 (lutHi, hiNibbles);
+  const __m128i lo = _mm_shuffle_epi8 (lutLo, loNibbles);
+  if (_mm_movemask_epi8 (_mm_cmpgt_epi8 (_mm_and_si128 (lo, hi), _mm_setzero_si128())) != 0) {
+    return false;
+  }
+  const __m128i eq2F = _mm_cmpeq_epi8 (str, mask2F);
+  const __m128i roll = _mm_shuffle_epi8 (lutRoll, _mm_add_epi8 (eq2F, hiNibbles));
+  str = _mm_add_epi8 (str, roll);
+  return true;
+}
 
-    if (i < len) {
-      c = data[i] & 0x3f;
-      ret.append(1, Base64Table[c]);
-    } else {
-      ret.append(1, fillchar);
-    }
+/// Packs 16 6-bit values into 12 bytes (last 4 bytes are zero)
+SF_SSSE3 static inline __m128i decReshuffle (__m128i in) {
+  const __m128i mergeAbBc = _mm_maddubs_epi16 (in, _mm_set1_epi32 (0x01400140));
+  const __m128i out = _mm_madd_epi16 (mergeAbBc, _mm_set1_epi32 (0x00011000));
+  return _mm_shuffle_epi8 (out, _mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+SF_SSSE3 static size_t decodeSSSE3 (const unsigned char * data, size_t len, char * dst) {
+  size_t i = 0;
+  char * o = dst;
+  // Writes 16 bytes, 12 are valid; the lookahead guarantees enough space in dst
+  for (; i + 20 <= len; i += 16) {
+    __m128i str = _mm_loadu_si128 ((const __m128i*) (data + i));
+    if (!decTranslate (str)) break; // fill characters, whitespace or garbage
+    _mm_storeu_si128 ((__m128i*) o, decReshuffle (str));
+    o += 12;
   }
+  return (o - dst) + decodeScalar (data + i, len - i, o);
+}
 
-  return(ret);
+SF_AVX2 static size_t encodeAVX2 (const unsigned char * data, size_t len, char * dst) {
+  size_t i = 0;
+  char * o = dst;
+  const __m256i shuffle = _mm256_set_epi8 (
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m256i shift = _mm256_setr_epi8 (
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  // Every lane works on 12 of 24 consumed bytes (reads 28)
+  for (; i + 32 <= len; i += 24) {
+    __m256i in = _mm256_inserti128_si256 (
+      _mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i*) (data + i))),
+      _mm_loadu_si128 ((const __m128i*) (data + i + 12)), 1);
+    in = _mm256_shuffle_epi8 (in, shuffle);
+    const __m256i t0 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16 (t0, _mm256_set1_epi32 (0x04000040));
+    const __m256i t2 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16 (t2, _mm256_set1_epi32 (0x01000010));
+    const __m256i indices = _mm256_or_si256 (t1, t3);
+
+    __m256i result = _mm256_subs_epu8 (indices, _mm256_set1_epi8 (51));
+    const __m256i less = _mm256_cmpgt_epi8 (_mm256_set1_epi8 (26), indices);
+    result = _mm256_or_si256 (result, _mm256_and_si256 (less, _mm256_set1_epi8 (13)));
+    result = _mm256_add_epi8 (_mm256_shuffle_epi8 (shift, result), indices);
+    _mm256_storeu_si256 ((__m256i*) o, result);
+    o += 32;
+  }
+  // Rest (at least one SSSE3 round is possible)
+  return (o - dst) + encodeSSSE3 (data + i, len - i, o);
 }
 
-string Base64::decode(const string& data) {
-  string::size_type i;
-  char c;
-  char c1;
-  string::size_type len = data.length();
-  string ret;
-
-  ret.reserve(len);
-
-  for (i = 0; i < len; ++i) {
-    do {
-      c = static_cast<char>(DecodeTable[static_cast<unsigned char>(data[i])]);
-    } while (c == static_cast<char> (np) && ++i < len);
-
-    ++i;
-
-    do {
-      c1 = static_cast<char>(DecodeTable[static_cast<unsigned char>(data[i])]);
-    } while (c == static_cast<char> (np) && ++i < len);
-
-    c = (c << 2) | ((c1 >> 4) & 0x3);
-    ret.append(1, c);
-    if (++i < len) {
-      c = data[i];
-      if (fillchar == c) {         
-        break;
-      }
-
-      do {
-        c = static_cast<char>(DecodeTable[static_cast<unsigned char>(data[i])]);
-      } while (c == static_cast<char>(np) && ++i < len);
-      c1 = ((c1 << 4) & 0xf0) | ((c >> 2) & 0xf);
-      ret.append(1, c1);
-    }
+SF_AVX2 static size_t decodeAVX2 (const unsigned char * data, size_t len, char * dst) {
+  size_t i = 0;
+  char * o = dst;
+  const __m256i lutLo = _mm256_setr_epi8 (
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lutHi = _mm256_setr_epi8 (
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lutRoll = _mm256_setr_epi8 (
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask2F = _mm256_set1_epi8 (0x2f);
+  const __m256i pack = _mm256_setr_epi8 (
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+  // Writes 32 bytes, 24 are valid; the lookahead guarantees enough space in dst
+  for (; i + 40 <= len; i += 32) {
+    __m256i str = _mm256_loadu_si256 ((const __m256i*) (data + i));
+    const __m256i hiNibbles = _mm256_and_si256 (_mm256_srli_epi32 (str, 4), mask2F);
+    const __m256i loNibbles = _mm256_and_si256 (str, mask2F);
+    const __m256i hi = _mm256_shuffle_epi8 (lutHi, hiNibbles);
+    const __m256i lo = _mm256_shuffle_epi8 (lutLo, loNibbles);
+    if (!_mm256_testz_si256 (lo, hi)) break; // fill characters, whitespace or garbage
+    const __m256i eq2F = _mm256_cmpeq_epi8 (str, mask2F);
+    str = _mm256_add_epi8 (str, _mm256_shuffle_epi8 (lutRoll, _mm256_add_epi8 (eq2F, hiNibbles)));
+
+    const __m256i mergeAbBc = _mm256_maddubs_epi16 (str, _mm256_set1_epi32 (0x01400140));
+    __m256i out = _mm256_madd_epi16 (mergeAbBc, _mm256_set1_epi32 (0x00011000));
+    out = _mm256_shuffle_epi8 (out, pack);
+    out = _mm256_permutevar8x32_epi32 (out, _mm256_setr_epi32 (0, 1, 2, 4, 5, 6, -1, -1));
+    _mm256_storeu_si256 ((__m256i*) o, out);
+    o += 24;
+  }
+  return (o - dst) + decodeSSSE3 (data + i, len - i, o);
+}
 
-    if (++i < len) {
-      c1 = data[i];
-      if (fillchar == c1) {
-        break;
-      }
+#endif // SF_BASE64_SIMD
 
-      do {
-        c1 = static_cast<char>(DecodeTable[static_cast<unsigned char>(data[i])]);
-      } while (c == static_cast<char>(np) && ++i < len);
+typedef size_t (*CodecFunction) (const unsigned char * data, size_t len, char * dst);
 
-      c = ((c << 6) & 0xc0) | c1;
-      ret.append(1, c);
+/// Holds the selected implementation
+struct Base64Codec {
+  Base64Codec () {
+    select (Base64::AVX2) || select (Base64::SSSE3) || select (Base64::Scalar);
+  }
+
+  bool select (Base64::Implementation i) {
+    if (!Base64::isSupported (i)) return false;
+    switch (i) {
+#ifdef SF_BASE64_SIMD
+    case Base64::AVX2:
+      encode = encodeAVX2;
+      decode = decodeAVX2;
+      break;
+    case Base64::SSSE3:
+      encode = encodeSSSE3;
+      decode = decodeSSSE3;
+      break;
+#endif
+    default:
+      encode = encodeScalar;
+      decode = decodeScalar;
+      i = Base64::Scalar;
     }
+    implementation = i;
+    return true;
   }
 
-  return(ret);
+  Base64::Implementation implementation;
+  CodecFunction encode;
+  CodecFunction decode;
+};
+static Base64Codec gCodec;
+
+Base64::Implementation Base64::implementation () {
+  return gCodec.implementation;
+}
+
+bool Base64::setImplementation (Implementation i) {
+  return gCodec.select (i);
+}
+
+bool Base64::isSupported (Implementation i) {
+  switch (i) {
+  case Scalar:
+    return true;
+#ifdef SF_BASE64_SIMD
+  case SSSE3:
+    __builtin_cpu_init (); // we may be called during static initialization
+    return __builtin_cpu_supports ("ssse3");
+  case AVX2:
+    __builtin_cpu_init ();
+    return __builtin_cpu_supports ("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+const char * Base64::implementationName (Implementation i) {
+  switch (i) {
+  case Scalar: return "scalar";
+  case SSSE3:  return "ssse3";
+  case AVX2:   return "avx2";
+  }
+  return "unknown";
+}
+
+void Base64::encodeTo (const char * data, size_t len, char * dst) {
+  gCodec.encode ((const unsigned char*) data, len, dst);
+}
+
+size_t Base64::decodeTo (const char * data, size_t len, char * dst) {
+  return gCodec.decode ((const unsigned char*) data, len, dst);
+}
+
+string Base64::encodeFromArray(const char * data, size_t len) {
+  string ret (encodedLength (len), '\0');
+  if (len > 0) encodeTo (data, len, &ret[0]);
+  return ret;
+}
+
+string Base64::encodeFromArray (const ByteArray & data){
+  return encodeFromArray (data.empty() ? 0 : data.const_c_array(), data.size());
+}
+
+string Base64::encode(const string& data) {
+  return encodeFromArray (data.data(), data.length());
+}
+
+string Base64::decode(const string& data) {
+  string ret ((data.length() / 4) * 3 + 3, '\0');
+  ret.resize (decodeTo (data.data(), data.length(), &ret[0]));
+  return ret;
+}
+
+void Base64::decodeToArray (const char * data, size_t len, sf::ByteArray & ret){
+  ret.resize ((len / 4) * 3 + 3);
+  ret.resize (decodeTo (data, len, ret.c_array()));
 }
 
 void Base64::decodeToArray (const string & data, sf::ByteArray & ret){
-	string::size_type i;
-	char c;
-	char c1;
-	string::size_type len = data.length();
-	ret.clear();
-	ret.reserve(len);
-	
-	for (i = 0; i < len; ++i) {
-	do {
-	  c = static_cast<char>(DecodeTable[static_cast<unsigned char>(data[i])]);
-	} while (c == static_cast<char>(np) && ++i < len);
-	
-	++i;
-	
-	do {
-	  c1 = static_cast<char>(DecodeTable[static_cast<unsigned char>(data[i])]);
-	} while (c == static_cast<char>(np) && ++i < len);
-	
-	c = (c << 2) | ((c1 >> 4) & 0x3);
-	ret.push_back (c);
-	if (++i < len) {
-	  c = data[i];
-	  if (fillchar == c) {         
-		break;
-	  }
-	
-	  do {
-		c = static_cast<char>(DecodeTable[static_cast<unsigned char>(data[i])]);
-	  } while (c == static_cast<char>(np) && ++i < len);
-	  c1 = ((c1 << 4) & 0xf0) | ((c >> 2) & 0xf);
-	  ret.push_back (c1);
-	}
-	
-	if (++i < len) {
-	  c1 = data[i];
-	  if (fillchar == c1) {
-		break;
-	  }
-	
-	  do {
-		c1 = static_cast<char>(DecodeTable[static_cast<unsigned char>(data[i])]);
-	  } while (c == static_cast<char>(np) && ++i < len);
-	
-	  c = ((c << 6) & 0xc0) | c1;
-	  ret.push_back (c);
-	}
-	}
+  decodeToArray (data.data(), data.length(), ret);
 }
 
 }
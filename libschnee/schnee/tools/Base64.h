@@ -1,4 +1,3 @@
-
 //*********************************************************************
 //* C_Base64 - a simple base64 encoder and decoder.
 //*
@@ -12,8 +11,9 @@
 /*
  * libschnee notice: copied from Google Talk, seems public domain as it is used
  * everywhere through the net.
- * 
- * Modificated for use with ByteArray
+ *
+ * Modificated for use with ByteArray, encoding/decoding now works on preallocated
+ * buffers and uses SSSE3/AVX2 on x86 CPUs supporting it (selected at runtime).
  */
 
 #pragma once
@@ -27,8 +27,11 @@ namespace sf {
 
 /**
  * Base64 encoder by Bob Withers, freeware.
- * 
+ *
  * With some enhancements of Stanley Yamane and Norbert Schultz.
+ *
+ * Decoding skips all characters which are not part of the Base64 alphabet (e.g. whitespace)
+ * and stops at the first fill character.
  */
 class Base64
 {
@@ -36,11 +39,35 @@ public:
   static std::string encode(const std::string & data);
   static std::string decode(const std::string & data);
   static void decodeToArray (const std::string & data, sf::ByteArray & ret);
+  static void decodeToArray (const char * data, size_t len, sf::ByteArray & ret);
   static std::string encodeFromArray(const char * data, size_t len);
   static std::string encodeFromArray(const ByteArray & arr);
-private:
-  static const std::string Base64Table;
-  static const std::string::size_type DecodeTable[];
+
+  /// Returns the number of characters len bytes need in encoded form (including fill characters)
+  static size_t encodedLength (size_t len) { return ((len + 2) / 3) * 4; }
+
+  /// Encodes len bytes into dst, which must have space for encodedLength (len) characters
+  static void encodeTo (const char * data, size_t len, char * dst);
+
+  /// Decodes len characters into dst, which must have space for len / 4 * 3 + 3 bytes
+  /// Returns number of decoded bytes.
+  static size_t decodeTo (const char * data, size_t len, char * dst);
+
+  /// Available implementations
+  enum Implementation { Scalar = 0, SSSE3, AVX2 };
+
+  /// Currently used implementation (the best the CPU supports by default)
+  static Implementation implementation ();
+
+  /// Forces an implementation (for testing/benchmarking)
+  /// Returns false if the CPU doesn't support it
+  static bool setImplementation (Implementation i);
+
+  /// Returns true if the implementation is supported by the CPU (and compiled in)
+  static bool isSupported (Implementation i);
+
+  /// Name of an implementation
+  static const char * implementationName (Implementation i);
 };
 
 } // namespace talk_base
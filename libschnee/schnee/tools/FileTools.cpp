@@ -1,6 +1,14 @@
 #include "FileTools.h"
 
 #include <boost/filesystem.hpp>
+#include <fstream>
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 namespace fs = boost::filesystem;
 
 namespace sf {
@@ -88,4 +96,35 @@ Error createDirectoriesForFilePath (const String & path) {
 }
 
 
+Error writePrivateFile (const String & path, const String & content) {
+#ifdef WIN32
+	std::ofstream stream (path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!stream) return error::WriteError;
+	stream.write (content.c_str(), content.size());
+	return stream ? NoError : error::WriteError;
+#else
+	int fd = ::open (path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd < 0) return error::WriteError;
+	// the mode of open only applies to new files
+	if (::fchmod (fd, S_IRUSR | S_IWUSR) != 0) {
+		::close (fd);
+		return error::WriteError;
+	}
+	const char * data = content.c_str();
+	size_t rest = content.size();
+	while (rest > 0) {
+		ssize_t written = ::write (fd, data, rest);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			::close (fd);
+			return error::WriteError;
+		}
+		data += written;
+		rest -= written;
+	}
+	if (::close (fd) != 0) return error::WriteError;
+	return NoError;
+#endif
+}
+
 }
@@ -60,6 +60,10 @@ Error createDirectory (const String & directory);
 /// (All directories shall be created but not pathFilename (path))
 Error createDirectoriesForFilePath (const String & path);
 
+/// Writes content into a file which only the user may read and write (mode 0600 on Unix).
+/// The file is created with these permissions, so its content is never visible to others.
+Error writePrivateFile (const String & path, const String & content);
+
 
 
 ///@}
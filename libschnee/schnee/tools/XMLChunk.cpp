@@ -91,6 +91,7 @@ static XMLChunk convertTree (rapidxml::xml_node<> * node){
 			}
 			break;
 			case rapidxml::node_data:
+			case rapidxml::node_cdata:
 				target.setText (target.text() + String (subnode->value()));
 			break;
 			case rapidxml::node_comment:
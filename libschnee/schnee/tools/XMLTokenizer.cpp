@@ -0,0 +1,189 @@
+#include "XMLTokenizer.h"
+#include <string.h>
+
+// SSE2 is always there on x86_64 (and enabled on most x86 builds)
+#if defined(__SSE2__) && defined(__GNUC__)
+#define SF_XMLTOKENIZER_SSE2
+#include <emmintrin.h>
+#endif
+
+///@cond DEV
+
+namespace sf {
+
+static inline bool isWhiteSpace (char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/// Returns the position of the first a, b or c in data between pos and len (or len if not found)
+static size_t findAny (const char * data, size_t pos, size_t len, char a, char b, char c) {
+#ifdef SF_XMLTOKENIZER_SSE2
+	const __m128i va = _mm_set1_epi8 (a);
+	const __m128i vb = _mm_set1_epi8 (b);
+	const __m128i vc = _mm_set1_epi8 (c);
+	while (pos + 16 <= len) {
+		__m128i x = _mm_loadu_si128 ((const __m128i*) (data + pos));
+		__m128i m = _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (x, va), _mm_cmpeq_epi8 (x, vb)), _mm_cmpeq_epi8 (x, vc));
+		int mask = _mm_movemask_epi8 (m);
+		if (mask) return pos + __builtin_ctz (mask);
+		pos += 16;
+	}
+#endif
+	for (; pos < len; pos++) {
+		char x = data[pos];
+		if (x == a || x == b || x == c) return pos;
+	}
+	return len;
+}
+
+XMLTokenizer::XMLTokenizer () {
+	reset ();
+	mLastBegin   = 0;
+	mLastClosing = false;
+}
+
+void XMLTokenizer::reset () {
+	mPos     = 0;
+	mBegin   = 0;
+	mStarted = false;
+	mDepth   = 0;
+	mMode    = Content;
+	mQuote   = 0;
+}
+
+int XMLTokenizer::finish (size_t end, bool closing) {
+	mLastBegin   = mBegin;
+	mLastClosing = closing;
+	reset ();
+	return (int) end;
+}
+
+int XMLTokenizer::scanElement (const char * data, size_t len) {
+	size_t i = mPos;
+	while (i < len) {
+		switch (mMode) {
+		case Content:{
+			if (!mStarted) {
+				while (i < len && isWhiteSpace (data[i])) i++;
+				if (i == len) break;
+				if (data[i] != '<') return -2; // cannot be an element
+				mBegin   = i;
+				mStarted = true;
+			} else {
+				i = findAny (data, i, len, '<', '<', 0);
+				if (i == len) break;
+				if (data[i] == 0) return -8; // no \NULL allowed
+			}
+			// data[i] == '<'
+			if (i + 1 >= len) {
+				mPos = i;
+				return 0;
+			}
+			char d = data[i + 1];
+			if (d == '!') {
+				size_t rest = len - i;
+				if (rest >= 4 && strncmp (data + i, "<!--", 4) == 0) {
+					mMode = Comment;
+					i += 4;
+					continue;
+				}
+				if (rest >= 9 && strncmp (data + i, "<![CDATA[", 9) == 0) {
+					mMode = CData;
+					i += 9;
+					continue;
+				}
+				if ((rest < 4 && strncmp (data + i, "<!--", rest) == 0) || (rest < 9 && strncmp (data + i, "<![CDATA[", rest) == 0)) {
+					// not decidable yet
+					mPos = i;
+					return 0;
+				}
+				return -3; // no declarations in streams
+			}
+			if (d == '?') {
+				mMode = Special;
+				i += 2;
+				continue;
+			}
+			if (d == '/') {
+				mDepth--;
+				i += 2;
+			} else {
+				mDepth++;
+				i += 1;
+			}
+			mMode = Tag;
+			continue;
+		}
+		case Tag:{
+			for (; i < len; i++) {
+				char c = data[i];
+				if (c == '>' || c == '/' || c == '\"' || c == '\'') break;
+				if (c == '<') return -4; // starting tag inside tag
+				if (c == 0) return -8;
+			}
+			if (i == len) break;
+			char c = data[i];
+			if (c == '\"' || c == '\'') {
+				mMode  = Quote;
+				mQuote = c;
+				i++;
+				continue;
+			}
+			if (c == '/') {
+				if (i + 1 >= len) {
+					mPos = i;
+					return 0;
+				}
+				if (data[i + 1] != '>') {
+					i++;
+					continue;
+				}
+				// shortened tag
+				mDepth--;
+				i++;
+			}
+			// data[i] == '>'
+			i++;
+			mMode = Content;
+			if (mDepth == 0) return finish (i, false);
+			if (mDepth < 0)  return finish (i, true);
+			continue;
+		}
+		case Quote:{
+			i = findAny (data, i, len, mQuote, mQuote, 0);
+			if (i == len) break;
+			if (data[i] == 0) return -8;
+			mMode = Tag;
+			i++;
+			continue;
+		}
+		case Comment:
+		case Special:
+		case CData:{
+			// searching for -->, ?> or ]]>
+			const char first = mMode == Comment ? '-' : (mMode == Special ? '?' : ']');
+			const size_t endLength = mMode == Special ? 2 : 3;
+			i = findAny (data, i, len, first, first, 0);
+			if (i == len) break;
+			if (data[i] == 0) return -8;
+			if (i + endLength > len) {
+				mPos = i;
+				return 0;
+			}
+			if (data[i + endLength - 1] == '>' && (endLength == 2 || data[i + 1] == first)) {
+				mMode = Content;
+				i += endLength;
+			} else {
+				i++;
+			}
+			continue;
+		}
+		}
+	}
+	mPos = i;
+	return 0;
+}
+
+}
+
+///@endcond DEV
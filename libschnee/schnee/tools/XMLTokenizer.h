@@ -0,0 +1,63 @@
+#pragma once
+#include <schnee/sftypes.h>
+
+///@cond DEV
+
+namespace sf {
+
+/**
+ * Resumable scanner for element boundaries in an XML stream (e.g. XMPP stanzas).
+ *
+ * In contrast to xml::completionDetection it keeps its state between calls, so
+ * an element arriving in many pieces is scanned only once. Text content and
+ * attribute values are skipped with SSE2 if available.
+ *
+ * Quotes are only regarded inside tags, comments, processing instructions
+ * and CDATA sections are skipped.
+ */
+class XMLTokenizer {
+public:
+	XMLTokenizer ();
+
+	/// Forgets the current scanning state
+	void reset ();
+
+	/// Continues scanning for the end of the current element.
+	/// data must point to the beginning of the element (including preceding white space)
+	/// and must contain at least the data of the previous call.
+	///
+	/// @return >0: length of the complete element (the tokenizer is reset afterwards), 0: incomplete, <0: error
+	int scanElement (const char * data, size_t len);
+
+	/// Offset of the element's begin ('<') of the last complete element (after white space)
+	size_t begin () const { return mLastBegin; }
+
+	/// The last complete element was a single closing tag (e.g. </stream:stream>)
+	bool closing () const { return mLastClosing; }
+
+	/// Number of bytes already scanned in the current element
+	size_t scanned () const { return mPos; }
+
+	/// Found the begin of the current element (otherwise only white space was scanned)
+	bool started () const { return mStarted; }
+
+private:
+	enum Mode { Content, Tag, Quote, Comment, Special, CData };
+
+	/// Finishes an element at position end
+	int finish (size_t end, bool closing);
+
+	size_t mPos;			///< Next position to scan
+	size_t mBegin;			///< Begin of the current element
+	bool   mStarted;		///< Found the begin of the current element
+	int    mDepth;			///< Element depth
+	Mode   mMode;			///< Current scanning mode
+	char   mQuote;			///< Quote character in Quote mode
+
+	size_t mLastBegin;
+	bool   mLastClosing;
+};
+
+}
+
+///@endcond DEV
@@ -0,0 +1,135 @@
+#include "XMLView.h"
+#include <schnee/tools/Log.h>
+
+#include <rapidxml/rapidxml.hpp>
+
+namespace sf {
+
+XMLDocument::XMLDocument () {
+	mDocument = new rapidxml::xml_document<char> ();
+}
+
+XMLDocument::~XMLDocument () {
+	delete mDocument;
+}
+
+Error XMLDocument::parse (const char * data, size_t len) {
+	mDocument->clear ();
+	// the parsed buffer lives inside the arena, too
+	char * buffer = mDocument->allocate_string (0, len + 1);
+	memcpy (buffer, data, len);
+	buffer[len] = 0;
+	try {
+		const int flags = rapidxml::parse_validate_closing_tags;
+		mDocument->parse<flags> (buffer);
+	} catch (rapidxml::parse_error & error){
+		Log (LogInfo) << LOGID << "Parsing error during parsing of " << String (data, len) << ":" << error.what() << std::endl;
+		mDocument->clear ();
+		return error::BadDeserialization;
+	}
+	return NoError;
+}
+
+void XMLDocument::clear () {
+	mDocument->clear ();
+}
+
+XMLView XMLDocument::root () const {
+	for (rapidxml::xml_node<> * node = mDocument->first_node(); node; node = node->next_sibling()){
+		if (node->type() == rapidxml::node_element) return XMLView (node);
+	}
+	return XMLView ();
+}
+
+XMLView XMLView::ownedRoot (const XMLDocumentPtr & document) {
+	if (!document) return XMLView ();
+	return XMLView (document->root().mNode, document);
+}
+
+StringRef XMLView::name () const {
+	if (!mNode) return StringRef ();
+	return StringRef (mNode->name(), mNode->name_size());
+}
+
+StringRef XMLView::text () const {
+	if (!mNode) return StringRef ();
+	rapidxml::xml_node<> * single = 0;
+	size_t count = 0;
+	size_t length = 0;
+	for (rapidxml::xml_node<> * node = mNode->first_node(); node; node = node->next_sibling()){
+		if (node->type() == rapidxml::node_data || node->type() == rapidxml::node_cdata){
+			single = node;
+			count++;
+			length += node->value_size();
+		}
+	}
+	if (count == 0) return StringRef ();
+	if (count == 1) return StringRef (single->value(), single->value_size());
+	// Mixed content (rare), concatenating inside the document's arena
+	char * target = mNode->document()->allocate_string (0, length);
+	char * p = target;
+	for (rapidxml::xml_node<> * node = mNode->first_node(); node; node = node->next_sibling()){
+		if (node->type() == rapidxml::node_data || node->type() == rapidxml::node_cdata){
+			memcpy (p, node->value(), node->value_size());
+			p += node->value_size();
+		}
+	}
+	return StringRef (target, length);
+}
+
+StringRef XMLView::attribute (const char * name, bool * wasSet) const {
+	rapidxml::xml_attribute<> * attr = mNode ? mNode->first_attribute (name) : 0;
+	if (wasSet) *wasSet = (attr != 0);
+	if (!attr) return StringRef ();
+	return StringRef (attr->value(), attr->value_size());
+}
+
+/// Skips non-element nodes (beginning with node)
+static rapidxml::xml_node<> * nextElement (rapidxml::xml_node<> * node, const char * name) {
+	while (node && node->type() != rapidxml::node_element) {
+		node = node->next_sibling (name);
+	}
+	return node;
+}
+
+XMLView XMLView::child (const char * name) const {
+	if (!mNode) return XMLView ();
+	return XMLView (nextElement (mNode->first_node (name), name));
+}
+
+XMLView XMLView::next (const char * name) const {
+	if (!mNode) return XMLView ();
+	return XMLView (nextElement (mNode->next_sibling (name), name));
+}
+
+StringRef XMLView::childText (const char * name, bool * found) const {
+	XMLView c = child (name);
+	if (found) *found = c.valid();
+	return c.text();
+}
+
+XMLChunk XMLView::toChunk () const {
+	if (!mNode) return XMLChunk::errChunk();
+	XMLChunk target;
+	target.setName (name());
+	for (rapidxml::xml_attribute<> * attr = mNode->first_attribute(); attr; attr = attr->next_attribute()){
+		String name (attr->name(), attr->name_size());
+		String value (attr->value(), attr->value_size());
+		if (name == "xmlns"){
+			target.setNs (value);
+		} else {
+			target.attributes().insert (std::pair<String, String> (name, value));
+		}
+	}
+	for (XMLView c = child(); c.valid(); c = c.next()){
+		target.children().push_back (c.toChunk());
+	}
+	target.setText (text());
+	return target;
+}
+
+}
+
+std::ostream & operator<< (std::ostream & stream, const sf::XMLView & view) {
+	return stream << view.toChunk();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <schnee/sftypes.h>
+#include <schnee/tools/XMLChunk.h>
+#include <cstring>
+
+namespace rapidxml {
+template<class Ch> class xml_node;
+template<class Ch> class xml_document;
+}
+
+namespace sf {
+
+class XMLView;
+
+/// A reference to a (not changeable) string, e.g. inside a parsed XMLDocument.
+class StringRef {
+public:
+	StringRef () : mData (""), mSize (0) {}
+	StringRef (const char * data, size_t size) : mData (data), mSize (size) {}
+
+	const char * data () const { return mData; }
+	size_t size () const { return mSize; }
+	bool empty () const { return mSize == 0; }
+
+	/// Copies the content into a String
+	String str () const { return String (mData, mSize); }
+	operator String () const { return str (); }
+
+	bool operator== (const char * s) const { return std::strlen (s) == mSize && std::memcmp (s, mData, mSize) == 0; }
+	bool operator== (const String & s) const { return s.size() == mSize && std::memcmp (s.data(), mData, mSize) == 0; }
+	bool operator!= (const char * s) const { return !(*this == s); }
+	bool operator!= (const String & s) const { return !(*this == s); }
+private:
+	const char * mData;
+	size_t mSize;
+};
+
+/**
+ * A parsed XML document (using rapidxml).
+ *
+ * The document owns a copy of the parsed data and an arena where all nodes are allocated,
+ * XMLViews on it point directly into the parsed buffer. Reparsing (or clearing) releases
+ * everything at once, so one document can be reused for many small documents (like XMPP stanzas).
+ */
+class XMLDocument {
+public:
+	XMLDocument ();
+	~XMLDocument ();
+
+	/// Parses data (after clearing the old content). Invalidates all views.
+	Error parse (const char * data, size_t len);
+
+	/// Releases the parsed content. Invalidates all views.
+	void clear ();
+
+	/// Returns the first element of the document (invalid if there is none)
+	XMLView root () const;
+
+private:
+	XMLDocument (const XMLDocument &);
+	XMLDocument & operator= (const XMLDocument &);
+	rapidxml::xml_document<char> * mDocument;
+};
+typedef shared_ptr<XMLDocument> XMLDocumentPtr;
+
+/**
+ * A lightweight view on an element of an XMLDocument. It is only valid as long as the
+ * document is alive and was not reparsed; for keeping something use toChunk ().
+ *
+ * Like XMLChunk, names include their namespace prefixes (e.g. stream:features) and
+ * XML entities are already decoded.
+ */
+class XMLView {
+public:
+	XMLView () : mNode (0) {}
+	explicit XMLView (rapidxml::xml_node<char> * node, const XMLDocumentPtr & owner = XMLDocumentPtr ()) : mNode (node), mOwner (owner) {}
+
+	/// Returns the root element of a document, which is kept alive as long as the view exists
+	/// (e.g. for views passed along with asynchronous calls). Child views do not hold the document.
+	static XMLView ownedRoot (const XMLDocumentPtr & document);
+
+	/// View points to an element
+	bool valid () const { return mNode != 0; }
+
+	/// Name of the element
+	StringRef name () const;
+	/// Namespace (xmlns attribute) of the element
+	StringRef ns () const { return attribute ("xmlns"); }
+	/// Text of the element (concatenation of all text parts)
+	StringRef text () const;
+
+	/// Returns an attribute or an empty string if not existant
+	StringRef attribute (const char * name, bool * wasSet = 0) const;
+
+	/// Returns the first child element (with a given name), invalid if not existant
+	XMLView child (const char * name = 0) const;
+	/// Returns the next sibling element (with a given name), invalid if not existant
+	XMLView next (const char * name = 0) const;
+
+	/// Returns the text of the first child with the given name ("" if not existant)
+	StringRef childText (const char * name, bool * found = 0) const;
+
+	/// Copies the element into an XMLChunk
+	XMLChunk toChunk () const;
+
+private:
+	rapidxml::xml_node<char> * mNode;
+	XMLDocumentPtr mOwner;
+};
+
+inline std::ostream & operator<< (std::ostream & stream, const StringRef & s) {
+	return stream.write (s.data(), s.size());
+}
+
+}
+
+/// (debug) output operator
+std::ostream & operator<< (std::ostream & stream, const sf::XMLView & view);
@@ -12,6 +12,7 @@ static DispatcherMap gDispatchers;
 NetworkDispatcher::NetworkDispatcher (Network & network, LocalChannelUsageCollectorPtr usageCollector) : mNetwork (network) {
 	SF_REGISTER_ME;
 	mOnline = false;
+	mNeighborsOnly = false;
 	mUsageCollector = usageCollector;
 	mAuthentication = 0;
 }
@@ -137,6 +138,7 @@ sf::Error NetworkDispatcher::createChannel (const HostId & target, const ResultC
 	}
 	if (!src || !dst) return error::CouldNotConnectHost;
 	if (!suc) return error::CouldNotConnectHost;
+	if (mNeighborsOnly && route.size() > 1) return error::CouldNotConnectHost;
 	
 	if (route.size() < 3) neighbor = true; // maximum one router
 
@@ -219,6 +221,24 @@ void NetworkDispatcher::onChannelReplyAuth (Error result, ChannelPtr channel, sh
 }
 
 void NetworkDispatcher::onPeersChanged () {
+	HostInfoMap current = hosts ();
+	PeersChange change;
+	for (HostSet::const_iterator i = mKnownHosts.begin(); i != mKnownHosts.end(); i++) {
+		if (current.count (*i) == 0) {
+			change.offline.insert (*i);
+			change.removedUsers.insert (*i); // are the same here
+		}
+	}
+	HostSet known;
+	for (HostInfoMap::const_iterator i = current.begin(); i != current.end(); i++) {
+		if (mKnownHosts.count (i->first) == 0) {
+			change.online.insert (i->first);
+			change.users.insert (i->first);
+		}
+		known.insert (i->first);
+	}
+	mKnownHosts.swap (known);
+	if (mPeersChange) mPeersChange (change);
 	if (mPeersChanged) mPeersChanged ();
 }
 
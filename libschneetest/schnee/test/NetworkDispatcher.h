@@ -28,6 +28,10 @@ public:
 	/// all created LocalChannels will be bound to it.
 	NetworkDispatcher (Network & network, LocalChannelUsageCollectorPtr usageCollector = LocalChannelUsageCollectorPtr());
 	virtual ~NetworkDispatcher ();
+
+	/// Only creates channels to hosts with a direct connection (no routers in between)
+	/// e.g. for simulating peers which can only reach each other through a third one
+	void setNeighborsOnly (bool v = true) { mNeighborsOnly = v; }
 	
 	// Implementation of PresenceProvider
 	virtual Error setConnectionString (const String & connectionString, const String & password);
@@ -44,6 +48,7 @@ public:
 
 	
 	virtual VoidSignal & peersChanged () { return mPeersChanged; }
+	virtual PeersChangeSignal & peersChange () { return mPeersChange; }
 	virtual ServerStreamErrorSignal & serverStreamErrorReceived() { static ServerStreamErrorSignal s; return s; }
 	virtual OnlineStateChangedSignal & onlineStateChanged () { return mOnlineStateChanged; }
 
@@ -69,11 +74,14 @@ private:
 	/// Gets called if peers changed
 	void onPeersChanged ();
 	bool mOnline;
+	bool mNeighborsOnly;
 	Network & mNetwork;
 	HostId mHostId;
 	Authentication * mAuthentication;
 	
 	VoidSignal mPeersChanged;
+	PeersChangeSignal mPeersChange;
+	HostSet mKnownHosts;	///< Hosts at the last peersChange
 	OnlineStateChangedSignal mOnlineStateChanged;
 
 	ChannelCreationDelegate mChannelCreated;
@@ -5,6 +5,7 @@
 #include <schnee/p2p/impl/GenericInterplexBeacon.h>
 #include "NetworkDispatcher.h"
 #include "PseudoRandom.h"
+#include <time.h>
 
 namespace sf {
 namespace test {
@@ -55,6 +56,19 @@ bool noPendingData (sf::test::LocalChannelUsageCollectorPtr collector) {
 	return x.value == 0;
 }
 
+void createIdentity (x509::PrivateKeyPtr & key, x509::CertificatePtr & cert, const String & name) {
+	key  = x509::PrivateKeyPtr  (new x509::PrivateKey());
+	cert = x509::CertificatePtr (new x509::Certificate());
+	key->generate (2048);
+	cert->setKey (key.get());
+	cert->setVersion (1);
+	cert->setActivationTime (time (NULL) - 7200);
+	cert->setExpirationDays (365);
+	cert->setSerial (1);
+	cert->setCommonName (name.c_str());
+	cert->sign (cert.get(), key.get());
+}
+
 const char * testNames (int id) {
 	const char * names[] = {"Alice","Bob","Carol","Dave", "Eve", "Fred", "Gustav", "Hank", "Ina", "John" };
 	const int num = (int) (sizeof (names) / sizeof (const char*));
@@ -1,6 +1,7 @@
 #pragma once
 #include <schnee/schnee.h>
 #include <schnee/p2p/InterplexBeacon.h>
+#include <schnee/net/x509.h>
 #include "Network.h"
 #include "LocalChannel.h"
 
@@ -43,6 +44,9 @@ const char * testNames (int id);
 /// Returns the name of a server used in a testcase
 inline const char * serverName (int id = 0) { return id==0?"Server" : 0; }
 
+/// Generates a key and a self signed certificate for it (e.g. for a TLS server in a testcase)
+void createIdentity (x509::PrivateKeyPtr & key, x509::CertificatePtr & cert, const String & name = "server@example.com/test");
+
 /// Typical inner network delay ~3..8ms
 float smallRandDelay ();
 
@@ -0,0 +1,239 @@
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/Log.h>
+#include <schnee/net/TCPServer.h>
+#include <schnee/im/xmpp/bosh_impl/BoshNodeBuilder.h>
+#include <schnee/im/xmpp/bosh_impl/BoshNodeParser.h>
+#include <schnee/im/xmpp/bosh_impl/BoshTransport.h>
+#include <boost/lexical_cast.hpp>
+
+/*
+ * @file
+ * Tests the BoshTransport against a local BOSH stand-in, which echoes all
+ * received payload. Measures message latency and throughput.
+ */
+using namespace sf;
+
+/// Minimal BOSH server: holds requests and sends back all payload it receives
+struct BoshStandIn : public DelegateBase {
+	BoshStandIn () : hold (1), nextRid (0), requestCount (0), maxHeld (0) {
+		SF_REGISTER_ME;
+	}
+	~BoshStandIn () {
+		SF_UNREGISTER_ME;
+	}
+
+	bool start () {
+		server.newConnection() = dMemFun (this, &BoshStandIn::onNewConnection);
+		return server.listen ();
+	}
+
+	Url url () const { return Url ("http://localhost:" + toString (server.serverPort()) + "/http-bind/"); }
+
+	struct Request {
+		TCPSocket * socket;
+		String content;
+		bool terminate;
+	};
+
+	void onNewConnection () {
+		TCPSocketPtr socket;
+		while ((socket = server.nextPendingConnection())) {
+			socket->readyRead() = abind (dMemFun (this, &BoshStandIn::onReadyRead), socket.get());
+			sockets.push_back (socket);
+			inputs[socket.get()] = ByteArray ();
+		}
+	}
+
+	void onReadyRead (TCPSocket * socket) {
+		ByteArray & input = inputs[socket];
+		input.append (*socket->read());
+		while (true) {
+			// HttpRequest sends a trailing line break after the content
+			size_t skip = 0;
+			while (skip < input.size() && (input[skip] == '\r' || input[skip] == '\n')) skip++;
+			input.l_truncate (skip);
+
+			String s (input.const_c_array(), input.size());
+			size_t headerEnd = s.find ("\r\n\r\n");
+			if (headerEnd == s.npos) return;
+			size_t length = 0;
+			size_t cl = s.find ("Content-Length: ");
+			if (cl != s.npos && cl < headerEnd) {
+				length = boost::lexical_cast<size_t> (s.substr (cl + 16, s.find ("\r\n", cl) - cl - 16));
+			}
+			if (s.size() < headerEnd + 4 + length) return;
+			String body = s.substr (headerEnd + 4, length);
+			input.l_truncate (headerEnd + 4 + length);
+			onRequest (socket, body);
+		}
+	}
+
+	void onRequest (TCPSocket * socket, const String & body) {
+		BoshNodeParser parser;
+		if (parser.parse (body)) {
+			Log (LogError) << LOGID << "Could not parse " << body << std::endl;
+			return;
+		}
+		requestCount++;
+		int64_t rid = boost::lexical_cast<int64_t> (parser.attribute ("rid"));
+		if (parser.attribute ("sid").empty()) {
+			// session creation
+			hold = boost::lexical_cast<int> (parser.attribute ("hold"));
+			nextRid = rid + 1;
+			BoshNodeBuilder builder;
+			builder.addAttribute ("xmlns", "http://jabber.org/protocol/httpbind");
+			builder.addAttribute ("sid", "standin");
+			builder.addAttribute ("wait", "60");
+			builder.addAttribute ("hold", toString (hold));
+			builder.addAttribute ("requests", toString (hold + 1));
+			respond (socket, builder.toString());
+			return;
+		}
+		Request & r = waiting[rid];
+		r.socket    = socket;
+		r.content   = parser.content();
+		r.terminate = parser.attribute ("type") == "terminate";
+		maxHeld = std::max (maxHeld, (int) (queue.size() + waiting.size()));
+
+		// handling requests in RID order (they may come in out of order on different connections)
+		std::map<int64_t, Request>::iterator i;
+		while ((i = waiting.find (nextRid)) != waiting.end()) {
+			outgoing.append (i->second.content);
+			queue.push_back (i->second);
+			waiting.erase (i);
+			nextRid++;
+		}
+		while (!queue.empty() && ((int) queue.size() > hold || !outgoing.empty() || queue.back().terminate)) {
+			BoshNodeBuilder builder;
+			builder.addAttribute ("xmlns", "http://jabber.org/protocol/httpbind");
+			if (queue.front().terminate) builder.addAttribute ("type", "terminate");
+			builder.addContent (sf::createByteArrayPtr (outgoing));
+			outgoing.clear ();
+			respond (queue.front().socket, builder.toString());
+			queue.pop_front ();
+		}
+	}
+
+	void respond (TCPSocket * socket, const String & body) {
+		String response = "HTTP/1.1 200 OK\r\nContent-Type: text/xml; charset=utf-8\r\nContent-Length: " + toString (body.size()) + "\r\n\r\n" + body;
+		socket->write (sf::createByteArrayPtr (response));
+	}
+
+	TCPServer server;
+	std::vector<TCPSocketPtr> sockets;
+	std::map<TCPSocket*, ByteArray> inputs;
+	std::map<int64_t, Request> waiting;	///< Requests with a RID gap before
+	std::deque<Request> queue;			///< Requests in order, not yet answered
+	String outgoing;					///< Data to echo
+
+	int hold;
+	int64_t nextRid;
+	int requestCount;
+	int maxHeld;	///< Maximum count of concurrent requests
+};
+
+/// Counts echoed messages
+struct Receiver : public DelegateBase {
+	Receiver (BoshTransport * t) : transport (t), count (0) {
+		SF_REGISTER_ME;
+		transport->changed() = dMemFun (this, &Receiver::onChanged);
+	}
+	~Receiver () {
+		SF_UNREGISTER_ME;
+	}
+	void onChanged () {
+		ByteArrayPtr data = transport->read ();
+		if (data->empty()) return;
+		// the stand-in only echoes complete stanzas
+		String received (data->const_c_array(), data->size());
+		for (size_t pos = received.find ("</m>"); pos != received.npos; pos = received.find ("</m>", pos + 1)) {
+			count++;
+		}
+		lastReceive = sf::currentTime ();
+	}
+	bool hasReceived (int n) const { return count >= n; }
+
+	BoshTransport * transport;
+	int count;
+	sf::Time lastReceive;
+};
+
+static Error connect (BoshStandIn & standIn, BoshTransport & transport, int hold) {
+	BoshTransport::StringMap args;
+	args["to"] = "localhost";
+	args["hold"] = toString (hold);
+	ResultCallbackHelper helper;
+	transport.connect (standIn.url(), args, 5000, helper.onResultFunc());
+	return helper.wait (5000);
+}
+
+static String message (int i, size_t size) {
+	return "<m id='" + toString (i) + "'>" + String (size, 'x') + "</m>";
+}
+
+/// Sequential round trips
+int testLatency (int hold) {
+	BoshStandIn standIn;
+	tcheck1 (standIn.start());
+	BoshTransport transport;
+	Receiver receiver (&transport);
+	tcheck1 (!connect (standIn, transport, hold));
+	tcheck1 (transport.hold() == hold);
+	tcheck1 (transport.requests() == hold + 1);
+
+	const int rounds = 50;
+	double sum = 0;
+	double maxLatency = 0;
+	for (int i = 0; i < rounds; i++) {
+		Time start = sf::currentTime ();
+		tcheck1 (!transport.write (sf::createByteArrayPtr (message (i, 16))));
+		tcheck1 (test::waitUntilTrueMs (sf::bind (&Receiver::hasReceived, &receiver, i + 1), 5000));
+		double ms = (receiver.lastReceive - start).total_microseconds() / 1000.0;
+		sum += ms;
+		maxLatency = std::max (maxLatency, ms);
+	}
+	std::cout << "BOSH hold=" << hold << " latency: avg " << (sum / rounds) << "ms, max " << maxLatency << "ms, "
+			<< standIn.requestCount << " requests" << std::endl;
+	tcheck1 (standIn.maxHeld <= transport.requests());
+	tcheck1 (sum / rounds < 100);
+	return 0;
+}
+
+/// Many stanzas in a row
+int testThroughput (int hold) {
+	BoshStandIn standIn;
+	tcheck1 (standIn.start());
+	BoshTransport transport;
+	Receiver receiver (&transport);
+	tcheck1 (!connect (standIn, transport, hold));
+
+	const int count = 2000;
+	const size_t size = 1024;
+	Time start = sf::currentTime ();
+	ResultCallbackHelper lastWritten;
+	for (int i = 0; i < count; i++) {
+		tcheck1 (!transport.write (sf::createByteArrayPtr (message (i, size)), i == count - 1 ? lastWritten.onResultFunc() : ResultCallback()));
+	}
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Receiver::hasReceived, &receiver, count), 30000));
+	tcheck1 (!lastWritten.wait (1000));
+	double seconds = (receiver.lastReceive - start).total_microseconds() / 1000000.0;
+	std::cout << "BOSH hold=" << hold << " throughput: " << (count / seconds) << " stanzas/s, "
+			<< (count * size / seconds / 1024.0 / 1024.0) << "MB/s in " << standIn.requestCount << " requests" << std::endl;
+	tcheck (standIn.requestCount < count / 10, "Stanzas should be batched");
+	tcheck1 (standIn.maxHeld <= transport.requests());
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testLatency(1));
+	testcase (testLatency(2));
+	testcase (testThroughput(1));
+	testcase (testThroughput(2));
+	testcase_end();
+	return ret;
+}
@@ -0,0 +1,174 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/LocalChannel.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+#include <schnee/im/xmpp/XMPPClient.h>
+#include <schnee/p2p/channels/IMDispatcher.h>
+
+/*
+ * @file
+ * Benchmarks presence processing of XMPPClient and IMDispatcher with a synthetic
+ * roster of 5000 contacts, fed by a scripted server over a LocalChannel.
+ * Checks that presence bursts are coalesced and that the incremental peer changes
+ * are consistent with the full host list. A full roster reload has to drop
+ * the removed contacts.
+ */
+using namespace sf;
+
+static const int gContacts = 5000;
+
+/// Drains the server side of the channel
+struct Drain : public DelegateBase {
+	Drain (ChannelPtr c) : channel (c), opened (false) {
+		SF_REGISTER_ME;
+		channel->changed() = dMemFun (this, &Drain::onChanged);
+	}
+	~Drain () {
+		SF_UNREGISTER_ME;
+	}
+	void onChanged () {
+		ByteArrayPtr data = channel->read ();
+		if (!opened) opened = String (data->const_c_array(), data->size()).find ("<stream:stream") != String::npos;
+	}
+	bool isOpened () const { return opened; }
+	ChannelPtr channel;
+	bool opened;
+};
+
+/// Follows the peer list only through incremental changes
+struct Tracker : public DelegateBase {
+	Tracker () : signals (0) { SF_REGISTER_ME; }
+	~Tracker () { SF_UNREGISTER_ME; }
+	void onPeersChange (const PresenceManagement::PeersChange & change) {
+		signals++;
+		for (HostSet::const_iterator i = change.online.begin(); i != change.online.end(); i++) hosts.insert (*i);
+		for (HostSet::const_iterator i = change.offline.begin(); i != change.offline.end(); i++) hosts.erase (*i);
+		for (std::set<UserId>::const_iterator i = change.users.begin(); i != change.users.end(); i++) users.insert (*i);
+		for (std::set<UserId>::const_iterator i = change.removedUsers.begin(); i != change.removedUsers.end(); i++) users.erase (*i);
+	}
+	bool hasHosts (size_t n) const { return hosts.size() == n; }
+	bool hasUsers (size_t n) const { return users.size() == n; }
+
+	int signals;
+	HostSet hosts;
+	std::set<UserId> users;
+};
+
+static String contact (int i) {
+	return "contact" + toString (i) + "@example.com";
+}
+
+/// Writes n presences in chunks like they would arrive from the network
+static void sendPresences (ChannelPtr server, int n, bool available) {
+	String chunk;
+	for (int i = 0; i < n; i++) {
+		if (available) {
+			chunk += "<presence from='" + contact (i) + "/schneeflocke' to='me@example.com/test'><show>chat</show><priority>5</priority></presence>";
+		} else {
+			chunk += "<presence from='" + contact (i) + "/schneeflocke' to='me@example.com/test' type='unavailable'/>";
+		}
+		if (i % 100 == 99 || i == n - 1) {
+			server->write (sf::createByteArrayPtr (chunk));
+			chunk.clear();
+		}
+	}
+}
+
+/// Runs the roster and presence burst
+/// @param batchMs presence batching window of XMPPClient
+/// @param incremental if false the dispatcher uses the old full roster copy on every change
+int benchmark (int n, int batchMs, bool incremental) {
+	test::LocalChannelPtr a (new test::LocalChannel);
+	test::LocalChannelPtr b (new test::LocalChannel);
+	test::LocalChannel::bindChannels (*a, *b);
+	Drain drain (b);
+
+	shared_ptr<XMPPStream> stream (new XMPPStream);
+	stream->setInfo ("me@example.com", "example.com");
+	ResultCallbackHelper helper;
+	tcheck1 (!stream->startInit (a, helper.onResultFunc()));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Drain::isOpened, &drain), 1000));
+	b->write (sf::createByteArrayPtr ("<?xml version='1.0'?><stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams' from='example.com' id='s1' version='1.0'><stream:features/>"));
+	tcheck1 (!helper.wait (1000));
+
+	XMPPClient * client = new XMPPClient ();
+	client->setConnectionString ("xmpp://me@example.com/test");
+	client->setPresenceBatching (batchMs);
+	IMDispatcher dispatcher;
+	dispatcher.setClient (client);
+	if (!incremental) client->contactRosterChange()->clear();
+	Tracker tracker;
+	dispatcher.peersChange().add (dMemFun (&tracker, &Tracker::onPeersChange));
+	tcheck1 (!client->attachStream (stream));
+
+	// roster
+	String roster = "<iq type='set' id='push1'><query xmlns='jabber:iq:roster'>";
+	for (int i = 0; i < n; i++) {
+		roster += "<item jid='" + contact (i) + "' name='Contact " + toString (i) + "' subscription='both'/>";
+	}
+	roster += "</query></iq>";
+	b->write (sf::createByteArrayPtr (roster));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Tracker::hasUsers, &tracker, n), 10000));
+	tcheck1 (dispatcher.users().size() == (size_t) n);
+
+	// everyone comes online
+	int signalsBefore = tracker.signals;
+	double t0 = sf::microtime ();
+	sendPresences (b, n, true);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Tracker::hasHosts, &tracker, n), 120000));
+	double online = sf::microtime () - t0;
+	int onlineSignals = tracker.signals - signalsBefore;
+
+	PresenceManagement::HostInfoMap hosts = dispatcher.hosts();
+	tcheck1 (hosts.size() == (size_t) n);
+	for (PresenceManagement::HostInfoMap::const_iterator i = hosts.begin(); i != hosts.end(); i++) {
+		tcheck1 (tracker.hosts.count (i->first) > 0);
+	}
+	tcheck1 (dispatcher.hosts (contact (7)).size() == 1);
+	tcheck1 (dispatcher.onlineState (contact (7) + "/schneeflocke") == OS_ONLINE);
+
+	// everyone leaves
+	signalsBefore = tracker.signals;
+	t0 = sf::microtime ();
+	sendPresences (b, n, false);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Tracker::hasHosts, &tracker, 0), 120000));
+	double offline = sf::microtime () - t0;
+	int offlineSignals = tracker.signals - signalsBefore;
+	tcheck1 (dispatcher.hosts().empty());
+	tcheck1 (dispatcher.users().size() == (size_t) n);
+
+	// full reload without the second half of the contacts
+	String reload = "<iq type='result' id='reload1'><query xmlns='jabber:iq:roster'>";
+	for (int i = 0; i < n / 2; i++) {
+		reload += "<item jid='" + contact (i) + "' name='Contact " + toString (i) + "' subscription='both'/>";
+	}
+	reload += "</query></iq>";
+	b->write (sf::createByteArrayPtr (reload));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Tracker::hasUsers, &tracker, n / 2), 10000));
+	tcheck1 (dispatcher.users().size() == (size_t) (n / 2));
+	tcheck1 (dispatcher.users().count (contact (n - 1)) == 0);
+
+	std::cout << n << " contacts, batching " << batchMs << "ms, " << (incremental ? "incremental" : "full copy") << ": "
+			<< "online " << online << "s (" << onlineSignals << " changes), "
+			<< "offline " << offline << "s (" << offlineSignals << " changes)" << std::endl;
+	if (batchMs > 0) {
+		// bursts are coalesced
+		tcheck1 (onlineSignals  < n / 10);
+		tcheck1 (offlineSignals < n / 10);
+	}
+	dispatcher.peersChange().clear();
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (benchmark (500, 0, false)); // old behaviour, full roster copy per presence
+	testcase (benchmark (gContacts, 0, true));
+	testcase (benchmark (gContacts, 50, true));
+	testcase_end();
+	return ret;
+}
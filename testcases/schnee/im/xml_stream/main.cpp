@@ -16,8 +16,8 @@ struct Collector {
 		stream.stateChange () = memFun (this, &Collector::onStateChange);
 	}
 
-	void onChunk (const XMLChunk & chunk) {
-		received.push_back (chunk);
+	void onChunk (const XMLView & chunk) {
+		received.push_back (chunk.toChunk());
 	}
 
 	void onStateChange () {
@@ -73,6 +73,51 @@ int whiteSpaces () {
 	return 0;
 }
 
+static void startStream (Collector & c) {
+	c.write ("<?xml version='1.0'?><stream:stream xmlns:stream='http://etherx.jabber.org/streams'>");
+}
+
+int fragmented () {
+	Collector c;
+	startStream (c);
+	tcheck1 (c.state() == XMLStreamDecoder::XS_ReadOpener);
+	// a large stanza arriving in small pieces
+	String body (256 * 1024, 'A');
+	String stanza = "<message to='a@b' id=\"x>\"><body>BNRY" + body + "</body></message>";
+	for (size_t i = 0; i < stanza.size(); i += 7) {
+		c.write (stanza.substr (i, 7));
+	}
+	tcheck1 (c.received.size() == 1 && c.received[0].name() == "message");
+	tcheck1 (c.received[0].getChildText("body") == "BNRY" + body);
+	// byte by byte, including comments and quotes
+	String second = "<iq type='get'><!-- <x> --><q a=\"'\"/><![CDATA[<y>]]></iq>";
+	for (size_t i = 0; i < second.size(); i++){
+		c.write (second.substr (i, 1));
+	}
+	tcheck1 (c.received.size() == 2 && c.received[1].name() == "iq");
+	c.write ("</stream:stream>");
+	tcheck1 (c.state() == XMLStreamDecoder::XS_Closed);
+	return 0;
+}
+
+int textContent () {
+	Collector c;
+	startStream (c);
+	// quotes in text are no attribute values
+	c.write ("<message><body>Don't do it</body></message>  \n ");
+	tcheck1 (c.received.size() == 1);
+	c.write ("<message><body>\"quoted\" 3 > 2</body></message>");
+	tcheck1 (c.received.size() == 2 && c.received[1].getChildText("body") == "\"quoted\" 3 > 2");
+	// many stanzas in one piece
+	String many;
+	for (int i = 0; i < 100; i++) many += "<presence/> ";
+	c.write (many);
+	tcheck1 (c.received.size() == 102);
+	c.write (" ");  // white space keep alive
+	tcheck1 (c.state() == XMLStreamDecoder::XS_ReadOpener);
+	return 0;
+}
+
 int main (int argc, char * argv[]){
 	sf::schnee::SchneeApp app (argc, argv);
 	SF_SCHNEE_LOCK;
@@ -80,5 +125,7 @@ int main (int argc, char * argv[]){
 	testcase (validStart());
 	testcase (strangeProtocol());
 	testcase (whiteSpaces());
+	testcase (fragmented());
+	testcase (textContent());
 	testcase_end();
 }
@@ -0,0 +1,145 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/timing.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+
+#include <schnee/net/TCPSocket.h>
+#include <boost/asio.hpp>
+
+/*
+ * @file
+ * Tests parallel connection attempts of TCPSocket::connectToHosts.
+ * Uses 127.0.0.2 as a dead address: its listening socket has a full backlog,
+ * so that SYNs are dropped and a connect hangs until it times out.
+ * Acceptors are plain asio sockets, a connect succeeds without accepting.
+ */
+using namespace sf;
+using boost::asio::ip::tcp;
+
+/// Good server on 127.0.0.1, dead one on 127.0.0.2 (same port)
+struct Servers {
+	Servers () : good (service), dead (service), filler (service) {
+		good.open (tcp::v4());
+		good.bind (tcp::endpoint (boost::asio::ip::address::from_string ("127.0.0.1"), 0));
+		good.listen ();
+		port = good.local_endpoint().port();
+		dead.open (tcp::v4());
+		dead.bind (tcp::endpoint (boost::asio::ip::address::from_string ("127.0.0.2"), port));
+		dead.listen (0);
+		filler.connect (dead.local_endpoint()); // fills the backlog
+	}
+	boost::asio::io_service service;
+	tcp::acceptor good;
+	tcp::acceptor dead;
+	tcp::socket filler;
+	int port;
+};
+
+static std::vector<String> hosts (const char * a, const char * b = 0) {
+	std::vector<String> result;
+	result.push_back (a);
+	if (b) result.push_back (b);
+	return result;
+}
+
+/// Time of a connect in ms
+static int connect (TCPSocket & socket, const std::vector<String> & hosts, int port, Error * result) {
+	ResultCallbackHelper helper;
+	double t0 = microtime ();
+	tcheck1 (!socket.connectToHosts (hosts, port, 5000, helper.onResultFunc()));
+	*result = helper.wait (10000);
+	return (int) ((microtime () - t0) * 1000);
+}
+
+int testDeadFirst () {
+	Servers servers;
+	TCPSocket socket;
+	Error result;
+	int ms = connect (socket, hosts ("127.0.0.2", "127.0.0.1"), servers.port, &result);
+	tcheck1 (!result);
+	tcheck1 (socket.isConnected());
+	tcheck1 (ms < 1000); // connect attempt delay, not the timeout
+	tcheck1 (socket.info().raddress == "127.0.0.1:" + toString (servers.port));
+
+	// the winning socket is the one used
+	tcp::socket other (servers.service);
+	servers.good.accept (other);
+	ResultCallbackHelper helper;
+	tcheck1 (!socket.write (createByteArrayPtr ("hello"), helper.onResultFunc()));
+	tcheck1 (!helper.wait ());
+	char buffer[5];
+	boost::asio::read (other, boost::asio::buffer (buffer, 5));
+	tcheck1 (String (buffer, 5) == "hello");
+	return 0;
+}
+
+int testFailingFirst () {
+	Servers servers;
+	TCPSocket socket;
+	socket.setConnectAttemptDelay (4000);
+	Error result;
+	// nothing listens on 127.0.0.3, the refused attempt starts the next one at once
+	int ms = connect (socket, hosts ("127.0.0.3", "127.0.0.1"), servers.port, &result);
+	tcheck1 (!result);
+	tcheck1 (ms < 1000);
+	return 0;
+}
+
+int testAllFailing () {
+	Servers servers;
+	TCPSocket socket;
+	Error result;
+	int ms = connect (socket, hosts ("127.0.0.3", "127.0.0.4"), servers.port, &result);
+	tcheck1 (result == error::CouldNotConnectHost);
+	tcheck1 (!socket.isConnected());
+	tcheck1 (ms < 1000);
+	return 0;
+}
+
+int testLateEndpoints () {
+	Servers servers;
+	TCPSocket socket;
+	// the attempt timer fires before localhost is resolved, its endpoints must be tried nevertheless
+	socket.setConnectAttemptDelay (1);
+	Error result;
+	int ms = connect (socket, hosts ("127.0.0.2", "localhost"), servers.port, &result);
+	tcheck1 (!result);
+	tcheck1 (ms < 1000);
+	return 0;
+}
+
+int testTimeOut () {
+	Servers servers;
+	TCPSocket socket;
+	ResultCallbackHelper helper;
+	tcheck1 (!socket.connectToHosts (hosts ("127.0.0.2", "127.0.0.2"), servers.port, 500, helper.onResultFunc()));
+	tcheck1 (helper.wait (5000) == error::TimeOut);
+	return 0;
+}
+
+int testDeleteWhileConnecting () {
+	Servers servers;
+	TCPSocket * socket = new TCPSocket ();
+	socket->setConnectAttemptDelay (50);
+	ResultCallbackHelper helper;
+	tcheck1 (!socket->connectToHosts (hosts ("127.0.0.2", "localhost"), servers.port, 5000, helper.onResultFunc()));
+	test::millisleep_locked (20);
+	delete socket; // running attempts must be canceled cleanly
+	test::millisleep_locked (200);
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testDeadFirst());
+	testcase (testFailingFirst());
+	testcase (testAllFailing());
+	testcase (testLateEndpoints());
+	testcase (testTimeOut());
+	testcase (testDeleteWhileConnecting());
+	testcase_end();
+	return ret;
+}
@@ -0,0 +1,162 @@
+#include <schnee/test/test.h>
+#include <schnee/schnee.h>
+#include <schnee/net/http/impl/HttpResponseParser.h>
+#include <schnee/tools/async/ABind.h>
+#include <zlib.h>
+#include <stdlib.h>
+
+/*
+ * @file
+ * Tests the HttpResponseParser with fragmented input, chunked transfer,
+ * gzip/deflate content encoding and the streaming mode.
+ */
+using namespace sf;
+
+static String randomText (size_t len) {
+	String result (len, ' ');
+	for (size_t i = 0; i < len; i++) {
+		result[i] = "abcdefgh <>/\n"[rand() % 13];
+	}
+	return result;
+}
+
+/// Compresses data; windowBits: 15 zlib, 31 gzip, -15 raw deflate
+static String compress (const String & data, int windowBits) {
+	z_stream z;
+	memset (&z, 0, sizeof (z));
+	deflateInit2 (&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+	String result (deflateBound (&z, data.size()) + 32, '\0');
+	z.next_in   = (Bytef*) data.data();
+	z.avail_in  = data.size();
+	z.next_out  = (Bytef*) &result[0];
+	z.avail_out = result.size();
+	deflate (&z, Z_FINISH);
+	result.resize (z.total_out);
+	deflateEnd (&z);
+	return result;
+}
+
+static String chunked (const String & data, size_t chunkSize) {
+	String result;
+	for (size_t i = 0; i < data.size(); i += chunkSize) {
+		size_t l = std::min (chunkSize, data.size() - i);
+		char buf[16];
+		sprintf (buf, "%x", (unsigned int) l);
+		result += String (buf) + "\r\n" + data.substr (i, l) + "\r\n";
+	}
+	return result + "0\r\n\r\n";
+}
+
+static String response (const String & body, const String & encoding, bool chunkedTransfer) {
+	String result = "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\n";
+	if (!encoding.empty()) result += "Content-Encoding: " + encoding + "\r\n";
+	if (chunkedTransfer) {
+		return result + "Transfer-Encoding: chunked\r\n\r\n" + chunked (body, 1000);
+	}
+	return result + "Content-Length: " + toString (body.size()) + "\r\n\r\n" + body;
+}
+
+/// Pushes data in pieces of step bytes
+static void pushAll (HttpResponseParser & parser, const String & data, size_t step) {
+	for (size_t i = 0; i < data.size() && !parser.ready(); i += step) {
+		parser.push (ByteArray (data.c_str() + i, std::min (step, data.size() - i)));
+	}
+}
+
+static void collect (const char * data, size_t len, String * target) {
+	target->append (data, len);
+}
+
+int testPlain () {
+	String body = randomText (10000);
+	size_t steps[] = { 1, 7, 1000, 100000 };
+	for (int chunkedTransfer = 0; chunkedTransfer < 2; chunkedTransfer++) {
+		for (int i = 0; i < 4; i++) {
+			HttpResponsePtr r (new HttpResponse);
+			HttpResponseParser parser;
+			parser.setDestination (r);
+			pushAll (parser, response (body, "", chunkedTransfer), steps[i]);
+			tcheck1 (parser.ready() && !parser.result());
+			tcheck1 (r->resultCode == 200);
+			tcheck1 (r->headers["Content-Type"] == "text/xml");
+			tcheck1 (r->data && String (r->data->const_c_array(), r->data->size()) == body);
+		}
+	}
+	return 0;
+}
+
+int testEncodings () {
+	String body = randomText (50000);
+	struct { const char * name; int windowBits; } encodings [] = { { "gzip", 31 }, { "deflate", 15 }, { "deflate", -15 } };
+	for (int chunkedTransfer = 0; chunkedTransfer < 2; chunkedTransfer++) {
+		for (int i = 0; i < 3; i++) {
+			String encoded = compress (body, encodings[i].windowBits);
+			tcheck1 (encoded.size() < body.size());
+			HttpResponsePtr r (new HttpResponse);
+			HttpResponseParser parser;
+			parser.setDestination (r);
+			pushAll (parser, response (encoded, encodings[i].name, chunkedTransfer), 1400);
+			tcheck (parser.ready() && !parser.result(), encodings[i].name);
+			tcheck (r->data && String (r->data->const_c_array(), r->data->size()) == body, encodings[i].name);
+		}
+	}
+	// unknown encoding
+	HttpResponsePtr r (new HttpResponse);
+	HttpResponseParser parser;
+	parser.setDestination (r);
+	pushAll (parser, response ("bla", "br", false), 100);
+	tcheck1 (parser.ready() && parser.result() == error::NotSupported);
+	return 0;
+}
+
+int testStreaming () {
+	String body = randomText (100000);
+	String encoded = compress (body, 31);
+	for (int compressed = 0; compressed < 2; compressed++) {
+		HttpResponsePtr r (new HttpResponse);
+		HttpResponseParser parser;
+		String received;
+		parser.setDestination (r);
+		parser.setConsumer (abind (&collect, &received));
+		String data = compressed ? response (encoded, "gzip", true) : response (body, "", false);
+		size_t half = data.size() / 2;
+		parser.push (ByteArray (data.c_str(), half));
+		tcheck (!parser.ready() && !received.empty(), "Should deliver before the end");
+		parser.push (ByteArray (data.c_str() + half, data.size() - half));
+		tcheck1 (parser.ready() && !parser.result());
+		tcheck1 (!r->data);
+		tcheck1 (received == body);
+	}
+	return 0;
+}
+
+int testFollowing () {
+	// data of the next response stays in the input buffer
+	String first  = response ("Hello", "", false);
+	String second = "HTTP/1.1 200 OK\r\n";
+	HttpResponsePtr r (new HttpResponse);
+	HttpResponseParser parser;
+	parser.setDestination (r);
+	parser.push (ByteArray (first + second));
+	tcheck1 (parser.ready() && !parser.result());
+	tcheck1 (String (r->data->const_c_array(), r->data->size()) == "Hello");
+	tcheck1 (String (parser.inputBuffer().const_c_array(), parser.inputBuffer().size()) == second);
+
+	// 100 continue
+	HttpResponsePtr r2 (new HttpResponse);
+	HttpResponseParser parser2;
+	parser2.setDestination (r2);
+	parser2.push (ByteArray ("HTTP/1.1 100 Continue\r\n\r\n" + first));
+	tcheck1 (parser2.ready() && !parser2.result() && r2->resultCode == 200);
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	testcase_start();
+	testcase (testPlain());
+	testcase (testEncodings());
+	testcase (testStreaming());
+	testcase (testFollowing());
+	testcase_end();
+}
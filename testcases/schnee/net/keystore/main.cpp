@@ -0,0 +1,162 @@
+#include <schnee/schnee.h>
+#include <schnee/settings.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/test/LocalChannel.h>
+#include <schnee/net/KeyStore.h>
+#include <schnee/net/TLSChannel.h>
+#include <schnee/p2p/Authentication.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+#include <boost/filesystem.hpp>
+
+/*
+ * @file
+ * Tests the persistent key store and benchmarks the startup cost of Authentication::setIdentity
+ * with and without stored keys, for all key types.
+ */
+using namespace sf;
+
+static const char * gDirectory = "keystore_test";
+
+/// Sets identity on a fresh Authentication (like on program start), returns time in ms
+static double startup (const String & identity, String * fingerprint) {
+	Authentication auth;
+	double t0 = sf::microtime ();
+	auth.setIdentity (identity);
+	double t1 = sf::microtime ();
+	*fingerprint = auth.certFingerprint();
+	return (t1 - t0) * 1000.0;
+}
+
+/// Handshake with the stored key
+static int handshake (const Authentication & auth) {
+	test::LocalChannelPtr a (new test::LocalChannel());
+	test::LocalChannelPtr b (new test::LocalChannel());
+	test::LocalChannel::bindChannels (*a, *b);
+	TLSChannel client (a);
+	TLSChannel server (b);
+	server.setKey (auth.certificate(), auth.key());
+	client.disableAuthentication();
+	ResultCallbackHelper clientHelper;
+	ResultCallbackHelper serverHelper;
+	client.clientHandshake (TLSChannel::X509, "", clientHelper.onResultFunc());
+	server.serverHandshake (TLSChannel::X509, serverHelper.onResultFunc());
+	tcheck1 (clientHelper.wait() == NoError);
+	tcheck1 (serverHelper.wait() == NoError);
+	x509::CertificatePtr peerCert = client.peerCertificate();
+	tcheck1 (peerCert);
+	String fp;
+	peerCert->fingerprintSha256 (&fp);
+	tcheck1 (fp == auth.certFingerprint());
+	return 0;
+}
+
+int keyTypeTest (const String & type) {
+	boost::filesystem::remove_all (gDirectory);
+	schnee::setKeyStore (gDirectory);
+	schnee::setKeyType (type);
+
+	String fp1, fp2, fp3;
+	double generation = startup ("alice@example.com/test", &fp1);
+	double loading    = startup ("alice@example.com/test", &fp2);
+	std::cout << type << ": generation " << generation << "ms, loading " << loading << "ms" << std::endl;
+	tcheck1 (!fp1.empty());
+	tcheck1 (fp1 == fp2);
+
+	x509::KeyType keyType;
+	tcheck1 (x509::fromString (type, &keyType));
+	Authentication auth;
+	auth.setIdentity ("alice@example.com/test");
+	x509::KeyType storedType;
+	tcheck1 (auth.key()->type (&storedType) == 0);
+	tcheck1 (storedType == keyType);
+	tcheck1 (handshake (auth) == 0);
+
+	// other identity gets a new key
+	startup ("bob@example.com/test", &fp3);
+	tcheck1 (fp3 != fp1);
+	return 0;
+}
+
+int keyTypeChangeTest () {
+	boost::filesystem::remove_all (gDirectory);
+	schnee::setKeyStore (gDirectory);
+	schnee::setKeyType ("rsa");
+	String fp1, fp2;
+	startup ("alice@example.com/test", &fp1);
+	schnee::setKeyType ("ecdsa");
+	startup ("alice@example.com/test", &fp2);
+	tcheck1 (fp1 != fp2);
+	return 0;
+}
+
+int fallbackTypeTest () {
+	boost::filesystem::remove_all (gDirectory);
+	KeyStore store (gDirectory);
+	// an rsa key generated as ed25519 could not be generated
+	x509::PrivateKeyPtr  key;
+	x509::CertificatePtr cert;
+	test::createIdentity (key, cert, "alice@example.com/test");
+	tcheck1 (!store.saveIdentity (key, cert, x509::KT_ED25519));
+	x509::PrivateKeyPtr  loadedKey;
+	x509::CertificatePtr loadedCert;
+	tcheck1 (!store.loadIdentity ("alice@example.com/test", x509::KT_ED25519, &loadedKey, &loadedCert));
+	String a, b;
+	cert->fingerprintSha256 (&a);
+	loadedCert->fingerprintSha256 (&b);
+	tcheck1 (a == b);
+	// other requested types still get a new key
+	tcheck1 (store.loadIdentity ("alice@example.com/test", x509::KT_RSA, &loadedKey, &loadedCert) == error::NotFound);
+	tcheck1 (store.loadIdentity ("alice@example.com/test", x509::KT_ECDSA, &loadedKey, &loadedCert) == error::NotFound);
+	return 0;
+}
+
+int noStoreTest () {
+	schnee::setKeyStore ("");
+	schnee::setKeyType ("rsa");
+	String fp1, fp2;
+	startup ("alice@example.com/test", &fp1);
+	startup ("alice@example.com/test", &fp2);
+	tcheck1 (fp1 != fp2);
+	return 0;
+}
+
+int dhParamsTest () {
+	boost::filesystem::remove_all (gDirectory);
+	KeyStore store (gDirectory);
+	x509::DhParamsPtr params;
+	tcheck1 (store.loadDhParams (1024, &params) == error::NotFound);
+	params = x509::DhParamsPtr (new x509::DhParams());
+	double t0 = sf::microtime ();
+	tcheck1 (params->generate (1024) == 0);
+	double t1 = sf::microtime ();
+	tcheck1 (!store.saveDhParams (1024, params));
+	x509::DhParamsPtr loaded;
+	tcheck1 (!store.loadDhParams (1024, &loaded));
+	double t2 = sf::microtime ();
+	String a, b;
+	tcheck1 (params->textExport (&a) == 0);
+	tcheck1 (loaded->textExport (&b) == 0);
+	tcheck1 (a == b);
+	std::cout << "DH parameters: generation " << (t1 - t0) * 1000.0 << "ms, loading " << (t2 - t1) * 1000.0 << "ms" << std::endl;
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (keyTypeTest ("rsa"));
+	testcase (keyTypeTest ("ecdsa"));
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+	testcase (keyTypeTest ("ed25519"));
+#endif
+	testcase (keyTypeChangeTest());
+	testcase (fallbackTypeTest());
+	testcase (noStoreTest());
+	testcase (dhParamsTest());
+	boost::filesystem::remove_all (gDirectory);
+	testcase_end();
+	return ret;
+}
@@ -0,0 +1,145 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/net/TCPServer.h>
+#include <schnee/net/TCPSocket.h>
+#include <schnee/net/TLSChannel.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+
+/*
+ * @file
+ * Tests kernel TLS (kTLS) for sending over TCP and benchmarks loopback throughput
+ * with and without it. Without kernel support the fallback to GnuTLS is tested.
+ */
+using namespace sf;
+
+static x509::PrivateKeyPtr  gKey;
+static x509::CertificatePtr gCert;
+
+/// Byte at position pos of the transferred stream
+static char pattern (size_t pos) {
+	return (char) (pos % 251);
+}
+
+/// Accepts one TLS connection and checks the received stream
+struct Server : public DelegateBase {
+	Server () : received (0), corrupt (false), handshaked (false) {
+		SF_REGISTER_ME;
+		server.newConnection() = dMemFun (this, &Server::onNewConnection);
+	}
+	~Server () {
+		SF_UNREGISTER_ME;
+		if (channel) channel->changed() = VoidDelegate ();
+	}
+	void onNewConnection () {
+		TCPSocketPtr socket = server.nextPendingConnection();
+		if (!socket) return;
+		channel = TLSChannelPtr (new TLSChannel (socket));
+		channel->setKey (gCert, gKey);
+		channel->changed() = dMemFun (this, &Server::onChanged);
+		channel->serverHandshake (TLSChannel::X509, dMemFun (this, &Server::onHandshake));
+	}
+	void onHandshake (Error result) {
+		handshaked = !result;
+	}
+	void onChanged () {
+		if (!handshaked) return;
+		ByteArrayPtr data;
+		while ((data = channel->read()) && !data->empty()) {
+			for (size_t i = 0; i < data->size(); i++) {
+				if ((*data)[i] != pattern (received + i)) corrupt = true;
+			}
+			received += data->size();
+		}
+	}
+	bool has (size_t size) {
+		onChanged ();
+		return received >= size || corrupt;
+	}
+	TCPServer server;
+	TLSChannelPtr channel;
+	size_t received;
+	bool corrupt;
+	bool handshaked;
+};
+
+/// Writes blocks with a window of outstanding writes
+struct Sender : public DelegateBase {
+	Sender (TLSChannelPtr c, size_t t) : channel (c), total (t), sent (0), error (NoError) {
+		SF_REGISTER_ME;
+	}
+	~Sender () {
+		SF_UNREGISTER_ME;
+	}
+	void start () {
+		for (int i = 0; i < 4; i++) sendNext ();
+	}
+	void sendNext () {
+		if (sent >= total || error) return;
+		const size_t blockSize = 1048576;
+		size_t size = std::min (blockSize, total - sent);
+		ByteArrayPtr block (new ByteArray (size, 0));
+		for (size_t i = 0; i < size; i++) (*block)[i] = pattern (sent + i);
+		sent += size;
+		Error e = channel->write (block, dMemFun (this, &Sender::onWritten));
+		if (e) error = e;
+	}
+	void onWritten (Error e) {
+		if (e) error = e;
+		sendNext ();
+	}
+	TLSChannelPtr channel;
+	size_t total;
+	size_t sent;
+	Error error;
+};
+
+/// Transfers total bytes over loopback
+/// @param kernelTls out: whether kTLS was used
+/// @return throughput in MB/s, < 0 on error
+static double transfer (bool useKernelTls, size_t total, bool * kernelTls) {
+	Server server;
+	if (!server.server.listen()) return -1;
+	TCPSocketPtr socket (new TCPSocket());
+	ResultCallbackHelper helper;
+	socket->connectToHost ("127.0.0.1", server.server.serverPort(), 5000, helper.onResultFunc());
+	if (helper.wait()) return -1;
+	TLSChannelPtr channel (new TLSChannel (socket));
+	channel->disableAuthentication();
+	if (useKernelTls) channel->enableKernelTls ();
+	if (channel->clientHandshake (TLSChannel::X509, "", helper.onResultFunc())) return -1;
+	if (helper.wait()) return -1;
+
+	Sender sender (channel, total);
+	double t0 = sf::microtime ();
+	sender.start ();
+	if (!test::waitUntilTrueMs (sf::bind (&Server::has, &server, total), 120000)) return -1;
+	double t1 = sf::microtime ();
+	if (server.corrupt || sender.error || server.received != total) return -1;
+	*kernelTls = channel->kernelTls();
+	return total / (1024.0 * 1024.0) / (t1 - t0);
+}
+
+int benchmark () {
+	const size_t total = 64 * 1024 * 1024;
+	bool kernelTls = true;
+	double userRate = transfer (false, total, &kernelTls);
+	tcheck1 (userRate > 0);
+	tcheck1 (!kernelTls);
+	double kernelRate = transfer (true, total, &kernelTls);
+	tcheck1 (kernelRate > 0);
+	std::cout << "Loopback TLS throughput: GnuTLS " << userRate << " MB/s, "
+			<< (kernelTls ? "kernel TLS " : "kernel TLS not available, fallback ") << kernelRate << " MB/s" << std::endl;
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	test::createIdentity (gKey, gCert);
+	testcase_start();
+	testcase (benchmark());
+	testcase_end();
+	return ret;
+}
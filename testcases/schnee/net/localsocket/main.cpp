@@ -0,0 +1,298 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/net/LocalServer.h>
+#include <schnee/net/TCPServer.h>
+#include <schnee/net/TLSChannel.h>
+#include <schnee/p2p/channels/LocalChannelConnector.h>
+#include <schnee/p2p/Authentication.h>
+#include <schnee/tools/FileTools.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * @file
+ * Tests LocalSocket / LocalServer and the setup of LocalChannelConnector,
+ * also authenticating peers over TLS.
+ * Benchmarks local sockets against the TCP + TLS path
+ * which peers on the same host use otherwise.
+ */
+using namespace sf;
+
+static const char * gPath = "/tmp/schnee_localsocket_test.sock";
+
+/// Collects everything a channel receives, checks the first byte of each piece
+struct Receiver : public DelegateBase {
+	Receiver (ChannelPtr c) : channel (c), received (0), corrupt (false) {
+		SF_REGISTER_ME;
+		channel->changed() = dMemFun (this, &Receiver::onChanged);
+	}
+	~Receiver () {
+		SF_UNREGISTER_ME;
+		channel->changed() = VoidDelegate ();
+	}
+	void onChanged () {
+		ByteArrayPtr data;
+		while ((data = channel->read ()) && !data->empty()) {
+			if ((*data)[0] != (char) (received % 251)) corrupt = true;
+			received += data->size();
+		}
+	}
+	bool has (size_t size) {
+		onChanged ();
+		return received >= size;
+	}
+	ChannelPtr channel;
+	size_t received;
+	bool corrupt;
+};
+
+/// Connects a LocalSocket to a LocalServer
+static int connectLocal (LocalServer & server, LocalSocketPtr * client, LocalSocketPtr * accepted) {
+	ResultCallbackHelper helper;
+	*client = LocalSocketPtr (new LocalSocket());
+	tcheck1 (!(*client)->connectToPath (gPath, helper.onResultFunc()));
+	tcheck1 (!helper.wait());
+	tcheck1 ((*client)->isConnected());
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&LocalServer::hasPendingConnections, &server), 1000));
+	*accepted = server.nextPendingConnection();
+	tcheck1 (*accepted && (*accepted)->isConnected());
+	return 0;
+}
+
+int testConnect () {
+	LocalServer server;
+	tcheck1 (!server.listen (gPath));
+	tcheck1 (server.isListening());
+	tcheck1 (fileExists (gPath));
+
+	LocalSocketPtr client, accepted;
+	tcheck1 (connectLocal (server, &client, &accepted) == 0);
+
+	int uid = -1;
+	tcheck1 (!client->peerUserId (&uid) && uid == (int) getuid());
+	tcheck1 (!accepted->peerUserId (&uid) && uid == (int) getuid());
+	tcheck1 (client->info().toNeighbor);
+	tcheck1 (!client->info().authenticated);
+	client->setAuthenticated (true);
+	tcheck1 (client->info().authenticated);
+	tcheck1 (client->info().raddress == gPath);
+
+	// both directions
+	ResultCallbackHelper helper;
+	tcheck1 (!client->write (createByteArrayPtr ("Hello"), helper.onResultFunc()));
+	tcheck1 (!helper.wait());
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&LocalSocket::bytesAvailable, accepted.get()) == 5, 1000));
+	tcheck1 (*accepted->read() == ByteArray ("Hello"));
+	tcheck1 (!accepted->write (createByteArrayPtr ("World")));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&LocalSocket::bytesAvailable, client.get()) == 5, 1000));
+	tcheck1 (*client->read() == ByteArray ("World"));
+
+	// a living socket may not be taken over
+	LocalServer second;
+	tcheck1 (second.listen (gPath) == error::ExistsAlready);
+
+	// closing is noticed by the other side
+	client->close ();
+	tcheck1 (test::waitUntilTrueMs (!sf::bind (&LocalSocket::isConnected, accepted.get()), 1000));
+	tcheck1 (accepted->atEnd());
+
+	// socket file is removed on close, connecting fails immediately
+	server.close ();
+	tcheck1 (!fileExists (gPath));
+	LocalSocket failing;
+	tcheck1 (!failing.connectToPath (gPath, helper.onResultFunc()));
+	tcheck1 (helper.wait (1000) == error::CouldNotConnectHost);
+	tcheck1 (!failing.isConnected());
+	return 0;
+}
+
+int testConnector () {
+	String directory = "/tmp/schnee_localsocket_test_" + toString ((int) getpid());
+	LocalChannelConnector connector;
+	connector.setDirectory (directory);
+	tcheck1 (connector.createChannel ("bob", ResultCallback()) == error::NotInitialized);
+	tcheck1 (!connector.start());
+	connector.setHostId ("alice");
+	tcheck1 (connector.isListening());
+	tcheck1 (fileExists (connector.socketPath ("alice")));
+	tcheck1 (connector.socketPath ("alice") != connector.socketPath ("bob"));
+	struct stat s;
+	tcheck1 (::stat (directory.c_str(), &s) == 0 && (s.st_mode & (S_IRWXG | S_IRWXO)) == 0);
+
+	// bob is not on this host
+	tcheck1 (connector.createChannel ("bob", ResultCallback()) == error::NotFound);
+
+	connector.stop ();
+	tcheck1 (!fileExists (connector.socketPath ("alice")));
+
+	// directories others can access are not used
+	::chmod (directory.c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+	tcheck1 (connector.start() == error::NoPerm);
+	::rmdir (directory.c_str());
+	return 0;
+}
+
+/// Collects channels created by a LocalChannelConnector
+struct CreatedChannels : public DelegateBase {
+	CreatedChannels (LocalChannelConnector & connector) {
+		SF_REGISTER_ME;
+		connector.channelCreated() = dMemFun (this, &CreatedChannels::onChannelCreated);
+	}
+	~CreatedChannels () {
+		SF_UNREGISTER_ME;
+	}
+	void onChannelCreated (const HostId & target, ChannelPtr channel, bool requested) {
+		targets.push_back (target);
+		channels.push_back (channel);
+	}
+	bool has (size_t count) const { return channels.size() >= count; }
+	std::vector<HostId> targets;
+	std::vector<ChannelPtr> channels;
+};
+
+int testConnectorTls () {
+	Authentication aliceAuth, bobAuth, eveAuth;
+	aliceAuth.setIdentity ("alice");
+	bobAuth.setIdentity ("bob");
+	eveAuth.setIdentity ("eve");
+
+	// alice and bob know each other, nobody knows eve; eve knows bob
+	Authentication::CertInfo info;
+	info.type = Authentication::CT_PEER;
+	info.cert = bobAuth.certificate();
+	aliceAuth.update ("bob", info);
+	eveAuth.update ("bob", info);
+	info.cert = aliceAuth.certificate();
+	bobAuth.update ("alice", info);
+
+	String directory = "/tmp/schnee_localsocket_test_" + toString ((int) getpid());
+	LocalChannelConnector alice, bob, eve;
+	alice.setAuthentication (&aliceAuth);
+	bob.setAuthentication (&bobAuth);
+	eve.setAuthentication (&eveAuth);
+	alice.setDirectory (directory);
+	bob.setDirectory (directory);
+	eve.setDirectory (directory);
+	tcheck1 (!alice.start() && !bob.start() && !eve.start());
+	alice.setHostId ("alice");
+	bob.setHostId ("bob");
+	eve.setHostId ("eve");
+	CreatedChannels aliceChannels (alice);
+	CreatedChannels bobChannels (bob);
+
+	ResultCallbackHelper helper;
+	tcheck1 (!alice.createChannel ("bob", helper.onResultFunc(), 5000));
+	tcheck1 (!helper.wait (5000));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&CreatedChannels::has, &bobChannels, 1), 1000));
+	tcheck1 (aliceChannels.has (1) && aliceChannels.targets[0] == "bob");
+	tcheck1 (bobChannels.targets[0] == "alice");
+	Channel::ChannelInfo aliceInfo = aliceChannels.channels[0]->info();
+	Channel::ChannelInfo bobInfo   = bobChannels.channels[0]->info();
+	tcheck1 (aliceInfo.authenticated && aliceInfo.encrypted);
+	tcheck1 (bobInfo.authenticated && bobInfo.encrypted);
+
+	// eve runs as the same user, but bob doesn't know her certificate
+	ResultCallbackHelper eveHelper;
+	tcheck1 (!eve.createChannel ("bob", eveHelper.onResultFunc(), 5000));
+	tcheck1 (eveHelper.wait (5000) == error::AuthError);
+	test::millisleep_locked (100);
+	tcheck1 (bobChannels.channels.size() == 1);
+
+	// nor does alice, when eve claims to be bob
+	ResultCallbackHelper aliceHelper;
+	tcheck1 (!alice.createChannel ("eve", aliceHelper.onResultFunc(), 5000));
+	tcheck1 (aliceHelper.wait (5000) == error::AuthError);
+
+	alice.stop ();
+	bob.stop ();
+	eve.stop ();
+	::rmdir (directory.c_str());
+	return 0;
+}
+
+/// Sends blocks from a to b and measures throughput in MB/s
+static int transfer (ChannelPtr a, ChannelPtr b, size_t blockSize, int blocks, double * rate) {
+	Receiver receiver (b);
+	std::vector<ByteArrayPtr> data;
+	for (int i = 0; i < blocks; i++) {
+		ByteArrayPtr block (new ByteArray (blockSize, 0));
+		for (size_t j = 0; j < blockSize; j++) (*block)[j] = (char) ((i * blockSize + j) % 251);
+		data.push_back (block);
+	}
+	double t0 = sf::microtime ();
+	for (int i = 0; i < blocks; i++) {
+		tcheck1 (!a->write (data[i]));
+	}
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Receiver::has, &receiver, blockSize * blocks), 60000));
+	double t1 = sf::microtime ();
+	tcheck1 (!receiver.corrupt);
+	tcheck1 (receiver.received == blockSize * blocks);
+	*rate = (blockSize * blocks) / (1024.0 * 1024.0) / (t1 - t0);
+	return 0;
+}
+
+static const size_t gBlockSizes [] = { 1000, 65536, 1048576 };
+static const size_t gBenchmarkBytes = 64 * 1024 * 1024;
+
+int benchmarkLocal () {
+	LocalServer server;
+	tcheck1 (!server.listen (gPath));
+	LocalSocketPtr client, accepted;
+	tcheck1 (connectLocal (server, &client, &accepted) == 0);
+	for (size_t i = 0; i < sizeof (gBlockSizes) / sizeof (gBlockSizes[0]); i++) {
+		int blocks = (int) (gBenchmarkBytes / gBlockSizes[i]);
+		double rate = 0;
+		tcheck1 (transfer (client, accepted, gBlockSizes[i], blocks, &rate) == 0);
+		std::cout << "local: " << blocks << " writes of " << gBlockSizes[i] << " bytes, " << rate << " MB/s" << std::endl;
+	}
+	return 0;
+}
+
+int benchmarkTcpTls () {
+	x509::PrivateKeyPtr  key;
+	x509::CertificatePtr cert;
+	test::createIdentity (key, cert);
+
+	TCPServer server;
+	tcheck1 (server.listen ());
+	TCPSocketPtr socket (new TCPSocket());
+	ResultCallbackHelper helper;
+	tcheck1 (!socket->connectToHost ("127.0.0.1", server.serverPort(), 5000, helper.onResultFunc()));
+	tcheck1 (!helper.wait());
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&TCPServer::hasPendingConnections, &server), 1000));
+	TCPSocketPtr accepted = server.nextPendingConnection();
+	tcheck1 (accepted);
+
+	TLSChannelPtr client (new TLSChannel (socket));
+	TLSChannelPtr tlsServer (new TLSChannel (accepted));
+	tlsServer->setKey (cert, key);
+	client->disableAuthentication();
+	ResultCallbackHelper clientHelper, serverHelper;
+	tcheck1 (!client->clientHandshake (TLSChannel::X509, "", clientHelper.onResultFunc()));
+	tcheck1 (!tlsServer->serverHandshake (TLSChannel::X509, serverHelper.onResultFunc()));
+	tcheck1 (!clientHelper.wait());
+	tcheck1 (!serverHelper.wait());
+	for (size_t i = 0; i < sizeof (gBlockSizes) / sizeof (gBlockSizes[0]); i++) {
+		int blocks = (int) (gBenchmarkBytes / gBlockSizes[i]);
+		double rate = 0;
+		tcheck1 (transfer (client, tlsServer, gBlockSizes[i], blocks, &rate) == 0);
+		std::cout << "tcp+tls: " << blocks << " writes of " << gBlockSizes[i] << " bytes, " << rate << " MB/s" << std::endl;
+	}
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testConnect());
+	testcase (testConnector());
+	testcase (testConnectorTls());
+	testcase (benchmarkLocal());
+	testcase (benchmarkTcpTls());
+	testcase_end();
+	return ret;
+}
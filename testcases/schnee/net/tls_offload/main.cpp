@@ -0,0 +1,221 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/test/LocalChannel.h>
+#include <schnee/net/TLSChannel.h>
+#include <schnee/net/TLSSessionCache.h>
+#include <schnee/net/impl/CryptoWorkers.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+
+/*
+ * @file
+ * Tests TLS record processing and handshakes on crypto worker threads (also with
+ * client certificates and session resumption) and benchmarks the throughput of
+ * several concurrent TLS sessions with and without workers.
+ */
+using namespace sf;
+
+static x509::PrivateKeyPtr  gKey;
+static x509::CertificatePtr gCert;
+static x509::PrivateKeyPtr  gClientKey;
+static x509::CertificatePtr gClientCert;
+
+static const size_t gBlockSize = 65536;
+static const int    gWindow    = 4;
+
+/// Byte at position pos of the transferred stream
+static char pattern (size_t pos) {
+	return (char) (pos % 251);
+}
+
+/// A TLS session over a pair of LocalChannels; the client streams data to the server, which checks it
+/// @param mutual client has a certificate, too, and both resume sessions
+struct Session : public DelegateBase {
+	Session (size_t total, bool mutual = false) : mTotal (total), mSent (0), mReceived (0), mCorrupt (false), mInFlight (0), mWriteError (NoError) {
+		SF_REGISTER_ME;
+		a = test::LocalChannelPtr (new test::LocalChannel());
+		b = test::LocalChannelPtr (new test::LocalChannel());
+		test::LocalChannel::bindChannels (*a, *b);
+		client = TLSChannelPtr (new TLSChannel (a));
+		server = TLSChannelPtr (new TLSChannel (b));
+		server->setKey (gCert, gKey);
+		client->disableAuthentication();
+		if (mutual) {
+			client->setKey (gClientCert, gClientKey);
+			client->enableSessionResumption ("client server");
+			server->enableSessionResumption ();
+		}
+		server->changed() = dMemFun (this, &Session::onServerChanged);
+	}
+	~Session () {
+		SF_UNREGISTER_ME;
+		server->changed() = VoidDelegate ();
+	}
+
+	Error handshake () {
+		ResultCallbackHelper clientHelper;
+		ResultCallbackHelper serverHelper;
+		client->clientHandshake (TLSChannel::X509, "", clientHelper.onResultFunc());
+		server->serverHandshake (TLSChannel::X509, serverHelper.onResultFunc());
+		Error e = clientHelper.wait();
+		if (e) return e;
+		return serverHelper.wait();
+	}
+
+	void start () {
+		for (int i = 0; i < gWindow; i++) sendNext ();
+	}
+
+	void sendNext () {
+		if (mSent >= mTotal || mWriteError) return;
+		size_t size = std::min (gBlockSize, mTotal - mSent);
+		ByteArrayPtr block (new ByteArray (size, 0));
+		for (size_t i = 0; i < size; i++) (*block)[i] = pattern (mSent + i);
+		mSent += size;
+		mInFlight++;
+		Error e = client->write (block, dMemFun (this, &Session::onWritten));
+		if (e) mWriteError = e;
+	}
+
+	void onWritten (Error e) {
+		mInFlight--;
+		if (e) mWriteError = e;
+		sendNext ();
+	}
+
+	void onServerChanged () {
+		ByteArrayPtr data = server->read ();
+		if (!data) return;
+		for (size_t i = 0; i < data->size(); i++) {
+			if ((*data)[i] != pattern (mReceived + i)) mCorrupt = true;
+		}
+		mReceived += data->size();
+	}
+
+	bool finished () {
+		onServerChanged (); // data may have come in with the handshake
+		return mReceived >= mTotal || mCorrupt || mWriteError;
+	}
+
+	test::LocalChannelPtr a, b;
+	TLSChannelPtr client, server;
+	size_t mTotal;
+	size_t mSent;
+	size_t mReceived;
+	bool   mCorrupt;
+	int    mInFlight;
+	Error  mWriteError;
+};
+typedef shared_ptr<Session> SessionPtr;
+
+static std::vector<SessionPtr> gSessions;
+
+static bool allFinished () {
+	for (size_t i = 0; i < gSessions.size(); i++) {
+		if (!gSessions[i]->finished()) return false;
+	}
+	return true;
+}
+
+/// Transfers total bytes on each of count concurrent sessions
+/// @return throughput in MB/s, < 0 on error
+static double transfer (int count, size_t total) {
+	gSessions.clear();
+	for (int i = 0; i < count; i++) {
+		SessionPtr s (new Session (total));
+		if (s->handshake()) return -1;
+		gSessions.push_back (s);
+	}
+	double t0 = sf::microtime ();
+	for (int i = 0; i < count; i++) gSessions[i]->start();
+	if (!test::waitUntilTrueMs (&allFinished, 120000)) return -1;
+	double t1 = sf::microtime ();
+	for (int i = 0; i < count; i++) {
+		Session & s = *gSessions[i];
+		if (s.mCorrupt || s.mWriteError || s.mReceived != total) return -1;
+	}
+	gSessions.clear();
+	return (count * total) / (1024.0 * 1024.0) / (t1 - t0);
+}
+
+int offloadTest () {
+	CryptoWorkers::instance().start (2);
+	Session s (1000000);
+	tcheck1 (!s.handshake());
+	x509::CertificatePtr peerCert = s.client->peerCertificate();
+	tcheck1 (peerCert);
+	String fp, expected;
+	peerCert->fingerprintSha256 (&fp);
+	gCert->fingerprintSha256 (&expected);
+	tcheck1 (fp == expected);
+	tcheck1 (!s.client->authenticate (gCert.get(), "server@example.com/test"));
+	s.start ();
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Session::finished, &s), 30000));
+	tcheck1 (!s.mCorrupt && !s.mWriteError);
+	tcheck1 (s.mReceived == 1000000);
+	CryptoWorkers::instance().stop ();
+	return 0;
+}
+
+static bool hasSession () {
+	return TLSSessionCache::instance().size() > 0;
+}
+
+int mutualTest () {
+	CryptoWorkers::instance().start (2);
+	TLSSessionCache::instance().clear();
+	for (int i = 0; i < 2; i++) {
+		Session s (100000, true);
+		tcheck1 (!s.handshake());
+		// the server requested the client certificate
+		x509::CertificatePtr peerCert = s.server->peerCertificate();
+		tcheck1 (peerCert);
+		String name;
+		peerCert->getCommonName (&name);
+		tcheck1 (name == "client@example.com/test");
+		tcheck1 (!s.server->authenticate (gClientCert.get(), name));
+		tcheck1 (!s.client->authenticate (gCert.get(), "server@example.com/test"));
+		// the first session got stored (TLS 1.3 tickets come after the handshake), the second one resumes it
+		tcheck1 (s.client->resumed() == (i > 0));
+		s.start ();
+		tcheck1 (test::waitUntilTrueMs (sf::bind (&Session::finished, &s), 30000));
+		tcheck1 (!s.mCorrupt && !s.mWriteError);
+		tcheck1 (test::waitUntilTrueMs (&hasSession, 5000));
+	}
+	TLSSessionCache::instance().clear();
+	CryptoWorkers::instance().stop ();
+	return 0;
+}
+
+int benchmark () {
+	const int sessions = 4;
+	const size_t total = 16 * 1024 * 1024;
+	int threads = std::max (2, (int) boost::thread::hardware_concurrency());
+
+	CryptoWorkers::instance().stop ();
+	double inlineRate = transfer (sessions, total);
+	tcheck1 (inlineRate > 0);
+
+	CryptoWorkers::instance().start (threads);
+	double workerRate = transfer (sessions, total);
+	CryptoWorkers::instance().stop ();
+	tcheck1 (workerRate > 0);
+
+	std::cout << "Throughput of " << sessions << " TLS sessions: inline " << inlineRate << " MB/s, "
+			<< threads << " crypto workers " << workerRate << " MB/s" << std::endl;
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	test::createIdentity (gKey, gCert);
+	test::createIdentity (gClientKey, gClientCert, "client@example.com/test");
+	testcase_start();
+	testcase (offloadTest());
+	testcase (mutualTest());
+	testcase (benchmark());
+	testcase_end();
+	return ret;
+}
@@ -0,0 +1,199 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/net/TCPServer.h>
+#include <schnee/net/TCPSocket.h>
+#include <schnee/net/TLSChannel.h>
+#include <schnee/net/TLSSessionCache.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+#include <boost/filesystem.hpp>
+
+/*
+ * @file
+ * Tests TLS session resumption with TLSSessionCache and benchmarks reconnect latency
+ * over loopback with and without resumption.
+ */
+using namespace sf;
+
+static x509::PrivateKeyPtr  gKey;
+static x509::CertificatePtr gCert;
+
+/// Accepts TLS connections and greets them
+struct Server : public DelegateBase {
+	Server () {
+		SF_REGISTER_ME;
+		server.newConnection() = dMemFun (this, &Server::onNewConnection);
+	}
+	~Server () {
+		SF_UNREGISTER_ME;
+	}
+	void onNewConnection () {
+		TCPSocketPtr socket = server.nextPendingConnection();
+		if (!socket) return;
+		TLSChannelPtr channel (new TLSChannel (socket));
+		channel->setKey (gCert, gKey);
+		channel->enableSessionResumption ();
+		channels.push_back (channel);
+		channel->serverHandshake (TLSChannel::X509, abind (dMemFun (this, &Server::onHandshake), channel.get()));
+	}
+	void onHandshake (Error result, TLSChannel * channel) {
+		if (result) return;
+		channel->write (sf::createByteArrayPtr ("hello"));
+	}
+	TCPServer server;
+	std::vector<TLSChannelPtr> channels;
+};
+
+/// Collects read data of the client
+struct Reader : public DelegateBase {
+	Reader (TLSChannelPtr c) : channel (c) {
+		SF_REGISTER_ME;
+		channel->changed() = dMemFun (this, &Reader::onChanged);
+	}
+	~Reader () {
+		SF_UNREGISTER_ME;
+		channel->changed() = VoidDelegate ();
+	}
+	void onChanged () {
+		ByteArrayPtr data = channel->read ();
+		if (data) received.append (data->const_c_array(), data->size());
+	}
+	/// Polls, as the greeting may have come in together with the handshake
+	bool hasGreeting () {
+		onChanged ();
+		return received == "hello";
+	}
+	TLSChannelPtr channel;
+	String received;
+};
+
+/// Connects, handshakes and waits for the greeting
+/// @param resumption enables session resumption
+/// @param resumed out: whether the session was resumed
+/// @return time until the handshake finished in ms, < 0 on error
+static double connect (int port, bool resumption, bool * resumed) {
+	double t0 = sf::microtime ();
+	TCPSocketPtr socket (new TCPSocket());
+	ResultCallbackHelper helper;
+	socket->connectToHost ("127.0.0.1", port, 5000, helper.onResultFunc());
+	if (helper.wait()) return -1;
+	TLSChannelPtr channel (new TLSChannel (socket));
+	channel->disableAuthentication();
+	if (resumption) channel->enableSessionResumption ("client server");
+	Reader reader (channel);
+	if (channel->clientHandshake (TLSChannel::X509, "", helper.onResultFunc())) return -1;
+	if (helper.wait()) return -1;
+	double t1 = sf::microtime ();
+	if (!test::waitUntilTrueMs (sf::bind (&Reader::hasGreeting, &reader), 5000)) return -1;
+
+	// peer certificate must be available after resumption, too
+	x509::CertificatePtr peerCert = channel->peerCertificate();
+	if (!peerCert) return -1;
+	String fp, expected;
+	peerCert->fingerprintSha256 (&fp);
+	gCert->fingerprintSha256 (&expected);
+	if (fp != expected) return -1;
+	if (channel->authenticate (gCert.get(), "server@example.com/test")) return -1;
+
+	*resumed = channel->resumed();
+	channel->changed() = VoidDelegate ();
+	return (t1 - t0) * 1000.0;
+}
+
+static bool hasSession () {
+	return TLSSessionCache::instance().size() > 0;
+}
+
+int benchmark () {
+	Server server;
+	tcheck1 (server.server.listen());
+	int port = server.server.serverPort();
+	TLSSessionCache::instance().clear();
+	const int rounds = 20;
+
+	double full = 0;
+	for (int i = 0; i < rounds; i++) {
+		bool resumed = true;
+		double t = connect (port, false, &resumed);
+		tcheck1 (t >= 0);
+		tcheck1 (!resumed);
+		full += t;
+	}
+	tcheck1 (TLSSessionCache::instance().size() == 0);
+
+	// first one is a full handshake, stores the session
+	bool resumed = true;
+	tcheck1 (connect (port, true, &resumed) >= 0);
+	tcheck1 (!resumed);
+	tcheck1 (test::waitUntilTrueMs (&hasSession, 1000));
+
+	double resuming = 0;
+	for (int i = 0; i < rounds; i++) {
+		bool resumed = false;
+		double t = connect (port, true, &resumed);
+		tcheck1 (t >= 0);
+		tcheck1 (resumed);
+		resuming += t;
+	}
+	std::cout << "Reconnect latency over loopback: full handshake " << full / rounds << "ms, resumed " << resuming / rounds << "ms" << std::endl;
+	const TLSSessionCache::Statistics & stats = TLSSessionCache::instance().statistics();
+	std::cout << "Session cache: " << stats.lookups << " lookups, " << stats.hits << " hits, " << stats.stored << " stored" << std::endl;
+	tcheck1 (stats.hits >= rounds);
+	return 0;
+}
+
+int cacheTest () {
+	TLSSessionCache & cache = TLSSessionCache::instance();
+	cache.clear();
+	cache.setMaxSessions (2);
+	cache.store ("a", ByteArray ("1", 1));
+	cache.store ("b", ByteArray ("2", 1));
+	ByteArray data;
+	tcheck1 (cache.lookup ("a", &data)); // a is used now, b is the oldest
+	cache.store ("c", ByteArray ("3", 1));
+	tcheck1 (cache.size() == 2);
+	tcheck1 (!cache.lookup ("b", &data));
+	tcheck1 (cache.lookup ("c", &data) && data == ByteArray ("3", 1));
+	cache.remove ("c");
+	tcheck1 (!cache.lookup ("c", &data));
+	cache.setMaxSessions (256);
+	cache.clear();
+	return 0;
+}
+
+int fileTest () {
+	const char * file = "tls_resumption_test/sessions";
+	boost::filesystem::remove_all ("tls_resumption_test");
+	TLSSessionCache & cache = TLSSessionCache::instance();
+	cache.clear();
+	tcheck1 (!cache.setFile (file));
+	cache.store ("some key", ByteArray ("session data", 12));
+	String ticketKey ((const char*) cache.ticketKey()->data, cache.ticketKey()->size);
+
+	// like a restart
+	TLSSessionCache::destroyInstance();
+	TLSSessionCache::initInstance();
+	TLSSessionCache & restarted = TLSSessionCache::instance();
+	tcheck1 (!restarted.setFile (file));
+	ByteArray data;
+	tcheck1 (restarted.lookup ("some key", &data));
+	tcheck1 (data == ByteArray ("session data", 12));
+	tcheck1 (String ((const char*) restarted.ticketKey()->data, restarted.ticketKey()->size) == ticketKey);
+	restarted.setFile ("");
+	restarted.clear();
+	boost::filesystem::remove_all ("tls_resumption_test");
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	test::createIdentity (gKey, gCert);
+	testcase_start();
+	testcase (cacheTest());
+	testcase (fileTest());
+	testcase (benchmark());
+	testcase_end();
+	return ret;
+}
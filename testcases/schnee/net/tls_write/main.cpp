@@ -0,0 +1,146 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/test/LocalChannel.h>
+#include <schnee/net/TLSChannel.h>
+#include <schnee/net/impl/CryptoWorkers.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+
+/*
+ * @file
+ * Tests the TLSChannel write path: all records of one write have to go into one write
+ * of the next channel, the callback has to be called exactly once.
+ * Benchmarks the throughput of large writes.
+ */
+using namespace sf;
+
+/// Counts writes going through
+struct CountingChannel : public test::LocalChannel {
+	CountingChannel () : writes (0), bytes (0) {}
+	virtual Error write (const ByteArrayPtr& data, const ResultCallback & callback = ResultCallback()) {
+		writes++;
+		bytes += data->size();
+		return test::LocalChannel::write (data, callback);
+	}
+	int writes;
+	size_t bytes;
+};
+typedef shared_ptr<CountingChannel> CountingChannelPtr;
+
+/// Collects everything the server receives
+struct Receiver : public DelegateBase {
+	Receiver (TLSChannelPtr c) : channel (c), received (0), corrupt (false) {
+		SF_REGISTER_ME;
+		channel->changed() = dMemFun (this, &Receiver::onChanged);
+	}
+	~Receiver () {
+		SF_UNREGISTER_ME;
+		channel->changed() = VoidDelegate ();
+	}
+	void onChanged () {
+		ByteArrayPtr data;
+		while ((data = channel->read ()) && !data->empty()) {
+			for (size_t i = 0; i < data->size(); i++) {
+				if ((*data)[i] != (char) ((received + i) % 251)) corrupt = true;
+			}
+			received += data->size();
+		}
+	}
+	bool has (size_t size) {
+		onChanged ();
+		return received >= size;
+	}
+	TLSChannelPtr channel;
+	size_t received;
+	bool corrupt;
+};
+
+/// Counts callbacks
+struct CallbackCounter : public DelegateBase {
+	CallbackCounter () : calls (0), lastError (NoError) { SF_REGISTER_ME; }
+	~CallbackCounter () { SF_UNREGISTER_ME; }
+	void onResult (Error e) { calls++; lastError = e; }
+	bool allCalled (int count) const { return calls >= count; }
+	int calls;
+	Error lastError;
+};
+
+static x509::PrivateKeyPtr  gKey;
+static x509::CertificatePtr gCert;
+
+/// Writes blocks of the given size through a fresh TLS session
+/// @param rate out: throughput in MB/s
+static int writeTest (size_t blockSize, int blocks, double * rate) {
+	CountingChannelPtr a (new CountingChannel());
+	test::LocalChannelPtr b (new test::LocalChannel());
+	test::LocalChannel::bindChannels (*a, *b);
+	TLSChannelPtr client (new TLSChannel (a));
+	TLSChannelPtr server (new TLSChannel (b));
+	server->setKey (gCert, gKey);
+	client->disableAuthentication();
+	ResultCallbackHelper clientHelper, serverHelper;
+	tcheck1 (!client->clientHandshake (TLSChannel::X509, "", clientHelper.onResultFunc()));
+	tcheck1 (!server->serverHandshake (TLSChannel::X509, serverHelper.onResultFunc()));
+	tcheck1 (!clientHelper.wait());
+	tcheck1 (!serverHelper.wait());
+	Receiver receiver (server);
+
+	int writesBefore = a->writes;
+	size_t bytesBefore = a->bytes;
+	CallbackCounter counter;
+	double t0 = sf::microtime ();
+	for (int i = 0; i < blocks; i++) {
+		ByteArrayPtr block (new ByteArray (blockSize, 0));
+		for (size_t j = 0; j < blockSize; j++) (*block)[j] = (char) ((i * blockSize + j) % 251);
+		tcheck1 (!client->write (block, dMemFun (&counter, &CallbackCounter::onResult)));
+	}
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Receiver::has, &receiver, blockSize * blocks), 60000));
+	double t1 = sf::microtime ();
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&CallbackCounter::allCalled, &counter, blocks), 1000));
+	tcheck1 (counter.calls == blocks && !counter.lastError);
+	tcheck1 (!receiver.corrupt);
+	tcheck1 (receiver.received == blockSize * blocks);
+	// one write per block, independent of the record count
+	tcheck1 (a->writes - writesBefore == blocks);
+	size_t records = (blockSize + 16383) / 16384;
+	tcheck1 (a->bytes - bytesBefore >= (size_t) blocks * (blockSize + records * 5));
+	*rate = (blockSize * blocks) / (1024.0 * 1024.0) / (t1 - t0);
+	return 0;
+}
+
+static int runAll (const char * name) {
+	const size_t sizes [] = { 1, 1000, 16384, 16385, 65536, 1048576, 16777216 };
+	for (size_t i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		int blocks = std::max (1, (int) (33554432 / sizes[i]));
+		blocks = std::min (blocks, 200);
+		double rate = 0;
+		int r = writeTest (sizes[i], blocks, &rate);
+		if (r) return r;
+		std::cout << name << ": " << blocks << " writes of " << sizes[i] << " bytes, " << rate << " MB/s" << std::endl;
+	}
+	return 0;
+}
+
+int inlineTest () {
+	CryptoWorkers::instance().stop ();
+	return runAll ("inline");
+}
+
+int workerTest () {
+	CryptoWorkers::instance().start (2);
+	int r = runAll ("crypto workers");
+	CryptoWorkers::instance().stop ();
+	return r;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	test::createIdentity (gKey, gCert);
+	testcase_start();
+	testcase (inlineTest());
+	testcase (workerTest());
+	testcase_end();
+	return ret;
+}
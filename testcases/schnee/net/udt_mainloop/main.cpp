@@ -0,0 +1,134 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/timing.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+
+#include <schnee/net/impl/UDTMainLoop.h>
+#include <schnee/net/UDTSocket.h>
+#include <schnee/net/UDTServer.h>
+
+#include <time.h>
+
+/*
+ * @file
+ * Benchmarks the UDTMainLoop with several hundred connected UDT sockets:
+ * Wake ups and CPU usage while idle and the latency of events if only a few sockets are busy.
+ */
+using namespace sf;
+
+static const int gPairs = 200; // two sockets per pair
+
+typedef std::vector<UDTSocket*> SocketVec;
+
+static bool hasData (const UDTSocket * socket, int amount) {
+	return socket->bytesAvailable() >= amount;
+}
+
+static bool allHaveData (const SocketVec * sockets) {
+	for (SocketVec::const_iterator i = sockets->begin(); i != sockets->end(); i++) {
+		if ((*i)->bytesAvailable() < 1) return false;
+	}
+	return true;
+}
+
+static bool hasPending (const UDTServer * server) {
+	return server->pendingConnections() > 0;
+}
+
+/// Connects gPairs client sockets to one server, clients share one UDP port
+static int connectAll (UDTServer * server, SocketVec * clients, SocketVec * accepted) {
+	int port = server->port();
+	int clientPort = 0;
+	for (int i = 0; i < gPairs; i++) {
+		UDTSocket * client = new UDTSocket ();
+		clients->push_back (client);
+		tcheck1 (!client->bind (clientPort));
+		if (!clientPort) clientPort = client->port();
+		ResultCallbackHelper helper;
+		client->connectAsync ("127.0.0.1", port, helper.onResultFunc());
+		tcheck1 (helper.waitReadyAndNoError (5000));
+		tcheck1 (test::waitUntilTrueMs (sf::bind (&hasPending, server), 5000));
+		UDTSocket * a = server->nextConnection();
+		tcheck1 (a);
+		accepted->push_back (a);
+	}
+	return 0;
+}
+
+/// Each socket shall still get its data
+static int transferAll (SocketVec * from, SocketVec * to) {
+	for (SocketVec::iterator i = from->begin(); i != from->end(); i++) {
+		tcheck1 (!(*i)->write (sf::createByteArrayPtr ("x")));
+	}
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&allHaveData, to), 10000));
+	for (SocketVec::iterator i = to->begin(); i != to->end(); i++) {
+		ByteArrayPtr data = (*i)->read();
+		tcheck1 (data && *data == ByteArray ("x"));
+	}
+	return 0;
+}
+
+int benchmark () {
+	UDTServer server;
+	tcheck1 (!server.listen (0));
+	SocketVec clients, accepted;
+	int result = connectAll (&server, &clients, &accepted);
+	if (!result) result = transferAll (&clients, &accepted);
+	if (!result) result = transferAll (&accepted, &clients);
+
+	if (!result) {
+		// idle
+		const int idleMs = 2000;
+		UDTMainLoop::Statistics s0 = UDTMainLoop::instance().statistics();
+		clock_t c0 = clock ();
+		test::millisleep_locked (idleMs);
+		clock_t c1 = clock ();
+		UDTMainLoop::Statistics s1 = UDTMainLoop::instance().statistics();
+		double cpu = (double) (c1 - c0) / CLOCKS_PER_SEC;
+		int64_t wakeups = s1.wakeups - s0.wakeups;
+		std::cout << "Idle with " << 2 * gPairs + 1 << " UDT sockets: " << wakeups << " loop wake ups in " << idleMs << "ms, process CPU "
+				<< (cpu * 100000.0 / idleMs) << "% (including UDT threads)" << std::endl;
+		if (wakeups > idleMs / 100) {
+			std::cerr << "Too many wake ups while idle" << std::endl;
+			result = 1;
+		}
+	}
+
+	if (!result) {
+		// ping pong on a few sockets, the others stay idle
+		const int active = 4;
+		const int rounds = 200;
+		UDTMainLoop::Statistics s0 = UDTMainLoop::instance().statistics();
+		double t0 = sf::microtime ();
+		for (int r = 0; r < rounds && !result; r++) {
+			UDTSocket * a = clients[r % active];
+			UDTSocket * b = accepted[r % active];
+			a->write (sf::createByteArrayPtr ("p"));
+			if (!test::waitUntilTrueMs (sf::bind (&hasData, b, 1), 5000)) { result = 1; break; }
+			b->read ();
+			b->write (sf::createByteArrayPtr ("p"));
+			if (!test::waitUntilTrueMs (sf::bind (&hasData, a, 1), 5000)) { result = 1; break; }
+			a->read ();
+		}
+		double t1 = sf::microtime ();
+		UDTMainLoop::Statistics s1 = UDTMainLoop::instance().statistics();
+		std::cout << "Round trip with " << active << " of " << 2 * gPairs + 1 << " sockets active: " << (t1 - t0) * 1000.0 / rounds << "ms, "
+				<< (s1.readEvents - s0.readEvents) << " read events, "
+				<< (s1.writeEvents - s0.writeEvents) << " write events in " << (s1.wakeups - s0.wakeups) << " loop wake ups" << std::endl;
+	}
+
+	for (SocketVec::iterator i = clients.begin(); i != clients.end(); i++) delete *i;
+	for (SocketVec::iterator i = accepted.begin(); i != accepted.end(); i++) delete *i;
+	return result;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (benchmark());
+	testcase_end();
+	return ret;
+}
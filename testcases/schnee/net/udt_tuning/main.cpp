@@ -0,0 +1,130 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/test/PseudoRandom.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+
+#include <schnee/net/UDTSocket.h>
+#include <schnee/net/UDTTuning.h>
+
+/*
+ * @file
+ * Tests UDT tuning profiles (buffer sizing from the bandwidth delay product,
+ * background congestion control), that only unopened sockets get tuned and
+ * the perfmon statistics in ChannelInfo.
+ * Benchmarks the throughput of the profiles over loopback.
+ */
+using namespace sf;
+
+int profileTest () {
+	UDTTuning def = UDTTuning::defaultProfile();
+	tcheck1 (def.congestion == UDTTuning::CC_UDT);
+	tcheck1 (def.sendBuffer == 524288 && def.receiveBuffer == 524288);
+	tcheck1 (def.flowWindow <= 0 && def.mss <= 0);
+
+	// unknown path: default profile
+	UDTTuning unknown = UDTTuning::fromPath (-1, 1000000);
+	tcheck1 (unknown.sendBuffer == def.sendBuffer);
+
+	// slow link, 50kB/s with 100ms: small buffers
+	UDTTuning slow = UDTTuning::fromPath (0.1f, 50000);
+	tcheck1 (slow.receiveBuffer == 64 * 1024);
+	tcheck1 (slow.maxInputBuffer < def.maxInputBuffer);
+
+	// fast link with high latency, 100MB/s with 500ms: big buffers
+	UDTTuning fast = UDTTuning::fromPath (0.5f, 100000000);
+	tcheck1 (fast.receiveBuffer == 64 * 1024 * 1024); // clamped from 100MB
+	tcheck1 (fast.flowWindow * (1500 - 28) >= fast.receiveBuffer);
+	tcheck1 (fast.inputTransferSize > def.inputTransferSize);
+
+	UDTTuning medium = UDTTuning::fromPath (0.05f, 10000000);
+	tcheck1 (medium.receiveBuffer == 1000000);
+
+	tcheck1 (UDTTuning::fromSettings ("background", 0.05f, 10000000).congestion == UDTTuning::CC_BACKGROUND);
+	tcheck1 (UDTTuning::fromSettings ("udt", 0.05f, 10000000).congestion == UDTTuning::CC_UDT);
+	return 0;
+}
+
+int stateTest () {
+	UDTSocket socket;
+	UDTTuning tuning = UDTTuning::fromPath (0.05f, 10000000);
+	tcheck1 (!socket.setTuning (tuning));
+	// the real values, UDT counts buffers in packets
+	UDTTuning real = socket.tuning ();
+	tcheck1 (real.receiveBuffer <= tuning.receiveBuffer && real.receiveBuffer > tuning.receiveBuffer - 1500);
+	tcheck1 (real.flowWindow == tuning.flowWindow);
+	tcheck1 (real.mss > 0);
+
+	// bound sockets can't be tuned anymore
+	tcheck1 (!socket.bind ());
+	tcheck1 (socket.setTuning (UDTTuning::defaultProfile()) == error::WrongState);
+	tcheck1 (socket.tuning().receiveBuffer == real.receiveBuffer);
+	return 0;
+}
+
+static bool hasData (const UDTSocket * socket) {
+	return socket->bytesAvailable() > 0;
+}
+
+/// Connects two tuned sockets in rendezvous mode, transfers data, returns MB/s or < 0 on error
+static double transfer (const UDTTuning & tuning, int blocks, const char * name) {
+	UDTSocket a;
+	UDTSocket b;
+	if (a.setTuning (tuning) || b.setTuning (tuning)) return -1;
+	if (a.bind() || b.bind()) return -1;
+	ResultCallbackHelper helperA, helperB;
+	a.connectRendezvousAsync ("127.0.0.1", b.port(), helperA.onResultFunc());
+	b.connectRendezvousAsync ("127.0.0.1", a.port(), helperB.onResultFunc());
+	if (!helperA.waitReadyAndNoError (5000) || !helperB.waitReadyAndNoError (5000)) return -1;
+
+	const size_t blockSize = 1024 * 1024;
+	ByteArrayPtr block = createByteArrayPtr (ByteArray (blockSize, 0));
+	test::pseudoRandomData (blockSize, block->c_array());
+
+	double t0 = sf::microtime ();
+	for (int i = 0; i < blocks; i++) {
+		a.write (block);
+	}
+	size_t received = 0;
+	while (received < blockSize * blocks) {
+		if (!test::waitUntilTrueMs (sf::bind (&hasData, &b), 10000)) return -1;
+		ByteArrayPtr data = b.read();
+		if (data) received += data->size();
+	}
+	double t1 = sf::microtime ();
+
+	Channel::ChannelInfo info = a.info();
+	const Channel::TransportStatistics & t = info.transport;
+	if (!t.valid || t.packetsSent <= 0 || t.rtt < 0) return -1;
+	if (info.delay != t.rtt) return -1;
+	if (b.info().transport.packetsReceived <= 0) return -1;
+	double rate = received / (t1 - t0) / 1024 / 1024;
+	std::cout << name << ": " << rate << " MiB/s, rtt " << t.rtt * 1000 << "ms, sent " << t.packetsSent << " packets, retransmitted " << t.packetsRetransmitted
+			<< ", loss " << t.sendLoss << ", congestion window " << t.congestionWindow << ", flow window " << t.flowWindow << std::endl;
+	return rate;
+}
+
+int benchmark () {
+	UDTTuning background = UDTTuning::defaultProfile ();
+	background.congestion = UDTTuning::CC_BACKGROUND;
+	UDTTuning fastBackground = UDTTuning::fromPath (0.01f, 200 * 1024 * 1024);
+	fastBackground.congestion = UDTTuning::CC_BACKGROUND;
+	tcheck1 (transfer (UDTTuning::defaultProfile(), 16, "default profile") > 0);
+	tcheck1 (transfer (UDTTuning::fromPath (0.01f, 200 * 1024 * 1024), 16, "derived from 10ms x 200MB/s") > 0);
+	tcheck1 (transfer (UDTTuning::fromPath (0.1f, 50000), 1, "derived from 100ms x 50kB/s") > 0);
+	tcheck1 (transfer (background, 16, "background congestion control") > 0);
+	tcheck1 (transfer (fastBackground, 16, "background congestion control, derived from 10ms x 200MB/s") > 0);
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (profileTest());
+	testcase (stateTest());
+	testcase (benchmark());
+	testcase_end();
+	return ret;
+}
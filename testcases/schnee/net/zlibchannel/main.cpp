@@ -0,0 +1,126 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/LocalChannel.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/net/ZlibChannel.h>
+#include <schnee/im/xmpp/XMPPStream.h>
+
+/*
+ * @file
+ * Tests the ZlibChannel and the XMPP stream compression negotiation (XEP-0138)
+ * against a scripted server.
+ */
+using namespace sf;
+
+/// Collects everything arriving on a channel
+struct Collector : public DelegateBase {
+	Collector (ChannelPtr c) : channel (c) {
+		SF_REGISTER_ME;
+		channel->changed() = dMemFun (this, &Collector::onChanged);
+	}
+	~Collector () {
+		SF_UNREGISTER_ME;
+	}
+	void onChanged () {
+		ByteArrayPtr data = channel->read ();
+		received.append (data->const_c_array(), data->size());
+	}
+	bool contains (const String & s) const { return received.find (s) != received.npos; }
+	bool hasSize (size_t size) const { return received.size() >= size; }
+
+	ChannelPtr channel;
+	String received;
+};
+
+static String presence (int i) {
+	return "<presence from='contact" + toString (i) + "@example.com/schneeflocke' to='me@example.com'><show>chat</show>"
+			"<status>Online</status><priority>5</priority><c xmlns='http://jabber.org/protocol/caps' node='http://sflx.net/caps' ver='0.1'/></presence>";
+}
+
+int testRoundTrip () {
+	test::LocalChannelPtr a (new test::LocalChannel);
+	test::LocalChannelPtr b (new test::LocalChannel);
+	test::LocalChannel::bindChannels (*a, *b);
+	ZlibChannelPtr za (new ZlibChannel (a));
+	ZlibChannelPtr zb (new ZlibChannel (b));
+	Collector collector (zb);
+
+	String sent;
+	for (int i = 0; i < 500; i++) {
+		String s = presence (i);
+		tcheck1 (!za->write (sf::createByteArrayPtr (s)));
+		sent += s;
+	}
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Collector::hasSize, &collector, sent.size()), 5000));
+	tcheck1 (collector.received == sent);
+
+	// other direction
+	Collector back (za);
+	tcheck1 (!zb->write (sf::createByteArrayPtr ("<message><body>Hello</body></message>")));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Collector::contains, &back, "Hello</body>"), 5000));
+
+	float ratio = za->info().compressionRatio;
+	std::cout << "Compression ratio of " << sent.size() << " bytes presence stanzas: " << ratio << std::endl;
+	tcheck1 (ratio > 2.0f);
+	tcheck1 (zb->info().compressionRatio > 2.0f);
+	tcheck1 (a->info().compressionRatio < 0);
+	return 0;
+}
+
+static const char * gServerOpener = "<?xml version='1.0'?><stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams' from='example.com' id='s1' version='1.0'>";
+
+int testNegotiation () {
+	test::LocalChannelPtr a (new test::LocalChannel);
+	test::LocalChannelPtr b (new test::LocalChannel);
+	test::LocalChannel::bindChannels (*a, *b);
+	Collector server (b);
+	XMPPStream stream;
+	stream.setInfo ("me@example.com", "example.com");
+
+	// plain stream, offering compression
+	ResultCallbackHelper helper;
+	tcheck1 (!stream.startInit (a, helper.onResultFunc()));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Collector::contains, &server, "<stream:stream"), 1000));
+	b->write (sf::createByteArrayPtr (String (gServerOpener) +
+			"<stream:features><compression xmlns='http://jabber.org/features/compress'><method>zlib</method></compression></stream:features>"));
+	tcheck1 (!helper.wait (1000));
+	tcheck1 (!stream.waitFeatures (helper.onResultFunc()));
+	tcheck1 (!helper.wait (1000));
+
+	tcheck1 (!stream.requestCompression (helper.onResultFunc()));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Collector::contains, &server, "<method>zlib</method></compress>"), 1000));
+	b->write (sf::createByteArrayPtr ("<compressed xmlns='http://jabber.org/protocol/compress'/>"));
+	tcheck1 (!helper.wait (1000));
+
+	// restarting compressed
+	stream.uncouple ();
+	ZlibChannelPtr za (new ZlibChannel (a));
+	ZlibChannelPtr zb (new ZlibChannel (b));
+	Collector compressedServer (zb);
+	tcheck1 (!stream.startInit (za, helper.onResultFunc()));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Collector::contains, &compressedServer, "<stream:stream"), 1000));
+	zb->write (sf::createByteArrayPtr (String (gServerOpener) + "<stream:features/>"));
+	tcheck1 (!helper.wait (1000));
+	tcheck1 (!stream.waitFeatures (helper.onResultFunc()));
+	tcheck1 (!helper.wait (1000));
+	tcheck (stream.requestCompression (helper.onResultFunc()) == error::NotSupported, "Not offered anymore");
+
+	xmpp::Message m;
+	m.to   = "you@example.com";
+	m.body = "Hello compressed world";
+	tcheck1 (!stream.sendMessage (m));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Collector::contains, &compressedServer, "Hello compressed world"), 1000));
+	tcheck1 (stream.channelInfo().compressionRatio > 0);
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testRoundTrip());
+	testcase (testNegotiation());
+	testcase_end();
+	return ret;
+}
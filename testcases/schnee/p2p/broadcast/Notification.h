@@ -0,0 +1,11 @@
+#pragma once
+#include <sfserialization/autoreflect.h>
+#include <string>
+
+/// Test notification for the testcase
+struct Notification {
+	Notification () : revision (1) {}
+	std::string path;
+	int revision;
+	SF_AUTOREFLECT_SDC;
+};
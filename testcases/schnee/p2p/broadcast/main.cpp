@@ -0,0 +1,172 @@
+#include <schnee/test/test.h>
+#include <schnee/tools/Log.h>
+#include <schnee/p2p/impl/ChannelHolder.h>
+#include "Notification.h"
+#include <new>
+#include <cstdlib>
+
+/*
+ * @file
+ * Tests sending one datagram to many receivers (like DataSharingServer notifications).
+ * The datagram shall be encoded only once and shared among all channels.
+ */
+using namespace sf;
+
+// Allocation counting
+static long gAllocations = 0;
+static long gAllocatedBytes = 0;
+
+void * operator new (size_t size) {
+	gAllocations++;
+	gAllocatedBytes += (long) size;
+	void * p = ::malloc (size == 0 ? 1 : size);
+	if (!p) throw std::bad_alloc ();
+	return p;
+}
+
+void operator delete (void * p) {
+	::free (p);
+}
+
+/// A channel which just records the buffers written into it
+class RecordingChannel : public Channel {
+public:
+	RecordingChannel () : mError (NoError) {}
+	virtual sf::Error error () const { return mError; }
+	virtual State state () const { return mError ? Unconnected : Connected; }
+	virtual Error write (const ByteArrayPtr& data, const ResultCallback & callback = ResultCallback()) {
+		if (mError) return mError;
+		written.push_back (data);
+		return NoError;
+	}
+	virtual sf::ByteArrayPtr read (long maxSize = -1) { return sf::ByteArrayPtr (); }
+	virtual void close (const ResultCallback & resultCallback = ResultCallback ()) { mError = error::Closed; }
+	virtual const char * stackInfo () const { return "recording"; }
+	virtual sf::VoidDelegate & changed () { return mChanged; }
+
+	void setError (Error e) { mError = e; }
+
+	std::vector<ByteArrayPtr> written;
+private:
+	Error mError;
+	VoidDelegate mChanged;
+};
+typedef shared_ptr<RecordingChannel> RecordingChannelPtr;
+
+struct Scenario {
+	ChannelHolder holder;
+	std::vector<RecordingChannelPtr> channels;
+	std::vector<ChannelHolder::ChannelId> ids;
+	HostSet receivers;
+
+	Scenario (int count) {
+		holder.setHostId ("server");
+		for (int i = 0; i < count; i++) {
+			RecordingChannelPtr channel (new RecordingChannel());
+			HostId target = "subscriber" + toString (i);
+			ids.push_back (holder.add (channel, target, true, 10));
+			channels.push_back (channel);
+			receivers.insert (target);
+		}
+	}
+
+	void clearWritten () {
+		for (size_t i = 0; i < channels.size(); i++) channels[i]->written.clear();
+	}
+};
+
+static const int gSubscriberCount = 300;
+
+static Datagram createDatagram () {
+	Notification n;
+	n.path = "shared/file";
+	return Datagram::fromCmd (n, createByteArrayPtr (ByteArray (4096, 'x')));
+}
+
+int testSharedBuffer () {
+	Scenario scenario (gSubscriberCount);
+	Datagram d = createDatagram ();
+	Error e = scenario.holder.send (scenario.receivers, d, true);
+	tcheck1 (!e);
+
+	ByteArrayPtr first;
+	for (size_t i = 0; i < scenario.channels.size(); i++) {
+		const RecordingChannelPtr & c (scenario.channels[i]);
+		tcheck1 (c->written.size() == 1);
+		if (!first) first = c->written[0];
+		tcheck (c->written[0] == first, "All receivers shall get the same buffer");
+	}
+	tcheck1 (*first == *d.encode());
+	return 0;
+}
+
+int testAllocations () {
+	Scenario scenario (gSubscriberCount);
+	Datagram d = createDatagram ();
+
+	// Sending one by one
+	long allocations = gAllocations;
+	long bytes = gAllocatedBytes;
+	for (size_t i = 0; i < scenario.ids.size(); i++) {
+		Error e = scenario.holder.send (scenario.ids[i], d, true);
+		tcheck1 (!e);
+	}
+	long singleAllocations = gAllocations - allocations;
+	long singleBytes       = gAllocatedBytes - bytes;
+	scenario.clearWritten ();
+
+	// Broadcast
+	allocations = gAllocations;
+	bytes = gAllocatedBytes;
+	Error e = scenario.holder.send (scenario.receivers, d, true);
+	tcheck1 (!e);
+	long broadcastAllocations = gAllocations - allocations;
+	long broadcastBytes       = gAllocatedBytes - bytes;
+
+	Log (LogProfile) << LOGID << gSubscriberCount << " receivers, one by one: " << singleAllocations << " allocations / " << singleBytes << " bytes, "
+			<< "broadcast: " << broadcastAllocations << " allocations / " << broadcastBytes << " bytes" << std::endl;
+	tcheck (broadcastAllocations < singleAllocations, "Broadcast shall allocate less");
+	tcheck (broadcastBytes * 10 < singleBytes, "Broadcast shall not copy the datagram for each receiver");
+	return 0;
+}
+
+int testErrorAggregation () {
+	Scenario scenario (gSubscriberCount);
+	Datagram d = createDatagram ();
+
+	// one failing receiver
+	scenario.channels[10]->setError (error::WriteError);
+	CommunicationDelegate::ErrorMap errors;
+	Error e = scenario.holder.send (scenario.receivers, d, true, &errors);
+	tcheck1 (e == error::WriteError);
+	tcheck1 (errors.size() == 1);
+	tcheck1 (errors["subscriber10"] == error::WriteError);
+
+	// more failing receivers, also unknown ones
+	errors.clear();
+	scenario.channels[20]->setError (error::Closed);
+	HostSet receivers = scenario.receivers;
+	receivers.insert ("unknown");
+	e = scenario.holder.send (receivers, d, true, &errors);
+	tcheck1 (e == error::MultipleErrors);
+	tcheck1 (errors.size() == 3);
+	tcheck1 (errors["subscriber20"] == error::Closed);
+	tcheck1 (errors["unknown"] == error::ConnectionError);
+
+	// all others still got their datagrams
+	for (size_t i = 0; i < scenario.channels.size(); i++){
+		if (i == 10 || i == 20) continue;
+		tcheck1 (scenario.channels[i]->written.size() == 2);
+	}
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	sf::schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testSharedBuffer());
+	testcase (testAllocations());
+	testcase (testErrorAggregation());
+	testcase_end();
+}
@@ -154,7 +154,7 @@ struct Peer : public CommunicationDelegate, CommunicationMultiplex, DelegateBase
 			return datagram.sendTo (mInitialChannel);
 		}
 	}
-	Error send (const HostSet & set, const Datagram & datagram) {
+	Error send (const HostSet & set, const Datagram & datagram, ErrorMap * errors) {
 		// to get it compiling
 		tassert (false, "Not Implemented");
 		return error::NotSupported;
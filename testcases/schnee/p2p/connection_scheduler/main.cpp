@@ -0,0 +1,158 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/p2p/impl/ConnectionScheduler.h>
+
+/*
+ * @file
+ * Tests the admission control of ConnectionScheduler: stage limits, priorities,
+ * backoff after failures and canceling.
+ */
+using namespace sf;
+
+/// Collects started attempts
+struct Starter : public DelegateBase {
+	Starter () { SF_REGISTER_ME; }
+	~Starter () { SF_UNREGISTER_ME; }
+	VoidDelegate startFunc (const HostId & host) { return abind (dMemFun (this, &Starter::onStart), host); }
+	void onStart (const HostId & host) { started.push_back (host); }
+	bool hasStarted (size_t n) const { return started.size() == n; }
+	std::vector<HostId> started;
+};
+
+int testStageLimit () {
+	ConnectionScheduler scheduler;
+	scheduler.setStageLimit (10, 2);
+	Starter starter;
+	std::vector<ConnectionScheduler::Ticket> tickets;
+	for (int i = 0; i < 5; i++) {
+		HostId host = "host" + toString (i);
+		tickets.push_back (scheduler.request (10, host, starter.startFunc (host)));
+	}
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 2), 1000));
+	test::millisleep_locked (50);
+	tcheck1 (starter.started.size() == 2);
+	tcheck1 (scheduler.metrics().find (10)->second.waiting == 3);
+
+	// other stages are not affected
+	scheduler.request (11, "other", starter.startFunc ("other"));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 3), 1000));
+
+	// finishing frees slots in arrival order
+	scheduler.finish (tickets[0], true);
+	scheduler.finish (tickets[1], true);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 5), 1000));
+	tcheck1 (starter.started[3] == "host2" && starter.started[4] == "host3");
+	scheduler.finish (tickets[2], true);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 6), 1000));
+	tcheck1 (starter.started[5] == "host4");
+
+	const ConnectionScheduler::StageMetrics & m = scheduler.metrics().find (10)->second;
+	tcheck1 (m.maxRunning == 2);
+	tcheck1 (m.attempts == 5);
+	tcheck1 (m.succeeded == 3);
+	tcheck1 (m.running == 2);
+	tcheck1 (m.waiting == 0);
+	return 0;
+}
+
+int testPriority () {
+	ConnectionScheduler scheduler;
+	scheduler.setStageLimit (10, 1);
+	Starter starter;
+	ConnectionScheduler::Ticket first = scheduler.request (10, "a", starter.startFunc ("a"));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 1), 1000));
+	ConnectionScheduler::Ticket t1 = scheduler.request (10, "b", starter.startFunc ("b"));
+	ConnectionScheduler::Ticket t2 = scheduler.request (10, "c", starter.startFunc ("c"));
+	scheduler.setPriority ("c", 1);
+	tcheck1 (scheduler.priority ("c") == 1);
+	scheduler.finish (first, true);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 2), 1000));
+	tcheck1 (starter.started[1] == "c");
+	scheduler.finish (t2, true);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 3), 1000));
+	tcheck1 (starter.started[2] == "b");
+	scheduler.finish (t1, true);
+	return 0;
+}
+
+int testBackoff () {
+	ConnectionScheduler scheduler;
+	ConnectionScheduler::Settings settings;
+	settings.backoffBaseMs = 200;
+	settings.backoffMaxMs  = 400;
+	settings.jitter        = 0.1f;
+	scheduler.setSettings (settings);
+	Starter starter;
+
+	ConnectionScheduler::Ticket t = scheduler.request (10, "a", starter.startFunc ("a"));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 1), 1000));
+	scheduler.finish (t, false);
+	int backoff = scheduler.backoffMs (10, "a");
+	tcheck1 (backoff > 150 && backoff <= 220);
+	tcheck1 (scheduler.backoffMs (11, "a") == 0);
+	tcheck1 (scheduler.backoffMs (10, "b") == 0);
+
+	// retry waits until the backoff ended
+	Time t0 = currentTime ();
+	t = scheduler.request (10, "a", starter.startFunc ("a"));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 2), 1000));
+	tcheck1 ((currentTime() - t0).total_milliseconds() >= 150);
+
+	// doubles, but not more than maximum
+	scheduler.finish (t, false);
+	backoff = scheduler.backoffMs (10, "a");
+	tcheck1 (backoff > 350 && backoff <= 440);
+	t = scheduler.request (10, "a", starter.startFunc ("a"));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 3), 1000));
+	scheduler.finish (t, false);
+	tcheck1 (scheduler.backoffMs (10, "a") <= 440);
+
+	// success resets
+	t = scheduler.request (10, "a", starter.startFunc ("a"));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 4), 1000));
+	scheduler.finish (t, true);
+	tcheck1 (scheduler.backoffMs (10, "a") == 0);
+	return 0;
+}
+
+int testCancel () {
+	ConnectionScheduler scheduler;
+	scheduler.setStageLimit (10, 1);
+	Starter starter;
+	ConnectionScheduler::Ticket running = scheduler.request (10, "a", starter.startFunc ("a"));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 1), 1000));
+	ConnectionScheduler::Ticket waiting = scheduler.request (10, "b", starter.startFunc ("b"));
+	scheduler.request (10, "c", starter.startFunc ("c"));
+
+	// canceling a waiting attempt does not start it and does not count as failure
+	scheduler.cancel (waiting);
+	tcheck1 (scheduler.backoffMs (10, "b") == 0);
+	// canceling a running one frees the slot, but counts as failure
+	scheduler.cancel (running);
+	tcheck1 (scheduler.backoffMs (10, "a") > 0);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Starter::hasStarted, &starter, 2), 1000));
+	tcheck1 (starter.started[1] == "c");
+
+	const ConnectionScheduler::StageMetrics & m = scheduler.metrics().find (10)->second;
+	tcheck1 (m.canceled == 2);
+	tcheck1 (m.running == 1);
+	tcheck1 (m.waiting == 0);
+	// unknown tickets are ignored
+	scheduler.cancel (running);
+	scheduler.finish (waiting, true);
+	tcheck1 (m.running == 1);
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testStageLimit());
+	testcase (testPriority());
+	testcase (testBackoff());
+	testcase (testCancel());
+	testcase_end();
+	return ret;
+}
@@ -0,0 +1,264 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/timing.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+#include <schnee/tools/FileTools.h>
+#include <schnee/p2p/channels/EndpointCache.h>
+#include <schnee/p2p/channels/TCPChannelConnector.h>
+#include <schnee/p2p/channels/UDTChannelConnector.h>
+#include <schnee/net/UDPSocket.h>
+#include <schnee/tools/Deserialization.h>
+#include <schnee/p2p/CommunicationDelegate.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * @file
+ * Tests the EndpointCache and reconnecting via cached TCP endpoints
+ * while the regular address exchange gets no answer; also how
+ * UDTChannelConnector uses cached NAT information.
+ */
+using namespace sf;
+
+/// Communication delegate (the initial channel) which never delivers
+struct DeadDelegate : public CommunicationDelegate {
+	DeadDelegate (Error _result = NoError) : result (_result), sent (0) {}
+	virtual sf::Error send (const HostId & receiver, const sf::Datagram & datagram, const ResultCallback & callback) {
+		sent++;
+		last = datagram;
+		return result;
+	}
+	virtual sf::Error send (const HostSet & receivers, const sf::Datagram & datagram, ErrorMap * errors) {
+		sent++;
+		return result;
+	}
+	virtual int channelLevel (const HostId & receiver) { return 1; }
+	Error result;
+	int sent;
+	Datagram last;	///< Last datagram sent to a single receiver
+};
+
+static EndpointCache::Entry tcpEntry (const String & address, int port) {
+	EndpointCache::Entry e;
+	e.transport = "tcp";
+	e.addresses.push_back (address);
+	e.port = port;
+	return e;
+}
+
+int testCache () {
+	String file = "endpoint_cache_test_" + toString ((int) getpid()) + ".txt";
+	{
+		EndpointCache cache;
+		tcheck1 (!cache.setFile (file));
+		EndpointCache::Entry e = tcpEntry ("192.168.1.2", 1234);
+		e.addresses.push_back ("10.0.0.2");
+		e.udpAddress     = "1.2.3.4";
+		e.udpPort        = 4000;
+		e.externAddress  = "5.6.7.8";
+		e.portPreserving = true;
+		e.nat            = EndpointCache::NAT_PUNCHED;
+		cache.store ("bob@example.com/res", e);
+		cache.store ("carol", tcpEntry ("192.168.1.3", 99));
+		cache.remove ("carol");
+
+		EndpointCache::Entry found;
+		tcheck1 (cache.lookup ("bob@example.com/res", &found));
+		tcheck1 (found.addresses.size() == 2 && found.lastSeen > 0);
+		tcheck1 (!cache.lookup ("carol", &found));
+		tcheck1 (cache.statistics().hits == 1 && cache.statistics().removed == 1);
+	}
+	{
+		// survives restarts
+		EndpointCache cache;
+		tcheck1 (!cache.setFile (file));
+		EndpointCache::Entry found;
+		tcheck1 (cache.lookup ("bob@example.com/res", &found));
+		tcheck1 (found.transport == "tcp");
+		tcheck1 (found.addresses.size() == 2 && found.addresses[0] == "192.168.1.2" && found.addresses[1] == "10.0.0.2");
+		tcheck1 (found.port == 1234);
+		tcheck1 (found.udpAddress == "1.2.3.4" && found.udpPort == 4000);
+		tcheck1 (found.externAddress == "5.6.7.8" && found.portPreserving);
+		tcheck1 (found.nat == EndpointCache::NAT_PUNCHED);
+		tcheck1 (cache.size() == 1);
+
+		// old entries are not used
+		cache.setMaxAge (-1);
+		tcheck1 (!cache.lookup ("bob@example.com/res", &found));
+	}
+	{
+		EndpointCache cache;
+		cache.setMaxEntries (2);
+		cache.store ("a", tcpEntry ("1.1.1.1", 1));
+		cache.store ("b", tcpEntry ("1.1.1.2", 1));
+		cache.store ("c", tcpEntry ("1.1.1.3", 1));
+		tcheck1 (cache.size() == 2);
+	}
+	::remove (file.c_str());
+	return 0;
+}
+
+/// A connector for alice which cannot exchange addresses
+struct Alice {
+	Alice (Error sendResult = NoError) : delegate (sendResult) {
+		connector.setHostId ("alice");
+		connector.protocol()->setDelegate (&delegate);
+	}
+	DeadDelegate delegate;
+	TCPChannelConnector connector;
+};
+
+int testReconnectViaCache () {
+	EndpointCache::instance().clear ();
+	TCPChannelConnector bob;
+	bob.setHostId ("bob");
+	tcheck1 (!bob.start ());
+	EndpointCache::instance().store ("bob", tcpEntry ("127.0.0.1", bob.port()));
+
+	Alice alice;
+	ResultCallbackHelper helper;
+	double t0 = microtime ();
+	tcheck1 (!alice.connector.createChannel ("bob", helper.onResultFunc(), 5000));
+	tcheck1 (!helper.wait (10000));
+	tcheck1 ((microtime() - t0) < 2.5); // the address exchange would time out after 2.5s
+	tcheck1 (alice.delegate.sent == 1);	// it was still tried
+
+	EndpointCache::Entry found;
+	tcheck1 (EndpointCache::instance().lookup ("bob", &found));
+	tcheck1 (found.transport == "tcp" && found.addresses[0] == "127.0.0.1" && found.port == bob.port());
+	return 0;
+}
+
+int testStaleCache () {
+	EndpointCache::instance().clear ();
+	TCPChannelConnector bob;
+	bob.setHostId ("bob");
+	tcheck1 (!bob.start ());
+	int port = bob.port ();
+	bob.stop ();
+	EndpointCache::instance().store ("bob", tcpEntry ("127.0.0.1", port));
+
+	// neither the cache nor the initial channel work
+	Alice alice (error::ConnectionError);
+	ResultCallbackHelper helper;
+	tcheck1 (!alice.connector.createChannel ("bob", helper.onResultFunc(), 5000));
+	tcheck1 (helper.wait (10000) == error::CouldNotConnectHost);
+	return 0;
+}
+
+int testWrongCachedPeer () {
+	EndpointCache::instance().clear ();
+	// bob's cached endpoint belongs to carol now
+	TCPChannelConnector carol;
+	carol.setHostId ("carol");
+	tcheck1 (!carol.start ());
+	EndpointCache::instance().store ("bob", tcpEntry ("127.0.0.1", carol.port()));
+
+	Alice alice (error::ConnectionError);
+	ResultCallbackHelper helper;
+	tcheck1 (!alice.connector.createChannel ("bob", helper.onResultFunc(), 5000));
+	tcheck1 (helper.wait (10000) == error::AuthError);
+	EndpointCache::Entry found;
+	tcheck1 (!EndpointCache::instance().lookup ("bob", &found));
+	return 0;
+}
+
+/// A UDT connector for alice with an echo server which never answers
+struct UdtAlice {
+	UdtAlice () {
+		echoServer.bind (0, "127.0.0.1");
+		connector.setHostId ("alice");
+		connector.setDelegate (&delegate);
+		connector.setEchoServer (UDTChannelConnector::NetEndpoint ("127.0.0.1", echoServer.port()));
+	}
+	DeadDelegate delegate;
+	UDPSocket echoServer;
+	UDTChannelConnector connector;
+};
+
+/// Decodes the last RequestUDTConnect alice sent
+static bool lastRequest (const DeadDelegate & delegate, UDTChannelConnector::RequestUDTConnect * request) {
+	if (!delegate.last.header()) return false;
+	String cmd;
+	Deserialization ds (*delegate.last.header(), cmd);
+	if (ds.error() || cmd != UDTChannelConnector::RequestUDTConnect::getCmdName()) return false;
+	return request->deserialize (ds);
+}
+
+int testUdtSkipsEcho () {
+	EndpointCache::instance().clear ();
+	EndpointCache::Entry preserving;
+	preserving.externAddress  = "5.6.7.8";
+	preserving.portPreserving = true;
+	EndpointCache::instance().store ("bob", preserving);
+	EndpointCache::Entry changing = preserving;
+	changing.portPreserving = false;
+	EndpointCache::instance().store ("carol", changing);
+
+	// the NAT kept the port towards bob, the request goes out without echoing
+	UdtAlice alice;
+	tcheck1 (alice.echoServer.port() > 0);
+	tcheck1 (!alice.connector.createChannel ("bob", ResultCallback(), 10000));
+	tcheck1 (alice.delegate.sent == 1);
+	UDTChannelConnector::RequestUDTConnect request;
+	tcheck1 (lastRequest (alice.delegate, &request));
+	tcheck1 (request.extern_.address == "5.6.7.8" && request.extern_.port > 0);
+
+	// towards carol it did not, so the echo server is asked first
+	tcheck1 (!alice.connector.createChannel ("carol", ResultCallback(), 10000));
+	test::millisleep_locked (300);
+	tcheck1 (alice.delegate.sent == 1);
+	tcheck1 (alice.echoServer.datagramsAvailable() > 0);
+	return 0;
+}
+
+static bool hasDatagrams (UDPSocket * socket) {
+	return socket->datagramsAvailable() > 0;
+}
+
+int testUdtCachedExternAddress () {
+	EndpointCache::instance().clear ();
+	UDPSocket bobExtern;
+	tcheck1 (!bobExtern.bind (0, "127.0.0.1"));
+	// bob got punched at 127.0.0.1 the last time; alice's NAT keeps ports
+	EndpointCache::Entry entry;
+	entry.udpAddress     = "127.0.0.1";
+	entry.udpPort        = bobExtern.port();
+	entry.nat            = EndpointCache::NAT_PUNCHED;
+	entry.externAddress  = "5.6.7.8";
+	entry.portPreserving = true;
+	EndpointCache::instance().store ("bob", entry);
+
+	// bob could not find out his external address, his internal one is not reachable
+	UdtAlice alice;
+	UDTChannelConnector::RequestUDTConnect request;
+	request.id = 1;
+	request.intern.push_back (UDTChannelConnector::NetEndpoint ("192.0.2.1", bobExtern.port()));
+	request.echoResult = error::TimeOut;
+	ByteArray header = sf::toJSONCmd (request);
+	String cmd;
+	Deserialization ds (header, cmd);
+	tcheck1 (!ds.error());
+	tcheck1 (alice.connector.handleRpc ("bob", cmd, ds));
+
+	// alice punches the cached external address with bob's port
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&hasDatagrams, &bobExtern), 3000));
+	tcheck1 (alice.echoServer.datagramsAvailable() == 0);
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testCache());
+	testcase (testReconnectViaCache());
+	testcase (testStaleCache());
+	testcase (testWrongCachedPeer());
+	testcase (testUdtSkipsEcho());
+	testcase (testUdtCachedExternAddress());
+	testcase_end();
+	return ret;
+}
@@ -0,0 +1,190 @@
+#include <schnee/test/test.h>
+#include <schnee/test/LocalChannel.h>
+#include <schnee/test/timing.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/Base64.h>
+#include <schnee/im/xmpp/XMPPStream.h>
+#include <schnee/p2p/channels/IMDispatcher.h>
+#include <schnee/p2p/channels/IMChannel.h>
+
+/*
+ * @file
+ * Tests the IMChannel over a local XMPP stand-in (two XMPPStreams bound with LocalChannels).
+ * Measures throughput and checks pacing and write completion.
+ */
+using namespace sf;
+
+/// IMClient sending its messages through a local XMPPStream
+class LocalIMClient : public IMClient {
+public:
+	LocalIMClient (XMPPStream * stream) : mStream (stream) {}
+
+	virtual bool isAuthenticated () const { return true; }
+	virtual ConnectionState connectionState () const { return CS_CONNECTED; }
+	virtual void connect (const ResultDelegate & callback = ResultDelegate ()) { notifyAsync (callback, NoError); }
+	virtual void disconnect () {}
+	virtual ContactInfo ownInfo () { return ContactInfo (); }
+	virtual String ownId () { return "a@localhost/test"; }
+	virtual void setPresence (const PresenceState & state, const String & desc = String (), int priority = 0) {}
+	virtual Contacts contactRoster () const { return Contacts (); }
+	virtual void updateContactRoster () {}
+	virtual bool sendMessage (const Message & msg, const ResultCallback & callback = ResultCallback()) {
+		return !mStream->sendMessage (xmpp::Message (msg), callback);
+	}
+	virtual ConnectionStateChangedDelegate & connectionStateChanged () { return mConnectionStateChanged; }
+	virtual VoidDelegate & contactRosterChanged () { return mContactRosterChanged; }
+	virtual MessageReceivedDelegate & messageReceived () { return mMessageReceived; }
+
+private:
+	XMPPStream * mStream;
+	ConnectionStateChangedDelegate mConnectionStateChanged;
+	VoidDelegate mContactRosterChanged;
+	MessageReceivedDelegate mMessageReceived;
+};
+
+/// Decodes incoming binary messages like IMChannel
+struct Receiver : public DelegateBase {
+	Receiver () : messages (0) { SF_REGISTER_ME; }
+	~Receiver () { SF_UNREGISTER_ME; }
+
+	void onMessage (const xmpp::Message & m, const XMLView & base) {
+		messages++;
+		if (m.body.substr (0, 4) != "BNRY") return;
+		ByteArray part;
+		Base64::decodeToArray (m.body.data() + 4, m.body.size() - 4, part);
+		data.append (part);
+	}
+	bool hasReceived (size_t size) const { return data.size() >= size; }
+
+	ByteArray data;
+	int messages;
+};
+
+struct Scenario {
+	Scenario () {
+		channel1 = test::LocalChannelPtr (new test::LocalChannel);
+		channel2 = test::LocalChannelPtr (new test::LocalChannel);
+		test::LocalChannel::bindChannels (*channel1, *channel2);
+	}
+
+	Error connect (const IMChannel::Settings & settings) {
+		ResultCallbackHelper initHelper1;
+		ResultCallbackHelper initHelper2;
+		stream1.setInfo ("a@localhost", "b@localhost");
+		stream2.setInfo ("b@localhost", "a@localhost");
+		Error e = stream1.startInit (channel1, initHelper1.onResultFunc());
+		if (e) return e;
+		e = stream2.respondInit (channel2, initHelper2.onResultFunc());
+		if (e) return e;
+		if (initHelper1.wait(1000) || initHelper2.wait(1000)) return error::ConnectionError;
+		stream2.incomingMessage() = dMemFun (&receiver, &Receiver::onMessage);
+
+		dispatcher.setChannelSettings (settings);
+		e = dispatcher.setClient (new LocalIMClient (&stream1));
+		if (e) return e;
+		channel = IMDispatcher::IMChannelPtr (new IMChannel (&dispatcher, "b@localhost/test", OS_ONLINE));
+		return NoError;
+	}
+
+	test::LocalChannelPtr channel1;
+	test::LocalChannelPtr channel2;
+	XMPPStream stream1;
+	XMPPStream stream2;
+	Receiver receiver;
+	IMDispatcher dispatcher;
+	IMDispatcher::IMChannelPtr channel;
+};
+
+static ByteArrayPtr randomData (size_t size) {
+	ByteArrayPtr data = createByteArrayPtr ();
+	data->resize (size);
+	for (size_t i = 0; i < size; i++) (*data)[i] = (char) (rand () & 0xff);
+	return data;
+}
+
+// Unpaced: measures throughput through the XMPP stand-in
+int testThroughput () {
+	IMChannel::Settings settings;
+	settings.stanzaSize = 16384;
+	settings.rate = 0;
+	settings.maxPendingStanzas = 16;
+	Scenario scenario;
+	tcheck1 (!scenario.connect (settings));
+
+	const size_t size = 4 * 1024 * 1024;
+	ByteArrayPtr data = randomData (size);
+	ResultCallbackHelper writeHelper;
+	Time start = sf::currentTime ();
+	tcheck1 (!scenario.channel->write (data, writeHelper.onResultFunc()));
+	tcheck1 (!writeHelper.wait (30000));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Receiver::hasReceived, &scenario.receiver, size), 10000));
+	double seconds = (sf::currentTime() - start).total_microseconds() / 1000000.0;
+	tcheck1 (scenario.receiver.data.size() == size);
+	tcheck1 (memcmp (scenario.receiver.data.const_c_array(), data->const_c_array(), size) == 0);
+	tcheck1 (scenario.receiver.messages == (int) ((size + settings.stanzaSize - 1) / settings.stanzaSize));
+	std::cout << "IMChannel throughput (unpaced, " << settings.stanzaSize << " byte stanzas): "
+			<< (size / seconds / 1024.0 / 1024.0) << "MB/s" << std::endl;
+	return 0;
+}
+
+// Paced: write completes only after the token bucket let all stanzas go out
+int testPacing () {
+	IMChannel::Settings settings;
+	settings.stanzaSize = 2048;
+	settings.rate  = 40000;
+	settings.burst = 10000;
+	Scenario scenario;
+	tcheck1 (!scenario.connect (settings));
+
+	// ~54kb of message bodies, 10kb burst --> ~1.1s
+	const size_t size = 40 * 1024;
+	ByteArrayPtr data = randomData (size);
+	ResultCallbackHelper writeHelper;
+	Time start = sf::currentTime ();
+	tcheck1 (!scenario.channel->write (data, writeHelper.onResultFunc()));
+	test::millisleep_locked (300);
+	tcheck (!writeHelper.ready(), "Write may not complete before the data is sent");
+	tcheck1 (!writeHelper.wait (10000));
+	double seconds = (sf::currentTime() - start).total_microseconds() / 1000000.0;
+	double expected = (20 * (4 + sf::Base64::encodedLength (2048)) - settings.burst) / (double) settings.rate;
+	std::cout << "IMChannel paced: " << seconds << "s, expected " << expected << "s, "
+			<< (size / seconds / 1024.0) << "kb/s payload" << std::endl;
+	tcheck1 (seconds >= expected * 0.9);
+	tcheck1 (seconds < expected + 1.0);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Receiver::hasReceived, &scenario.receiver, size), 1000));
+	tcheck1 (scenario.receiver.data.size() == size);
+	tcheck1 (memcmp (scenario.receiver.data.const_c_array(), data->const_c_array(), size) == 0);
+	return 0;
+}
+
+// Write callbacks come in order, each as soon as its data left
+int testCompletionOrder () {
+	IMChannel::Settings settings;
+	settings.stanzaSize = 1024;
+	settings.rate  = 8192;
+	settings.burst = 4096;
+	Scenario scenario;
+	tcheck1 (!scenario.connect (settings));
+
+	ResultCallbackHelper first;
+	ResultCallbackHelper second;
+	tcheck1 (!scenario.channel->write (randomData (1024), first.onResultFunc()));
+	tcheck1 (!scenario.channel->write (randomData (16 * 1024), second.onResultFunc()));
+	tcheck1 (!first.wait (500));
+	tcheck (!second.ready(), "Second write needs ~2s");
+	tcheck1 (!second.wait (5000));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Receiver::hasReceived, &scenario.receiver, 17 * 1024), 1000));
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testThroughput());
+	testcase (testPacing());
+	testcase (testCompletionOrder());
+	testcase_end();
+	return ret;
+}
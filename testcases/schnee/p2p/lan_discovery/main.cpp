@@ -0,0 +1,147 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/test/timing.h>
+#include <schnee/p2p/channels/LANChannelConnector.h>
+#include <schnee/p2p/Authentication.h>
+#include <schnee/net/UDPSocket.h>
+
+/*
+ * @file
+ * Tests finding peers in the local network with LANChannelConnector.
+ * Runs over the loopback interface. Authenticated announcements can't be replayed.
+ */
+using namespace sf;
+
+static const char * gGroup     = "239.255.83.70";
+static const int    gGroupPort = 35312;
+static const char * gInterface = "127.0.0.1";
+
+/// Initializes a connector which does not connect automatically
+static Error startConnector (LANChannelConnector & c, const HostId & id, Authentication * auth = 0) {
+	c.setHostId (id);
+	if (auth) c.setAuthentication (auth);
+	c.setAnnounceInterval (100);
+	c.setAutoConnect (false);
+	return c.start (gGroup, gGroupPort, gInterface);
+}
+
+/// Records announcements of one host in the multicast group
+struct Sniffer : public DelegateBase {
+	Sniffer (const HostId & host) : host (host) {
+		SF_REGISTER_ME;
+		socket.readyRead() = dMemFun (this, &Sniffer::onReadyRead);
+	}
+	~Sniffer () {
+		SF_UNREGISTER_ME;
+	}
+	void onReadyRead () {
+		ByteArrayPtr data;
+		while ((data = socket.recvFrom ())) {
+			if (String (data->begin(), data->end()).find ("\"" + host + "\"") != String::npos) recorded = data;
+		}
+	}
+	bool hasRecorded () const { return recorded.get() != 0; }
+	HostId host;
+	UDPSocket socket;
+	ByteArrayPtr recorded;
+};
+
+int testDiscovery () {
+	LANChannelConnector a;
+	LANChannelConnector b;
+	tcheck1 (!startConnector (a, "alice"));
+	tcheck1 (!startConnector (b, "bob"));
+	tcheck1 (a.start (gGroup, gGroupPort, gInterface) == error::ExistsAlready);
+
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&LANChannelConnector::isNeighbor, &a, "bob"), 3000));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&LANChannelConnector::isNeighbor, &b, "alice"), 3000));
+	tcheck1 (!a.isNeighbor ("alice"));
+
+	LANChannelConnector::NeighborVec neighbors = a.neighbors();
+	tcheck1 (neighbors.size() == 1);
+	tcheck1 (neighbors[0].host == "bob");
+	tcheck1 (neighbors[0].port == b.port());
+
+	// unknown hosts cannot be connected
+	tcheck1 (a.createChannel ("carol", ResultCallback()) == error::NotFound);
+
+	// silent neighbors are forgotten
+	b.stop ();
+	tcheck1 (test::waitUntilTrueMs (!sf::bind (&LANChannelConnector::isNeighbor, &a, "bob"), 3000));
+	return 0;
+}
+
+int testAuthenticatedDiscovery () {
+	Authentication aliceAuth, bobAuth, eveAuth;
+	aliceAuth.setIdentity ("alice");
+	bobAuth.setIdentity ("bob");
+	eveAuth.setIdentity ("eve");
+
+	// alice and bob know each other, nobody knows eve
+	Authentication::CertInfo info;
+	info.type = Authentication::CT_PEER;
+	info.cert = bobAuth.certificate();
+	aliceAuth.update ("bob", info);
+	info.cert = aliceAuth.certificate();
+	bobAuth.update ("alice", info);
+
+	LANChannelConnector a, b, eve, fakeBob;
+	tcheck1 (!startConnector (a, "alice", &aliceAuth));
+	tcheck1 (!startConnector (b, "bob", &bobAuth));
+	tcheck1 (!startConnector (eve, "eve", &eveAuth));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&LANChannelConnector::isNeighbor, &a, "bob"), 3000));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&LANChannelConnector::isNeighbor, &b, "alice"), 3000));
+
+	// eve sends her announcements, but is not accepted
+	test::millisleep_locked (300);
+	tcheck1 (!a.isNeighbor ("eve"));
+	tcheck1 (!b.isNeighbor ("eve"));
+	tcheck1 (eve.neighbors().empty());
+
+	// eve cannot pretend to be bob
+	b.stop ();
+	tcheck1 (test::waitUntilTrueMs (!sf::bind (&LANChannelConnector::isNeighbor, &a, "bob"), 3000));
+	tcheck1 (!startConnector (fakeBob, "bob", &eveAuth));
+	test::millisleep_locked (300);
+	tcheck1 (!a.isNeighbor ("bob"));
+	return 0;
+}
+
+int testReplay () {
+	Authentication aliceAuth, bobAuth;
+	aliceAuth.setIdentity ("alice");
+	bobAuth.setIdentity ("bob");
+	Authentication::CertInfo info;
+	info.type = Authentication::CT_PEER;
+	info.cert = bobAuth.certificate();
+	aliceAuth.update ("bob", info);
+
+	Sniffer sniffer ("bob");
+	tcheck1 (!sniffer.socket.bindMulticast (gGroup, gGroupPort, gInterface));
+	LANChannelConnector a, b;
+	tcheck1 (!startConnector (a, "alice", &aliceAuth));
+	tcheck1 (!startConnector (b, "bob", &bobAuth));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&LANChannelConnector::isNeighbor, &a, "bob"), 3000));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Sniffer::hasRecorded, &sniffer), 3000));
+
+	// a recorded announcement of bob doesn't bring him back
+	b.stop ();
+	tcheck1 (test::waitUntilTrueMs (!sf::bind (&LANChannelConnector::isNeighbor, &a, "bob"), 3000));
+	for (int i = 0; i < 5; i++) {
+		tcheck1 (!sniffer.socket.sendTo (gGroup, gGroupPort, sniffer.recorded));
+		test::millisleep_locked (50);
+	}
+	tcheck1 (!a.isNeighbor ("bob"));
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testDiscovery());
+	testcase (testAuthenticatedDiscovery());
+	testcase (testReplay());
+	testcase_end();
+}
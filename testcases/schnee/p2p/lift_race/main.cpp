@@ -0,0 +1,163 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/test/LocalChannel.h>
+#include <schnee/p2p/impl/GenericConnectionManagement.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+
+/*
+ * @file
+ * Tests the lift strategies of GenericConnectionManagement with fake channel providers:
+ * racing has to be as fast as the fastest provider, sequential lifting waits for
+ * the better ones to fail first.
+ */
+using namespace sf;
+
+/// Creates local channels after a delay (or fails)
+class FakeProvider : public ChannelProvider, public DelegateBase {
+public:
+	FakeProvider (bool initial, int delayMs, bool succeed) : mInitial (initial), mDelayMs (delayMs), mSucceed (succeed), attempts (0) {
+		SF_REGISTER_ME;
+	}
+	~FakeProvider () {
+		SF_UNREGISTER_ME;
+	}
+	virtual sf::Error createChannel (const HostId & target, const ResultCallback & callback, int timeOutMs) {
+		attempts++;
+		xcallTimed (abind (dMemFun (this, &FakeProvider::onDone), target, callback), futureInMs (mDelayMs));
+		return NoError;
+	}
+	virtual bool providesInitialChannels () { return mInitial; }
+	virtual void setHostId (const sf::HostId & id) {}
+	virtual void setAuthentication (Authentication * auth) {}
+	virtual ChannelCreationDelegate & channelCreated () { return mChannelCreated; }
+
+	int attempts;
+private:
+	void onDone (const HostId & target, const ResultCallback & callback) {
+		if (!mSucceed) {
+			notify (callback, error::CouldNotConnectHost);
+			return;
+		}
+		test::LocalChannelPtr a (new test::LocalChannel ());
+		test::LocalChannelPtr b (new test::LocalChannel ());
+		test::LocalChannel::bindChannels (*a, *b);
+		mOthers.push_back (b);
+		notify (mChannelCreated, target, ChannelPtr (a), true);
+		notify (callback, NoError);
+	}
+	bool mInitial;
+	int  mDelayMs;
+	bool mSucceed;
+	std::vector<test::LocalChannelPtr> mOthers;
+	ChannelCreationDelegate mChannelCreated;
+};
+typedef shared_ptr<FakeProvider> FakeProviderPtr;
+
+/// Connection management with an initial provider (level 1) and two lifting ones
+struct Setup {
+	Setup (GenericConnectionManagement::LiftStrategy strategy, int slowMs, bool slowSucceeds, int fastMs, bool fastSucceeds) {
+		im   = FakeProviderPtr (new FakeProvider (true, 10, true));
+		slow = FakeProviderPtr (new FakeProvider (false, slowMs, slowSucceeds));
+		fast = FakeProviderPtr (new FakeProvider (false, fastMs, fastSucceeds));
+		connections.init (&multiplex, 0);
+		connections.setHostId ("alice");
+		connections.setLiftStrategy (strategy);
+		connections.addChannelProvider (im, 1);
+		connections.addChannelProvider (fast, 10);
+		connections.addChannelProvider (slow, 11); // better, tried first if sequential
+	}
+	~Setup () {
+		connections.uninit ();
+	}
+	CommunicationMultiplex multiplex;
+	GenericConnectionManagement connections;
+	FakeProviderPtr im, slow, fast;
+};
+
+static bool hasLevel (GenericConnectionManagement * connections, const HostId & host, int level) {
+	return connections->channelLevel (host) == level;
+}
+
+/// Lifts and returns the time until the lift finished
+static int lift (Setup & setup, Error * result) {
+	ResultCallbackHelper helper;
+	double t0 = sf::microtime ();
+	tcheck1 (!setup.connections.liftConnection ("bob", helper.onResultFunc(), 10000));
+	*result = helper.wait (10000);
+	return (int) ((sf::microtime () - t0) * 1000);
+}
+
+int testSequential () {
+	// the better provider fails slowly, the other one is only tried afterwards
+	Setup setup (GenericConnectionManagement::LS_SEQUENTIAL, 500, false, 100, true);
+	Error result;
+	int ms = lift (setup, &result);
+	tcheck1 (!result);
+	tcheck1 (ms >= 600);
+	tcheck1 (setup.connections.channelLevel ("bob") == 10);
+	const GenericConnectionManagement::LiftMetrics & m = setup.connections.liftMetrics();
+	tcheck1 (m.lifts == 1 && m.raced == 0 && m.lifted == 1);
+	tcheck1 (m.lastTimeToFirstChannelMs >= 600);
+	return 0;
+}
+
+int testRace () {
+	Setup setup (GenericConnectionManagement::LS_RACE, 500, false, 100, true);
+	Error result;
+	int ms = lift (setup, &result);
+	tcheck1 (!result);
+	tcheck1 (ms < 400);
+	tcheck1 (setup.connections.channelLevel ("bob") == 10);
+	tcheck1 (setup.slow->attempts == 1 && setup.fast->attempts == 1);
+	const GenericConnectionManagement::LiftMetrics & m = setup.connections.liftMetrics();
+	tcheck1 (m.lifts == 1 && m.raced == 1 && m.lifted == 1);
+	tcheck1 (m.lastTimeToFirstChannelMs >= 100 && m.lastTimeToFirstChannelMs < 400);
+
+	// the loser still finishes in the background and frees its slot
+	test::millisleep_locked (600);
+	const ConnectionScheduler::MetricsMap & sm = setup.connections.scheduler().metrics();
+	tcheck1 (sm.find (11)->second.running == 0);
+	tcheck1 (sm.find (11)->second.failed == 1);
+	return 0;
+}
+
+int testRaceLateBetterChannel () {
+	// the better channel arrives after the race is over and replaces the winner
+	Setup setup (GenericConnectionManagement::LS_RACE, 300, true, 100, true);
+	Error result;
+	int ms = lift (setup, &result);
+	tcheck1 (!result);
+	tcheck1 (ms < 300);
+	tcheck1 (setup.connections.channelLevel ("bob") == 10);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&hasLevel, &setup.connections, "bob", 11), 2000));
+	tcheck1 (setup.connections.scheduler().metrics().find (11)->second.succeeded == 1);
+	return 0;
+}
+
+int testRaceAllFail () {
+	Setup setup (GenericConnectionManagement::LS_RACE, 200, false, 100, false);
+	Error result;
+	lift (setup, &result);
+	tcheck1 (!result); // initial channel is enough for liftConnection
+	tcheck1 (setup.connections.channelLevel ("bob") == 1);
+	tcheck1 (setup.connections.liftMetrics().lifted == 0);
+
+	ResultCallbackHelper helper;
+	tcheck1 (!setup.connections.liftToAtLeast (10, "bob", helper.onResultFunc(), 5000));
+	tcheck1 (helper.wait (5000) == error::CouldNotConnectHost);
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testSequential());
+	testcase (testRace());
+	testcase (testRaceLateBetterChannel());
+	testcase (testRaceAllFail());
+	testcase_end();
+	return ret;
+}
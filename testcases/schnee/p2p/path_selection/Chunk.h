@@ -0,0 +1,9 @@
+#pragma once
+#include <sfserialization/autoreflect.h>
+
+/// Numbered test datagram
+struct Chunk {
+	Chunk () : num (0) {}
+	int num;
+	SF_AUTOREFLECT_SDC;
+};
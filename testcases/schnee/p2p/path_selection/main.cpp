@@ -0,0 +1,244 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/test/LocalChannel.h>
+#include <schnee/p2p/impl/ChannelHolder.h>
+#include <schnee/p2p/impl/ChannelProber.h>
+#include <schnee/p2p/impl/PathEstimator.h>
+#include <math.h>
+#include "Chunk.h"
+
+/*
+ * @file
+ * Tests measurement driven channel selection of the ChannelHolder:
+ * the estimator, selection by traffic class with hysteresis, keeping the
+ * order of datagrams until the peer confirmed them and probing of idle channels.
+ */
+using namespace sf;
+
+/// Calls back writes at once but holds the data back until released, like a large send buffer
+class HoldingChannel : public Channel {
+public:
+	HoldingChannel (const ChannelPtr & next) : mNext (next), mHolding (true) {}
+	virtual sf::Error error () const { return mNext->error(); }
+	virtual State state () const { return mNext->state(); }
+	virtual Error write (const ByteArrayPtr& data, const ResultCallback & callback = ResultCallback()) {
+		if (!mHolding) return mNext->write (data, callback);
+		mHeld.push_back (data);
+		if (callback) xcall (abind (callback, NoError));
+		return NoError;
+	}
+	virtual sf::ByteArrayPtr read (long maxSize = -1) { return mNext->read (maxSize); }
+	virtual void close (const ResultCallback & resultCallback = ResultCallback ()) { mNext->close (resultCallback); }
+	virtual const char * stackInfo () const { return "holding"; }
+	virtual const ChannelPtr next () const { return mNext; }
+	virtual sf::VoidDelegate & changed () { return mNext->changed(); }
+
+	/// Writes all held data and stops holding
+	void release () {
+		mHolding = false;
+		for (size_t i = 0; i < mHeld.size(); i++) mNext->write (mHeld[i]);
+		mHeld.clear ();
+	}
+private:
+	ChannelPtr mNext;
+	bool mHolding;
+	std::vector<ByteArrayPtr> mHeld;
+};
+typedef shared_ptr<HoldingChannel> HoldingChannelPtr;
+
+/// Two peers A and B with a "UDT" (level 10) and a "TCP" (level 11) channel
+struct Scenario {
+	ChannelHolder holder1;
+	ChannelHolder holder2;
+	ChannelHolder::ChannelId udt;
+	ChannelHolder::ChannelId tcp;
+	HoldingChannelPtr holding;	///< A's side of the UDT channel if holding
+	std::vector<int> received;	///< Chunks B got
+	Scenario (bool holdUdt = false) {
+		holder1.setHostId ("A");
+		holder2.setHostId ("B");
+		holder2.incomingDatagram() = sf::bind (&Scenario::onDatagram, this, _1, _2, _3, _4);
+		udt = addChannels (10, holdUdt);
+		tcp = addChannels (11, false);
+	}
+
+	ChannelHolder::ChannelId addChannels (int level, bool hold) {
+		test::LocalChannelPtr a (new test::LocalChannel()), b (new test::LocalChannel());
+		test::LocalChannel::bindChannels (*a, *b);
+		holder2.add (b, "A", false, level);
+		if (!hold) return holder1.add (a, "B", true, level);
+		holding = HoldingChannelPtr (new HoldingChannel (a));
+		return holder1.add (holding, "B", true, level);
+	}
+
+	ChannelHolder::ChannelId best (ChannelHolder::TrafficClass c) const {
+		return holder1.findBestChannel ("B", c);
+	}
+
+	/// Sends a chunk from A to B like GenericConnectionManagement does
+	/// @return the used channel
+	ChannelHolder::ChannelId send (int num, size_t size) {
+		Chunk chunk;
+		chunk.num = num;
+		Datagram d = Datagram::fromCmd (chunk, createByteArrayPtr (ByteArray (size, 'x')));
+		ChannelHolder::ChannelId id = holder1.selectChannel ("B", d.encodedSize());
+		if (!id || holder1.send (id, d, true)) return 0;
+		return id;
+	}
+
+	void onDatagram (const HostId & source, const String & cmd, const Deserialization & ds, const ByteArray & data) {
+		Chunk chunk;
+		if (cmd == Chunk::getCmdName() && chunk.deserialize (ds)) received.push_back (chunk.num);
+	}
+
+	bool hasReceived (size_t count) const {
+		return received.size() >= count;
+	}
+
+	/// B got chunks 0 .. count-1 in order
+	bool inOrder (size_t count) const {
+		if (received.size() != count) return false;
+		for (size_t i = 0; i < count; i++) {
+			if (received[i] != (int) i) return false;
+		}
+		return true;
+	}
+};
+
+int testEstimator () {
+	PathEstimator e;
+	tcheck1 (!e.hasRtt() && !e.hasBandwidth());
+	e.addRtt (0.1f);
+	tcheck1 (e.hasRtt() && e.srtt() == 0.1f && e.rttVar() == 0.05f);
+	e.addRtt (0.2f);
+	// srtt = 7/8 * 0.1 + 1/8 * 0.2
+	tcheck1 (fabs (e.srtt() - 0.1125f) < 0.0001f);
+	tcheck1 (fabs (e.rttVar() - 0.0625f) < 0.0001f);
+
+	e.addPassive (1000);
+	tcheck1 (e.hasBandwidth() && e.bandwidth() == 1000);
+	e.addProbe (5000);
+	tcheck1 (e.bandwidth() == 5000);
+	e.addProbe (1000);
+	tcheck1 (e.bandwidth() == 4000);
+	// passive traffic is a lower bound
+	e.addPassive (9000);
+	tcheck1 (e.bandwidth() == 4000);
+	for (int i = 0; i < 10; i++) e.addPassive (9000);
+	tcheck1 (e.bandwidth() > 8000);
+	return 0;
+}
+
+int testSelection () {
+	Scenario s;
+	// without measurement the level decides
+	tcheck1 (s.holder1.findBestChannel ("B") == s.tcp);
+	tcheck1 (s.best (ChannelHolder::Control) == s.tcp);
+	tcheck1 (s.best (ChannelHolder::Bulk) == s.tcp);
+
+	// measured tcp, unmeasured udt: stays tcp
+	s.holder1.addChannelPingMeasure (s.tcp, 0.05f);
+	s.holder1.addChannelBandwidthMeasure (s.tcp, 1000000, false);
+	tcheck1 (s.best (ChannelHolder::Control) == s.tcp);
+	tcheck1 (s.best (ChannelHolder::Bulk) == s.tcp);
+
+	// slightly better udt: hysteresis
+	s.holder1.addChannelPingMeasure (s.udt, 0.045f);
+	s.holder1.addChannelBandwidthMeasure (s.udt, 1100000, false);
+	tcheck1 (s.best (ChannelHolder::Control) == s.tcp);
+	tcheck1 (s.best (ChannelHolder::Bulk) == s.tcp);
+
+	// much faster udt, but congested (high delay)
+	for (int i = 0; i < 10; i++) s.holder1.addChannelPingMeasure (s.udt, 0.3f);
+	s.holder1.addChannelBandwidthMeasure (s.udt, 10000000, false);
+	tcheck1 (s.best (ChannelHolder::Control) == s.tcp);
+	tcheck1 (s.best (ChannelHolder::Bulk) == s.udt);
+	tcheck1 (s.holder1.findBestChannel ("B") == s.tcp);
+
+	// bandwidth shows up in connection infos
+	ConnectionManagement::ConnectionInfos infos = s.holder1.connections();
+	tcheck1 (infos.size() == 2);
+	for (ConnectionManagement::ConnectionInfos::const_iterator i = infos.begin(); i != infos.end(); i++) {
+		tcheck1 (i->cinfo.bandwidth > 0 && i->cinfo.delay > 0);
+	}
+
+	// measured best channels are not redundant
+	s.holder1.closeRedundantChannelsToHost ("B");
+	tcheck1 (s.holder1.findChannel ("B", 10) == s.udt);
+	tcheck1 (s.holder1.findChannel ("B", 11) == s.tcp);
+
+	// closing the bulk channel falls back
+	s.holder1.close (s.udt);
+	tcheck1 (s.best (ChannelHolder::Bulk) == s.tcp);
+	return 0;
+}
+
+int testOrder () {
+	// data written into the UDT channel doesn't reach B until released
+	Scenario s (true);
+	s.holder1.setBulkThreshold (1000);
+	s.holder1.addChannelPingMeasure (s.tcp, 0.01f);
+	s.holder1.addChannelPingMeasure (s.udt, 0.1f);
+	s.holder1.addChannelBandwidthMeasure (s.tcp, 100000, false);
+	s.holder1.addChannelBandwidthMeasure (s.udt, 1000000, false);
+	tcheck1 (s.best (ChannelHolder::Control) == s.tcp);
+	tcheck1 (s.best (ChannelHolder::Bulk) == s.udt);
+
+	tcheck1 (s.send (0, 10) == s.tcp);
+	// not confirmed yet, bulk stays after control
+	tcheck1 (s.send (1, 5000) == s.tcp);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Scenario::hasReceived, &s, 2), 1000));
+	test::millisleep_locked (100);
+	tcheck1 (s.send (2, 5000) == s.udt);
+	// written (and called back) but still held, control stays after bulk
+	test::millisleep_locked (100);
+	tcheck1 (s.send (3, 10) == s.udt);
+	test::millisleep_locked (100);
+	tcheck1 (s.send (4, 10) == s.udt);
+	tcheck1 (s.received.size() == 2);
+
+	// B confirms after getting everything
+	s.holding->release ();
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Scenario::hasReceived, &s, 5), 1000));
+	test::millisleep_locked (100);
+	tcheck1 (s.send (5, 10) == s.tcp);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Scenario::hasReceived, &s, 6), 1000));
+	tcheck1 (s.inOrder (6));
+	tcheck1 (s.holder1.selectChannel ("C", 100) == 0);
+	return 0;
+}
+
+bool hasBandwidth (const ChannelHolder * holder, ChannelHolder::ChannelId id) {
+	ConnectionManagement::ConnectionInfos infos = holder->connections();
+	for (ConnectionManagement::ConnectionInfos::const_iterator i = infos.begin(); i != infos.end(); i++) {
+		if (i->id == id) return i->cinfo.bandwidth > 0;
+	}
+	return false;
+}
+
+int testProbing () {
+	Scenario s;
+	ChannelProber prober;
+	prober.init (&s.holder1);
+	prober.setCheckInterval (100);
+	s.holder1.incomingProbeReport() = dMemFun (&prober, &ChannelProber::onProbeReport);
+	prober.measure() = dMemFun (&s.holder1, &ChannelHolder::addChannelBandwidthMeasure);
+	prober.start ();
+	// channels are probed after being idle
+	tcheck1 (test::waitUntilTrueMs (bind (&hasBandwidth, &s.holder1, s.tcp), 5000));
+	tcheck1 (test::waitUntilTrueMs (bind (&hasBandwidth, &s.holder1, s.udt), 5000));
+	prober.stop ();
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	sf::schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testEstimator());
+	testcase (testSelection());
+	testcase (testOrder());
+	testcase (testProbing());
+	testcase_end();
+}
@@ -0,0 +1,227 @@
+#include <schnee/schnee.h>
+#include <schnee/test/test.h>
+#include <schnee/test/initHelpers.h>
+#include <schnee/test/NetworkDispatcher.h>
+#include <schnee/p2p/impl/GenericInterplexBeacon.h>
+#include <schnee/p2p/channels/RelayChannelProvider.h>
+#include <schnee/p2p/Messaging.h>
+#include <schnee/tools/ResultCallbackHelper.h>
+#include <schnee/tools/MicroTime.h>
+
+/*
+ * @file
+ * Tests relayed channels: A and B can't reach each other directly,
+ * but both are connected to R, which relays for them (if it wants to)
+ * with a limited bandwidth.
+ *
+ * Relays are no initial channel provider and there is no IM channel between A and B
+ * here, so the tests ask the relay provider directly instead of lifting.
+ */
+using namespace sf;
+
+/// A peer with simulated direct channels (level 10) and relayed ones (level 5)
+struct Node {
+	Node (test::Network & network, const HostId & name) : id (name), received (0) {
+		beacon     = new GenericInterplexBeacon ();
+		dispatcher = shared_ptr<test::NetworkDispatcher> (new test::NetworkDispatcher (network));
+		dispatcher->setNeighborsOnly ();
+		relay      = shared_ptr<RelayChannelProvider> (new RelayChannelProvider ());
+		relay->setConnectionManagement (&beacon->connections());
+		beacon->setPresenceProvider (dispatcher);
+		beacon->connections().addChannelProvider (dispatcher, 10);
+		beacon->connections().addChannelProvider (relay, 5);
+		beacon->setConnectionString (name, "");
+		messaging = Messaging::create ();
+		messaging->messageReceived() = sf::bind (&Node::onMessage, this, _1, _2);
+		beacon->components().addComponent (messaging);
+	}
+	~Node () {
+		beacon->components().delComponent (messaging);
+		delete messaging;
+		delete beacon;
+	}
+
+	void onMessage (const sf::String & sender, const sf::ByteArray & message) {
+		received += message.size();
+	}
+
+	int level (const Node & other) {
+		return beacon->connections().channelLevel (other.id);
+	}
+
+	HostId id;
+	GenericInterplexBeacon * beacon;
+	shared_ptr<test::NetworkDispatcher> dispatcher;
+	shared_ptr<RelayChannelProvider> relay;
+	Messaging * messaging;
+	size_t received;
+};
+
+/// A -- R -- B
+struct Scenario {
+	Scenario () {
+		network.setAuthentication (true);
+		network.addConnection (test::Connection ("A", "R", 0.01f));
+		network.addConnection (test::Connection ("R", "B", 0.01f));
+		a = new Node (network, "A");
+		r = new Node (network, "R");
+		b = new Node (network, "B");
+	}
+	~Scenario () {
+		delete a;
+		delete b;
+		delete r;
+	}
+
+	/// Goes online, connects both to R and lets A and B know their certificates
+	/// (as friends would do via their IM channel)
+	int init () {
+		tcheck1 (!a->beacon->connect());
+		tcheck1 (!r->beacon->connect());
+		tcheck1 (!b->beacon->connect());
+		tcheck1 (test::waitUntilTrueMs (sf::bind (&Scenario::seeEachOther, this), 2000));
+		ResultCallbackHelper helperA, helperB;
+		tcheck1 (!a->beacon->connections().liftConnection (r->id, helperA.onResultFunc(), 5000));
+		tcheck1 (!b->beacon->connections().liftConnection (r->id, helperB.onResultFunc(), 5000));
+		tcheck1 (!helperA.wait (5000));
+		tcheck1 (!helperB.wait (5000));
+		tcheck1 (a->level (*r) == 10 && b->level (*r) == 10);
+		befriend (a, b);
+		befriend (b, a);
+		return 0;
+	}
+
+	static void befriend (Node * x, Node * y) {
+		Authentication::CertInfo info;
+		info.type = Authentication::CT_PEER;
+		info.cert = y->beacon->authentication().certificate();
+		x->beacon->authentication().update (y->id, info);
+	}
+
+	bool seeEachOther () const {
+		return a->dispatcher->hosts().size() == 3 && b->dispatcher->hosts().size() == 3 && r->dispatcher->hosts().size() == 3;
+	}
+
+	bool relayedStreams (int count) const {
+		return r->relay->relayProtocol().statistics().streams == count;
+	}
+
+	bool received (size_t bytes) const {
+		return b->received >= bytes;
+	}
+
+	test::Network network;
+	Node * a;
+	Node * r;
+	Node * b;
+};
+
+static bool hasLevel (Node * x, Node * y, int level) {
+	return x->level (*y) == level;
+}
+
+int testNoRelaying () {
+	Scenario s;
+	tcheck1 (s.init() == 0);
+	// relays are no initial channels, so without an existing channel nobody gets asked
+	ResultCallbackHelper liftHelper;
+	tcheck1 (!s.a->beacon->connections().liftConnection (s.b->id, liftHelper.onResultFunc(), 5000));
+	tcheck1 (liftHelper.wait (10000) == error::CouldNotConnectHost);
+	tcheck1 (s.r->relay->relayProtocol().statistics().rejected == 0);
+
+	// R doesn't relay by default
+	ResultCallbackHelper helper;
+	tcheck1 (!s.a->relay->createChannel (s.b->id, helper.onResultFunc(), 5000));
+	tcheck1 (helper.wait (10000) == error::CouldNotConnectHost);
+	tcheck1 (s.a->level (*s.b) == 0);
+	tcheck1 (s.r->relay->relayProtocol().statistics().rejected == 1);
+
+	// and doesn't get asked again
+	tcheck1 (s.a->relay->createChannel (s.b->id, helper.onResultFunc(), 5000) == error::NotFound);
+	tcheck1 (s.r->relay->relayProtocol().statistics().rejected == 1);
+	return 0;
+}
+
+int testRelayed () {
+	Scenario s;
+	float rate = 512 * 1024;
+	s.r->relay->setRelayBandwidth (rate);
+	tcheck1 (s.init() == 0);
+
+	ResultCallbackHelper helper;
+	tcheck1 (!s.a->relay->createChannel (s.b->id, helper.onResultFunc(), 10000));
+	tcheck1 (!helper.wait (10000));
+	tcheck1 (s.a->level (*s.b) == 5);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&hasLevel, s.b, s.a, 5), 2000));
+	tcheck1 (s.relayedStreams (1));
+
+	// throughput follows the relay bandwidth
+	const int count = 16;
+	const size_t size = 65536;
+	double t0 = sf::microtime ();
+	for (int i = 0; i < count; i++) {
+		tcheck1 (!s.a->messaging->send (s.b->id, ByteArray (size, 'x')));
+	}
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Scenario::received, &s, count * size), 15000));
+	double seconds = sf::microtime () - t0;
+	double expected = (count * size - 131072) / rate; // minus the burst
+	tcheck1 (seconds >= expected * 0.8);
+	tcheck1 (seconds <= expected * 3);
+	tcheck1 (s.r->relay->relayProtocol().statistics().bytes >= (int64_t) (count * size));
+	tcheck1 (s.r->relay->relayProtocol().statistics().overflows == 0);
+
+	// closing releases the stream at the relay
+	tcheck1 (!s.a->beacon->connections().closeChannel (s.b->id, 5));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Scenario::relayedStreams, &s, 0), 2000));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&hasLevel, s.b, s.a, 0), 2000));
+	return 0;
+}
+
+int testRelayGone () {
+	Scenario s;
+	s.r->relay->setRelayBandwidth (-1);
+	tcheck1 (s.init() == 0);
+	ResultCallbackHelper helper;
+	tcheck1 (!s.a->relay->createChannel (s.b->id, helper.onResultFunc(), 10000));
+	tcheck1 (!helper.wait (10000));
+	tcheck1 (s.a->level (*s.b) == 5);
+
+	// the relay stops relaying, both ends lose the channel
+	s.r->relay->setRelayBandwidth (0);
+	tcheck1 (s.relayedStreams (0));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&hasLevel, s.a, s.b, 0), 2000));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&hasLevel, s.b, s.a, 0), 2000));
+	return 0;
+}
+
+int testWindowExceeded () {
+	Scenario s;
+	s.r->relay->setRelayBandwidth (-1);
+	// smaller than the window of the relayed channel
+	s.r->relay->relayProtocol().setMaxWindow (32768);
+	tcheck1 (s.init() == 0);
+	ResultCallbackHelper helper;
+	tcheck1 (!s.a->relay->createChannel (s.b->id, helper.onResultFunc(), 10000));
+	tcheck1 (!helper.wait (10000));
+	tcheck1 (s.a->level (*s.b) == 5);
+
+	// the relay doesn't buffer more than its window but closes the stream
+	tcheck1 (!s.a->messaging->send (s.b->id, ByteArray (262144, 'x')));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&Scenario::relayedStreams, &s, 0), 5000));
+	tcheck1 (s.r->relay->relayProtocol().statistics().overflows == 1);
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&hasLevel, s.a, s.b, 0), 2000));
+	tcheck1 (test::waitUntilTrueMs (sf::bind (&hasLevel, s.b, s.a, 0), 2000));
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	schnee::SchneeApp app (argc, argv);
+	SF_SCHNEE_LOCK;
+	testcase_start();
+	testcase (testNoRelaying());
+	testcase (testRelayed());
+	testcase (testRelayGone());
+	testcase (testWindowExceeded());
+	testcase_end();
+	return ret;
+}
@@ -0,0 +1,103 @@
+#include <schnee/test/test.h>
+#include <schnee/tools/Base64.h>
+#include <schnee/tools/MicroTime.h>
+#include <stdlib.h>
+
+/*
+ * @file
+ * Checks all available Base64 implementations against each other and
+ * measures their throughput.
+ */
+using namespace sf;
+
+static const Base64::Implementation gImplementations[] = { Base64::Scalar, Base64::SSSE3, Base64::AVX2 };
+static const int gImplementationCount = 3;
+
+static ByteArray randomData (size_t len) {
+	ByteArray result (len, 0);
+	for (size_t i = 0; i < len; i++) {
+		result[i] = (char) (rand () & 0xff);
+	}
+	return result;
+}
+
+/// Known values (RFC 4648)
+int testVectors () {
+	const char * plain [] = { "", "f", "fo", "foo", "foob", "fooba", "foobar" };
+	const char * coded [] = { "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy" };
+	for (int i = 0; i < 7; i++) {
+		tcheck1 (Base64::encode (plain[i]) == coded[i]);
+		tcheck1 (Base64::decode (coded[i]) == plain[i]);
+	}
+	// whitespace and line breaks are skipped
+	tcheck1 (Base64::decode ("Zm9v\nYmFy") == "foobar");
+	tcheck1 (Base64::decode (" Zm 9vY g== ") == "foob");
+	return 0;
+}
+
+/// All implementations must produce the same as the scalar one
+int testImplementations () {
+	for (int j = 0; j < gImplementationCount; j++) {
+		Base64::Implementation impl = gImplementations[j];
+		if (!Base64::setImplementation (impl)) {
+			printf ("Skipping %s (not supported)\n", Base64::implementationName (impl));
+			continue;
+		}
+		for (size_t len = 0; len < 300; len++) {
+			ByteArray data = randomData (len);
+			Base64::setImplementation (Base64::Scalar);
+			String reference = Base64::encodeFromArray (data);
+			Base64::setImplementation (impl);
+			String encoded = Base64::encodeFromArray (data);
+			tcheck (encoded == reference, Base64::implementationName (impl));
+
+			ByteArray decoded;
+			Base64::decodeToArray (encoded, decoded);
+			tcheck (decoded == data, Base64::implementationName (impl));
+
+			// with line breaks inside (like in some XMPP streams)
+			String broken = encoded;
+			for (size_t k = 76; k < broken.size(); k+= 77) {
+				broken.insert (k, "\n");
+			}
+			Base64::decodeToArray (broken, decoded);
+			tcheck (decoded == data, Base64::implementationName (impl));
+		}
+	}
+	return 0;
+}
+
+/// Measures throughput of all implementations
+int benchmark () {
+	const size_t size = 1024 * 1024;
+	const int rounds = 50;
+	ByteArray data = randomData (size);
+	String encoded (Base64::encodedLength (size), '\0');
+	ByteArray decoded (size + 3, 0);
+	for (int j = 0; j < gImplementationCount; j++) {
+		Base64::Implementation impl = gImplementations[j];
+		if (!Base64::setImplementation (impl)) continue;
+		double t0 = microtime ();
+		for (int i = 0; i < rounds; i++) {
+			Base64::encodeTo (data.const_c_array(), size, &encoded[0]);
+		}
+		double t1 = microtime ();
+		size_t decodedSize = 0;
+		for (int i = 0; i < rounds; i++) {
+			decodedSize = Base64::decodeTo (encoded.data(), encoded.size(), decoded.c_array());
+		}
+		double t2 = microtime ();
+		tcheck1 (decodedSize == size);
+		double mb = (double) size * rounds / (1024.0 * 1024.0);
+		printf ("Base64 %-7s encode: %8.1f MB/s decode: %8.1f MB/s\n", Base64::implementationName (impl), mb / (t1 - t0), mb / (t2 - t1));
+	}
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	testcase_start();
+	testcase (testVectors());
+	testcase (testImplementations());
+	testcase (benchmark());
+	testcase_end();
+}
@@ -0,0 +1,108 @@
+#include <schnee/test/test.h>
+#include <schnee/tools/XMLView.h>
+#include <schnee/tools/XMLChunk.h>
+#include <schnee/tools/MicroTime.h>
+#include <schnee/im/xmpp/XMPPStanzas.h>
+
+/*
+ * @file
+ * Tests the zero copy XMLView on parsed XMLDocuments and compares
+ * the stanza decoding throughput against building XMLChunk trees.
+ */
+using namespace sf;
+
+static const char * gPresence = "<presence from='enob2@shodan/shodan' to='enob1@shodan/schneeflocke' xml:lang='en'><show>chat</show>"
+		"<status>bla &amp; blub</status><priority>5</priority><c xmlns='http://jabber.org/protocol/caps' node='http://psi-im.org/caps' ver='0.12.1' ext='cs ep-notify html'/></presence>";
+static const char * gMessage  = "<message from='enob2@shodan/shodan' to='enob1@shodan/schneeflocke' type='chat' id='m1'>"
+		"<body>Hello &lt;World&gt;</body><thread>t42</thread></message>";
+
+int testView () {
+	XMLDocument doc;
+	tcheck1 (!doc.parse (gPresence, strlen (gPresence)));
+	XMLView root = doc.root ();
+	tcheck1 (root.valid());
+	tcheck1 (root.name() == "presence");
+	tcheck1 (root.attribute ("from") == "enob2@shodan/shodan");
+	bool wasSet = true;
+	tcheck1 (root.attribute ("type", &wasSet).empty() && !wasSet);
+	tcheck1 (root.childText ("show") == "chat");
+	tcheck1 (root.childText ("status") == "bla & blub");
+	tcheck1 (root.child ("c").ns() == "http://jabber.org/protocol/caps");
+	tcheck1 (!root.child ("nonexistant").valid());
+
+	// iterating children
+	int count = 0;
+	for (XMLView i = root.child(); i.valid(); i = i.next()) count++;
+	tcheck1 (count == 4);
+
+	// copies are equal to XMLChunk parsing
+	XMLChunk chunk = xml::parseDocument (gPresence, strlen (gPresence));
+	tcheck1 (toJSON (root.toChunk()) == toJSON (chunk.getChild ("presence")));
+
+	// mixed content and CDATA
+	const char * mixed = "<a>one<b/>two<![CDATA[<three>]]></a>";
+	tcheck1 (!doc.parse (mixed, strlen (mixed)));
+	tcheck1 (doc.root().text() == "onetwo<three>");
+
+	// errors
+	const char * broken = "<a><b></a>";
+	tcheck1 (doc.parse (broken, strlen (broken)));
+	tcheck1 (!doc.root().valid());
+
+	// owned roots survive their document pointer
+	XMLView owned;
+	{
+		XMLDocumentPtr ptr (new XMLDocument);
+		tcheck1 (!ptr->parse (gMessage, strlen (gMessage)));
+		owned = XMLView::ownedRoot (ptr);
+	}
+	xmpp::Message message;
+	tcheck1 (message.decode (owned));
+	tcheck1 (message.body == "Hello <World>");
+	tcheck1 (message.thread == "t42");
+	return 0;
+}
+
+/// Measures stanzas/s of XMLChunk trees vs. XMLViews
+int benchmark () {
+	const int rounds = 100000;
+	const char * stanzas[] = { gPresence, gMessage };
+	size_t lengths[] = { strlen (gPresence), strlen (gMessage) };
+
+	double t0 = microtime ();
+	size_t dummy = 0;
+	for (int i = 0; i < rounds; i++) {
+		int j = i % 2;
+		XMLChunk chunk = xml::parseDocument (stanzas[j], lengths[j]);
+		dummy += chunk.children().size();
+	}
+	double t1 = microtime ();
+	XMLDocument doc;
+	for (int i = 0; i < rounds; i++) {
+		int j = i % 2;
+		doc.parse (stanzas[j], lengths[j]);
+		dummy += doc.root().name().size();
+	}
+	double t2 = microtime ();
+	xmpp::PresenceInfo presence;
+	xmpp::Message message;
+	for (int i = 0; i < rounds; i++) {
+		int j = i % 2;
+		doc.parse (stanzas[j], lengths[j]);
+		bool ok = j == 0 ? presence.decode (doc.root()) : message.decode (doc.root());
+		tcheck1 (ok);
+	}
+	double t3 = microtime ();
+	tcheck1 (dummy > 0);
+	printf ("XMLChunk parse:         %10.0f stanzas/s\n", rounds / (t1 - t0));
+	printf ("XMLDocument parse:      %10.0f stanzas/s\n", rounds / (t2 - t1));
+	printf ("XMLDocument + decode:   %10.0f stanzas/s\n", rounds / (t3 - t2));
+	return 0;
+}
+
+int main (int argc, char * argv[]){
+	testcase_start();
+	testcase (testView());
+	testcase (benchmark());
+	testcase_end();
+}